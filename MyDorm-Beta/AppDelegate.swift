@@ -10,6 +10,7 @@ import UIKit
 import Stripe
 import CoreData
 import FirebaseCore
+import FirebaseDatabase
 @UIApplicationMain
 class AppDelegate: UIResponder, UIApplicationDelegate {
     var window: UIWindow?
@@ -19,6 +20,9 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
         STPPaymentConfiguration.shared().publishableKey = STRIPE_PUBLISHABLE_KEY 
         // configure Fire Base
         FIRApp.configure()
+        // persistence can only be set before the database is first used
+        FIRDatabase.database().persistenceEnabled = true
+        FIRDatabase.database().persistenceCacheSizeBytes = 20 * 1024 * 1024
         return true
     }
 
@@ -30,6 +34,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
     func applicationDidEnterBackground(_ application: UIApplication) {
         // Use this method to release shared resources, save user data, invalidate timers, and store enough application state information to restore your application to its current state in case it is terminated later.
         // If your application supports background execution, this method is called instead of applicationWillTerminate: when the user quits.
+        DataService.instance.saveSnapshot()
     }
 
     func applicationWillEnterForeground(_ application: UIApplication) {
@@ -20,9 +20,23 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
     var messages = [JSQMessage]()
     var username: String!
     var agreement: Agreement!
+    private var ingestor: MessageIngestor!
+    private let bubbleSizes = PrecomputedBubbleSizeCalculator()
     override func viewDidLoad() {
         super.viewDidLoad()
+        agreement = createAgreement()
+        // implement own back button
+        self.navigationItem.hidesBackButton = true
+        let newBackButton = UIBarButtonItem(title: "Back", style: UIBarButtonItemStyle.plain, target: self, action: #selector(self.back(sender:)))
+        self.navigationItem.leftBarButtonItem = newBackButton
+        guard let myID = myID else {
+            showErrorAlert(title: "Development Error", msg: "In Chat With No User ID", currentView: self)
+            return
+        }
         self.senderId = myID
+        self.senderDisplayName = myID
+        ingestor = MessageIngestor(senderID: myID, senderName: myID)
+        collectionView.collectionViewLayout.bubbleSizeCalculator = bubbleSizes
         if !Reachability.isConnectedToNetwork() {
             // makes this show connection error view controller
             print("no internet connection")
@@ -32,6 +46,7 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
 
                 if let currentUser = user {
                     self.username = currentUser.nickname
+                    self.ingestor.reset(senderName: currentUser.nickname ?? myID)
                 
                 if let my = self.myID, let other = self.otherID {
                     print(my)
@@ -49,15 +64,7 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
                                 return
                             } else {
                                 if let msgs = messages {
-                                    for message in msgs {
-                                        print(message.description)
-                                        if message.description.contains(self.username) {
-                                                self.displayMessage(message: message, sender: self.myID, displayName: self.username)
-                                        } else {
-                                            self.displayMessage(message: message, sender: "other", displayName: self.username)
-                                        }
-                                    }
-                                    
+                                    self.ingest(msgs)
                                 }
                             }
                         })
@@ -66,11 +73,6 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
               }
             })
         }
-        agreement = createAgreement()
-        // implement own back button
-        self.navigationItem.hidesBackButton = true
-        let newBackButton = UIBarButtonItem(title: "Back", style: UIBarButtonItemStyle.plain, target: self, action: #selector(self.back(sender:)))
-        self.navigationItem.leftBarButtonItem = newBackButton
     }
     
     func createAgreement() -> Agreement {
@@ -150,8 +152,9 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
                     NSLog("Error: %@", error!)
                     return
                 }
+                self.clearInputToolbar()
                 if let msg = userMessage {
-                    self.displayMessage(message: msg, sender: self.myID, displayName: self.myID)
+                    self.ingest([msg])
                 }
             })
         } else {
@@ -160,18 +163,47 @@ class ChatViewController: JSQMessagesViewController, SBDChannelDelegate {
     }
     
     func channel(_ sender: SBDBaseChannel, didReceive message: SBDBaseMessage) {
-        displayMessage(message: message, sender: self.otherID, displayName: self.otherID)
+        ingest([message])
     }
-    
-    func displayMessage(message: SBDBaseMessage, sender: String, displayName: String) {
-        func parseOutMessage(message: SBDBaseMessage) -> String {
-           return message.description.components(separatedBy: "Message: ")[1].components(separatedBy: ",")[0] 
+
+/*************************************************/
+/*              Message Ingestion                */
+/*************************************************/
+    // messages are parsed and their bubbles sized in the background, then inserted as one batch
+    func ingest(_ batch: [SBDBaseMessage]) {
+        let fields = batch.flatMap { ChatMessageFields(message: $0) }
+        if fields.isEmpty {
+            return
+        }
+        let metrics = BubbleMetrics(layout: collectionView.collectionViewLayout)
+        ingestor.ingest(fields, metrics: metrics) { (ingested) in
+            self.bubbleSizes.store(ingested.bubbleSizes)
+            self.insert(ingested.messages)
         }
-        let text = parseOutMessage(message: message)
-        if let msg = JSQMessage(senderId: sender, displayName: displayName, text: text) {
-            messages.append(msg)
-            finishSendingMessage()
-            finishReceivingMessage()
+    }
+
+    // one batch update for the new messages instead of a reload and scroll for each of them
+    private func insert(_ newMessages: [JSQMessage]) {
+        if newMessages.isEmpty {
+            return
+        }
+        let start = messages.count
+        let indexPaths = (start..<(start + newMessages.count)).map { IndexPath(item: $0, section: 0) }
+        collectionView.performBatchUpdates({
+            self.messages.append(contentsOf: newMessages)
+            self.collectionView.insertItems(at: indexPaths)
+        }, completion: nil)
+        if automaticallyScrollsToMostRecentMessage {
+            scrollToBottom(animated: true)
         }
     }
+
+    // what finishSendingMessage does to the toolbar, without its reload
+    private func clearInputToolbar() {
+        let textView = inputToolbar.contentView.textView
+        textView?.text = nil
+        textView?.undoManager?.removeAllActions()
+        inputToolbar.toggleSendButtonEnabled()
+        NotificationCenter.default.post(name: NSNotification.Name.UITextViewTextDidChange, object: textView)
+    }
 }
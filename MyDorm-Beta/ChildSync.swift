@@ -0,0 +1,306 @@
+//
+//  ChildSync.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import FirebaseDatabase
+
+/*************************************************/
+/*         Child Events From The Database        */
+/*************************************************/
+enum ChildEventType {
+    case added
+    case changed
+    case removed
+    // every child there was when observing started has been delivered
+    case loaded
+    // the database refused or ended the observation, the event value is the Error
+    case failed
+}
+
+struct ChildEvent {
+    let type: ChildEventType
+    let key: String
+    let value: Any?
+}
+
+// A window of children ordered by one of their fields, the first `limit` of them
+struct ChildQuery {
+    var orderedByChild: String?
+    var limit: UInt?
+}
+
+// Anything that can stream child events for a path, FIRDatabase in the app and an in memory fake in tests
+protocol ChildEventSource {
+    // returns a handle for stopObserving
+    func observeChildren(path: String, query: ChildQuery, handler: @escaping (ChildEvent) -> ()) -> AnyObject
+    func stopObserving(_ handle: AnyObject)
+}
+
+private final class FirebaseChildObservation {
+    let query: FIRDatabaseQuery
+    var handles = [FIRDatabaseHandle]()
+
+    init(query: FIRDatabaseQuery) {
+        self.query = query
+    }
+}
+
+extension FIRDatabase: ChildEventSource {
+    func observeChildren(path: String, query: ChildQuery, handler: @escaping (ChildEvent) -> ()) -> AnyObject {
+        var databaseQuery: FIRDatabaseQuery = reference(withPath: path)
+        if let child = query.orderedByChild {
+            databaseQuery = databaseQuery.queryOrdered(byChild: child)
+        }
+        if let limit = query.limit {
+            databaseQuery = databaseQuery.queryLimited(toFirst: limit)
+        }
+        let observation = FirebaseChildObservation(query: databaseQuery)
+        let events: [(FIRDataEventType, ChildEventType)] = [(.childAdded, .added), (.childChanged, .changed), (.childRemoved, .removed)]
+        for (firebaseType, type) in events {
+            let handle = databaseQuery.observe(firebaseType, with: { (snapshot) in
+                handler(ChildEvent(type: type, key: snapshot.key, value: snapshot.value))
+            }) { (error) in
+                handler(ChildEvent(type: .failed, key: path, value: error))
+            }
+            observation.handles.append(handle)
+        }
+        // value events come after the child events of the same data, without downloading it again
+        databaseQuery.observeSingleEvent(of: .value, with: { (snapshot) in
+            handler(ChildEvent(type: .loaded, key: snapshot.key, value: nil))
+        })
+        return observation
+    }
+
+    func stopObserving(_ handle: AnyObject) {
+        if let observation = handle as? FirebaseChildObservation {
+            for handle in observation.handles {
+                observation.query.removeObserver(withHandle: handle)
+            }
+        }
+    }
+}
+
+/*************************************************/
+/*                 Synced Children               */
+/*************************************************/
+// What changed in a synced collection since the last diff, keyed by child key
+struct ChildDiff<Element> {
+    var inserted = [String: Element]()
+    var updated = [String: Element]()
+    var deleted = [String]()
+    // set when the database stopped sending events, the items stay as they were last synced
+    var error: Error?
+
+    var isEmpty: Bool {
+        return inserted.isEmpty && updated.isEmpty && deleted.isEmpty && error == nil
+    }
+}
+
+// Keeps the children of one path in memory, applying child events one at a time instead of downloading and
+// parsing the whole tree on every change. Events arriving together are handed to subscribers as one diff.
+// Everything happens on the main queue, where Firebase delivers its events.
+class ChildSync<Element> {
+    private let source: ChildEventSource
+    private let path: String
+    private let parse: (String, Any) -> Element?
+    private var query: ChildQuery
+    private let pageSize: UInt?
+    private var observation: AnyObject?
+    private var elements = [String: Element]()
+    // last raw value of each child, to drop events that do not change anything
+    private var rawValues = [String: NSObject]()
+    private var pending = ChildDiff<Element>()
+    private var flushScheduled = false
+    private var isLoaded = false
+    // keys restored from a saved snapshot that the database has not confirmed yet
+    private var seededKeys = Set<String>()
+    private var loadedPendingFlush = false
+    // in subscription order, so the ones that index the items run before the ones that read the index
+    private var subscribers = [(id: Int, handler: (ChildDiff<Element>) -> ())]()
+    private var nextSubscriberID = 0
+    private var loadWaiters = [() -> ()]()
+
+    // every element parsed so far, by child key
+    var items: [String: Element] {
+        return elements
+    }
+
+    init(source: ChildEventSource, path: String, orderedByChild: String? = nil, pageSize: UInt? = nil, parse: @escaping (String, Any) -> Element?) {
+        self.source = source
+        self.path = path
+        self.parse = parse
+        self.query = ChildQuery(orderedByChild: orderedByChild, limit: pageSize)
+        self.pageSize = pageSize
+    }
+
+    deinit {
+        if let observation = observation {
+            source.stopObserving(observation)
+        }
+    }
+
+    // handler gets the current items as inserts once they are loaded, then every later diff; returns an id for unsubscribe
+    @discardableResult
+    func subscribe(_ handler: @escaping (ChildDiff<Element>) -> ()) -> Int {
+        let id = nextSubscriberID
+        nextSubscriberID += 1
+        subscribers.append((id, handler))
+        // inserts still pending reach the new subscriber with the next flush
+        var initial = ChildDiff<Element>()
+        for (key, element) in elements where pending.inserted[key] == nil {
+            initial.inserted[key] = element
+        }
+        if isLoaded || !initial.isEmpty {
+            handler(initial)
+        }
+        start()
+        return id
+    }
+
+    // starts from previously saved elements, before anything is observed. Live events then update them, and
+    // the ones the database no longer has are deleted once the first load is in.
+    func seed(_ items: [String: Element]) {
+        guard observation == nil && elements.isEmpty else {
+            return
+        }
+        elements = items
+        seededKeys = Set(items.keys)
+    }
+
+    // complete is called once, after the first load is in or failed; right away if it already is in
+    func whenLoaded(_ complete: @escaping () -> ()) {
+        if isLoaded {
+            complete()
+            return
+        }
+        loadWaiters.append(complete)
+        start()
+    }
+
+    func unsubscribe(_ id: Int) {
+        if let index = subscribers.index(where: { $0.id == id }) {
+            subscribers.remove(at: index)
+        }
+    }
+
+    // grows the window by one page, only meaningful when the sync was created with a page size
+    func loadNextPage() {
+        guard let limit = query.limit, let pageSize = pageSize else {
+            return
+        }
+        query.limit = limit + pageSize
+        restart()
+    }
+
+    private func start() {
+        if observation == nil {
+            observation = source.observeChildren(path: path, query: query) { [weak self] (event) in
+                self?.apply(event)
+            }
+        }
+    }
+
+    // The bigger window replays its first children as adds, they are dropped as unchanged
+    private func restart() {
+        if let current = observation {
+            source.stopObserving(current)
+            observation = nil
+        }
+        start()
+    }
+
+    private func apply(_ event: ChildEvent) {
+        switch event.type {
+        case .added, .changed:
+            guard let value = event.value, let element = parse(event.key, value) else {
+                // a child that no longer parses is as good as gone
+                remove(key: event.key)
+                break
+            }
+            let raw = value as? NSObject
+            if let raw = raw, let previous = rawValues[event.key], previous.isEqual(raw) {
+                break
+            }
+            rawValues[event.key] = raw
+            seededKeys.remove(event.key)
+            let isNew = elements[event.key] == nil
+            elements[event.key] = element
+            if isNew || pending.inserted[event.key] != nil {
+                pending.inserted[event.key] = element
+            } else {
+                pending.updated[event.key] = element
+            }
+            if let index = pending.deleted.index(of: event.key) {
+                pending.deleted.remove(at: index)
+                pending.inserted.removeValue(forKey: event.key)
+                pending.updated[event.key] = element
+            }
+        case .removed:
+            remove(key: event.key)
+        case .failed:
+            // each event type fails on its own, subscribers hear about the first one. The next subscribe starts over.
+            guard let current = observation else {
+                break
+            }
+            source.stopObserving(current)
+            observation = nil
+            pending.error = event.value as? Error
+        case .loaded:
+            // subscribers hear about the first load even when there is nothing in it
+            if !isLoaded {
+                isLoaded = true
+                loadedPendingFlush = true
+                for key in seededKeys {
+                    remove(key: key)
+                }
+                seededKeys.removeAll()
+            }
+        }
+        scheduleFlush()
+    }
+
+    private func remove(key: String) {
+        rawValues.removeValue(forKey: key)
+        guard elements.removeValue(forKey: key) != nil else {
+            return
+        }
+        pending.updated.removeValue(forKey: key)
+        if pending.inserted.removeValue(forKey: key) == nil {
+            pending.deleted.append(key)
+        }
+    }
+
+    private func scheduleFlush() {
+        if flushScheduled {
+            return
+        }
+        flushScheduled = true
+        DispatchQueue.main.async { [weak self] in
+            self?.flush()
+        }
+    }
+
+    private func flush() {
+        flushScheduled = false
+        let diff = pending
+        pending = ChildDiff<Element>()
+        let firstLoad = loadedPendingFlush
+        loadedPendingFlush = false
+        if diff.isEmpty && !firstLoad {
+            return
+        }
+        for subscriber in subscribers {
+            subscriber.handler(diff)
+        }
+        // a failed load is not going to finish, waiters make do with what there is
+        if firstLoad || diff.error != nil {
+            let waiters = loadWaiters
+            loadWaiters.removeAll()
+            for waiter in waiters {
+                waiter()
+            }
+        }
+    }
+}
@@ -52,16 +52,9 @@ extension String {
 }
 
 extension Date {
+    // MM/dd/yy, the way dates are stored in the database
     func formatDate() -> String {
-        let date = self
-        var formattedDate = date.description
-        formattedDate = formattedDate.replacingOccurrences(of: "-", with: "/")
-        let month = formattedDate.components(separatedBy: "/")[1]
-        let year = formattedDate.components(separatedBy: "/")[0].components(separatedBy: "0")[1]
-        let day = formattedDate.components(separatedBy: "/")[2].components(separatedBy: " ")[0]
-        formattedDate = "\(month)/\(day)/\(year)"
-        print(formattedDate)
-        return formattedDate
+        return ModelFormats.string(from: self)
     }
 }
 
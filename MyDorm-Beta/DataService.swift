@@ -9,19 +9,24 @@
 import Foundation
 import Firebase
 import UIKit
+import CoreLocation
 class DataService {
     static let instance = DataService()
     private let _USER_BASE = DATA_BASE.reference(withPath: "Users")
     private let ORDER_BASE = DATA_BASE.reference(withPath: "Orders")
     private let LISTING_BASE = DATA_BASE.reference(withPath: "Listings")
-    private let ITEM_BASE = DATA_BASE.reference(withPath: "Storable Objects")
-    private let COMPANY_BASE = DATA_BASE.reference(withPath: "Companies")
-    private let storage = STORAGE_BASE
-    private var storableObjects: [StorableObject]?
     private var _storageCompanies = [StorageCompany]()
     private var _listings = [Listing]()
-    private var downloadedObjectImages = Dictionary <String, UIImage>()
-    private var downloadedCompanyImages = Dictionary <String, UIImage>()
+    private let source: ChildEventSource
+    private lazy var objectSync: ChildSync<StorableObject> = ChildSync(source: self.source, path: "Storable Objects", parse: DataService.parseStorableObject)
+    private lazy var companySync: ChildSync<StorageCompany> = ChildSync(source: self.source, path: "Companies", parse: DataService.parseCompany)
+    private lazy var listingSync: ChildSync<Listing> = ChildSync(source: self.source, path: "Listings", parse: DataService.parseListing)
+    private let imageCache = ImageCache(backend: STORAGE_BASE)
+    private let snapshotStore: SnapshotStore
+    private var users = [String: User]()
+    private let listingIndex = ListingIndex()
+    private var listingIndexSubscription: Int?
+    private var pendingSnapshotSave: DispatchWorkItem?
 
     var storageCompanies : [StorageCompany] {
         return _storageCompanies
@@ -33,137 +38,196 @@ class DataService {
         return _USER_BASE
     }
     
+    // tests pass an in memory source and a snapshot file of their own
+    init(source: ChildEventSource = DATA_BASE, snapshotStore: SnapshotStore = SnapshotStore(fileURL: SnapshotStore.defaultFileURL())) {
+        self.source = source
+        self.snapshotStore = snapshotStore
+        restoreSnapshot()
+    }
+    
 /*************************************************/
 /*      FireBase Data Download Functions         */
 /*************************************************/
-    func getStorableObjects(complete: @escaping ([StorableObject])-> ()) {
-        // read in storable objects
-        if storableObjects != nil {
-            complete(storableObjects!)
-        }
-        ITEM_BASE.observe(.value, with: { (snapshot) in
-            var loadedobjects = [StorableObject]()
-            if let objects = snapshot.value as? Dictionary<String, String> {
-                for object in objects.values {
-                    loadedobjects.append(StorableObject(name: object))
-                }
-            }
-            self.storableObjects = loadedobjects
-            complete(loadedobjects)
-        }) { (error) in
-            print(error.localizedDescription)
+    // complete is called with every storable object now and again after each change, with the error if the
+    // database stops sending changes. Returns an id for unsubscribeFromStorableObjects
+    @discardableResult
+    func getStorableObjects(complete: @escaping ([StorableObject], Error?)-> ()) -> Int {
+        return objectSync.subscribe { (diff) in
+            self.scheduleSnapshotSave()
+            complete(DataService.sortedByKey(self.objectSync.items), diff.error)
         }
     }
     
-    func getCompanydata(complete: @escaping complete) {
-        COMPANY_BASE.observe(.value, with: { (snapshot) in
-            var loadededcompanies = [StorageCompany]()
-            if let companies = snapshot.value as? Dictionary<String, Dictionary<String, AnyObject>> {
-                for company in companies.values {
-                    // later on add the pickup and drop off date lists here
-                    if let companyname = company["Name"] as? String, let index = company["Price Index"] as? Dictionary<String, Dictionary<String, AnyObject>> {
-                        var priceIndex = Dictionary<String, Double>()
-                        for item in index.values {
-                            if let name = item["Name"] as? String {
-                                for option in item.values {
-                                    if let currentOpt = option as? Dictionary<String,
-                                        AnyObject> {
-                                        if let price = currentOpt["Price"] as? Double {
-                                            // need to add something to distinguish prices of different options for each type of item
-                                            priceIndex["\(name)"] = price
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        // need to replace dummy pickup and dropoff times with actual ones as well as the UI Image
-                        loadededcompanies.append(StorageCompany(name: companyname, priceIndex: priceIndex, pickupTimes: [DateTime](), dropoffTimes: [DateTime](), image: UIImage()))
-                    }
-                }
-            }
-            self._storageCompanies = loadededcompanies
-            complete()
-        }) { (error) in
-            print(error.localizedDescription)
+    func unsubscribeFromStorableObjects(id: Int) {
+        objectSync.unsubscribe(id)
+    }
+    
+    // complete is called once the companies are loaded and again after each change, with the error if the
+    // database stops sending changes. Returns an id for unsubscribeFromCompanies
+    @discardableResult
+    func getCompanydata(complete: @escaping (Error?) -> ()) -> Int {
+        return companySync.subscribe { (diff) in
+            self._storageCompanies = DataService.sortedByKey(self.companySync.items)
+            self.scheduleSnapshotSave()
+            complete(diff.error)
         }
     }
     
+    func unsubscribeFromCompanies(id: Int) {
+        companySync.unsubscribe(id)
+    }
+    
     // attempts to download image that is inquired if image could not be downloaded returns stock image
     func getObjectImage (name: String, complete: @escaping (UIImage)->()) {
-        if let img = downloadedObjectImages[name] {
-            complete(img)
-        } else {
-            let reference: FIRStorageReference = storage.reference(withPath: "\(name.lowercased().replacingOccurrences(of: " ", with: "")).jpg")
-            reference.data(withMaxSize: (80 * 1024 * 1024), completion: { (data, error) in
-                if (error != nil) {
-                    print(error.debugDescription)
-                    complete(UIImage(named: "default")!)
-                } else {
-                    if let img = UIImage(data: data!) {
-                        self.downloadedObjectImages[name] = img
-                        complete(img)
-                    }
-                }
-            })
-        }
+        getStorageImage(name: name, complete: complete)
     }
     
     // attempts to download image that is inquired if image could not be downloaded returns stock image
     func getCompanyImage (name: String, complete: @escaping (UIImage)->()) {
-        if let img = downloadedCompanyImages[name] {
-            complete(img)
-        } else {
-            let reference: FIRStorageReference = storage.reference(withPath: "\(name.lowercased().replacingOccurrences(of: " ", with: "")).jpg")
-            reference.data(withMaxSize: (80 * 1024 * 1024), completion: { (data, error) in
-                if (error != nil) {
-                    print(error.debugDescription)
-                } else {
-                    if let img = UIImage(data: data!) {
-                        self.downloadedCompanyImages[name] = img
-                        complete(img)
-                    }
-                }
-                complete(UIImage(named: "default")!)
-            })
+        getStorageImage(name: name, complete: complete)
+    }
+    
+    // object and company images live side by side in storage, named after the lowercased name without spaces
+    private func getStorageImage (name: String, complete: @escaping (UIImage)->()) {
+        let path = "\(name.lowercased().replacingOccurrences(of: " ", with: "")).jpg"
+        imageCache.image(path: path) { (image, _) in
+            complete(image ?? UIImage(named: "default")!)
         }
     }
     
+    // complete is called with the saved user right away if there is one, then with the live user
     func getUserDetails (uid: String, complete: @escaping (User)->()) {
+        if let user = users[uid] {
+            complete(user)
+        }
         var userInfo = [String:Any]()
         USER_BASE.child(uid).observe(.value, with: { (snapshot) in
             if let details = snapshot.value as? Dictionary<String, Any> {
                  userInfo = details
                 }
-            complete(User(uid: uid, userInfo: userInfo))
+            User(uid: uid, userInfo: userInfo).hydrateOrders(from: self) { (user) in
+                self.users[uid] = user
+                self.scheduleSnapshotSave()
+                complete(user)
+            }
         }) { (error) in
             print(error.localizedDescription)
         }
         
     }
-    func getListings(uid: String = "", complete: @escaping ([Listing])->()) {
-        LISTING_BASE.observe(.value, with: { (snapshot) in
-            var listings = [Listing]()
-            if let lists = snapshot.value as? Dictionary<String, (Dictionary<String, String>) > {
-                for key in lists.keys {
-                    if let listing = lists[key] {
-                        var newListing = Listing()
-                        newListing.listingID = key
-                        newListing.uid = listing["uid"]
-                        newListing.location = listing["Location"]
-                        newListing.storageType = StorageType(rawValue: listing["Storage Type"]!)!
-                        newListing.rentType = RentType(rawValue: listing["Rent Type"]!)!
-                        newListing.rent = listing["Rent"]
-                        newListing.cubicFeet = listing["Cubic Feet"]
-                        newListing.date = listing["Date Available"]
-                        listings.append(newListing)
+    // complete is called with every listing now and again after each change, with the error if the database
+    // stops sending changes. Returns an id for unsubscribeFromListings
+    @discardableResult
+    func getListings(uid: String = "", complete: @escaping ([Listing], Error?)->()) -> Int {
+        return subscribeToListings { (diff) in
+            complete(self._listings, diff.error)
+        }
+    }
+    
+    // handler gets only what changed: the listings inserted, updated and deleted since the last call
+    @discardableResult
+    func subscribeToListings(handler: @escaping (ChildDiff<Listing>)->()) -> Int {
+        // the index subscribes first so handlers can query it
+        if listingIndexSubscription == nil {
+            listingIndexSubscription = listingSync.subscribe { (diff) in
+                self.listingIndex.apply(diff)
+                self._listings = DataService.sortedByKey(self.listingSync.items)
+                self.scheduleSnapshotSave()
+            }
+        }
+        return listingSync.subscribe(handler)
+    }
+    
+    // listings matching every constraint of the query, as of the last listing update
+    func listings(matching query: ListingQuery) -> [Listing] {
+        return listingIndex.listings(matching: query)
+    }
+    
+    func unsubscribeFromListings(id: Int) {
+        listingSync.unsubscribe(id)
+    }
+
+/*************************************************/
+/*               Snapshot Warm Start             */
+/*************************************************/
+    // shows the models saved by the last run until the live events reconcile them
+    private func restoreSnapshot() {
+        guard let snapshot = snapshotStore.load() else {
+            return
+        }
+        listingSync.seed(snapshot.listings)
+        companySync.seed(snapshot.companies)
+        objectSync.seed(snapshot.storableObjects)
+        users = snapshot.users
+        _listings = DataService.sortedByKey(snapshot.listings)
+        for listing in _listings {
+            listingIndex.insert(listing)
+        }
+        _storageCompanies = DataService.sortedByKey(snapshot.companies)
+    }
+    
+    func saveSnapshot() {
+        pendingSnapshotSave?.cancel()
+        pendingSnapshotSave = nil
+        let snapshot = ModelSnapshot(listings: listingSync.items, companies: companySync.items, storableObjects: objectSync.items, users: users)
+        snapshotStore.save(snapshot)
+    }
+    
+    // changes tend to come in bursts, save once they settle
+    private func scheduleSnapshotSave() {
+        pendingSnapshotSave?.cancel()
+        let save = DispatchWorkItem { [weak self] in
+            self?.saveSnapshot()
+        }
+        pendingSnapshotSave = save
+        DispatchQueue.main.asyncAfter(deadline: .now() + 2, execute: save)
+    }
+
+/*************************************************/
+/*           FireBase Child Parsing              */
+/*************************************************/
+    private static func sortedByKey<Element>(_ items: [String: Element]) -> [Element] {
+        return items.keys.sorted().map { items[$0]! }
+    }
+    
+    private static func parseStorableObject(key: String, value: Any) -> StorableObject? {
+        return try? StorableObject.decode(firebase: value)
+    }
+    
+    private static func parseCompany(key: String, value: Any) -> StorageCompany? {
+        // later on add the pickup and drop off date lists here
+        guard let company = value as? Dictionary<String, AnyObject>, let companyname = company["Name"] as? String, let index = company["Price Index"] as? Dictionary<String, Dictionary<String, AnyObject>> else {
+            return nil
+        }
+        var priceIndex = Dictionary<String, Double>()
+        for item in index.values {
+            if let name = item["Name"] as? String {
+                for option in item.values {
+                    if let currentOpt = option as? Dictionary<String,
+                        AnyObject> {
+                        if let price = currentOpt["Price"] as? Double {
+                            // need to add something to distinguish prices of different options for each type of item
+                            priceIndex["\(name)"] = price
+                        }
                     }
                 }
             }
-            self._listings = listings
-            complete(listings)
-        }) { (error) in
-            print(error.localizedDescription)
         }
+        var discounts = [PriceDiscount]()
+        if let discountList = company["Discounts"] as? Dictionary<String, Dictionary<String, AnyObject>> {
+            for discount in discountList.values {
+                if let type = discount["Type"] as? String, let kind = PriceDiscount.Kind(rawValue: type), let minimum = discount["Minimum"] as? Double, let percentOff = discount["Percent Off"] as? Double {
+                    discounts.append(PriceDiscount(kind: kind, minimum: minimum, percentOff: percentOff))
+                }
+            }
+        }
+        // need to replace dummy pickup and dropoff times with actual ones as well as the UI Image
+        return StorageCompany(name: companyname, priceIndex: priceIndex, pickupTimes: [DateTime](), dropoffTimes: [DateTime](), image: UIImage(), discounts: discounts)
+    }
+    
+    // a listing with a missing or malformed field is skipped rather than shown half parsed
+    private static func parseListing(key: String, value: Any) -> Listing? {
+        return try? Listing(id: key, firebase: value)
     }
 
 /*************************************************/
@@ -181,8 +245,25 @@ class DataService {
     func createListing(listing: Listing, currentVC: UIViewController) {
         if let LID = listing.listingID, let UID = listing.uid {
             USER_BASE.child(UID).child("Listings").child(LID).child("Rented").setValue("false")
-            let listinginfo = ["uid": UID, "Location": listing.location, "Storage Type":listing.storageType.rawValue, "Rent Type" : listing.rentType.rawValue, "Rent" : listing.rent, "Date Available": listing.date, "Cubic Feet": listing.cubicFeet] as [String: String]
+            var listinginfo = listing.firebaseValue
+            listinginfo["uid"] = UID
                 LISTING_BASE.child(LID).setValue(listinginfo)
             } 
     }
 }
+
+/*************************************************/
+/*            Order Object Hydration             */
+/*************************************************/
+extension DataService: StorableObjectBackend {
+    // every caller before the object tree has loaded waits on the same observation of it
+    func storableObjects(named names: Set<String>, complete: @escaping ([String : StorableObject]) -> ()) {
+        objectSync.whenLoaded {
+            var objects = [String: StorableObject]()
+            for object in self.objectSync.items.values where names.contains(object.name) {
+                objects[object.name] = object
+            }
+            complete(objects)
+        }
+    }
+}
@@ -0,0 +1,287 @@
+//
+//  GeocodingService.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import CoreLocation
+
+struct GeocodedPlace {
+    // formatted the way listings store their location
+    let address: String
+    let coordinate: CLLocationCoordinate2D?
+
+    init(address: String, coordinate: CLLocationCoordinate2D?) {
+        self.address = address
+        self.coordinate = coordinate
+    }
+
+    // placemarks without a full street address are not places a listing can be at
+    init?(placemark: CLPlacemark) {
+        guard let streetNumber = placemark.subThoroughfare, let street = placemark.thoroughfare, let city = placemark.locality, let state = placemark.administrativeArea, let zip = placemark.postalCode else {
+            return nil
+        }
+        self.init(address: "\(streetNumber) \(street), \(city), \(state) \(zip)", coordinate: placemark.location?.coordinate)
+    }
+}
+
+// Where addresses are looked up when the gazetteer and the cache do not have them
+protocol RemoteGeocoder {
+    // complete gets nil when the lookup failed or was cancelled, nothing is cached then
+    func geocode(_ address: String, in region: CLRegion?, complete: @escaping ([GeocodedPlace]?) -> ())
+    func cancel()
+}
+
+extension CLGeocoder: RemoteGeocoder {
+    func geocode(_ address: String, in region: CLRegion?, complete: @escaping ([GeocodedPlace]?) -> ()) {
+        geocodeAddressString(address, in: region) { (placemarks, error) in
+            if error != nil && placemarks == nil {
+                complete(nil)
+            } else {
+                complete((placemarks ?? []).flatMap { GeocodedPlace(placemark: $0) })
+            }
+        }
+    }
+
+    func cancel() {
+        cancelGeocode()
+    }
+}
+
+/*************************************************/
+/*               Campus Gazetteer                */
+/*************************************************/
+// Campus places by name, answered without a network call. Coordinates are the middle of each building.
+struct GazetteerPlace {
+    let name: String
+    let place: GeocodedPlace
+}
+
+class Gazetteer {
+    private let index: SearchIndex<GazetteerPlace>
+
+    init(places: [GazetteerPlace]) {
+        index = SearchIndex(items: places) { $0.name }
+    }
+
+    // shipped with the app, the residential colleges and the main campus address
+    static let campus = Gazetteer(places: [
+        GazetteerPlace(name: "Butler College", place: GeocodedPlace(address: "Butler College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3445, longitude: -74.6565))),
+        GazetteerPlace(name: "Forbes College", place: GeocodedPlace(address: "Forbes College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3421, longitude: -74.6619))),
+        GazetteerPlace(name: "Mathey College", place: GeocodedPlace(address: "Mathey College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3480, longitude: -74.6623))),
+        GazetteerPlace(name: "Rockefeller College", place: GeocodedPlace(address: "Rockefeller College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3484, longitude: -74.6628))),
+        GazetteerPlace(name: "Whitman College", place: GeocodedPlace(address: "Whitman College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3442, longitude: -74.6585))),
+        GazetteerPlace(name: "Wilson College", place: GeocodedPlace(address: "Wilson College, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3448, longitude: -74.6552))),
+        GazetteerPlace(name: "Nassau Hall", place: GeocodedPlace(address: "Nassau Hall, \(PRINCETON_ADDRESS)", coordinate: CLLocationCoordinate2D(latitude: 40.3487, longitude: -74.6593)))
+    ])
+
+    func places(matching query: String) -> [GeocodedPlace] {
+        return index.search(query).map { $0.place }
+    }
+}
+
+/*************************************************/
+/*                 Geocode Cache                 */
+/*************************************************/
+// Least recently used normalized queries and their places, kept in a property list between launches
+class GeocodeCache {
+    let capacity: Int
+    private let fileURL: URL?
+    private let ioQueue = DispatchQueue(label: "com.mydorm.geocodecache")
+    private var places = [String: [GeocodedPlace]]()
+    // least recently used first
+    private var order = [String]()
+
+    init(fileURL: URL?, capacity: Int = 200) {
+        self.fileURL = fileURL
+        self.capacity = capacity
+        load()
+    }
+
+    static func defaultFileURL() -> URL {
+        let directory = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first!
+        return directory.appendingPathComponent("GeocodeCache.plist")
+    }
+
+    func places(for key: String) -> [GeocodedPlace]? {
+        guard let found = places[key] else {
+            return nil
+        }
+        touch(key)
+        return found
+    }
+
+    func store(_ found: [GeocodedPlace], for key: String) {
+        places[key] = found
+        touch(key)
+        while order.count > capacity {
+            places.removeValue(forKey: order.removeFirst())
+        }
+        save()
+    }
+
+    private func touch(_ key: String) {
+        if let index = order.index(of: key) {
+            order.remove(at: index)
+        }
+        order.append(key)
+    }
+
+    private func load() {
+        guard let url = fileURL, let data = try? Data(contentsOf: url), let list = (try? PropertyListSerialization.propertyList(from: data, options: [], format: nil)) as? [[String: Any]] else {
+            return
+        }
+        for entry in list {
+            guard let key = entry["Query"] as? String, let stored = entry["Places"] as? [[String: Any]] else {
+                continue
+            }
+            places[key] = stored.flatMap { (fields) -> GeocodedPlace? in
+                guard let address = fields["Address"] as? String else {
+                    return nil
+                }
+                var coordinate: CLLocationCoordinate2D?
+                if let latitude = fields["Latitude"] as? Double, let longitude = fields["Longitude"] as? Double {
+                    coordinate = CLLocationCoordinate2D(latitude: latitude, longitude: longitude)
+                }
+                return GeocodedPlace(address: address, coordinate: coordinate)
+            }
+            touch(key)
+        }
+    }
+
+    // the list is built here and written in the background
+    private func save() {
+        guard let url = fileURL else {
+            return
+        }
+        let list: [[String: Any]] = order.map { key in
+            let stored: [[String: Any]] = (places[key] ?? []).map { place in
+                var fields: [String: Any] = ["Address": place.address]
+                if let coordinate = place.coordinate {
+                    fields["Latitude"] = coordinate.latitude
+                    fields["Longitude"] = coordinate.longitude
+                }
+                return fields
+            }
+            return ["Query": key, "Places": stored]
+        }
+        ioQueue.async {
+            if let data = try? PropertyListSerialization.data(fromPropertyList: list, format: .binary, options: 0) {
+                try? data.write(to: url, options: .atomic)
+            }
+        }
+    }
+}
+
+/*************************************************/
+/*               Geocoding Service               */
+/*************************************************/
+// Answers address searches as the user types: campus places right away, then cached or remote addresses once
+// typing pauses. Only the newest search completes, an older remote lookup is cancelled. Used from main only.
+class GeocodingService {
+    // how long typing has to pause before a remote lookup
+    var debounceInterval: TimeInterval = 0.35
+    // shorter queries are only answered from the gazetteer
+    var minimumRemoteQueryLength = 4
+    // runs a lookup once the debounce interval has passed, tests replace it with a clock they advance themselves
+    var scheduleLookup: (TimeInterval, DispatchWorkItem) -> () = { (delay, lookup) in
+        DispatchQueue.main.asyncAfter(deadline: .now() + delay, execute: lookup)
+    }
+
+    // how many searches were made, how many reached the remote geocoder, and how many remote calls were saved
+    // by a cached answer or by a newer keystroke arriving before the debounce ran out
+    private(set) var searchCount = 0
+    private(set) var remoteCallCount = 0
+    private(set) var cacheHitCount = 0
+    private(set) var coalescedCount = 0
+    var remoteCallsAvoided: Int {
+        return cacheHitCount + coalescedCount
+    }
+
+    private let remote: RemoteGeocoder
+    private let gazetteer: Gazetteer
+    private let cache: GeocodeCache
+    private var pendingLookup: DispatchWorkItem?
+    private var latestSearch = 0
+
+    init(remote: RemoteGeocoder = CLGeocoder(), gazetteer: Gazetteer = Gazetteer.campus, cache: GeocodeCache = GeocodeCache(fileURL: GeocodeCache.defaultFileURL())) {
+        self.remote = remote
+        self.gazetteer = gazetteer
+        self.cache = cache
+    }
+
+    // lowercased, without accents or repeated spaces, trailing punctuation dropped
+    static func normalize(_ text: String) -> String {
+        let folded = text.folding(options: [.caseInsensitive, .diacriticInsensitive], locale: nil).lowercased()
+        let words = folded.components(separatedBy: .whitespacesAndNewlines).filter { !$0.isEmpty }
+        return words.joined(separator: " ").trimmingCharacters(in: CharacterSet(charactersIn: ",.;"))
+    }
+
+    // the same text searched near different places gives different addresses
+    static func cacheKey(_ key: String, in region: CLRegion?) -> String {
+        if let circle = region as? CLCircularRegion {
+            return String(format: "%@|%.4f,%.4f,%.0f", key, circle.center.latitude, circle.center.longitude, circle.radius)
+        }
+        if let region = region {
+            return "\(key)|\(region.identifier)"
+        }
+        return key
+    }
+
+    // complete may be called twice for one search, with the campus places and then with the addresses as well
+    func search(_ text: String, in region: CLRegion?, complete: @escaping ([GeocodedPlace]) -> ()) {
+        latestSearch += 1
+        let search = latestSearch
+        if let pending = pendingLookup {
+            // the lookup for the previous keystroke never went out
+            pending.cancel()
+            coalescedCount += 1
+            pendingLookup = nil
+        }
+        // a lookup already sent for older text would only be thrown away
+        remote.cancel()
+        let key = GeocodingService.normalize(text)
+        if key.isEmpty {
+            complete([])
+            return
+        }
+        searchCount += 1
+        let local = gazetteer.places(matching: key)
+        let cacheKey = GeocodingService.cacheKey(key, in: region)
+        if let cached = cache.places(for: cacheKey) {
+            cacheHitCount += 1
+            complete(local + cached)
+            return
+        }
+        complete(local)
+        if key.characters.count < minimumRemoteQueryLength {
+            return
+        }
+        let lookup = DispatchWorkItem { [weak self] in
+            guard let service = self, search == service.latestSearch else {
+                return
+            }
+            service.pendingLookup = nil
+            service.remoteCallCount += 1
+            service.remote.geocode(text, in: region) { (places) in
+                guard let places = places else {
+                    return
+                }
+                service.cache.store(places, for: cacheKey)
+                if search == service.latestSearch {
+                    complete(local + places)
+                }
+            }
+        }
+        pendingLookup = lookup
+        scheduleLookup(debounceInterval, lookup)
+    }
+
+    // stops the pending or running lookup, nothing more is completed
+    func cancel() {
+        latestSearch += 1
+        pendingLookup?.cancel()
+        pendingLookup = nil
+        remote.cancel()
+    }
+}
@@ -16,6 +16,7 @@ class HomeScreenVC: UIViewController, UITableViewDelegate, UITableViewDataSource
     var listings = [Listing]()
     var orders = [Order]()
     var agreements = [Agreement]()
+    private var listingSubscription: Int?
     
     enum tableType: Int {
        case Agreement = 0
@@ -38,13 +39,11 @@ class HomeScreenVC: UIViewController, UITableViewDelegate, UITableViewDataSource
             SBDMain.connect(withUserId: uid, completionHandler: { (user, error) in
             
             })
-            DataService.instance.getUserDetails(uid: uid, complete: { (user) in
-                DataService.instance.getListings(complete: { (listings) in
-                    self.listings = listings.filter{
-                        $0.uid == uid
-                    }
-                })
-                self.orders = user.orders
+            listingSubscription = DataService.instance.subscribeToListings(handler: { [weak self] (_) in
+                self?.listings = DataService.instance.listings(matching: ListingQuery(uid: uid))
+            })
+            DataService.instance.getUserDetails(uid: uid, complete: { [weak self] (user) in
+                self?.orders = user.orders
             })
            
           
@@ -53,6 +52,12 @@ class HomeScreenVC: UIViewController, UITableViewDelegate, UITableViewDataSource
         }
     }
     
+    deinit {
+        if let id = listingSubscription {
+            DataService.instance.unsubscribeFromListings(id: id)
+        }
+    }
+    
  
 /*************************************************/
 /*          TableView Functions                  */
@@ -0,0 +1,360 @@
+//
+//  ImageCache.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import FirebaseStorage
+import UIKit
+
+// Where the image cache downloads images from, FIRStorage in the app
+protocol ImageStorageBackend {
+    func fetchData(path: String, maxSize: Int64, completion: @escaping (Data?, Error?) -> ())
+    // when the object at path last changed, used to revalidate disk copies
+    func fetchUpdatedDate(path: String, completion: @escaping (Date?, Error?) -> ())
+}
+
+extension FIRStorage: ImageStorageBackend {
+    func fetchData(path: String, maxSize: Int64, completion: @escaping (Data?, Error?) -> ()) {
+        reference(withPath: path).data(withMaxSize: maxSize, completion: completion)
+    }
+
+    func fetchUpdatedDate(path: String, completion: @escaping (Date?, Error?) -> ()) {
+        reference(withPath: path).metadata { (metadata, error) in
+            completion(metadata?.updated, error)
+        }
+    }
+}
+
+enum ImageCacheError: Error {
+    // the backend answered with data that is not an image
+    case undecodableData
+}
+
+/*************************************************/
+/*      Memory Tier: least recently used first   */
+/*************************************************/
+private final class ImageCacheEntry {
+    let path: String
+    let image: UIImage
+    let cost: Int
+    weak var previous: ImageCacheEntry?
+    var next: ImageCacheEntry?
+
+    init(path: String, image: UIImage, cost: Int) {
+        self.path = path
+        self.image = image
+        self.cost = cost
+    }
+}
+
+// Not thread safe, ImageCache only touches it from its queue
+private final class ImageMemoryCache {
+    let costLimit: Int
+    private(set) var totalCost = 0
+    private var entries = [String: ImageCacheEntry]()
+    // most recently used
+    private var head: ImageCacheEntry?
+    // least recently used
+    private var tail: ImageCacheEntry?
+
+    init(costLimit: Int) {
+        self.costLimit = costLimit
+    }
+
+    func image(path: String) -> UIImage? {
+        guard let entry = entries[path] else {
+            return nil
+        }
+        unlink(entry)
+        pushFront(entry)
+        return entry.image
+    }
+
+    func insert(image: UIImage, path: String) {
+        let cost = ImageMemoryCache.cost(of: image)
+        remove(path: path)
+        // an image bigger than the whole tier would only flush everything else
+        if cost > costLimit {
+            return
+        }
+        let entry = ImageCacheEntry(path: path, image: image, cost: cost)
+        entries[path] = entry
+        pushFront(entry)
+        totalCost += cost
+        while totalCost > costLimit, let last = tail {
+            remove(path: last.path)
+        }
+    }
+
+    func remove(path: String) {
+        if let entry = entries.removeValue(forKey: path) {
+            unlink(entry)
+            totalCost -= entry.cost
+        }
+    }
+
+    func removeAll() {
+        entries.removeAll()
+        head = nil
+        tail = nil
+        totalCost = 0
+    }
+
+    // decoded size of the bitmap, what the image actually holds in memory
+    static func cost(of image: UIImage) -> Int {
+        if let cgImage = image.cgImage {
+            return cgImage.bytesPerRow * cgImage.height
+        }
+        return Int(image.size.width * image.scale * image.size.height * image.scale * 4)
+    }
+
+    private func pushFront(_ entry: ImageCacheEntry) {
+        entry.next = head
+        entry.previous = nil
+        head?.previous = entry
+        head = entry
+        if tail == nil {
+            tail = entry
+        }
+    }
+
+    private func unlink(_ entry: ImageCacheEntry) {
+        if let previous = entry.previous {
+            previous.next = entry.next
+        } else {
+            head = entry.next
+        }
+        if let next = entry.next {
+            next.previous = entry.previous
+        } else {
+            tail = entry.previous
+        }
+        entry.previous = nil
+        entry.next = nil
+    }
+}
+
+/*************************************************/
+/*      Disk Tier: least recently used first     */
+/*************************************************/
+private struct ImageDiskEntry {
+    var size: Int
+    var lastAccess: Date
+    // when the file was downloaded or last found current on the backend, kept as its modification date
+    var validated: Date
+}
+
+// Not thread safe, ImageCache only touches it from its io queue. Access times are kept in memory, after a
+// relaunch files are trimmed in the order they were last validated.
+private final class ImageDiskCache {
+    let directory: URL
+    let byteLimit: Int
+    private(set) var totalSize = 0
+    private var entries = [String: ImageDiskEntry]()
+
+    init(directory: URL, byteLimit: Int) {
+        self.directory = directory
+        self.byteLimit = byteLimit
+        let fileManager = FileManager.default
+        try? fileManager.createDirectory(at: directory, withIntermediateDirectories: true, attributes: nil)
+        let keys: [URLResourceKey] = [.fileSizeKey, .contentModificationDateKey]
+        let urls = (try? fileManager.contentsOfDirectory(at: directory, includingPropertiesForKeys: keys, options: [])) ?? []
+        for url in urls {
+            guard let values = try? url.resourceValues(forKeys: Set(keys)), let size = values.fileSize else {
+                continue
+            }
+            let modified = values.contentModificationDate ?? Date.distantPast
+            entries[url.lastPathComponent] = ImageDiskEntry(size: size, lastAccess: modified, validated: modified)
+            totalSize += size
+        }
+        trim()
+    }
+
+    // the stored data and when it was last validated
+    func data(path: String) -> (data: Data, validated: Date)? {
+        let name = ImageDiskCache.fileName(path: path)
+        guard var entry = entries[name] else {
+            return nil
+        }
+        guard let data = try? Data(contentsOf: directory.appendingPathComponent(name)) else {
+            remove(name: name)
+            return nil
+        }
+        entry.lastAccess = Date()
+        entries[name] = entry
+        return (data, entry.validated)
+    }
+
+    func store(_ data: Data, path: String) {
+        let name = ImageDiskCache.fileName(path: path)
+        guard (try? data.write(to: directory.appendingPathComponent(name), options: .atomic)) != nil else {
+            return
+        }
+        totalSize -= entries[name]?.size ?? 0
+        let now = Date()
+        entries[name] = ImageDiskEntry(size: data.count, lastAccess: now, validated: now)
+        totalSize += data.count
+        trim()
+    }
+
+    func markValidated(path: String) {
+        let name = ImageDiskCache.fileName(path: path)
+        guard entries[name] != nil else {
+            return
+        }
+        let now = Date()
+        try? FileManager.default.setAttributes([.modificationDate: now], ofItemAtPath: directory.appendingPathComponent(name).path)
+        entries[name]!.validated = now
+    }
+
+    // drops the least recently used files until the tier is a quarter under its limit, so trimming is rare
+    private func trim() {
+        guard totalSize > byteLimit else {
+            return
+        }
+        let target = byteLimit / 4 * 3
+        for (name, _) in entries.sorted(by: { $0.value.lastAccess < $1.value.lastAccess }) {
+            if totalSize <= target {
+                break
+            }
+            remove(name: name)
+        }
+    }
+
+    private func remove(name: String) {
+        if let entry = entries.removeValue(forKey: name) {
+            totalSize -= entry.size
+        }
+        try? FileManager.default.removeItem(at: directory.appendingPathComponent(name))
+    }
+
+    static func fileName(path: String) -> String {
+        return path.replacingOccurrences(of: "/", with: "_")
+    }
+}
+
+/*************************************************/
+/*                  Image Cache                  */
+/*************************************************/
+// Memory, then disk, then the storage backend. Concurrent requests for the same path share one download
+// and every request gets exactly one callback, on the queue it asked for. Disk copies older than the
+// revalidation interval are checked against the backend's updated date before they are used.
+class ImageCache {
+    private typealias Waiter = (queue: DispatchQueue, complete: (UIImage?, Error?) -> ())
+
+    private let backend: ImageStorageBackend
+    private let memory: ImageMemoryCache
+    private let diskDirectory: URL?
+    private let diskByteLimit: Int
+    private let revalidationInterval: TimeInterval
+    private let maxDownloadSize: Int64
+    // guards memory and inFlight
+    private let queue = DispatchQueue(label: "com.mydorm.imagecache")
+    // guards disk, which lists the directory the first time it is used
+    private let ioQueue = DispatchQueue(label: "com.mydorm.imagecache.io")
+    private lazy var disk: ImageDiskCache? = self.diskDirectory.map { ImageDiskCache(directory: $0, byteLimit: self.diskByteLimit) }
+    private var inFlight = [String: [Waiter]]()
+    private var memoryWarningObserver: NSObjectProtocol?
+
+    init(backend: ImageStorageBackend, memoryCostLimit: Int = 30 * 1024 * 1024, diskDirectory: URL? = ImageCache.defaultDiskDirectory(), diskByteLimit: Int = 100 * 1024 * 1024, revalidationInterval: TimeInterval = 24 * 60 * 60, maxDownloadSize: Int64 = 80 * 1024 * 1024) {
+        self.backend = backend
+        self.memory = ImageMemoryCache(costLimit: memoryCostLimit)
+        self.diskDirectory = diskDirectory
+        self.diskByteLimit = diskByteLimit
+        self.revalidationInterval = revalidationInterval
+        self.maxDownloadSize = maxDownloadSize
+        memoryWarningObserver = NotificationCenter.default.addObserver(forName: .UIApplicationDidReceiveMemoryWarning, object: nil, queue: nil) { [weak self] (_) in
+            self?.clearMemory()
+        }
+    }
+
+    deinit {
+        if let observer = memoryWarningObserver {
+            NotificationCenter.default.removeObserver(observer)
+        }
+    }
+
+    static func defaultDiskDirectory() -> URL? {
+        return FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first?.appendingPathComponent("StorageImages", isDirectory: true)
+    }
+
+    // calls complete once with the image at the storage path, or with nil and the reason it could not be loaded
+    func image(path: String, queue callbackQueue: DispatchQueue = .main, complete: @escaping (UIImage?, Error?) -> ()) {
+        queue.async {
+            if let image = self.memory.image(path: path) {
+                callbackQueue.async { complete(image, nil) }
+                return
+            }
+            let waiter: Waiter = (callbackQueue, complete)
+            if self.inFlight[path] != nil {
+                self.inFlight[path]!.append(waiter)
+                return
+            }
+            self.inFlight[path] = [waiter]
+            self.ioQueue.async {
+                guard let stored = self.disk?.data(path: path), let image = UIImage(data: stored.data) else {
+                    self.download(path: path, fallback: nil)
+                    return
+                }
+                if Date().timeIntervalSince(stored.validated) < self.revalidationInterval {
+                    self.finish(path: path, image: image, error: nil)
+                } else {
+                    self.revalidate(path: path, image: image, validated: stored.validated)
+                }
+            }
+        }
+    }
+
+    func clearMemory() {
+        queue.async {
+            self.memory.removeAll()
+        }
+    }
+
+    // uses the disk copy unless the backend has a newer one, and also when the backend cannot be asked
+    private func revalidate(path: String, image: UIImage, validated: Date) {
+        backend.fetchUpdatedDate(path: path) { (updated, error) in
+            if let updated = updated, updated > validated {
+                self.download(path: path, fallback: image)
+                return
+            }
+            if error == nil {
+                self.ioQueue.async {
+                    self.disk?.markValidated(path: path)
+                }
+            }
+            self.finish(path: path, image: image, error: nil)
+        }
+    }
+
+    // fallback is the stale disk copy, delivered if the newer image cannot be downloaded
+    private func download(path: String, fallback: UIImage?) {
+        backend.fetchData(path: path, maxSize: maxDownloadSize) { (data, error) in
+            guard let data = data, let image = UIImage(data: data) else {
+                if let fallback = fallback {
+                    self.finish(path: path, image: fallback, error: nil)
+                } else {
+                    self.finish(path: path, image: nil, error: error ?? ImageCacheError.undecodableData)
+                }
+                return
+            }
+            self.ioQueue.async {
+                self.disk?.store(data, path: path)
+            }
+            self.finish(path: path, image: image, error: nil)
+        }
+    }
+
+    private func finish(path: String, image: UIImage?, error: Error?) {
+        queue.async {
+            if let image = image {
+                self.memory.insert(image: image, path: path)
+            }
+            let waiters = self.inFlight.removeValue(forKey: path) ?? []
+            for waiter in waiters {
+                waiter.queue.async { waiter.complete(image, error) }
+            }
+        }
+    }
+}
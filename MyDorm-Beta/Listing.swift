@@ -26,11 +26,13 @@ enum RentType: String {
     var listingID: String!
     var location: String!
     var storageType = StorageType.InHouse
-    var cubicFeet: String!
+    var cubicFeet: Double?
     var rentType = RentType.Summer
-    var rent: String!
-    var date: String!
+    var rent: Decimal?
+    // the day the space is available from
+    var date: Date?
     var restrictedItems = [StorableObject]()
     var image = UIImage()
     var description: String = ""
+    var coordinate: CLLocationCoordinate2D?
 }
@@ -0,0 +1,269 @@
+//
+//  ListingIndex.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import CoreLocation
+
+// Every constraint that is set has to hold, the ones left nil match anything
+struct ListingQuery {
+    var uid: String?
+    var storageType: StorageType?
+    var rentType: RentType?
+    var rent: ClosedRange<Double>?
+    var cubicFeet: ClosedRange<Double>?
+    var center: CLLocationCoordinate2D?
+    var radiusInMiles: Double?
+
+    init(uid: String? = nil, storageType: StorageType? = nil, rentType: RentType? = nil, rent: ClosedRange<Double>? = nil, cubicFeet: ClosedRange<Double>? = nil, center: CLLocationCoordinate2D? = nil, radiusInMiles: Double? = nil) {
+        self.uid = uid
+        self.storageType = storageType
+        self.rentType = rentType
+        self.rent = rent
+        self.cubicFeet = cubicFeet
+        self.center = center
+        self.radiusInMiles = radiusInMiles
+    }
+}
+
+/*************************************************/
+/*             Sorted Numeric Index              */
+/*************************************************/
+// listing ids ordered by a numeric field, ties broken by id so every entry has one position
+private struct SortedIndex {
+    private var entries = [(value: Double, id: String)]()
+
+    mutating func insert(_ value: Double, id: String) {
+        entries.insert((value, id), at: position(value, id: id))
+    }
+
+    mutating func remove(_ value: Double, id: String) {
+        let index = position(value, id: id)
+        if index < entries.count && entries[index].id == id {
+            entries.remove(at: index)
+        }
+    }
+
+    func ids(in range: ClosedRange<Double>) -> Set<String> {
+        var ids = Set<String>()
+        var index = position(range.lowerBound, id: "")
+        while index < entries.count && entries[index].value <= range.upperBound {
+            ids.insert(entries[index].id)
+            index += 1
+        }
+        return ids
+    }
+
+    // first entry not ordered before (value, id)
+    private func position(_ value: Double, id: String) -> Int {
+        var low = 0
+        var high = entries.count
+        while low < high {
+            let middle = (low + high) / 2
+            let entry = entries[middle]
+            if entry.value < value || (entry.value == value && entry.id < id) {
+                low = middle + 1
+            } else {
+                high = middle
+            }
+        }
+        return low
+    }
+}
+
+/*************************************************/
+/*                 Listing Index                 */
+/*************************************************/
+// Answers listing queries from hash indexes on uid, storage type and rent type, sorted indexes on rent and
+// cubic feet, and a grid of coordinate cells for distance queries. Each constraint narrows a set of ids and the
+// sets are intersected smallest first. Kept up to date from listing diffs, not rebuilt.
+class ListingIndex {
+    private static let earthRadiusInMiles = 3958.8
+    // cells are this many degrees on a side, about 3.5 miles of latitude
+    private static let cellDegrees = 0.05
+
+    private struct CellKey: Hashable {
+        let latitude: Int
+        let longitude: Int
+
+        var hashValue: Int {
+            return latitude &* 31 &+ longitude
+        }
+
+        static func ==(lhs: CellKey, rhs: CellKey) -> Bool {
+            return lhs.latitude == rhs.latitude && lhs.longitude == rhs.longitude
+        }
+    }
+
+    private var listingsByID = [String: Listing]()
+    private var byUID = [String: Set<String>]()
+    private var byStorageType = [StorageType: Set<String>]()
+    private var byRentType = [RentType: Set<String>]()
+    private var byRent = SortedIndex()
+    private var byCubicFeet = SortedIndex()
+    private var byCell = [CellKey: Set<String>]()
+
+    var count: Int {
+        return listingsByID.count
+    }
+
+    func apply(_ diff: ChildDiff<Listing>) {
+        for listing in diff.inserted.values {
+            insert(listing)
+        }
+        for listing in diff.updated.values {
+            insert(listing)
+        }
+        for id in diff.deleted {
+            remove(id: id)
+        }
+    }
+
+    // adds the listing, replacing the one with the same id
+    func insert(_ listing: Listing) {
+        guard let id = listing.listingID else {
+            return
+        }
+        remove(id: id)
+        listingsByID[id] = listing
+        if let uid = listing.uid {
+            ListingIndex.add(id, key: uid, to: &byUID)
+        }
+        ListingIndex.add(id, key: listing.storageType, to: &byStorageType)
+        ListingIndex.add(id, key: listing.rentType, to: &byRentType)
+        if let rent = listing.rent.map({ ModelFormats.double(from: $0) }) {
+            byRent.insert(rent, id: id)
+        }
+        if let cubicFeet = listing.cubicFeet {
+            byCubicFeet.insert(cubicFeet, id: id)
+        }
+        if let coordinate = listing.coordinate {
+            ListingIndex.add(id, key: ListingIndex.cell(coordinate), to: &byCell)
+        }
+    }
+
+    func remove(id: String) {
+        guard let listing = listingsByID.removeValue(forKey: id) else {
+            return
+        }
+        if let uid = listing.uid {
+            byUID[uid]?.remove(id)
+        }
+        byStorageType[listing.storageType]?.remove(id)
+        byRentType[listing.rentType]?.remove(id)
+        if let rent = listing.rent.map({ ModelFormats.double(from: $0) }) {
+            byRent.remove(rent, id: id)
+        }
+        if let cubicFeet = listing.cubicFeet {
+            byCubicFeet.remove(cubicFeet, id: id)
+        }
+        if let coordinate = listing.coordinate {
+            byCell[ListingIndex.cell(coordinate)]?.remove(id)
+        }
+    }
+
+    func removeAll() {
+        listingsByID.removeAll()
+        byUID.removeAll()
+        byStorageType.removeAll()
+        byRentType.removeAll()
+        byRent = SortedIndex()
+        byCubicFeet = SortedIndex()
+        byCell.removeAll()
+    }
+
+    // matching listings ordered by id
+    func listings(matching query: ListingQuery) -> [Listing] {
+        var candidates = [Set<String>]()
+        if let uid = query.uid {
+            candidates.append(byUID[uid] ?? [])
+        }
+        if let storageType = query.storageType {
+            candidates.append(byStorageType[storageType] ?? [])
+        }
+        if let rentType = query.rentType {
+            candidates.append(byRentType[rentType] ?? [])
+        }
+        if let rent = query.rent {
+            candidates.append(byRent.ids(in: rent))
+        }
+        if let cubicFeet = query.cubicFeet {
+            candidates.append(byCubicFeet.ids(in: cubicFeet))
+        }
+        if let center = query.center, let radius = query.radiusInMiles {
+            candidates.append(ids(near: center, withinMiles: radius))
+        }
+
+        var ids: Set<String>
+        if candidates.isEmpty {
+            ids = Set(listingsByID.keys)
+        } else {
+            candidates.sort { $0.count < $1.count }
+            ids = candidates[0]
+            for other in candidates.dropFirst() {
+                if ids.isEmpty {
+                    break
+                }
+                ids.formIntersection(other)
+            }
+        }
+        return ids.sorted().flatMap { listingsByID[$0] }
+    }
+
+/*************************************************/
+/*                 Distance Queries              */
+/*************************************************/
+    private func ids(near center: CLLocationCoordinate2D, withinMiles radius: Double) -> Set<String> {
+        // the cells overlapping the box around the circle, then the exact distance
+        let latitudeSpan = radius / ListingIndex.earthRadiusInMiles * 180 / Double.pi
+        let longitudeSpan = latitudeSpan / max(cos(center.latitude * Double.pi / 180), 0.01)
+        let minCell = ListingIndex.cell(CLLocationCoordinate2D(latitude: center.latitude - latitudeSpan, longitude: center.longitude - longitudeSpan))
+        let maxCell = ListingIndex.cell(CLLocationCoordinate2D(latitude: center.latitude + latitudeSpan, longitude: center.longitude + longitudeSpan))
+
+        var cells = [CellKey]()
+        let boxCellCount = (maxCell.latitude - minCell.latitude + 1) * (maxCell.longitude - minCell.longitude + 1)
+        if boxCellCount > byCell.count {
+            // a wide radius covers more cells than have listings, check the occupied ones instead
+            cells = byCell.keys.filter {
+                $0.latitude >= minCell.latitude && $0.latitude <= maxCell.latitude && $0.longitude >= minCell.longitude && $0.longitude <= maxCell.longitude
+            }
+        } else {
+            for latitude in minCell.latitude...maxCell.latitude {
+                for longitude in minCell.longitude...maxCell.longitude {
+                    cells.append(CellKey(latitude: latitude, longitude: longitude))
+                }
+            }
+        }
+
+        var ids = Set<String>()
+        for cell in cells {
+            for id in byCell[cell] ?? [] {
+                if let coordinate = listingsByID[id]?.coordinate, ListingIndex.miles(from: center, to: coordinate) <= radius {
+                    ids.insert(id)
+                }
+            }
+        }
+        return ids
+    }
+
+    private static func cell(_ coordinate: CLLocationCoordinate2D) -> CellKey {
+        return CellKey(latitude: Int(floor(coordinate.latitude / cellDegrees)), longitude: Int(floor(coordinate.longitude / cellDegrees)))
+    }
+
+    // haversine distance
+    static func miles(from: CLLocationCoordinate2D, to: CLLocationCoordinate2D) -> Double {
+        let lat1 = from.latitude * Double.pi / 180
+        let lat2 = to.latitude * Double.pi / 180
+        let deltaLatitude = lat2 - lat1
+        let deltaLongitude = (to.longitude - from.longitude) * Double.pi / 180
+        let a = sin(deltaLatitude / 2) * sin(deltaLatitude / 2) + cos(lat1) * cos(lat2) * sin(deltaLongitude / 2) * sin(deltaLongitude / 2)
+        return 2 * earthRadiusInMiles * atan2(sqrt(a), sqrt(1 - a))
+    }
+
+    private static func add<Key>(_ id: String, key: Key, to index: inout [Key: Set<String>]) {
+        var ids = index[key] ?? []
+        ids.insert(id)
+        index[key] = ids
+    }
+}
@@ -10,8 +10,8 @@ import UIKit
 import CoreLocation
 class LocationSearchTVC: UITableViewController, UISearchResultsUpdating, UISearchBarDelegate {
     let searchController = UISearchController(searchResultsController: nil)
-    var geocoder = CLGeocoder()
-    var results = [String]()
+    let geocoding = GeocodingService()
+    var results = [GeocodedPlace]()
     var listing: Listing!
     var region: CLRegion!
     var parentVC: LocationSelectionVC!
@@ -34,31 +34,19 @@ class LocationSearchTVC: UITableViewController, UISearchResultsUpdating, UISearc
     func searchBarCancelButtonClicked(_ searchBar: UISearchBar) {
         self.navigationController?.isNavigationBarHidden = false
         _ = self.navigationController?.popViewController(animated: true)
+        geocoding.cancel()
         if listing.location !=  nil {
             parentVC.listing = listing
         }
     }
+    // campus places show right away, addresses once typing pauses
     func updateSearchResults(for: UISearchController) {
-        if let address = searchController.searchBar.text {
-            geocoder.geocodeAddressString(address, in: region) { (placemarks, error) in
-                if let marks = placemarks as [CLPlacemark]! {
-                    self.results = self.getFormattedAddresses(placemarks:marks)
-                    self.tableView.reloadData()
-                }
-            }
+        geocoding.search(searchController.searchBar.text ?? "", in: region) { (places) in
+            self.results = places
+            self.tableView.reloadData()
         }
     }
 
-    func getFormattedAddresses(placemarks: [CLPlacemark])-> [String] {
-        var addresses = [String]()
-        for mark in placemarks {
-            if let streetNumber = mark.subThoroughfare, let street = mark.thoroughfare, let city = mark.locality, let state = mark.administrativeArea, let zip = mark.postalCode {
-                addresses.append("\(streetNumber) \(street), \(city), \(state) \(zip)")
-            }
-        }
-        return addresses
-    }
-
     
     override func numberOfSections(in tableView: UITableView) -> Int {
         return 1
@@ -72,12 +60,13 @@ class LocationSearchTVC: UITableViewController, UISearchResultsUpdating, UISearc
 
     override func tableView(_ tableView: UITableView, cellForRowAt indexPath: IndexPath) -> UITableViewCell {
         let cell = UITableViewCell(style: UITableViewCellStyle.value1, reuseIdentifier: "locationCell")
-        cell.textLabel?.text = results[indexPath.row]
+        cell.textLabel?.text = results[indexPath.row].address
         return cell
     }
     
     override func tableView(_ tableView: UITableView, didSelectRowAt indexPath: IndexPath) {
-        listing.location = results[indexPath.row]
+        listing.location = results[indexPath.row].address
+        listing.coordinate = results[indexPath.row].coordinate
         searchBarCancelButtonClicked(self.searchController.searchBar)
         searchController.isActive = false
     }
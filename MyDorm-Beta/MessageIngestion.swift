@@ -0,0 +1,158 @@
+//
+//  MessageIngestion.swift
+//  MyDorm-Beta
+//
+
+import UIKit
+import JSQMessagesViewController
+import SendBirdSDK
+
+// The parts of a SendBird message the chat shows, read from its properties
+struct ChatMessageFields {
+    let senderID: String?
+    let senderName: String?
+    let text: String
+    let sentAt: Date
+
+    init(senderID: String?, senderName: String?, text: String, sentAt: Date) {
+        self.senderID = senderID
+        self.senderName = senderName
+        self.text = text
+        self.sentAt = sentAt
+    }
+
+    // file messages and messages without text are not shown
+    init?(message: SBDBaseMessage) {
+        // createdAt is in milliseconds
+        let sentAt = Date(timeIntervalSince1970: TimeInterval(message.createdAt) / 1000)
+        if let userMessage = message as? SBDUserMessage, let text = userMessage.message {
+            self.init(senderID: userMessage.sender?.userId, senderName: userMessage.sender?.nickname, text: text, sentAt: sentAt)
+        } else if let adminMessage = message as? SBDAdminMessage, let text = adminMessage.message {
+            self.init(senderID: nil, senderName: nil, text: text, sentAt: sentAt)
+        } else {
+            return nil
+        }
+    }
+}
+
+/*************************************************/
+/*               Bubble Size Metrics             */
+/*************************************************/
+// The layout values JSQMessagesBubblesSizeCalculator sizes text bubbles from, read once on main so the sizes
+// can be worked out on any thread
+struct BubbleMetrics {
+    let font: UIFont
+    let outgoingTextWidth: CGFloat
+    let incomingTextWidth: CGFloat
+    let horizontalInsets: CGFloat
+    let verticalInsets: CGFloat
+    let minimumWidth: CGFloat
+    // JSQMessagesBubblesSizeCalculator pads by this much because boundingRect is slightly off
+    private static let additionalInset: CGFloat = 2
+
+    init(layout: JSQMessagesCollectionViewFlowLayout) {
+        // there is a 2 point space between avatar and bubble in the cell xibs
+        let spacingBetweenAvatarAndBubble: CGFloat = 2
+        let containerInsets = layout.messageBubbleTextViewTextContainerInsets
+        let frameInsets = layout.messageBubbleTextViewFrameInsets
+        font = layout.messageBubbleFont
+        horizontalInsets = containerInsets.left + containerInsets.right + frameInsets.left + frameInsets.right + spacingBetweenAvatarAndBubble
+        verticalInsets = containerInsets.top + containerInsets.bottom + frameInsets.top + frameInsets.bottom + BubbleMetrics.additionalInset
+        let textWidth = layout.itemWidth - layout.messageBubbleLeftRightMargin - horizontalInsets
+        outgoingTextWidth = textWidth - layout.outgoingAvatarViewSize.width
+        incomingTextWidth = textWidth - layout.incomingAvatarViewSize.width
+        minimumWidth = UIImage.jsq_bubbleCompact().size.width
+    }
+
+    func bubbleSize(for text: String, outgoing: Bool) -> CGSize {
+        let maximumWidth = outgoing ? outgoingTextWidth : incomingTextWidth
+        let rect = (text as NSString).boundingRect(with: CGSize(width: maximumWidth, height: CGFloat.greatestFiniteMagnitude), options: [.usesLineFragmentOrigin, .usesFontLeading], attributes: [NSFontAttributeName: font], context: nil)
+        let textSize = rect.integral.size
+        let width = max(textSize.width + horizontalInsets, minimumWidth) + BubbleMetrics.additionalInset
+        return CGSize(width: width, height: textSize.height + verticalInsets)
+    }
+}
+
+// Answers with sizes worked out before the messages were inserted, and asks the stock calculator otherwise
+class PrecomputedBubbleSizeCalculator: NSObject, JSQMessagesBubbleSizeCalculating {
+    private var sizes = [UInt: CGSize]()
+    private let fallback = JSQMessagesBubblesSizeCalculator()
+
+    func store(_ newSizes: [UInt: CGSize]) {
+        for (hash, size) in newSizes {
+            sizes[hash] = size
+        }
+    }
+
+    func messageBubbleSize(for messageData: JSQMessageData!, at indexPath: IndexPath!, with layout: JSQMessagesCollectionViewFlowLayout!) -> CGSize {
+        if let size = sizes[messageData.messageHash()] {
+            return size
+        }
+        return fallback.messageBubbleSize(for: messageData, at: indexPath, with: layout)
+    }
+
+    // the layout changed width, the stored sizes no longer hold
+    func prepare(forResettingLayout layout: JSQMessagesCollectionViewFlowLayout!) {
+        sizes.removeAll()
+        fallback.prepare(forResettingLayout: layout)
+    }
+}
+
+/*************************************************/
+/*               Message Ingestion               */
+/*************************************************/
+struct IngestedMessages {
+    let messages: [JSQMessage]
+    // bubble sizes by message hash, empty when no metrics were given
+    let bubbleSizes: [UInt: CGSize]
+}
+
+// Turns batches of messages into JSQMessages and their bubble sizes on a background queue. Batches complete on
+// main in the order they were given, so history and live messages cannot overtake each other.
+class MessageIngestor {
+    private let queue = DispatchQueue(label: "com.mydorm.messageingestion")
+    let senderID: String
+    // only changed on queue, after the batches given before the change
+    private(set) var senderName: String
+
+    init(senderID: String, senderName: String) {
+        self.senderID = senderID
+        self.senderName = senderName
+    }
+
+    // batches given from now on show the sender under the new name, the ones already given keep the old one
+    func reset(senderName: String) {
+        queue.async {
+            self.senderName = senderName
+        }
+    }
+
+    func ingest(_ batch: [ChatMessageFields], metrics: BubbleMetrics?, complete: @escaping (IngestedMessages) -> ()) {
+        queue.async {
+            let ingested = self.prepare(batch, metrics: metrics)
+            DispatchQueue.main.async {
+                complete(ingested)
+            }
+        }
+    }
+
+    // on the calling thread; messages from anyone other than the sender are shown as the other side
+    func prepare(_ batch: [ChatMessageFields], metrics: BubbleMetrics?) -> IngestedMessages {
+        var messages = [JSQMessage]()
+        var sizes = [UInt: CGSize]()
+        messages.reserveCapacity(batch.count)
+        for fields in batch {
+            let outgoing = fields.senderID == senderID
+            let sender = outgoing ? senderID : (fields.senderID ?? "other")
+            let name = outgoing ? senderName : (fields.senderName ?? sender)
+            guard let message = JSQMessage(senderId: sender, senderDisplayName: name, date: fields.sentAt, text: fields.text) else {
+                continue
+            }
+            messages.append(message)
+            if let metrics = metrics {
+                sizes[message.messageHash()] = metrics.bubbleSize(for: fields.text, outgoing: outgoing)
+            }
+        }
+        return IngestedMessages(messages: messages, bubbleSizes: sizes)
+    }
+}
@@ -0,0 +1,422 @@
+//
+//  ModelCoding.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import CoreLocation
+
+enum ModelDecodingError: Error {
+    case missing(field: String)
+    case invalid(field: String, value: String)
+}
+
+/*************************************************/
+/*          Database Formats Of Values           */
+/*************************************************/
+// The database keeps every value as text. These are the only places that text is turned into values and back.
+enum ModelFormats {
+    // dates are stored as MM/dd/yy in UTC, see Date.formatDate()
+    private static let dateFormatter: DateFormatter = {
+        let formatter = DateFormatter()
+        formatter.locale = Locale(identifier: "en_US_POSIX")
+        formatter.timeZone = TimeZone(identifier: "UTC")
+        formatter.dateFormat = "MM/dd/yy"
+        return formatter
+    }()
+
+    static func date(from text: String?) -> Date? {
+        guard let text = text else {
+            return nil
+        }
+        return dateFormatter.date(from: text)
+    }
+
+    static func string(from date: Date) -> String {
+        return dateFormatter.string(from: date)
+    }
+
+    // accepts "50", "50.5" and "$50"
+    static func money(from text: String?) -> Decimal? {
+        guard let text = text?.replacingOccurrences(of: "$", with: "").trimmingCharacters(in: .whitespaces), !text.isEmpty else {
+            return nil
+        }
+        return Decimal(string: text, locale: Locale(identifier: "en_US_POSIX"))
+    }
+
+    static func string(from money: Decimal) -> String {
+        return NSDecimalNumber(decimal: money).description(withLocale: Locale(identifier: "en_US_POSIX"))
+    }
+
+    static func number(from text: String?) -> Double? {
+        guard let text = text?.trimmingCharacters(in: .whitespaces), !text.isEmpty else {
+            return nil
+        }
+        return Double(text)
+    }
+
+    // whole numbers without a trailing .0
+    static func string(from number: Double) -> String {
+        if number == number.rounded() && abs(number) < 1e15 {
+            return String(Int64(number))
+        }
+        return String(number)
+    }
+
+    static func double(from money: Decimal) -> Double {
+        return NSDecimalNumber(decimal: money).doubleValue
+    }
+}
+
+/*************************************************/
+/*               Listing Coding                  */
+/*************************************************/
+extension Listing {
+    // a listing as stored under Listings/<id>; storage and rent type are required, the other fields are
+    // optional but have to be valid when they are there
+    init(id: String, firebase value: Any) throws {
+        guard let fields = value as? Dictionary<String, Any> else {
+            throw ModelDecodingError.invalid(field: id, value: "\(value)")
+        }
+        func text(_ field: String) -> String? {
+            return fields[field] as? String
+        }
+        guard let storageText = text("Storage Type") else {
+            throw ModelDecodingError.missing(field: "Storage Type")
+        }
+        guard let storageType = StorageType(rawValue: storageText) else {
+            throw ModelDecodingError.invalid(field: "Storage Type", value: storageText)
+        }
+        guard let rentText = text("Rent Type") else {
+            throw ModelDecodingError.missing(field: "Rent Type")
+        }
+        guard let rentType = RentType(rawValue: rentText) else {
+            throw ModelDecodingError.invalid(field: "Rent Type", value: rentText)
+        }
+        self.init()
+        listingID = id
+        uid = text("uid")
+        location = text("Location")
+        self.storageType = storageType
+        self.rentType = rentType
+        if let rentAmount = text("Rent") {
+            guard let money = ModelFormats.money(from: rentAmount) else {
+                throw ModelDecodingError.invalid(field: "Rent", value: rentAmount)
+            }
+            rent = money
+        }
+        if let size = text("Cubic Feet") {
+            guard let number = ModelFormats.number(from: size) else {
+                throw ModelDecodingError.invalid(field: "Cubic Feet", value: size)
+            }
+            cubicFeet = number
+        }
+        if let available = text("Date Available") {
+            guard let day = ModelFormats.date(from: available) else {
+                throw ModelDecodingError.invalid(field: "Date Available", value: available)
+            }
+            date = day
+        }
+        if let latitude = ModelFormats.number(from: text("Latitude")), let longitude = ModelFormats.number(from: text("Longitude")) {
+            coordinate = CLLocationCoordinate2D(latitude: latitude, longitude: longitude)
+        }
+    }
+
+    // the listing as createListing stores it
+    var firebaseValue: [String: String] {
+        var fields = [String: String]()
+        fields["uid"] = uid
+        fields["Location"] = location
+        fields["Storage Type"] = storageType.rawValue
+        fields["Rent Type"] = rentType.rawValue
+        fields["Rent"] = rent.map { ModelFormats.string(from: $0) }
+        fields["Cubic Feet"] = cubicFeet.map { ModelFormats.string(from: $0) }
+        fields["Date Available"] = date.map { ModelFormats.string(from: $0) }
+        if let coordinate = coordinate {
+            fields["Latitude"] = "\(coordinate.latitude)"
+            fields["Longitude"] = "\(coordinate.longitude)"
+        }
+        return fields
+    }
+
+    func write(to writer: inout BinaryWriter) {
+        writer.writeOptional(listingID)
+        writer.writeOptional(uid)
+        writer.writeOptional(location)
+        writer.write(storageType.rawValue)
+        writer.write(rentType.rawValue)
+        writer.writeOptional(rent.map { ModelFormats.string(from: $0) })
+        writer.writeOptional(cubicFeet)
+        writer.writeOptional(date.map { $0.timeIntervalSinceReferenceDate })
+        writer.write(description)
+        writer.writeOptional(coordinate)
+    }
+
+    static func read(from reader: inout BinaryReader) -> Listing? {
+        guard let listingID = reader.readOptionalString(),
+            let uid = reader.readOptionalString(),
+            let location = reader.readOptionalString(),
+            let storageType = reader.readString().flatMap({ StorageType(rawValue: $0) }),
+            let rentType = reader.readString().flatMap({ RentType(rawValue: $0) }),
+            let rent = reader.readOptionalString(),
+            let cubicFeet = reader.readOptionalDouble(),
+            let date = reader.readOptionalDouble(),
+            let description = reader.readString(),
+            let coordinate = reader.readOptionalCoordinate() else {
+            return nil
+        }
+        var listing = Listing()
+        listing.listingID = listingID
+        listing.uid = uid
+        listing.location = location
+        listing.storageType = storageType
+        listing.rentType = rentType
+        listing.rent = ModelFormats.money(from: rent)
+        listing.cubicFeet = cubicFeet
+        listing.date = date.map { Date(timeIntervalSinceReferenceDate: $0) }
+        listing.description = description
+        listing.coordinate = coordinate
+        return listing
+    }
+}
+
+/*************************************************/
+/*            Storable Object Coding             */
+/*************************************************/
+extension StorableObject {
+    // Storable Objects/<id> holds the name, or the name and dimensions in inches
+    static func decode(firebase value: Any) throws -> StorableObject {
+        if let name = value as? String {
+            return StorableObject(name: name)
+        }
+        guard let fields = value as? Dictionary<String, Any> else {
+            throw ModelDecodingError.invalid(field: "Storable Object", value: "\(value)")
+        }
+        guard let name = fields["Name"] as? String else {
+            throw ModelDecodingError.missing(field: "Name")
+        }
+        let object = StorableObject(name: name)
+        for field in ["Height", "Width", "Length"] {
+            guard let value = fields[field] else {
+                continue
+            }
+            guard let inches = (value as? Double) ?? ModelFormats.number(from: value as? String), inches > 0 else {
+                throw ModelDecodingError.invalid(field: field, value: "\(value)")
+            }
+            switch field {
+            case "Height":
+                object.height = inches
+            case "Width":
+                object.width = inches
+            default:
+                object.length = inches
+            }
+        }
+        return object
+    }
+
+    func write(to writer: inout BinaryWriter) {
+        writer.write(name)
+        writer.write(height)
+        writer.write(width)
+        writer.write(length)
+    }
+
+    static func read(from reader: inout BinaryReader) -> StorableObject? {
+        guard let name = reader.readString(), let height = reader.readDouble(), let width = reader.readDouble(), let length = reader.readDouble() else {
+            return nil
+        }
+        let object = StorableObject(name: name)
+        object.height = height
+        object.width = width
+        object.length = length
+        return object
+    }
+}
+
+/*************************************************/
+/*                 Order Coding                  */
+/*************************************************/
+extension Order {
+    // an order as stored under Users/<uid>/Orders/<id>, its objects are hydrated separately
+    init(id: String, uid: String, firebase value: Any) throws {
+        guard let fields = value as? Dictionary<String, Any> else {
+            throw ModelDecodingError.invalid(field: id, value: "\(value)")
+        }
+        self.init()
+        self.orderID = id
+        self.uid = uid
+        for (field, text) in [("Pick Up", fields["Pick Up"] as? String), ("Drop Off", fields["Drop Off"] as? String)] {
+            guard let text = text else {
+                throw ModelDecodingError.missing(field: field)
+            }
+            guard let day = ModelFormats.date(from: text) else {
+                throw ModelDecodingError.invalid(field: field, value: text)
+            }
+            if field == "Pick Up" {
+                pickup = day
+            } else {
+                dropoff = day
+            }
+        }
+    }
+
+    // names of the storable objects in the order
+    static func objectNames(firebase value: Any) -> [String] {
+        guard let fields = value as? Dictionary<String, Any>, let objects = fields["Objects"] as? Dictionary<String, Any> else {
+            return []
+        }
+        return Array(objects.keys)
+    }
+}
+
+/*************************************************/
+/*             Binary Reading And Writing        */
+/*************************************************/
+// Little endian, strings are length prefixed UTF-8, optionals have a presence byte
+struct BinaryWriter {
+    var data = Data()
+
+    mutating func write(_ value: UInt32) {
+        var littleEndian = value.littleEndian
+        data.append(UnsafeBufferPointer(start: &littleEndian, count: 1))
+    }
+
+    mutating func write(_ value: Double) {
+        var littleEndian = value.bitPattern.littleEndian
+        data.append(UnsafeBufferPointer(start: &littleEndian, count: 1))
+    }
+
+    mutating func write(_ value: String) {
+        let bytes = value.data(using: .utf8) ?? Data()
+        write(UInt32(bytes.count))
+        data.append(bytes)
+    }
+
+    mutating func writeOptional(_ value: String?) {
+        if let value = value {
+            data.append(1)
+            write(value)
+        } else {
+            data.append(0)
+        }
+    }
+
+    mutating func writeOptional(_ value: Double?) {
+        if let value = value {
+            data.append(1)
+            write(value)
+        } else {
+            data.append(0)
+        }
+    }
+
+    mutating func writeOptional(_ value: CLLocationCoordinate2D?) {
+        if let value = value {
+            data.append(1)
+            write(value.latitude)
+            write(value.longitude)
+        } else {
+            data.append(0)
+        }
+    }
+}
+
+// every read returns nil past the end of the data, so a truncated file never reads out of bounds.
+// Optional reads return nil when the data ends and .some(nil) for a value that was not set.
+struct BinaryReader {
+    let data: Data
+    private var offset = 0
+
+    init(data: Data) {
+        self.data = data
+    }
+
+    var isAtEnd: Bool {
+        return offset == data.count
+    }
+
+    mutating func readUInt32() -> UInt32? {
+        guard let bytes = readBytes(4) else {
+            return nil
+        }
+        var value: UInt32 = 0
+        for (shift, byte) in bytes.enumerated() {
+            value |= UInt32(byte) << UInt32(shift * 8)
+        }
+        return value
+    }
+
+    mutating func readDouble() -> Double? {
+        guard let bytes = readBytes(8) else {
+            return nil
+        }
+        var bits: UInt64 = 0
+        for (shift, byte) in bytes.enumerated() {
+            bits |= UInt64(byte) << UInt64(shift * 8)
+        }
+        return Double(bitPattern: bits)
+    }
+
+    mutating func readString() -> String? {
+        guard let length = readUInt32(), let bytes = readBytes(Int(length)) else {
+            return nil
+        }
+        return String(bytes: bytes, encoding: .utf8)
+    }
+
+    mutating func readOptionalString() -> String?? {
+        guard let present = readPresence() else {
+            return nil
+        }
+        guard present else {
+            return .some(nil)
+        }
+        guard let value = readString() else {
+            return nil
+        }
+        return .some(value)
+    }
+
+    mutating func readOptionalDouble() -> Double?? {
+        guard let present = readPresence() else {
+            return nil
+        }
+        guard present else {
+            return .some(nil)
+        }
+        guard let value = readDouble() else {
+            return nil
+        }
+        return .some(value)
+    }
+
+    mutating func readOptionalCoordinate() -> CLLocationCoordinate2D?? {
+        guard let present = readPresence() else {
+            return nil
+        }
+        guard present else {
+            return .some(nil)
+        }
+        guard let latitude = readDouble(), let longitude = readDouble() else {
+            return nil
+        }
+        return .some(CLLocationCoordinate2D(latitude: latitude, longitude: longitude))
+    }
+
+    private mutating func readPresence() -> Bool? {
+        guard let byte = readBytes(1) else {
+            return nil
+        }
+        return byte[0] != 0
+    }
+
+    private mutating func readBytes(_ count: Int) -> [UInt8]? {
+        guard count >= 0, count <= data.count - offset else {
+            return nil
+        }
+        let bytes = [UInt8](data.subdata(in: offset..<(offset + count)))
+        offset += count
+        return bytes
+    }
+}
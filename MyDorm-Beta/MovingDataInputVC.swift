@@ -48,21 +48,21 @@ class MovingDataInputVC: UIViewController, PDTSimpleCalendarViewDelegate, UIColl
  
     func simpleCalendarViewController(_ controller: PDTSimpleCalendarViewController!, didSelect date: Date!) {
         if controller.accessibilityLabel == "pickup" {
-            order.pickup = date.formatDate()
+            order.pickup = date
             pickupDateLbl.setTitle(date.formatDate(), for: UIControlState.normal)
-            if order.dropoff != nil {
-                if order.pickup > order.dropoff {
-                    order.dropoff = date.formatDate()
+            if let dropoff = order.dropoff {
+                if date > dropoff {
+                    order.dropoff = date
                     dropoffDateLbl.setTitle(date.formatDate(), for: UIControlState.normal)
                 }
             }
         }
         if controller.accessibilityLabel == "dropoff" {
-             order.dropoff = date.formatDate()
+             order.dropoff = date
              dropoffDateLbl.setTitle(date.formatDate(), for: UIControlState.normal)
-            if order.pickup != nil {
-                if order.pickup > order.dropoff {
-                    order.pickup = date.formatDate()
+            if let pickup = order.pickup {
+                if pickup > date {
+                    order.pickup = date
                     pickupDateLbl.setTitle(date.formatDate(), for: UIControlState.normal)
                 }
             }
@@ -12,11 +12,20 @@ class ObjectListVC: UITableViewController, UISearchResultsUpdating,  UISearchBar
 {
     var allStorableObjects = [StorableObject]()
     var suggestions = [StorableObject]()
+    private let search = SearchSession<StorableObject>()
     var order: Order!
     var listing: Listing!
     let searchController = UISearchController(searchResultsController: nil)
     var UNWIND_SEGUE: String!
     var parentVC: UIViewController!
+    private var objectSubscription: Int?
+    
+    deinit {
+        if let id = objectSubscription {
+            DataService.instance.unsubscribeFromStorableObjects(id: id)
+        }
+    }
+    
     //add a clear button that erases all the selected objects 
     override func viewDidLoad() {
         super.viewDidLoad()
@@ -49,21 +58,35 @@ class ObjectListVC: UITableViewController, UISearchResultsUpdating,  UISearchBar
 /*           Searchbar Functions                 */
 /*************************************************/
     func updateSearchResults(for: UISearchController) {
-        if let input = searchController.searchBar.text, input != "" {
-            suggestions = allStorableObjects.filter { $0.name.lowercased().contains(input.lowercased())}
-
-        } else {
-            suggestions = allStorableObjects
+        refreshSuggestions()
+    }
+    
+    // ranked off the main thread, a result only arrives if no newer keystroke or object update came in since
+    private func refreshSuggestions() {
+        search.search(searchController.searchBar.text ?? "") { [weak self] (results) in
+            self?.suggestions = results
+            self?.tableView.reloadData()
         }
-        tableView.reloadData()
     }
     // download them from firebase
     //need to make this thread safe by making get storable objects take a closoure as an arguement
     func loadAllObjects() {
-        DataService.instance.getStorableObjects { objects in
+        objectSubscription = DataService.instance.getStorableObjects { [weak self] (objects, error) in
+           guard let `self` = self else {
+               return
+           }
+           if let error = error {
+               showErrorAlert(title: "Connection Error", msg: error.localizedDescription, currentView: self)
+           }
            self.allStorableObjects = objects
-           self.suggestions = self.allStorableObjects
-           self.tableView.reloadData()
+           self.search.setItems(objects) { $0.name }
+           if self.searchController.isActive {
+               // keep what the user typed applied to the new objects
+               self.refreshSuggestions()
+           } else {
+               self.suggestions = self.allStorableObjects
+               self.tableView.reloadData()
+           }
         }
         
     }
@@ -78,7 +101,7 @@ class ObjectListVC: UITableViewController, UISearchResultsUpdating,  UISearchBar
     
     override func tableView(_ tableView: UITableView, didSelectRowAt indexPath: IndexPath) {
         if let cell = tableView.cellForRow(at: indexPath) as? SuggestionCell {
-            if let object = cell.object, let h = cell.height.text, h != "", let w = cell.width.text, w != "", let l = cell.length.text, l != "" {
+            if let object = cell.object, let h = ModelFormats.number(from: cell.height.text), h > 0, let w = ModelFormats.number(from: cell.width.text), w > 0, let l = ModelFormats.number(from: cell.length.text), l > 0 {
                 object.width = w
                 object.height = h
                 object.length = l
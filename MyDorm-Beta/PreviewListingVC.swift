@@ -26,12 +26,12 @@ class PreviewListingVC: UIViewController {
         self.navigationItem.backBarButtonItem = UIBarButtonItem(title:"Back", style:.plain, target:nil, action:nil)
         addressLbl.text = listing.location
         image.image = listing.image
-        rentLbl.text = "$\(listing.rent!)/\(listing.rentType.rawValue)"
-        cbFtLbl.text = "\(listing.cubicFeet!) cbft"
+        rentLbl.text = "$\(ModelFormats.string(from: listing.rent!))/\(listing.rentType.rawValue)"
+        cbFtLbl.text = "\(ModelFormats.string(from: listing.cubicFeet!)) cbft"
         typeLbl.text = listing.storageType.rawValue
         descriptionTxtBox.text = listing.description
         if let date = listing.date {
-            dateLbl.text = date
+            dateLbl.text = date.formatDate()
             if let uid = listing.uid {
                 DataService.instance.getUserDetails(uid: uid) { (user) in
                         self.ownerNameLbl.text = user.name
@@ -12,17 +12,43 @@ class PriceDisplayVC: UIViewController, UITableViewDelegate, UITableViewDataSour
     @IBOutlet weak var storageOptionsTbl: UITableView!
     var order: Order!
     var storageCompanies = [StorageCompany]()
+    // price of the order at each company, cheapest first like storageCompanies
+    var companyPrices = [Double]()
     var listings = [Listing]()
+    private var companySubscription: Int?
+    private var listingSubscription: Int?
+    
+    deinit {
+        if let id = companySubscription {
+            DataService.instance.unsubscribeFromCompanies(id: id)
+        }
+        if let id = listingSubscription {
+            DataService.instance.unsubscribeFromListings(id: id)
+        }
+    }
+    
     override func viewDidLoad() {
         super.viewDidLoad()
         storageOptionsTbl.delegate = self
         storageOptionsTbl.dataSource = self
         // will probably move data retreival to beginning of moving launch to have all data loaded by time of use, will also add a local version of the data that would be updated only if the user is connected to the internet
-        DataService.instance.getCompanydata { 
-            self.storageCompanies = DataService.instance.storageCompanies
+        companySubscription = DataService.instance.getCompanydata { [weak self] (error) in
+            guard let `self` = self else {
+                return
+            }
+            if let error = error {
+                showErrorAlert(title: "Connection Error", msg: error.localizedDescription, currentView: self)
+            }
+            let quotes = PriceEngine(companies: DataService.instance.storageCompanies).quotes(for: self.order)
+            self.storageCompanies = quotes.map { $0.company }
+            self.companyPrices = quotes.map { $0.total }
             self.storageOptionsTbl.reloadData()
         }
-        DataService.instance.getListings {listings in
+        listingSubscription = DataService.instance.getListings { [weak self] (listings, _) in
+            // a failed listing sync is already reported with the companies
+            guard let `self` = self else {
+                return
+            }
             self.listings = self.matchOrder(order: self.order, listings: listings)
             self.storageOptionsTbl.reloadData()
         }
@@ -70,7 +96,7 @@ class PriceDisplayVC: UIViewController, UITableViewDelegate, UITableViewDataSour
     func tableView(_ tableView: UITableView, cellForRowAt indexPath: IndexPath) -> UITableViewCell {
         if let cell = tableView.dequeueReusableCell(withIdentifier: "StorageOptionCell", for: indexPath) as? StorageOptionCell {
             if indexPath.row < storageCompanies.count {
-                cell.configureCell(company: storageCompanies[indexPath.row], order: order)
+                cell.configureCell(company: storageCompanies[indexPath.row], price: companyPrices[indexPath.row])
             } else {
                 cell.configureCell(listing: listings[indexPath.row - storageCompanies.count], order: order)
             }
@@ -87,38 +113,17 @@ class PriceDisplayVC: UIViewController, UITableViewDelegate, UITableViewDataSour
 /*************************************************/
 /*        Storage Smart Match Algorithm          */
 /*************************************************/
-    // come up with the storage algorithm potentially do a bit of research to have some sources to write about the algorithm 
+    // listings of the cheapest ways to store the order, an order split across listings shows each of them
     func matchOrder(order: Order, listings: [Listing]) -> [Listing] {
-        func createBlock(objects: [StorableObject]) -> Double {
-            var cubicftNeeded = 0.0
-            for object in objects {
-                if let w = Double(object.width), let l = Double(object.length), let h = Double(object.height) {
-                    cubicftNeeded += (l * w * h)/(12.0*12.0*12.0)
-                }
-            }
-            print(cubicftNeeded)
-            return cubicftNeeded
-        }
-        let idealfit = (0.75)*createBlock(objects: order.objects)
-        print(idealfit)
-        var fitMap = Dictionary<Double, [Listing]>()
-        for list in listings {
-            if let cbft = Double(list.cubicFeet) {
-                let difference = Double.abs((cbft - idealfit))
-                if fitMap[difference] != nil {
-                    fitMap[difference]?.append(list)
-                } else {
-                    fitMap[difference] = [list]
-                }
-            }
-        }
+        let matches = StorageMatcher().topMatches(order: order, listings: listings, k: 20)
         var orderedListings = [Listing]()
-        let orderedKeys = fitMap.keys.sorted {
-            $0 < $1
-        }
-        for key in orderedKeys {
-            for list in fitMap[key]! {
-                orderedListings.append(list)
+        var shown = Set<String>()
+        for match in matches {
+            for listing in match.listings {
+                if let id = listing.listingID, !shown.contains(id) {
+                    shown.insert(id)
+                    orderedListings.append(listing)
+                }
             }
         }
         return orderedListings
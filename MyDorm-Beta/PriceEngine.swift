@@ -0,0 +1,123 @@
+//
+//  PriceEngine.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+
+// A percentage off the whole order once the order reaches a minimum. Tiered discounts count items, volume
+// discounts count cubic feet. Only the largest discount that applies is taken.
+struct PriceDiscount {
+    enum Kind: String {
+        case tiered = "Tiered"
+        case volume = "Volume"
+    }
+    var kind: Kind
+    var minimum: Double
+    var percentOff: Double
+}
+
+struct PriceQuote {
+    let company: StorageCompany
+    // before any discount, the same as company.calculateOrderPrice(order:)
+    let subtotal: Double
+    let percentOff: Double
+    let total: Double
+}
+
+/*************************************************/
+/*                  Price Engine                 */
+/*************************************************/
+// Compiles every company's price index into an array indexed by item id, item names being interned once, so
+// pricing an order is an array walk per company instead of a string lookup per item.
+class PriceEngine {
+    private struct CompiledCompany {
+        let company: StorageCompany
+        // NaN for items the company does not price
+        let prices: [Double]
+        let discounts: [PriceDiscount]
+    }
+
+    // an order reduced to item ids, in the order of its objects
+    struct CompiledOrder {
+        fileprivate let itemIDs: [Int]
+        // every object, priced or not, is what tiered discounts count
+        fileprivate let itemCount: Int
+        fileprivate let cubicFeet: Double
+    }
+
+    private var itemIDs = [String: Int]()
+    private var companies = [CompiledCompany]()
+
+    init(companies: [StorageCompany]) {
+        for company in companies {
+            for name in (company.priceIndex ?? [:]).keys where itemIDs[name] == nil {
+                itemIDs[name] = itemIDs.count
+            }
+        }
+        let itemCount = itemIDs.count
+        self.companies = companies.map { company in
+            var prices = [Double](repeating: Double.nan, count: itemCount)
+            for (name, price) in company.priceIndex ?? [:] {
+                prices[itemIDs[name]!] = price
+            }
+            return CompiledCompany(company: company, prices: prices, discounts: company.discounts)
+        }
+    }
+
+    // items no company prices are dropped, they would add nothing to any total
+    func compile(_ order: Order) -> CompiledOrder {
+        var ids = [Int]()
+        var cubicFeet = 0.0
+        for object in order.objects {
+            if let id = itemIDs[object.name] {
+                ids.append(id)
+            }
+            cubicFeet += StorageMatcher.box(for: object).volume / 1728
+        }
+        return CompiledOrder(itemIDs: ids, itemCount: order.objects.count, cubicFeet: cubicFeet)
+    }
+
+    // every company's quote for the order, cheapest first
+    func quotes(for order: Order) -> [PriceQuote] {
+        return quotes(for: compile(order))
+    }
+
+    func quotes(for order: CompiledOrder) -> [PriceQuote] {
+        var quotes = [PriceQuote]()
+        quotes.reserveCapacity(companies.count)
+        let itemCount = Double(order.itemCount)
+        for compiled in companies {
+            // summed in the order of the objects, so the subtotal matches calculateOrderPrice exactly
+            var subtotal = 0.0
+            for id in order.itemIDs {
+                let price = compiled.prices[id]
+                if !price.isNaN {
+                    subtotal += price
+                }
+            }
+            var percentOff = 0.0
+            for discount in compiled.discounts {
+                let amount = discount.kind == .tiered ? itemCount : order.cubicFeet
+                if amount >= discount.minimum && discount.percentOff > percentOff {
+                    percentOff = discount.percentOff
+                }
+            }
+            let total = percentOff > 0 ? subtotal * (1 - percentOff / 100) : subtotal
+            quotes.append(PriceQuote(company: compiled.company, subtotal: subtotal, percentOff: percentOff, total: total))
+        }
+        return PriceEngine.sorted(quotes)
+    }
+
+    // one row of sorted quotes per order, each order compiled once
+    func quotes(for orders: [Order]) -> [[PriceQuote]] {
+        return orders.map { quotes(for: compile($0)) }
+    }
+
+    // ties keep the order the companies were given in
+    private static func sorted(_ quotes: [PriceQuote]) -> [PriceQuote] {
+        return quotes.enumerated().sorted {
+            $0.element.total < $1.element.total || ($0.element.total == $1.element.total && $0.offset < $1.offset)
+        }.map { $0.element }
+    }
+}
@@ -0,0 +1,375 @@
+//
+//  SearchIndex.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+
+/*************************************************/
+/*                 Prefix Trie                   */
+/*************************************************/
+// Word starts of every name, sorted, so the entries under any trie node are one contiguous run. Keys are cut
+// at maxDepth to keep the trie small; longer queries walk to that depth and check the rest against the name.
+private struct PrefixTrie {
+    static let maxDepth = 8
+
+    // item id and where the word starts in the item's name
+    private(set) var entries = [(id: Int, offset: Int)]()
+    // child of (node << 16 | unit)
+    private var edges = [Int: Int]()
+    private var ranges = [(lower: Int, upper: Int)]()
+
+    init(keys: [(key: ArraySlice<UInt16>, id: Int, offset: Int)]) {
+        let sorted = keys.sorted {
+            $0.key.lexicographicallyPrecedes($1.key) || ($0.key.elementsEqual($1.key) && $0.id < $1.id)
+        }
+        ranges.append((0, sorted.count))
+        entries.reserveCapacity(sorted.count)
+        for (index, entry) in sorted.enumerated() {
+            entries.append((entry.id, entry.offset))
+            var node = 0
+            for unit in entry.key {
+                let edge = node << 16 | Int(unit)
+                if let child = edges[edge] {
+                    node = child
+                    ranges[node].upper = index + 1
+                } else {
+                    ranges.append((index, index + 1))
+                    node = ranges.count - 1
+                    edges[edge] = node
+                }
+            }
+        }
+    }
+
+    // entries whose key starts with the first maxDepth units of the query
+    func entries(startingWith query: [UInt16]) -> ArraySlice<(id: Int, offset: Int)> {
+        var node = 0
+        for unit in query.prefix(PrefixTrie.maxDepth) {
+            guard let child = edges[node << 16 | Int(unit)] else {
+                return []
+            }
+            node = child
+        }
+        return entries[ranges[node].lower..<ranges[node].upper]
+    }
+}
+
+/*************************************************/
+/*                  Search Index                 */
+/*************************************************/
+// Matches are ranked: name starts with the query, then a word starts with it, then the query is inside a word,
+// then names a few typos away. One and two letter queries only match word starts, longer ones match anywhere.
+// Built once per item list and never changed, so it can be read from any queue.
+final class SearchIndex<Item> {
+    let items: [Item]
+    // shortest query that is checked for typos
+    static var typoMinimumLength: Int { return 4 }
+    // typo matches are only looked for when there are fewer exact matches than this
+    static var typoResultLimit: Int { return 20 }
+
+    private let names: [[UInt16]]
+    private let wordStarts: [[Int]]
+    private let trie: PrefixTrie
+    // item ids containing each three unit run, ascending
+    private let trigrams: [UInt64: [Int]]
+
+    init(items: [Item], text: (Item) -> String) {
+        self.items = items
+        var names = [[UInt16]]()
+        var wordStarts = [[Int]]()
+        var keys = [(key: ArraySlice<UInt16>, id: Int, offset: Int)]()
+        var trigrams = [UInt64: [Int]]()
+        for (id, item) in items.enumerated() {
+            let name = SearchIndex.fold(text(item))
+            let starts = SearchIndex.wordStarts(of: name)
+            names.append(name)
+            wordStarts.append(starts)
+            for start in starts {
+                keys.append((name[start..<min(name.count, start + PrefixTrie.maxDepth)], id, start))
+            }
+            if name.count >= 3 {
+                for position in 0...(name.count - 3) {
+                    let trigram = SearchIndex.trigram(name, at: position)
+                    if trigrams[trigram]?.last != id {
+                        if trigrams[trigram] == nil {
+                            trigrams[trigram] = [id]
+                        } else {
+                            trigrams[trigram]!.append(id)
+                        }
+                    }
+                }
+            }
+        }
+        self.names = names
+        self.wordStarts = wordStarts
+        self.trie = PrefixTrie(keys: keys)
+        self.trigrams = trigrams
+    }
+
+    // lowercased and without accents, so "Café" and "cafe" search the same
+    static func fold(_ text: String) -> [UInt16] {
+        return Array(text.folding(options: [.caseInsensitive, .diacriticInsensitive], locale: nil).lowercased().utf16)
+    }
+
+    // ranked matches on the calling thread, for lists small enough not to need a session
+    func search(_ text: String) -> [Item] {
+        let query = SearchIndex.fold(text)
+        if query.isEmpty {
+            return items
+        }
+        let found = matches(query, narrowing: nil, isCancelled: { false }) ?? []
+        return ranked(query, matches: found, isCancelled: { false }) ?? []
+    }
+
+    // Ids of the items matching a folded query, unranked. When the query extends a longer than two unit query
+    // whose matches are given, only those are checked. Nil once isCancelled says so.
+    fileprivate func matches(_ query: [UInt16], narrowing previous: [Int]?, isCancelled: () -> Bool) -> [Int]? {
+        if query.count < 3 {
+            var seen = Set<Int>()
+            var ids = [Int]()
+            for entry in trie.entries(startingWith: query) where !seen.contains(entry.id) {
+                seen.insert(entry.id)
+                ids.append(entry.id)
+            }
+            return ids
+        }
+        let candidates = previous ?? intersectedTrigrams(of: query)
+        var ids = [Int]()
+        for (count, id) in candidates.enumerated() {
+            if count & 255 == 0 && isCancelled() {
+                return nil
+            }
+            if SearchIndex.find(query, in: names[id], from: 0) != nil {
+                ids.append(id)
+            }
+        }
+        return ids
+    }
+
+    // exact matches ranked first, then typo matches when there are few exact ones
+    fileprivate func ranked(_ query: [UInt16], matches: [Int], isCancelled: () -> Bool) -> [Item]? {
+        var scored = [(tier: Int, distance: Int, id: Int)]()
+        scored.reserveCapacity(matches.count)
+        for id in matches {
+            scored.append((tier(of: query, in: id), 0, id))
+        }
+        if query.count >= SearchIndex.typoMinimumLength && matches.count < SearchIndex.typoResultLimit {
+            let bound = query.count <= 6 ? 1 : 2
+            let exact = Set(matches)
+            for id in 0..<names.count where !exact.contains(id) {
+                if id & 255 == 0 && isCancelled() {
+                    return nil
+                }
+                var best: Int?
+                for start in wordStarts[id] {
+                    if let distance = SearchIndex.prefixDistance(query, names[id], from: start, bound: best.map { $0 - 1 } ?? bound) {
+                        best = distance
+                    }
+                }
+                if let distance = best {
+                    scored.append((3, distance, id))
+                }
+            }
+        }
+        scored.sort {
+            if $0.tier != $1.tier {
+                return $0.tier < $1.tier
+            }
+            if $0.distance != $1.distance {
+                return $0.distance < $1.distance
+            }
+            if names[$0.id].count != names[$1.id].count {
+                return names[$0.id].count < names[$1.id].count
+            }
+            return $0.id < $1.id
+        }
+        return scored.map { items[$0.id] }
+    }
+
+    private func tier(of query: [UInt16], in id: Int) -> Int {
+        let name = names[id]
+        if SearchIndex.hasPrefix(name, query, at: 0) {
+            return 0
+        }
+        for start in wordStarts[id] where SearchIndex.hasPrefix(name, query, at: start) {
+            return 1
+        }
+        return 2
+    }
+
+    // every id holding all the query's trigrams, smallest posting list first
+    private func intersectedTrigrams(of query: [UInt16]) -> [Int] {
+        var lists = [[Int]]()
+        var seen = Set<UInt64>()
+        for position in 0...(query.count - 3) {
+            let trigram = SearchIndex.trigram(query, at: position)
+            if seen.insert(trigram).inserted {
+                guard let list = trigrams[trigram] else {
+                    return []
+                }
+                lists.append(list)
+            }
+        }
+        lists.sort { $0.count < $1.count }
+        var result = lists[0]
+        for list in lists.dropFirst() {
+            var merged = [Int]()
+            var i = 0, j = 0
+            while i < result.count && j < list.count {
+                if result[i] == list[j] {
+                    merged.append(result[i])
+                    i += 1
+                    j += 1
+                } else if result[i] < list[j] {
+                    i += 1
+                } else {
+                    j += 1
+                }
+            }
+            result = merged
+            if result.isEmpty {
+                break
+            }
+        }
+        return result
+    }
+
+/*************************************************/
+/*               Folded Text Helpers             */
+/*************************************************/
+    private static func wordStarts(of name: [UInt16]) -> [Int] {
+        var starts = [Int]()
+        var inWord = false
+        for (index, unit) in name.enumerated() {
+            // ASCII punctuation and spaces separate words, everything else is part of one
+            let isSeparator = unit < 128 && !(unit >= 48 && unit <= 57) && !(unit >= 97 && unit <= 122)
+            if !isSeparator && !inWord {
+                starts.append(index)
+            }
+            inWord = !isSeparator
+        }
+        return starts
+    }
+
+    private static func trigram(_ units: [UInt16], at position: Int) -> UInt64 {
+        return UInt64(units[position]) << 32 | UInt64(units[position + 1]) << 16 | UInt64(units[position + 2])
+    }
+
+    private static func hasPrefix(_ name: [UInt16], _ query: [UInt16], at start: Int) -> Bool {
+        if name.count - start < query.count {
+            return false
+        }
+        for index in 0..<query.count where name[start + index] != query[index] {
+            return false
+        }
+        return true
+    }
+
+    static func find(_ query: [UInt16], in name: [UInt16], from start: Int) -> Int? {
+        if query.isEmpty {
+            return start
+        }
+        var position = start
+        while position + query.count <= name.count {
+            if hasPrefix(name, query, at: position) {
+                return position
+            }
+            position += 1
+        }
+        return nil
+    }
+
+    // Smallest edit distance between the query and any prefix of the text from start, nil above bound. Rows
+    // stop early once every cell is over the bound, so most names cost a row or two.
+    private static func prefixDistance(_ query: [UInt16], _ text: [UInt16], from start: Int, bound: Int) -> Int? {
+        if bound < 0 {
+            return nil
+        }
+        let m = query.count
+        let n = min(text.count - start, m + bound)
+        if n < m - bound || n < 1 {
+            return nil
+        }
+        var previousRow = Array(0...n)
+        var row = [Int](repeating: 0, count: n + 1)
+        for i in 1...m {
+            row[0] = i
+            var rowMinimum = i
+            for j in 1...n {
+                let substitution = previousRow[j - 1] + (query[i - 1] == text[start + j - 1] ? 0 : 1)
+                row[j] = min(substitution, previousRow[j] + 1, row[j - 1] + 1)
+                rowMinimum = min(rowMinimum, row[j])
+            }
+            if rowMinimum > bound {
+                return nil
+            }
+            swap(&previousRow, &row)
+        }
+        let best = previousRow[max(0, m - bound)...n].min() ?? bound + 1
+        return best <= bound ? best : nil
+    }
+}
+
+/*************************************************/
+/*                 Search Session                */
+/*************************************************/
+// Runs searches on a background queue, one at a time. A newer search cancels the one before it, and only the
+// newest result is delivered, on main. When a query extends the last one its matches narrow the last matches.
+class SearchSession<Item> {
+    private let queue = DispatchQueue(label: "com.mydorm.search")
+    private let lock = NSLock()
+    private var latestSearch = 0
+    // only touched on queue
+    private var index: SearchIndex<Item>?
+    private var previous: (query: [UInt16], matches: [Int])?
+
+    // rebuilds the index in the background, searches made after this see the new items
+    func setItems(_ items: [Item], text: @escaping (Item) -> String) {
+        queue.async {
+            self.index = SearchIndex(items: items, text: text)
+            self.previous = nil
+        }
+    }
+
+    // complete gets the ranked items, or every item for an empty query, unless a newer search started first
+    func search(_ text: String, complete: @escaping ([Item]) -> ()) {
+        lock.lock()
+        latestSearch += 1
+        let search = latestSearch
+        lock.unlock()
+        let isCancelled = { () -> Bool in
+            self.lock.lock()
+            defer { self.lock.unlock() }
+            return self.latestSearch != search
+        }
+        queue.async {
+            guard let index = self.index, !isCancelled() else {
+                return
+            }
+            let query = SearchIndex<Item>.fold(text)
+            var results: [Item]?
+            if query.isEmpty {
+                self.previous = nil
+                results = index.items
+            } else {
+                var narrowed: [Int]?
+                if let previous = self.previous, previous.query.count >= 3, SearchIndex<Item>.find(previous.query, in: query, from: 0) != nil {
+                    narrowed = previous.matches
+                }
+                if let matches = index.matches(query, narrowing: narrowed, isCancelled: isCancelled) {
+                    self.previous = (query, matches)
+                    results = index.ranked(query, matches: matches, isCancelled: isCancelled)
+                }
+            }
+            guard let ranked = results else {
+                return
+            }
+            DispatchQueue.main.async {
+                if !isCancelled() {
+                    complete(ranked)
+                }
+            }
+        }
+    }
+}
@@ -27,7 +27,7 @@ class SelectedObjectCell: UICollectionViewCell {
             deleteBtn.isEnabled = deleteBtnEnabled
             self.objectImage.image = object.image
             objectNameLbl.text = object.name.capitalized
-            objectDimensionLbl.text = "\(object.length)x\(object.width)x\(object.height)" 
+            objectDimensionLbl.text = "\(ModelFormats.string(from: object.length))x\(ModelFormats.string(from: object.width))x\(ModelFormats.string(from: object.height))" 
     }
     
 }
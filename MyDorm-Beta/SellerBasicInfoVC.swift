@@ -116,7 +116,7 @@ class SellerBasicInfoVC: UIViewController, UITextFieldDelegate, UIGestureRecogni
     }
     
     @IBAction func cbftInputChanged(_ sender: UITextField) {
-        if let input = sender.text, input != "" {
+        if let input = ModelFormats.number(from: sender.text), input > 0 {
                 listing.cubicFeet = input
             } else {
                 // invalidate if there is illegal input
@@ -125,9 +125,8 @@ class SellerBasicInfoVC: UIViewController, UITextFieldDelegate, UIGestureRecogni
     }
     
     @IBAction func rentInputChanged(_ sender: UITextField) {
-        if let input = sender.text, input != ""{
+        if let input = ModelFormats.money(from: sender.text), input >= 0 {
             listing.rent = input
-                print(input)
         } else {
             listing.rent = nil
             }
@@ -188,7 +187,7 @@ class SellerBasicInfoVC: UIViewController, UITextFieldDelegate, UIGestureRecogni
     }
     
     func simpleCalendarViewController(_ controller: PDTSimpleCalendarViewController!, didSelect date: Date!) {
-        listing.date = date.formatDate()
+        listing.date = date
         datesAvailableInput.text = date.formatDate()
         _ = self.navigationController?.popViewController(animated: true)
     }
@@ -14,7 +14,6 @@ class SignUpVC: UIViewController  {
     @IBOutlet weak var logInBtn: RoundedButton!
     override func viewDidLoad() {
         super.viewDidLoad()
-        FIRDatabase.database().persistenceEnabled = true
        
     }
 
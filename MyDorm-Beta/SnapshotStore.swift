@@ -0,0 +1,207 @@
+//
+//  SnapshotStore.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import UIKit
+import CoreLocation
+
+// The parsed models the app starts from, saved so the next launch can show them before Firebase answers
+struct ModelSnapshot {
+    var listings = [String: Listing]()
+    var companies = [String: StorageCompany]()
+    var storableObjects = [String: StorableObject]()
+    var users = [String: User]()
+}
+
+/*************************************************/
+/*               Snapshot File Format            */
+/*************************************************/
+// magic "MDSS" | schema version | payload length | CRC32 of payload | payload, integers are little endian UInt32.
+// A file with another version, a wrong length or a wrong checksum is ignored and later overwritten.
+class SnapshotStore {
+    static let schemaVersion: UInt32 = 4
+    private static let magic: UInt32 = 0x5353444D
+    private static let headerLength = 16
+
+    let fileURL: URL
+    private let ioQueue = DispatchQueue(label: "com.mydorm.snapshotstore")
+
+    init(fileURL: URL) {
+        self.fileURL = fileURL
+    }
+
+    static func defaultFileURL() -> URL {
+        let directory = FileManager.default.urls(for: .cachesDirectory, in: .userDomainMask).first!
+        return directory.appendingPathComponent("ModelSnapshot.bin")
+    }
+
+    // reads the snapshot on the calling thread, it is small and parsing it is one pass
+    func load() -> ModelSnapshot? {
+        guard let data = try? Data(contentsOf: fileURL) else {
+            return nil
+        }
+        return SnapshotStore.decode(data)
+    }
+
+    // encodes on the calling thread, where the models are owned, and writes in the background
+    func save(_ snapshot: ModelSnapshot) {
+        let data = SnapshotStore.encode(snapshot)
+        let url = fileURL
+        ioQueue.async {
+            try? data.write(to: url, options: .atomic)
+        }
+    }
+
+    static func encode(_ snapshot: ModelSnapshot) -> Data {
+        var payload = BinaryWriter()
+        payload.write(UInt32(snapshot.listings.count))
+        for (key, listing) in snapshot.listings {
+            payload.write(key)
+            listing.write(to: &payload)
+        }
+        payload.write(UInt32(snapshot.companies.count))
+        for (key, company) in snapshot.companies {
+            payload.write(key)
+            payload.write(company.name)
+            let prices = company.priceIndex ?? [:]
+            payload.write(UInt32(prices.count))
+            for (item, price) in prices {
+                payload.write(item)
+                payload.write(price)
+            }
+            payload.write(UInt32(company.discounts.count))
+            for discount in company.discounts {
+                payload.write(discount.kind.rawValue)
+                payload.write(discount.minimum)
+                payload.write(discount.percentOff)
+            }
+        }
+        payload.write(UInt32(snapshot.storableObjects.count))
+        for (key, object) in snapshot.storableObjects {
+            payload.write(key)
+            object.write(to: &payload)
+        }
+        payload.write(UInt32(snapshot.users.count))
+        for (key, user) in snapshot.users {
+            payload.write(key)
+            let details = user.details
+            payload.write(UInt32(details.count))
+            for (field, value) in details {
+                payload.write(field)
+                payload.write(value)
+            }
+        }
+
+        var file = BinaryWriter()
+        file.write(magic)
+        file.write(schemaVersion)
+        file.write(UInt32(payload.data.count))
+        file.write(SnapshotStore.crc32(payload.data))
+        file.data.append(payload.data)
+        return file.data
+    }
+
+    static func decode(_ data: Data) -> ModelSnapshot? {
+        var header = BinaryReader(data: data)
+        guard let fileMagic = header.readUInt32(), fileMagic == magic,
+            let version = header.readUInt32(), version == schemaVersion,
+            let length = header.readUInt32(), Int(length) == data.count - headerLength,
+            let checksum = header.readUInt32() else {
+            return nil
+        }
+        let payloadData = data.subdata(in: headerLength..<data.count)
+        guard checksum == SnapshotStore.crc32(payloadData) else {
+            return nil
+        }
+
+        var payload = BinaryReader(data: payloadData)
+        var snapshot = ModelSnapshot()
+
+        guard let listingCount = payload.readUInt32() else {
+            return nil
+        }
+        for _ in 0..<listingCount {
+            guard let key = payload.readString(), let listing = Listing.read(from: &payload) else {
+                return nil
+            }
+            snapshot.listings[key] = listing
+        }
+
+        guard let companyCount = payload.readUInt32() else {
+            return nil
+        }
+        for _ in 0..<companyCount {
+            guard let key = payload.readString(), let name = payload.readString(), let priceCount = payload.readUInt32() else {
+                return nil
+            }
+            var priceIndex = Dictionary<String, Double>()
+            for _ in 0..<priceCount {
+                guard let item = payload.readString(), let price = payload.readDouble() else {
+                    return nil
+                }
+                priceIndex[item] = price
+            }
+            guard let discountCount = payload.readUInt32() else {
+                return nil
+            }
+            var discounts = [PriceDiscount]()
+            for _ in 0..<discountCount {
+                guard let kind = payload.readString().flatMap({ PriceDiscount.Kind(rawValue: $0) }), let minimum = payload.readDouble(), let percentOff = payload.readDouble() else {
+                    return nil
+                }
+                discounts.append(PriceDiscount(kind: kind, minimum: minimum, percentOff: percentOff))
+            }
+            snapshot.companies[key] = StorageCompany(name: name, priceIndex: priceIndex, pickupTimes: [DateTime](), dropoffTimes: [DateTime](), image: UIImage(), discounts: discounts)
+        }
+
+        guard let objectCount = payload.readUInt32() else {
+            return nil
+        }
+        for _ in 0..<objectCount {
+            guard let key = payload.readString(), let object = StorableObject.read(from: &payload) else {
+                return nil
+            }
+            snapshot.storableObjects[key] = object
+        }
+
+        guard let userCount = payload.readUInt32() else {
+            return nil
+        }
+        for _ in 0..<userCount {
+            guard let key = payload.readString(), let fieldCount = payload.readUInt32() else {
+                return nil
+            }
+            var details = [String: Any]()
+            for _ in 0..<fieldCount {
+                guard let field = payload.readString(), let value = payload.readString() else {
+                    return nil
+                }
+                details[field] = value
+            }
+            snapshot.users[key] = User(uid: key, userInfo: details)
+        }
+        return payload.isAtEnd ? snapshot : nil
+    }
+
+    // CRC-32 (IEEE), the same checksum zip and PNG use
+    private static let crcTable: [UInt32] = (0..<256).map { (index: Int) -> UInt32 in
+        var crc = UInt32(index)
+        for _ in 0..<8 {
+            crc = (crc & 1) != 0 ? (0xEDB88320 ^ (crc >> 1)) : (crc >> 1)
+        }
+        return crc
+    }
+
+    static func crc32(_ data: Data) -> UInt32 {
+        var crc: UInt32 = 0xFFFFFFFF
+        data.withUnsafeBytes { (bytes: UnsafePointer<UInt8>) in
+            for i in 0..<data.count {
+                crc = crcTable[Int((crc ^ UInt32(bytes[i])) & 0xFF)] ^ (crc >> 8)
+            }
+        }
+        return crc ^ 0xFFFFFFFF
+    }
+}
+
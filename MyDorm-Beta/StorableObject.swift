@@ -11,9 +11,10 @@ import UIKit
 class StorableObject {
     private var _objectName: String!
     private var _objectType: String!
-    var height: String = "12"
-    var width: String = "12"
-    var length: String = "12"
+    // dimensions in inches
+    var height: Double = 12
+    var width: Double = 12
+    var length: Double = 12
     var image: UIImage = UIImage(named:"default")!
     var name: String {
         return _objectName
@@ -16,6 +16,7 @@ class StorageCompany {
     Double>!
     private var _pickupTimes: [DateTime]!
     private var _dropoffTimes: [DateTime]!
+    private var _discounts: [PriceDiscount]
     
     var name: String {
         return _name
@@ -32,9 +33,13 @@ class StorageCompany {
     var image: UIImage {
         return _image
     }
+    var discounts: [PriceDiscount] {
+        return _discounts
+    }
     
     init(name:String, priceIndex: Dictionary<String,
-        Double>, pickupTimes: [DateTime], dropoffTimes:[DateTime], image: UIImage) {
+        Double>, pickupTimes: [DateTime], dropoffTimes:[DateTime], image: UIImage, discounts: [PriceDiscount] = []) {
+        _discounts = discounts
         _name = name
         _priceIndex = priceIndex
         _dropoffTimes = dropoffTimes
@@ -42,6 +47,7 @@ class StorageCompany {
         _image = image
     }
     
+    // before discounts, use PriceEngine to price an order against many companies
     func calculateOrderPrice(order: Order) -> Double {
         var total = 0.0
         let items = order.objects
@@ -0,0 +1,302 @@
+//
+//  StorageMatcher.swift
+//  MyDorm-Beta
+//
+
+import Foundation
+import CoreLocation
+
+// One way to store an order: the listings it goes into and what that costs
+struct StorageMatch {
+    var listings: [Listing]
+    var cost: Double
+    var wastedCubicFeet: Double
+}
+
+// How much each unit counts in the cost of a match, lower cost ranks first
+struct MatchWeights {
+    var perWastedCubicFoot = 1.0
+    var perDollar = 1.0
+    var perMile = 2.0
+}
+
+/*************************************************/
+/*              3D Packing Feasibility           */
+/*************************************************/
+struct PackingBox {
+    var width: Double
+    var depth: Double
+    var height: Double
+
+    var volume: Double {
+        return width * depth * height
+    }
+
+    // the six ways to lay a box down
+    var rotations: [PackingBox] {
+        return [PackingBox(width: width, depth: depth, height: height),
+                PackingBox(width: width, depth: height, height: depth),
+                PackingBox(width: depth, depth: width, height: height),
+                PackingBox(width: depth, depth: height, height: width),
+                PackingBox(width: height, depth: width, height: depth),
+                PackingBox(width: height, depth: depth, height: width)]
+    }
+}
+
+private struct PlacedBox {
+    let x: Double, y: Double, z: Double
+    let box: PackingBox
+
+    func overlaps(_ other: PlacedBox) -> Bool {
+        return x < other.x + other.box.width && other.x < x + box.width &&
+            y < other.y + other.box.depth && other.y < y + box.depth &&
+            z < other.z + other.box.height && other.z < z + box.height
+    }
+}
+
+enum BoxPacker {
+    // First fit decreasing: largest items first, each at the first extreme point and rotation where it fits.
+    // A heuristic, so a false answer can still be packable in theory, but a true answer always is.
+    static func fits(_ items: [PackingBox], in container: PackingBox) -> Bool {
+        let sorted = items.sorted { $0.volume > $1.volume }
+        if sorted.reduce(0, { $0 + $1.volume }) > container.volume + 1e-9 {
+            return false
+        }
+        var placed = [PlacedBox]()
+        // corners where the next box can go, low and back first
+        var points: [(x: Double, y: Double, z: Double)] = [(0, 0, 0)]
+        for item in sorted {
+            var placement: PlacedBox?
+            search: for point in points {
+                for rotation in item.rotations {
+                    if point.x + rotation.width > container.width + 1e-9 || point.y + rotation.depth > container.depth + 1e-9 || point.z + rotation.height > container.height + 1e-9 {
+                        continue
+                    }
+                    let candidate = PlacedBox(x: point.x, y: point.y, z: point.z, box: rotation)
+                    if !placed.contains(where: { $0.overlaps(candidate) }) {
+                        placement = candidate
+                        break search
+                    }
+                }
+            }
+            guard let box = placement else {
+                return false
+            }
+            placed.append(box)
+            points = points.filter { !($0.x == box.x && $0.y == box.y && $0.z == box.z) }
+            points.append((box.x + box.box.width, box.y, box.z))
+            points.append((box.x, box.y + box.box.depth, box.z))
+            points.append((box.x, box.y, box.z + box.box.height))
+            points.sort { ($0.z, $0.y, $0.x) < ($1.z, $1.y, $1.x) }
+        }
+        return true
+    }
+}
+
+/*************************************************/
+/*                 Storage Matcher               */
+/*************************************************/
+// Ranks the listings an order fits in. A listing qualifies if it allows every item in the order, is available by
+// the pick up date and the items pack into its space. Orders that fit no single listing can be split across 2 or 3.
+class StorageMatcher {
+    var weights = MatchWeights()
+    // largest number of listings one order may be split across
+    var maxListingsPerMatch = 3
+    // how many of the cheapest qualifying listings are combined when splitting
+    var splitCandidateLimit = 24
+
+    // the k cheapest matches, cheapest first
+    func topMatches(order: Order, listings: [Listing], k: Int, origin: CLLocationCoordinate2D? = nil) -> [StorageMatch] {
+        guard k > 0 else {
+            return []
+        }
+        let items = order.objects.map { StorageMatcher.box(for: $0) }
+        let itemVolume = items.reduce(0) { $0 + $1.volume } / 1728
+        let orderNames = Set(order.objects.map { $0.name })
+
+        var candidates = [(listing: Listing, space: PackingBox, cost: Double)]()
+        for listing in listings {
+            guard let space = StorageMatcher.space(for: listing) else {
+                continue
+            }
+            if !listing.restrictedItems.isEmpty && listing.restrictedItems.contains(where: { orderNames.contains($0.name) }) {
+                continue
+            }
+            if let pickup = order.pickup, let available = listing.date, available > pickup {
+                continue
+            }
+            candidates.append((listing, space, cost(of: listing, space: space, origin: origin)))
+        }
+
+        var best = BoundedMatchHeap(capacity: k)
+        for candidate in candidates where BoxPacker.fits(items, in: candidate.space) {
+            let wasted = candidate.space.volume / 1728 - itemVolume
+            best.insert(StorageMatch(listings: [candidate.listing], cost: candidate.cost + weights.perWastedCubicFoot * wasted, wastedCubicFeet: wasted))
+        }
+
+        if maxListingsPerMatch > 1 && items.count > 1 {
+            let pool = Array(candidates.sorted { $0.cost < $1.cost }.prefix(splitCandidateLimit))
+            addSplits(items: items, itemVolume: itemVolume, pool: pool, into: &best)
+        }
+        return best.sorted()
+    }
+
+    // Branch and bound over combinations of listings. A combination's cost does not depend on which item goes
+    // where, so it is known before packing: a combination is only packed while it could still make the top k.
+    private func addSplits(items: [PackingBox], itemVolume: Double, pool: [(listing: Listing, space: PackingBox, cost: Double)], into best: inout BoundedMatchHeap) {
+        let sortedItems = items.sorted { $0.volume > $1.volume }
+        var chosen = [Int]()
+
+        func visit(from start: Int, cost: Double, capacity: Double) {
+            if chosen.count >= 2 && capacity / 1728 >= itemVolume {
+                let wasted = capacity / 1728 - itemVolume
+                let total = cost + weights.perWastedCubicFoot * wasted
+                if !best.isFull || total < best.worstCost {
+                    let spaces = chosen.map { pool[$0].space }
+                    if StorageMatcher.assign(sortedItems, to: spaces) {
+                        best.insert(StorageMatch(listings: chosen.map { pool[$0].listing }, cost: total, wastedCubicFeet: wasted))
+                    }
+                }
+            }
+            if chosen.count == maxListingsPerMatch {
+                return
+            }
+            for index in start..<pool.count {
+                // adding space only adds cost, and candidates are cheapest first
+                if best.isFull && cost + pool[index].cost >= best.worstCost {
+                    break
+                }
+                chosen.append(index)
+                visit(from: index + 1, cost: cost + pool[index].cost, capacity: capacity + pool[index].space.volume)
+                chosen.removeLast()
+            }
+        }
+        visit(from: 0, cost: 0, capacity: 0)
+    }
+
+    // Tries the ways to share the items among the spaces, pruning on remaining volume, then packs each space.
+    // Gives up after `budget` tries so a large order cannot stall the screen.
+    static func assign(_ items: [PackingBox], to spaces: [PackingBox], budget: Int = 20000) -> Bool {
+        var groups = [[PackingBox]](repeating: [], count: spaces.count)
+        var remaining = spaces.map { $0.volume }
+        var triesLeft = budget
+
+        func place(_ index: Int) -> Bool {
+            triesLeft -= 1
+            if triesLeft < 0 {
+                return false
+            }
+            if index == items.count {
+                return !groups.contains(where: { $0.isEmpty }) && zip(groups, spaces).reduce(true) { $0 && BoxPacker.fits($1.0, in: $1.1) }
+            }
+            for space in 0..<spaces.count where remaining[space] + 1e-9 >= items[index].volume {
+                // empty spaces are interchangeable with each other, only try the first
+                if groups[space].isEmpty && groups[0..<space].contains(where: { $0.isEmpty }) {
+                    continue
+                }
+                groups[space].append(items[index])
+                remaining[space] -= items[index].volume
+                if place(index + 1) {
+                    return true
+                }
+                groups[space].removeLast()
+                remaining[space] += items[index].volume
+            }
+            return false
+        }
+        return place(0)
+    }
+
+    private func cost(of listing: Listing, space: PackingBox, origin: CLLocationCoordinate2D?) -> Double {
+        var total = 0.0
+        if let rent = listing.rent {
+            total += weights.perDollar * ModelFormats.double(from: rent)
+        }
+        if let origin = origin, let coordinate = listing.coordinate {
+            total += weights.perMile * ListingIndex.miles(from: origin, to: coordinate)
+        }
+        return total
+    }
+
+    // object dimensions are in inches, one that was never given counts as the default 12 inches so the object
+    // still takes up space
+    static let defaultSide = 12.0
+
+    static func box(for object: StorableObject) -> PackingBox {
+        func side(_ inches: Double) -> Double {
+            return inches > 0 ? inches : defaultSide
+        }
+        return PackingBox(width: side(object.width), depth: side(object.length), height: side(object.height))
+    }
+
+    // listings only give a volume, their space is taken as a cube of that volume, in inches
+    static func space(for listing: Listing) -> PackingBox? {
+        guard let cubicFeet = listing.cubicFeet, cubicFeet > 0 else {
+            return nil
+        }
+        let side = cbrt(cubicFeet * 1728)
+        return PackingBox(width: side, depth: side, height: side)
+    }
+}
+
+/*************************************************/
+/*                 Top K Matches                 */
+/*************************************************/
+// a max heap on cost holding the k cheapest matches seen
+private struct BoundedMatchHeap {
+    let capacity: Int
+    private var heap = [StorageMatch]()
+
+    init(capacity: Int) {
+        self.capacity = capacity
+    }
+
+    var isFull: Bool {
+        return heap.count >= capacity
+    }
+
+    var worstCost: Double {
+        return heap.first?.cost ?? Double.infinity
+    }
+
+    mutating func insert(_ match: StorageMatch) {
+        if heap.count < capacity {
+            heap.append(match)
+            siftUp(heap.count - 1)
+        } else if match.cost < worstCost {
+            heap[0] = match
+            siftDown(0)
+        }
+    }
+
+    func sorted() -> [StorageMatch] {
+        return heap.sorted { $0.cost < $1.cost }
+    }
+
+    private mutating func siftUp(_ index: Int) {
+        var child = index
+        while child > 0 {
+            let parent = (child - 1) / 2
+            if heap[parent].cost >= heap[child].cost {
+                return
+            }
+            swap(&heap[parent], &heap[child])
+            child = parent
+        }
+    }
+
+    private mutating func siftDown(_ index: Int) {
+        var parent = index
+        while true {
+            var largest = parent
+            for child in [2 * parent + 1, 2 * parent + 2] where child < heap.count && heap[child].cost > heap[largest].cost {
+                largest = child
+            }
+            if largest == parent {
+                return
+            }
+            swap(&heap[parent], &heap[largest])
+            parent = largest
+        }
+    }
+}
@@ -28,7 +28,7 @@ class StorageOptionCell: UITableViewCell {
     
     func configureCell(listing: Listing, order: Order) {
         if let rent = listing.rent {
-            priceLbl.text = "$\(rent)"
+            priceLbl.text = "$\(ModelFormats.string(from: rent))"
         }
         storageTypeLbl.text = listing.storageType.rawValue
         if let uid = listing.uid {
@@ -39,8 +39,8 @@ class StorageOptionCell: UITableViewCell {
         LocationLbl.text = listing.location
     }
     
-    func configureCell(company: StorageCompany, order: Order) {
-      priceLbl.text = "$\(formatPrice(price: company.calculateOrderPrice(order: order)))"
+    func configureCell(company: StorageCompany, price: Double) {
+      priceLbl.text = "$\(formatPrice(price: price))"
         DataService.instance.getCompanyImage(name: company.name, complete: { (image) in
             self.companyLogo.image = image
         })
@@ -23,17 +23,17 @@ class SuggestionCell: UITableViewCell {
     
     func configureCell(object: StorableObject, order: Order) {
         objectName.text = object.name.capitalized
-        height.text = object.height
-        width.text = object.width
-        length.text = object.length
+        height.text = ModelFormats.string(from: object.height)
+        width.text = ModelFormats.string(from: object.width)
+        length.text = ModelFormats.string(from: object.length)
         self.object = object
         self.order = order
     }
     func configureCell(object: StorableObject) {
         objectName.text = object.name.capitalized
-        height.text = object.height
-        width.text = object.width
-        length.text = object.length
+        height.text = ModelFormats.string(from: object.height)
+        width.text = ModelFormats.string(from: object.width)
+        length.text = ModelFormats.string(from: object.length)
         self.object = object
     }
 
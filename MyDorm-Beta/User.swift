@@ -8,6 +8,12 @@
 
 import Foundation
 
+// Where the objects of a user's orders come from
+protocol StorableObjectBackend {
+    // the objects with any of the names, by name, in one request; names that do not exist are left out
+    func storableObjects(named names: Set<String>, complete: @escaping ([String: StorableObject]) -> ())
+}
+
 class User {
     private var _firstName: String!
     private var _lastName: String!
@@ -18,6 +24,8 @@ class User {
     var listings = [Listing]()
     var orders = [Order]()
     var agreements = [Agreement]()
+    // object names of each order until hydrateOrders fills the orders in, by order id
+    private var pendingObjectNames = [String: [String]]()
 
     var uid: String {
         return _uid
@@ -37,6 +45,15 @@ class User {
     var name: String {
         return "\(firstName) \(lastName)"
     }
+    // the profile fields that are set, under their database names
+    var details: [String: String] {
+        var info = [String: String]()
+        info["First Name"] = _firstName
+        info["Last Name"] = _lastName
+        info["Email"] = _email
+        info["Dorm"] = _dorm
+        return info
+    }
     
     init(uid: String, userInfo: [String:Any]) {
         if let first = userInfo["First Name"] as? String {
@@ -52,24 +69,35 @@ class User {
             _dorm = room
         }
         self._uid = uid
-        if let orders = userInfo["Orders"] as? Dictionary<String, Dictionary<String, Any>> {
-            for key in orders.keys {
-                var order = Order()
-                order.uid = uid
-                order.orderID = key
-                // force unwrap is okay because we are iterating through keys
-                let details = orders[key]!
-                order.dropoff = details["Drop Off"] as! String!
-                order.pickup = details["Pick Up"] as! String!
-                // change get storable objects to return desired list 
-                DataService.instance.getStorableObjects(complete: { (objects) in
-                    let objectNameList = (details["Objects"] as! Dictionary<String, String>).keys
-                    order.objects = objects.filter {
-                        objectNameList.contains($0.name)
-                    }
-                })
+        if let orders = userInfo["Orders"] as? Dictionary<String, Any> {
+            for (key, details) in orders {
+                // an order without valid dates is skipped
+                guard let order = try? Order(id: key, uid: uid, firebase: details) else {
+                    continue
+                }
+                self.orders.append(order)
+                pendingObjectNames[key] = Order.objectNames(firebase: details)
             }
+            self.orders.sort { $0.orderID < $1.orderID }
+        }
+    }
+
+    // Fills in the objects of every order from one request for all the names the orders use, however many
+    // orders there are. complete is called once, with every order populated.
+    func hydrateOrders(from backend: StorableObjectBackend, complete: @escaping (User) -> ()) {
+        let names = Set(pendingObjectNames.values.joined())
+        if names.isEmpty {
+            pendingObjectNames.removeAll()
+            complete(self)
+            return
+        }
+        backend.storableObjects(named: names) { (objects) in
+            for index in self.orders.indices {
+                let orderNames = self.pendingObjectNames[self.orders[index].orderID] ?? []
+                self.orders[index].objects = orderNames.flatMap { objects[$0] }
+            }
+            self.pendingObjectNames.removeAll()
+            complete(self)
         }
     }
 }
-    
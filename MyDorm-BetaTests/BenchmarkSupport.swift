@@ -0,0 +1,28 @@
+//
+//  BenchmarkSupport.swift
+//  MyDorm-BetaTests
+//
+
+import Foundation
+
+// Small deterministic generator so every run replays the same trace
+struct TraceGenerator {
+    private var state: UInt64
+
+    init(seed: UInt64) {
+        state = seed
+    }
+
+    mutating func next(_ upperBound: Int) -> Int {
+        state = state &* 6364136223846793005 &+ 1442695040888963407
+        return Int((state >> 33) % UInt64(upperBound))
+    }
+}
+
+func percentile(_ values: [Double], _ fraction: Double) -> Double {
+    if values.isEmpty {
+        return 0
+    }
+    let sorted = values.sorted()
+    return sorted[min(sorted.count - 1, Int(Double(sorted.count) * fraction))]
+}
@@ -0,0 +1,293 @@
+//
+//  ChildSyncTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+@testable import MyDorm_Beta
+
+// In memory stand in for FIRDatabase. Like Firebase it answers on the main queue: the existing children as adds,
+// then the load marker, then every change made through set, remove and fail.
+class FakeChildEventSource: ChildEventSource {
+    final class Observation {
+        let path: String
+        let handler: (ChildEvent) -> ()
+        var isActive = true
+
+        init(path: String, handler: @escaping (ChildEvent) -> ()) {
+            self.path = path
+            self.handler = handler
+        }
+    }
+
+    private var children = [String: [String: Any]]()
+    private(set) var observations = [Observation]()
+    // false leaves new observations waiting for their first load, like a database that is slow to answer
+    var deliversInitialLoad = true
+
+    var activeObservationCount: Int {
+        return observations.filter { $0.isActive }.count
+    }
+
+    func observeChildren(path: String, query: ChildQuery, handler: @escaping (ChildEvent) -> ()) -> AnyObject {
+        let observation = Observation(path: path, handler: handler)
+        observations.append(observation)
+        DispatchQueue.main.async {
+            guard observation.isActive && self.deliversInitialLoad else {
+                return
+            }
+            var keys = (self.children[path] ?? [:]).keys.sorted()
+            if let limit = query.limit {
+                keys = Array(keys.prefix(Int(limit)))
+            }
+            for key in keys {
+                handler(ChildEvent(type: .added, key: key, value: self.children[path]![key]))
+            }
+            handler(ChildEvent(type: .loaded, key: path, value: nil))
+        }
+        return observation
+    }
+
+    func stopObserving(_ handle: AnyObject) {
+        (handle as? Observation)?.isActive = false
+    }
+
+    func set(_ value: Any, key: String, path: String) {
+        let type: ChildEventType = children[path]?[key] == nil ? .added : .changed
+        var current = children[path] ?? [:]
+        current[key] = value
+        children[path] = current
+        send(ChildEvent(type: type, key: key, value: value), path: path)
+    }
+
+    func remove(key: String, path: String) {
+        guard children[path]?.removeValue(forKey: key) != nil else {
+            return
+        }
+        send(ChildEvent(type: .removed, key: key, value: nil), path: path)
+    }
+
+    func fail(path: String, error: Error) {
+        send(ChildEvent(type: .failed, key: path, value: error), path: path)
+    }
+
+    private func send(_ event: ChildEvent, path: String) {
+        for observation in observations where observation.isActive && observation.path == path {
+            DispatchQueue.main.async {
+                if observation.isActive {
+                    observation.handler(event)
+                }
+            }
+        }
+    }
+}
+
+// Lets queued main queue work, event delivery and diff flushes, run to completion
+func drainMainQueue() {
+    RunLoop.main.run(until: Date().addingTimeInterval(0.05))
+}
+
+class ChildSyncTests: XCTestCase {
+    let path = "Storable Objects"
+    var source: FakeChildEventSource!
+
+    override func setUp() {
+        super.setUp()
+        source = FakeChildEventSource()
+    }
+
+    private func makeSync(pageSize: UInt? = nil) -> ChildSync<String> {
+        return ChildSync(source: source, path: path, pageSize: pageSize) { (_, value) in value as? String }
+    }
+
+    func testFirstLoadArrivesAsInserts() {
+        source.set("desk", key: "a", path: path)
+        source.set("lamp", key: "b", path: path)
+        let sync = makeSync()
+        var diffs = [ChildDiff<String>]()
+        sync.subscribe { diffs.append($0) }
+        drainMainQueue()
+        XCTAssertEqual(diffs.count, 1)
+        XCTAssertEqual(diffs.first?.inserted ?? [:], ["a": "desk", "b": "lamp"])
+        XCTAssertEqual(sync.items, ["a": "desk", "b": "lamp"])
+    }
+
+    func testEmptyLoadIsStillDelivered() {
+        let sync = makeSync()
+        var calls = 0
+        sync.subscribe { _ in calls += 1 }
+        drainMainQueue()
+        XCTAssertEqual(calls, 1)
+    }
+
+    func testChangesAreBatchedAndUnchangedValuesDropped() {
+        source.set("desk", key: "a", path: path)
+        let sync = makeSync()
+        var diffs = [ChildDiff<String>]()
+        sync.subscribe { diffs.append($0) }
+        drainMainQueue()
+        diffs.removeAll()
+
+        source.set("desk", key: "a", path: path)
+        source.set("chair", key: "b", path: path)
+        source.set("big desk", key: "a", path: path)
+        drainMainQueue()
+        XCTAssertEqual(diffs.count, 1)
+        XCTAssertEqual(diffs[0].inserted, ["b": "chair"])
+        XCTAssertEqual(diffs[0].updated, ["a": "big desk"])
+
+        diffs.removeAll()
+        source.set("big desk", key: "a", path: path)
+        drainMainQueue()
+        XCTAssertTrue(diffs.isEmpty)
+
+        source.remove(key: "b", path: path)
+        drainMainQueue()
+        XCTAssertEqual(diffs.count, 1)
+        XCTAssertEqual(diffs[0].deleted, ["b"])
+    }
+
+    func testUnsubscribedHandlerIsReleased() {
+        final class Owner {}
+        let sync = makeSync()
+        var owner: Owner? = Owner()
+        weak var weakOwner = owner
+        var calls = 0
+        let id = sync.subscribe { [owner] _ in
+            _ = owner
+            calls += 1
+        }
+        owner = nil
+        drainMainQueue()
+        XCTAssertEqual(calls, 1)
+        XCTAssertNotNil(weakOwner)
+
+        sync.unsubscribe(id)
+        XCTAssertNil(weakOwner)
+        source.set("desk", key: "a", path: path)
+        drainMainQueue()
+        XCTAssertEqual(calls, 1)
+    }
+
+    func testFailureReachesSubscribersAndWaiters() {
+        source.set("desk", key: "a", path: path)
+        let sync = makeSync()
+        var errors = [Error]()
+        sync.subscribe { (diff) in
+            if let error = diff.error {
+                errors.append(error)
+            }
+        }
+        drainMainQueue()
+        source.fail(path: path, error: NSError(domain: "FakeChildEventSource", code: 1, userInfo: nil))
+        drainMainQueue()
+        XCTAssertEqual(errors.count, 1)
+        XCTAssertEqual(source.activeObservationCount, 0)
+        // what was synced before the failure stays
+        XCTAssertEqual(sync.items, ["a": "desk"])
+
+        // the next subscriber starts observing again
+        sync.subscribe { _ in }
+        XCTAssertEqual(source.activeObservationCount, 1)
+    }
+
+    func testFailureBeforeLoadReleasesWaiters() {
+        source.deliversInitialLoad = false
+        let sync = makeSync()
+        var released = false
+        sync.whenLoaded {
+            released = true
+        }
+        source.fail(path: path, error: NSError(domain: "FakeChildEventSource", code: 1, userInfo: nil))
+        drainMainQueue()
+        XCTAssertTrue(released)
+    }
+
+    func testSeededKeysTheDatabaseNoLongerHasAreDeleted() {
+        source.set("desk", key: "a", path: path)
+        let sync = makeSync()
+        sync.seed(["a": "desk", "gone": "lamp"])
+        var diffs = [ChildDiff<String>]()
+        sync.subscribe { diffs.append($0) }
+        drainMainQueue()
+        XCTAssertEqual(sync.items, ["a": "desk"])
+        XCTAssertEqual(diffs.last?.deleted ?? [], ["gone"])
+    }
+
+    func testNextPageWidensTheWindow() {
+        for index in 0..<5 {
+            source.set("item \(index)", key: "k\(index)", path: path)
+        }
+        let sync = makeSync(pageSize: 2)
+        sync.subscribe { _ in }
+        drainMainQueue()
+        XCTAssertEqual(sync.items.count, 2)
+        sync.loadNextPage()
+        drainMainQueue()
+        XCTAssertEqual(sync.items.count, 4)
+        XCTAssertEqual(source.activeObservationCount, 1)
+    }
+}
+
+class DataServiceSubscriptionTests: XCTestCase {
+    var source: FakeChildEventSource!
+    var service: DataService!
+    var snapshotURL: URL!
+
+    override func setUp() {
+        super.setUp()
+        source = FakeChildEventSource()
+        snapshotURL = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent(UUID().uuidString)
+        service = DataService(source: source, snapshotStore: SnapshotStore(fileURL: snapshotURL))
+    }
+
+    override func tearDown() {
+        service = nil
+        try? FileManager.default.removeItem(at: snapshotURL)
+        super.tearDown()
+    }
+
+    func testStorableObjectSubscriptionEndsWithUnsubscribe() {
+        source.set("Desk", key: "a", path: "Storable Objects")
+        var names = [[String]]()
+        let id = service.getStorableObjects { (objects, error) in
+            XCTAssertNil(error)
+            names.append(objects.map { $0.name })
+        }
+        drainMainQueue()
+        XCTAssertEqual(names.last ?? [], ["Desk"])
+
+        service.unsubscribeFromStorableObjects(id: id)
+        source.set("Lamp", key: "b", path: "Storable Objects")
+        drainMainQueue()
+        XCTAssertEqual(names.count, 1)
+    }
+
+    func testDatabaseErrorsReachTheCompletion() {
+        var received: Error?
+        service.getCompanydata { (error) in
+            if let error = error {
+                received = error
+            }
+        }
+        drainMainQueue()
+        source.fail(path: "Companies", error: NSError(domain: "FakeChildEventSource", code: 7, userInfo: nil))
+        drainMainQueue()
+        XCTAssertEqual((received as NSError?)?.code, 7)
+    }
+
+    func testListingSubscriptionsDoNotPileUp() {
+        var calls = 0
+        let first = service.getListings { (_, _) in calls += 1 }
+        drainMainQueue()
+        service.unsubscribeFromListings(id: first)
+        calls = 0
+        service.getListings { (_, _) in calls += 1 }
+        drainMainQueue()
+        source.set(["Name": "x"], key: "l1", path: "Listings")
+        drainMainQueue()
+        // one call for the current listings and at most one for the change, none from the first subscriber
+        XCTAssertLessThanOrEqual(calls, 2)
+        XCTAssertEqual(source.activeObservationCount, 1)
+    }
+}
@@ -0,0 +1,243 @@
+//
+//  GTMSessionCookieStorageTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import GTMSessionFetcher
+
+// Checks the indexed cookie storage against two references on random cookies and URLs:
+// - rfc6265Cookies gives exactly what the storage should return, in order.
+// - legacyCookies is the linear scan the storage used to do, and anything it disagrees on has to be one of
+//   the intended differences:
+//     host-only cookies (a domain without a leading ".") no longer match subdomains,
+//     a cookie path only matches at a "/" boundary, so /foo no longer matches /foobar,
+//     the request path keeps its trailing "/", so a /foo/ cookie now matches /foo/,
+//     results are ordered longest path first, then oldest first, instead of by insertion.
+class GTMSessionCookieStorageTests: XCTestCase {
+    let domains = ["example.com", ".example.com", "a.example.com", ".a.example.com", "b.a.example.com", "other.org", ".other.org", "10.0.0.1"]
+    let paths = ["/", "/foo", "/foo/", "/foo/bar", "/foobar"]
+    let hosts = ["example.com", "a.example.com", "b.a.example.com", "c.example.com", "other.org", "www.other.org", "10.0.0.1"]
+    let urlPaths = ["", "/", "/foo", "/foo/", "/foo/bar", "/foobar", "/foo/bar/baz"]
+
+    private func cookie(name: String, domain: String, path: String, secure: Bool = false, expires: Date? = nil) -> HTTPCookie {
+        var properties: [HTTPCookiePropertyKey: Any] = [.name: name, .value: "v", .domain: domain, .path: path]
+        if secure {
+            properties[.secure] = "TRUE"
+        }
+        if let expires = expires {
+            properties[.expires] = expires
+        }
+        return HTTPCookie(properties: properties)!
+    }
+
+    private static func key(_ cookie: HTTPCookie) -> String {
+        return "\(cookie.name)|\(cookie.domain.lowercased())|\(cookie.path)"
+    }
+
+    private static func rawPath(_ url: URL) -> String {
+        let path = (CFURLCopyPath(url as CFURL) as String?) ?? ""
+        return path.hasPrefix("/") ? path : "/"
+    }
+
+    private static func rfcPathMatches(_ cookiePath: String, _ requestPath: String) -> Bool {
+        guard requestPath.hasPrefix(cookiePath) else {
+            return false
+        }
+        return requestPath.characters.count == cookiePath.characters.count || cookiePath.hasSuffix("/") || requestPath.utf16[requestPath.utf16.index(requestPath.utf16.startIndex, offsetBy: cookiePath.utf16.count)] == 47
+    }
+
+    private static func isHostOnly(_ cookie: HTTPCookie) -> Bool {
+        return !cookie.domain.hasPrefix(".")
+    }
+
+    // the scan cookiesForURL: did before the index, stored holds the cookies in insertion order
+    private static func legacyCookies(_ stored: [HTTPCookie], for url: URL) -> [HTTPCookie] {
+        let requestingDomain = "." + (url.host ?? "").lowercased()
+        let path = url.path
+        let isHTTPS = url.scheme?.lowercased() == "https"
+        return stored.filter { (cookie) in
+            var cookieDomain = cookie.domain.lowercased()
+            if !cookieDomain.hasPrefix(".") {
+                cookieDomain = "." + cookieDomain
+            }
+            let isDomainOK = requestingDomain.hasSuffix(cookieDomain)
+            let isPathOK = cookie.path == "/" || path.hasPrefix(cookie.path)
+            return isDomainOK && isPathOK && (!cookie.isSecure || isHTTPS)
+        }
+    }
+
+    // RFC 6265 section 5.4, sequence gives each cookie's creation order
+    private static func rfc6265Cookies(_ stored: [HTTPCookie], sequence: [String: Int], for url: URL) -> [HTTPCookie] {
+        let host = (url.host ?? "").lowercased()
+        let path = rawPath(url)
+        let isHTTPS = url.scheme?.lowercased() == "https"
+        let isIPAddress = host.rangeOfCharacter(from: CharacterSet(charactersIn: "0123456789.").inverted) == nil
+        let found = stored.filter { (cookie) in
+            let domain = cookie.domain.lowercased()
+            var isDomainOK: Bool
+            if isHostOnly(cookie) {
+                isDomainOK = host == domain
+            } else {
+                let domainKey = String(domain.characters.dropFirst())
+                isDomainOK = host == domainKey || (!isIPAddress && host.hasSuffix("." + domainKey))
+            }
+            return isDomainOK && rfcPathMatches(cookie.path, path) && (!cookie.isSecure || isHTTPS)
+        }
+        return found.sorted {
+            let length0 = $0.path.characters.count
+            let length1 = $1.path.characters.count
+            if length0 != length1 {
+                return length0 > length1
+            }
+            return sequence[key($0)]! < sequence[key($1)]!
+        }
+    }
+
+    func testLookupsMatchRFC6265AndDifferFromTheOldScanOnlyAsIntended() {
+        var generator = TraceGenerator(seed: 24)
+        for _ in 0..<50 {
+            let storage = GTMSessionCookieStorage()
+            // insertion order for the old scan, where a replaced cookie moved to the end
+            var stored = [HTTPCookie]()
+            var sequence = [String: Int]()
+            var nextSequence = 0
+            for _ in 0..<(1 + generator.next(40)) {
+                let cookie = self.cookie(name: "c\(generator.next(4))", domain: domains[generator.next(domains.count)], path: paths[generator.next(paths.count)], secure: generator.next(4) == 0)
+                let key = GTMSessionCookieStorageTests.key(cookie)
+                if generator.next(8) == 0 {
+                    storage.deleteCookie(cookie)
+                    stored = stored.filter { GTMSessionCookieStorageTests.key($0) != key }
+                    sequence.removeValue(forKey: key)
+                    continue
+                }
+                storage.setCookies([cookie])
+                stored = stored.filter { GTMSessionCookieStorageTests.key($0) != key } + [cookie]
+                if sequence[key] == nil {
+                    sequence[key] = nextSequence
+                    nextSequence += 1
+                }
+            }
+
+            for host in hosts {
+                for path in urlPaths {
+                    for scheme in ["http", "https"] {
+                        let url = URL(string: "\(scheme)://\(host)\(path)")!
+                        let found = storage.cookies(for: url) ?? []
+                        let expected = GTMSessionCookieStorageTests.rfc6265Cookies(stored, sequence: sequence, for: url)
+                        XCTAssertEqual(found.map(GTMSessionCookieStorageTests.key), expected.map(GTMSessionCookieStorageTests.key), url.absoluteString)
+
+                        let legacy = Set(GTMSessionCookieStorageTests.legacyCookies(stored, for: url).map(GTMSessionCookieStorageTests.key))
+                        let current = Set(found.map(GTMSessionCookieStorageTests.key))
+                        let requestHost = host.lowercased()
+                        let requestPath = GTMSessionCookieStorageTests.rawPath(url)
+                        for cookie in stored where legacy.contains(GTMSessionCookieStorageTests.key(cookie)) && !current.contains(GTMSessionCookieStorageTests.key(cookie)) {
+                            let hostOnlyOnOtherHost = GTMSessionCookieStorageTests.isHostOnly(cookie) && cookie.domain.lowercased() != requestHost
+                            let pathNotAtBoundary = !GTMSessionCookieStorageTests.rfcPathMatches(cookie.path, requestPath)
+                            XCTAssertTrue(hostOnlyOnOtherHost || pathNotAtBoundary, "\(cookie) for \(url)")
+                        }
+                        for cookie in stored where current.contains(GTMSessionCookieStorageTests.key(cookie)) && !legacy.contains(GTMSessionCookieStorageTests.key(cookie)) {
+                            // only the kept trailing slash lets a cookie match that the old scan missed
+                            XCTAssertFalse(url.path.hasPrefix(cookie.path), "\(cookie) for \(url)")
+                            XCTAssertTrue(requestPath.hasPrefix(cookie.path), "\(cookie) for \(url)")
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    func testIntendedDifferences() {
+        let storage = GTMSessionCookieStorage()
+        storage.setCookies([cookie(name: "host", domain: "example.com", path: "/"),
+                            cookie(name: "domain", domain: ".example.com", path: "/"),
+                            cookie(name: "foo", domain: ".example.com", path: "/foo"),
+                            cookie(name: "deep", domain: ".example.com", path: "/foo/bar")])
+        let names = { (url: String) -> [String] in
+            (storage.cookies(for: URL(string: url)!) ?? []).map { $0.name }
+        }
+        // the old scan also sent "host" to the subdomain
+        XCTAssertEqual(names("http://www.example.com/"), ["domain"])
+        // the old scan also sent "foo" to /foobar
+        XCTAssertEqual(names("http://example.com/foobar"), ["host", "domain"])
+        // the old scan returned them in insertion order
+        XCTAssertEqual(names("http://example.com/foo/bar"), ["deep", "foo", "host", "domain"])
+    }
+
+    func testReplacedCookieKeepsItsPlaceAndExpiredCookiesGo() {
+        let storage = GTMSessionCookieStorage()
+        storage.setCookies([cookie(name: "first", domain: ".example.com", path: "/"),
+                            cookie(name: "second", domain: ".example.com", path: "/")])
+        storage.setCookies([cookie(name: "first", domain: ".example.com", path: "/")])
+        XCTAssertEqual((storage.cookies(for: URL(string: "http://example.com/")!) ?? []).map { $0.name }, ["first", "second"])
+
+        storage.setCookies([cookie(name: "brief", domain: ".example.com", path: "/", expires: Date(timeIntervalSinceNow: 0.1))])
+        XCTAssertEqual(storage.cookies(for: URL(string: "http://example.com/")!)?.count, 3)
+        Thread.sleep(forTimeInterval: 0.2)
+        XCTAssertEqual((storage.cookies(for: URL(string: "http://example.com/")!) ?? []).map { $0.name }, ["first", "second"])
+        XCTAssertEqual(storage.cookies?.count, 2)
+    }
+
+/*************************************************/
+/*                   Benchmark                   */
+/*************************************************/
+    // 10,000 cookies across 1,000 domains, and 1,000 lookups with the same generator
+    private func benchmarkCookies() -> ([HTTPCookie], [URL]) {
+        var generator = TraceGenerator(seed: 10_000)
+        var cookies = [HTTPCookie]()
+        for index in 0..<10_000 {
+            let domain = "site\(index % 1000).example.com"
+            cookies.append(cookie(name: "c\(index / 1000)", domain: generator.next(2) == 0 ? domain : "." + domain, path: paths[generator.next(paths.count)]))
+        }
+        let urls = (0..<1000).map { _ in URL(string: "https://site\(generator.next(1000)).example.com\(urlPaths[generator.next(urlPaths.count)])")! }
+        return (cookies, urls)
+    }
+
+    func testIndexedLookupsWithTenThousandCookies() {
+        let (cookies, urls) = benchmarkCookies()
+        let storage = GTMSessionCookieStorage()
+        storage.setCookies(cookies)
+        XCTAssertEqual(storage.cookies?.count, 10_000)
+        measure {
+            for url in urls {
+                _ = storage.cookies(for: url)
+            }
+        }
+    }
+
+    // what every lookup cost before the index
+    func testScanningLookupsWithTenThousandCookies() {
+        let (cookies, urls) = benchmarkCookies()
+        measure {
+            for url in urls {
+                _ = GTMSessionCookieStorageTests.legacyCookies(cookies, for: url)
+            }
+        }
+    }
+
+    func testIndexBeatsScanningEveryCookie() {
+        let (cookies, urls) = benchmarkCookies()
+        let storage = GTMSessionCookieStorage()
+        storage.setCookies(cookies)
+
+        var found = 0
+        var start = CFAbsoluteTimeGetCurrent()
+        for url in urls {
+            found += storage.cookies(for: url)?.count ?? 0
+        }
+        let indexed = (CFAbsoluteTimeGetCurrent() - start) * 1_000_000 / Double(urls.count)
+
+        var scanned = 0
+        start = CFAbsoluteTimeGetCurrent()
+        for url in urls {
+            scanned += GTMSessionCookieStorageTests.legacyCookies(cookies, for: url).count
+        }
+        XCTAssertGreaterThan(scanned, 0)
+        let linear = (CFAbsoluteTimeGetCurrent() - start) * 1_000_000 / Double(urls.count)
+
+        XCTAssertGreaterThan(found, 0)
+        // microseconds per lookup
+        XCTAssertLessThan(indexed, linear / 10)
+        XCTAssertLessThan(indexed, 100)
+    }
+}
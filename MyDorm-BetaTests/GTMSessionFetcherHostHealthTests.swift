@@ -0,0 +1,216 @@
+//
+//  GTMSessionFetcherHostHealthTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import GTMSessionFetcher
+
+// Drives the service's circuit breaker, retry budget and Retry-After handling through a test block that answers
+// each host with scripted status codes, on a clock the tests move themselves
+class GTMSessionFetcherHostHealthTests: XCTestCase {
+    let hostUnavailable = GTMSessionFetcherError.hostUnavailable.rawValue
+    var service: GTMSessionFetcherService!
+    var now: TimeInterval = 1000
+    // requests that reached each host, retries included
+    var requests = [String: Int]()
+    // status and headers for the host's nth request, counting from 1
+    var script: (String, Int) -> (Int, [String: String]) = { (_, _) in (200, [:]) }
+
+    override func setUp() {
+        super.setUp()
+        now = 1000
+        requests = [:]
+        script = { (_, _) in (200, [:]) }
+        service = GTMSessionFetcherService()
+        service.clockBlock = { [unowned self] in self.now }
+        service.testBlock = { [unowned self] (fetcher, testResponse) in
+            let url = fetcher.request!.url!
+            let host = url.host!
+            let count = (self.requests[host] ?? 0) + 1
+            self.requests[host] = count
+            let (status, headers) = self.script(host, count)
+            let response = HTTPURLResponse(url: url, statusCode: status, httpVersion: "HTTP/1.1", headerFields: headers)
+            if status < 300 {
+                testResponse(response, Data(), nil)
+            } else {
+                testResponse(response, nil, NSError(domain: kGTMSessionFetcherStatusDomain, code: status, userInfo: nil))
+            }
+        }
+    }
+
+    override func tearDown() {
+        service.testBlock = nil
+        service = nil
+        super.tearDown()
+    }
+
+    // Begins every fetch before waiting, and returns 200 or the error code of each
+    @discardableResult
+    private func fetch(_ urlStrings: [String], configure: (GTMSessionFetcher) -> () = { _ in }) -> [Int] {
+        var codes = [Int](repeating: 0, count: urlStrings.count)
+        for (index, urlString) in urlStrings.enumerated() {
+            let fetcher = service.fetcher(withURLString: urlString)
+            configure(fetcher)
+            let done = expectation(description: "\(urlString) \(index)")
+            fetcher.beginFetch { (_, error) in
+                codes[index] = (error as NSError?)?.code ?? 200
+                done.fulfill()
+            }
+        }
+        waitForExpectations(timeout: 60, handler: nil)
+        return codes
+    }
+
+    @discardableResult
+    private func fetch(_ urlString: String, configure: (GTMSessionFetcher) -> () = { _ in }) -> Int {
+        return fetch([urlString], configure: configure)[0]
+    }
+
+    private func enableRetries(min: TimeInterval, max: TimeInterval) {
+        let policy = GTMSessionFetcherBackoffRetryPolicy(jitter: .none)
+        policy.randomBlock = { 0 }
+        service.isRetryEnabled = true
+        service.minRetryInterval = min
+        service.maxRetryInterval = max
+        service.retryPolicy = policy
+    }
+
+    func testCircuitOpensProbesAndCloses() {
+        service.circuitBreakerFailureThreshold = 3
+        service.circuitBreakerOpenInterval = 30
+        var healthy = false
+        script = { (host, _) in (host == "flaky.test" && !healthy) ? (503, [:]) : (200, [:]) }
+
+        for _ in 0..<3 {
+            XCTAssertEqual(fetch("https://flaky.test/a"), 503)
+        }
+        // open: fetches fail at once without a request, other hosts are untouched
+        XCTAssertEqual(fetch("https://flaky.test/a"), hostUnavailable)
+        XCTAssertEqual(requests["flaky.test"], 3)
+        XCTAssertEqual(fetch("https://steady.test/a"), 200)
+
+        now += 29
+        XCTAssertEqual(fetch("https://flaky.test/a"), hostUnavailable)
+        XCTAssertEqual(requests["flaky.test"], 3)
+
+        // one probe per interval, a failed probe keeps the circuit open for another interval
+        now += 1
+        XCTAssertEqual(fetch(["https://flaky.test/a", "https://flaky.test/b"]), [503, hostUnavailable])
+        XCTAssertEqual(requests["flaky.test"], 4)
+        now += 29
+        XCTAssertEqual(fetch("https://flaky.test/a"), hostUnavailable)
+
+        // a successful probe closes the circuit
+        healthy = true
+        now += 1
+        XCTAssertEqual(fetch("https://flaky.test/a"), 200)
+        XCTAssertEqual(fetch(["https://flaky.test/a", "https://flaky.test/b"]), [200, 200])
+        XCTAssertEqual(requests["flaky.test"], 7)
+    }
+
+    func testFailuresHaveToBeConsecutive() {
+        service.circuitBreakerFailureThreshold = 3
+        script = { (_, count) in (count % 3 == 0) ? (200, [:]) : (503, [:]) }
+        for _ in 0..<9 {
+            XCTAssertNotEqual(fetch("https://flaky.test/a"), hostUnavailable)
+        }
+        XCTAssertEqual(requests["flaky.test"], 9)
+    }
+
+    // a 404 is the request's fault, not the host's
+    func testClientErrorsKeepTheCircuitClosed() {
+        service.circuitBreakerFailureThreshold = 2
+        script = { (_, _) in (404, [:]) }
+        for _ in 0..<5 {
+            XCTAssertEqual(fetch("https://missing.test/a"), 404)
+        }
+        script = { (_, _) in (429, [:]) }
+        XCTAssertEqual(fetch("https://missing.test/a"), 429)
+        XCTAssertEqual(fetch("https://missing.test/a"), 429)
+        XCTAssertEqual(fetch("https://missing.test/a"), hostUnavailable)
+    }
+
+    // The first fetch spends the three starting tokens, after that every second fetch earns one retry
+    func testRetryBudgetRunsOut() {
+        enableRetries(min: 0.01, max: 10)
+        service.retryBudgetCapacity = 3
+        service.retryBudgetRatio = 0.5
+        script = { (_, _) in (503, [:]) }
+
+        XCTAssertEqual(fetch("https://down.test/a"), 503)
+        XCTAssertEqual(requests["down.test"], 4)
+        for _ in 0..<20 {
+            XCTAssertEqual(fetch("https://down.test/a"), 503)
+        }
+        XCTAssertEqual(requests["down.test"], 4 + 20 + 10)
+        XCTAssertEqualWithAccuracy(service.requestAmplification(forHost: "down.test"), 34.0 / 21.0, accuracy: 0.0001)
+    }
+
+    func testWithoutABudgetRetriesStopAtTheMaxInterval() {
+        enableRetries(min: 0.01, max: 0.1)
+        script = { (_, _) in (503, [:]) }
+        XCTAssertEqual(fetch("https://down.test/a"), 503)
+        // waits of 0.01, 0.02, 0.04 and 0.08, then 0.16 is past the max
+        XCTAssertEqual(requests["down.test"], 5)
+    }
+
+    func testRetryAfterBelowTheMaxIntervalIsHonored() {
+        enableRetries(min: 0.5, max: 10)
+        script = { (_, count) in count == 1 ? (503, ["Retry-After": "1"]) : (200, [:]) }
+        var interval: TimeInterval = -1
+        let start = CFAbsoluteTimeGetCurrent()
+        let code = fetch("https://busy.test/a") { (fetcher) in
+            fetcher.retryBlock = { [unowned fetcher] (suggestedWillRetry, _, response) in
+                interval = fetcher.nextRetryInterval
+                response(suggestedWillRetry)
+            }
+        }
+        XCTAssertEqual(code, 200)
+        XCTAssertEqual(requests["busy.test"], 2)
+        XCTAssertEqualWithAccuracy(interval, 1, accuracy: 0.0001)
+        XCTAssertGreaterThanOrEqual(CFAbsoluteTimeGetCurrent() - start, 1)
+    }
+
+    func testRetryAfterAboveTheMaxIntervalGivesUp() {
+        enableRetries(min: 0.5, max: 10)
+        script = { (_, count) in count == 1 ? (503, ["Retry-After": "60"]) : (200, [:]) }
+        var retryBlockCalls = 0
+        let code = fetch("https://busy.test/a") { (fetcher) in
+            fetcher.retryBlock = { (suggestedWillRetry, _, response) in
+                retryBlockCalls += 1
+                response(suggestedWillRetry)
+            }
+        }
+        XCTAssertEqual(code, 503)
+        XCTAssertEqual(requests["busy.test"], 1)
+        XCTAssertEqual(retryBlockCalls, 0)
+    }
+
+    func testAmplificationReport() {
+        XCTAssertEqual(service.requestAmplification(forHost: nil), 1)
+
+        enableRetries(min: 0.01, max: 0.05)
+        script = { (host, count) in (host == "retried.test" && count % 3 != 0) ? (503, [:]) : (200, [:]) }
+        for _ in 0..<4 {
+            XCTAssertEqual(fetch("https://retried.test/a"), 200)
+        }
+        XCTAssertEqual(service.requestAmplification(forHost: "retried.test"), 3)
+
+        // fetches the open circuit fails without sending count, requests do not
+        service.isRetryEnabled = false
+        service.circuitBreakerFailureThreshold = 2
+        script = { (_, _) in (503, [:]) }
+        for _ in 0..<8 {
+            fetch("https://down.test/a")
+        }
+        XCTAssertEqual(requests["down.test"], 2)
+        XCTAssertEqualWithAccuracy(service.requestAmplification(forHost: "down.test"), 0.25, accuracy: 0.0001)
+        XCTAssertEqualWithAccuracy(service.requestAmplification(forHost: nil), 14.0 / 12.0, accuracy: 0.0001)
+        XCTAssertEqual(service.requestAmplification(forHost: "unknown.test"), 1)
+
+        service.resetHostHealth()
+        XCTAssertEqual(service.requestAmplification(forHost: nil), 1)
+        XCTAssertEqual(fetch("https://down.test/a"), 503)
+    }
+}
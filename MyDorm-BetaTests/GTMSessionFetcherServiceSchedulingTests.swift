@@ -0,0 +1,236 @@
+//
+//  GTMSessionFetcherServiceSchedulingTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import GTMSessionFetcher
+
+// Drives the service's fetcher scheduling through mockFetcherServiceWithFakedData: the per-host and overall limits,
+// freed slots going to waiting hosts in turn, and priority aging on a clock the tests move themselves
+class GTMSessionFetcherServiceSchedulingTests: XCTestCase {
+    let fakedData = "faked".data(using: .utf8)!
+    var service: GTMSessionFetcherService!
+    var now: TimeInterval = 1000
+    // host and path of each fetcher, in the order the service started them
+    var started = [String]()
+    // faked answers of started fetchers, held until the test lets them through
+    var held = [String: () -> ()]()
+    var finished = 0
+
+    override func setUp() {
+        super.setUp()
+        now = 1000
+        started = []
+        held = [:]
+        finished = 0
+        service = GTMSessionFetcherService.mockFetcherService(withFakedData: fakedData, fakedError: nil)
+        service.clockBlock = { [unowned self] in self.now }
+        let fakedAnswer = service.testBlock!
+        service.testBlock = { [unowned self] (fetcher, testResponse) in
+            let url = fetcher.request!.url!
+            let key = url.host! + url.path
+            self.started.append(key)
+            self.held[key] = {
+                fakedAnswer(fetcher, testResponse)
+            }
+        }
+    }
+
+    override func tearDown() {
+        service.stopAllFetchers()
+        service.testBlock = nil
+        service = nil
+        held = [:]
+        super.tearDown()
+    }
+
+    private func waitUntil(_ description: String, _ condition: () -> Bool) {
+        let deadline = Date(timeIntervalSinceNow: 10)
+        while !condition() && Date() < deadline {
+            RunLoop.current.run(until: Date(timeIntervalSinceNow: 0.001))
+        }
+        XCTAssertTrue(condition(), description)
+    }
+
+    private func begin(_ keys: [String], priority: Int = 0) {
+        for key in keys {
+            let fetcher = service.fetcher(withURLString: "https://\(key)")
+            fetcher.servicePriority = priority
+            fetcher.beginFetch { (data, error) in
+                XCTAssertNil(error)
+                XCTAssertEqual(data, self.fakedData)
+                self.finished += 1
+            }
+        }
+    }
+
+    // Lets the fetcher's answer through and waits for it to finish, which starts whatever the service picks next
+    private func finish(_ key: String) {
+        let finishedBefore = finished
+        held.removeValue(forKey: key)?()
+        waitUntil("\(key) finished") { self.finished == finishedBefore + 1 }
+    }
+
+    private func runningCount(_ host: String) -> Int {
+        return service.runningFetchersByHost?[host]?.count ?? 0
+    }
+
+    func testPerHostLimitDelaysTheRest() {
+        service.maxRunningFetchersPerHost = 2
+        begin(["a.test/1", "a.test/2", "a.test/3", "a.test/4", "b.test/1"])
+        XCTAssertEqual(started, ["a.test/1", "a.test/2", "b.test/1"])
+        XCTAssertEqual(runningCount("a.test"), 2)
+        XCTAssertEqual(service.numberOfDelayedFetchers(), 2)
+
+        finish("a.test/1")
+        XCTAssertEqual(started.last, "a.test/3")
+        XCTAssertEqual(runningCount("a.test"), 2)
+        finish("a.test/2")
+        finish("a.test/3")
+        finish("a.test/4")
+        finish("b.test/1")
+        XCTAssertEqual(started.count, 5)
+        XCTAssertEqual(service.numberOfRunningFetchers(), 0)
+    }
+
+    func testOverallLimitHoldsAcrossHosts() {
+        service.maxRunningFetchersPerHost = 10
+        service.maxRunningFetchers = 3
+        begin(["a.test/1", "b.test/1", "c.test/1", "d.test/1", "e.test/1"])
+        XCTAssertEqual(started, ["a.test/1", "b.test/1", "c.test/1"])
+        XCTAssertEqual(service.numberOfRunningFetchers(), 3)
+        XCTAssertTrue(service.isDelayingFetcher(service.delayedFetchersByHost!["d.test"]![0] as! GTMSessionFetcher))
+
+        finish("b.test/1")
+        XCTAssertEqual(started.last, "d.test/1")
+        XCTAssertEqual(service.numberOfRunningFetchers(), 3)
+        finish("a.test/1")
+        XCTAssertEqual(started.last, "e.test/1")
+    }
+
+    // A host that frees a slot with nothing left to start hands it to the hosts waiting for one, each in turn.
+    // A host that still has fetchers waiting keeps its own slot.
+    func testFreedSlotsGoToWaitingHostsInTurn() {
+        service.maxRunningFetchersPerHost = 10
+        service.maxRunningFetchers = 3
+        begin(["x.test/1", "x.test/2", "x.test/3"])
+        begin(["a.test/1", "a.test/2", "b.test/1", "b.test/2", "c.test/1", "c.test/2"])
+        XCTAssertEqual(service.numberOfDelayedFetchers(), 6)
+
+        for key in ["x.test/1", "x.test/2", "x.test/3"] {
+            finish(key)
+        }
+        XCTAssertEqual(Array(started.suffix(3)), ["a.test/1", "b.test/1", "c.test/1"])
+
+        finish("b.test/1")
+        XCTAssertEqual(started.last, "b.test/2")
+        finish("a.test/1")
+        XCTAssertEqual(started.last, "a.test/2")
+        finish("c.test/1")
+        XCTAssertEqual(started.last, "c.test/2")
+        XCTAssertEqual(service.numberOfDelayedFetchers(), 0)
+    }
+
+    // One slot for the host. The background fetcher waits from the start, an interactive one arrives 5 seconds
+    // later and another 25 seconds later.
+    private func agingStartOrder(interval: TimeInterval) -> [String] {
+        service.maxRunningFetchersPerHost = 1
+        service.priorityAgingInterval = interval
+        begin(["a.test/running"])
+        begin(["a.test/background"], priority: 1)
+        now += 5
+        begin(["a.test/interactive-1"], priority: -1)
+        finish("a.test/running")
+        now += 20
+        begin(["a.test/interactive-2"], priority: -1)
+        finish("a.test/interactive-1")
+        finish(started.last!)
+        finish(started.last!)
+        return started
+    }
+
+    func testInteractiveFetchersStartFirst() {
+        XCTAssertEqual(agingStartOrder(interval: 0), ["a.test/running", "a.test/interactive-1", "a.test/interactive-2", "a.test/background"])
+    }
+
+    // after two aging intervals the background fetcher counts as interactive, and it has waited the longest
+    func testWaitingFetchersAgeIntoAHigherClass() {
+        XCTAssertEqual(agingStartOrder(interval: 10), ["a.test/running", "a.test/interactive-1", "a.test/background", "a.test/interactive-2"])
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let stressFetcherCount = 10_000
+    let stressHostCount = 50
+
+    // Runs 10k fetchers across 50 hosts through a mock service that answers each one from the main queue right after
+    // it starts. Returns the most fetchers seen running overall and for one host.
+    private func runStress(perHost: UInt, overall: UInt) -> (running: Int, runningForHost: Int) {
+        let stressService = GTMSessionFetcherService.mockFetcherService(withFakedData: fakedData, fakedError: nil)
+        stressService.maxRunningFetchersPerHost = perHost
+        stressService.maxRunningFetchers = overall
+        let fakedAnswer = stressService.testBlock!
+        var mostRunning = 0
+        var mostRunningForHost = 0
+        stressService.testBlock = { [unowned stressService] (fetcher, testResponse) in
+            let host = fetcher.request!.url!.host!
+            mostRunning = max(mostRunning, Int(stressService.numberOfRunningFetchers()))
+            mostRunningForHost = max(mostRunningForHost, stressService.runningFetchersByHost?[host]?.count ?? 0)
+            DispatchQueue.main.async {
+                fakedAnswer(fetcher, testResponse)
+            }
+        }
+
+        var completed = 0
+        var failed = 0
+        for index in 0..<stressFetcherCount {
+            let fetcher = stressService.fetcher(withURLString: "https://host-\(index % stressHostCount).test/\(index)")
+            fetcher.servicePriority = (index % 7 == 0) ? -1 : ((index % 5 == 0) ? 1 : 0)
+            fetcher.beginFetch { (data, error) in
+                if error != nil || data != self.fakedData {
+                    failed += 1
+                }
+                completed += 1
+            }
+        }
+        XCTAssertTrue(stressService.waitForCompletionOfAllFetchers(withTimeout: 120))
+        waitUntil("every completion handler ran") { completed == self.stressFetcherCount }
+        XCTAssertEqual(failed, 0)
+        XCTAssertEqual(stressService.numberOfRunningFetchers(), 0)
+        XCTAssertEqual(stressService.numberOfDelayedFetchers(), 0)
+        stressService.testBlock = nil
+        return (mostRunning, mostRunningForHost)
+    }
+
+    func testStressStaysWithinBothLimits() {
+        let (running, runningForHost) = runStress(perHost: 4, overall: 64)
+        XCTAssertEqual(running, 64)
+        XCTAssertEqual(runningForHost, 4)
+    }
+
+    func testStressWithLimits() {
+        measure {
+            _ = self.runStress(perHost: 4, overall: 64)
+        }
+    }
+
+    func testStressWithoutLimits() {
+        measure {
+            _ = self.runStress(perHost: 0, overall: 0)
+        }
+    }
+
+    // delaying and handing off slots must not cost much more than starting everything at once
+    func testSchedulingOverheadStaysSmall() {
+        var start = CFAbsoluteTimeGetCurrent()
+        _ = runStress(perHost: 0, overall: 0)
+        let unlimited = CFAbsoluteTimeGetCurrent() - start
+        start = CFAbsoluteTimeGetCurrent()
+        _ = runStress(perHost: 4, overall: 64)
+        let limited = CFAbsoluteTimeGetCurrent() - start
+        XCTAssertLessThan(limited, unlimited * 3)
+    }
+}
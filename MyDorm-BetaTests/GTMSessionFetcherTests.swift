@@ -0,0 +1,194 @@
+//
+//  GTMSessionFetcherTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import GTMSessionFetcher
+
+// Serves stream.test requests with a body generated 1MB at a time, so the only copy of the bytes that stays
+// around is whatever the fetcher keeps
+class StreamingBodyURLProtocol: URLProtocol {
+    static let chunkSize = 1024 * 1024
+    static var length = 0
+
+    override class func canInit(with request: URLRequest) -> Bool {
+        return request.url?.host == "stream.test"
+    }
+
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+        return request
+    }
+
+    override func startLoading() {
+        let length = StreamingBodyURLProtocol.length
+        let response = HTTPURLResponse(url: request.url!, statusCode: 200, httpVersion: "HTTP/1.1", headerFields: ["Content-Length": "\(length)"])!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        var offset = 0
+        while offset < length {
+            let count = min(StreamingBodyURLProtocol.chunkSize, length - offset)
+            autoreleasepool {
+                client?.urlProtocol(self, didLoad: Data(repeating: UInt8(truncatingBitPattern: offset >> 20), count: count))
+            }
+            offset += count
+        }
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {
+    }
+}
+
+// Downloads through the fetcher's test block, which hands the body to the fetcher in three buffers like a session
+// would, and checks that the buffers come back in order whether they stay in memory or spill to a file part way
+class GTMSessionFetcherTests: XCTestCase {
+    let bodyLength = 300_001
+
+    private func bytes(_ count: Int, seed: UInt64) -> Data {
+        var generator = TraceGenerator(seed: seed)
+        var data = Data(count: count)
+        data.withUnsafeMutableBytes { (bytes: UnsafeMutablePointer<UInt8>) in
+            for index in 0..<count {
+                bytes[index] = UInt8(generator.next(256))
+            }
+        }
+        return data
+    }
+
+    // files the fetcher spills downloads to
+    private func spillFileCount() -> Int {
+        let names = (try? FileManager.default.contentsOfDirectory(atPath: NSTemporaryDirectory())) ?? []
+        return names.filter { $0.hasPrefix("GTMSessionFetcher-") }.count
+    }
+
+    // Returns the data handed to the completion handler and how many spill files existed while it ran
+    private func fetch(_ body: Data, spillThreshold: Int64) -> (data: Data?, spillFiles: Int) {
+        let fetcher = GTMSessionFetcher(request: URLRequest(url: URL(string: "https://chunked.test/body")!))
+        fetcher.downloadSpillThreshold = spillThreshold
+        fetcher.testBlock = { (fetcherToTest, testResponse) in
+            let response = HTTPURLResponse(url: fetcherToTest.request!.url!, statusCode: 200, httpVersion: "HTTP/1.1", headerFields: nil)
+            testResponse(response, body, nil)
+        }
+
+        var result: (data: Data?, spillFiles: Int) = (nil, 0)
+        let done = expectation(description: "fetched")
+        fetcher.beginFetch { (data, error) in
+            XCTAssertNil(error)
+            XCTAssertEqual(fetcher.downloadedLength, Int64(body.count))
+            result = (data, self.spillFileCount())
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 10, handler: nil)
+        return result
+    }
+
+    // bytes on both sides of every buffer boundary
+    private func assertBoundaries(_ data: Data, _ body: Data, file: StaticString = #file, line: UInt = #line) {
+        let pieceLength = body.count / 3 + 1
+        for boundary in [pieceLength, 2 * pieceLength] {
+            let range = (boundary - 16)..<(boundary + 16)
+            XCTAssertEqual(data.subdata(in: range), body.subdata(in: range), "at \(boundary)", file: file, line: line)
+        }
+    }
+
+    func testBuffersAreJoinedInOrderInMemory() {
+        let body = bytes(bodyLength, seed: 21)
+        let before = spillFileCount()
+        let (data, spillFiles) = fetch(body, spillThreshold: 0)
+        XCTAssertEqual(data, body)
+        assertBoundaries(data!, body)
+        XCTAssertEqual(spillFiles, before)
+    }
+
+    func testBodyBelowTheThresholdStaysInMemory() {
+        let body = bytes(bodyLength, seed: 22)
+        let before = spillFileCount()
+        let (data, spillFiles) = fetch(body, spillThreshold: Int64(bodyLength))
+        XCTAssertEqual(data, body)
+        XCTAssertEqual(spillFiles, before)
+    }
+
+    // the second buffer crosses the threshold, the third is written straight to the file
+    func testBuffersAfterTheSpillGoToTheFile() {
+        let body = bytes(bodyLength, seed: 23)
+        let before = spillFileCount()
+        let (data, spillFiles) = fetch(body, spillThreshold: Int64(bodyLength / 2))
+        XCTAssertEqual(data, body)
+        assertBoundaries(data!, body)
+        XCTAssertEqual(spillFiles, before + 1)
+    }
+
+    func testFirstBufferCanCrossTheThreshold() {
+        let body = bytes(bodyLength, seed: 24)
+        let before = spillFileCount()
+        let (data, spillFiles) = fetch(body, spillThreshold: 1)
+        XCTAssertEqual(data, body)
+        assertBoundaries(data!, body)
+        XCTAssertEqual(spillFiles, before + 1)
+    }
+
+    func testBodyShorterThanThreeBuffers() {
+        for length in [1, 2, 3, 4] {
+            let body = bytes(length, seed: UInt64(length))
+            XCTAssertEqual(fetch(body, spillThreshold: 0).data, body)
+            XCTAssertEqual(fetch(body, spillThreshold: 1).data, body)
+        }
+    }
+
+    func testEmptyBodyGivesNoData() {
+        let data = fetch(Data(), spillThreshold: 1).data
+        XCTAssertTrue(data?.isEmpty ?? true)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let streamedLength = 32 * 1024 * 1024
+
+    // How far the footprint grew at its highest while the streamed body came in
+    private func peakFootprintGrowth(spillThreshold: Int64) -> Int {
+        StreamingBodyURLProtocol.length = streamedLength
+        let fetcher = GTMSessionFetcher(request: URLRequest(url: URL(string: "https://stream.test/body")!))
+        fetcher.downloadSpillThreshold = spillThreshold
+        fetcher.minimumReceivedProgressInterval = 0
+        fetcher.configurationBlock = { (_, configuration) in
+            configuration.protocolClasses = [StreamingBodyURLProtocol.self]
+        }
+
+        let baseline = physicalFootprint()
+        var peak = baseline
+        fetcher.receivedProgressBlock = { (_, _) in
+            peak = max(peak, physicalFootprint())
+        }
+        let done = expectation(description: "streamed")
+        fetcher.beginFetch { (data, error) in
+            XCTAssertNil(error)
+            XCTAssertEqual(data?.count, self.streamedLength)
+            peak = max(peak, physicalFootprint())
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 60, handler: nil)
+        return peak - baseline
+    }
+
+    func testPeakMemoryDownloadingInMemory() {
+        measure {
+            _ = self.peakFootprintGrowth(spillThreshold: 0)
+        }
+    }
+
+    func testPeakMemoryDownloadingWithSpill() {
+        measure {
+            _ = self.peakFootprintGrowth(spillThreshold: 1024 * 1024)
+        }
+    }
+
+    // past the threshold the download must stop growing the footprint
+    func testSpillKeepsThePeakFootprintDown() {
+        let inMemory = peakFootprintGrowth(spillThreshold: 0)
+        let spilled = peakFootprintGrowth(spillThreshold: 1024 * 1024)
+        XCTAssertGreaterThan(inMemory, streamedLength / 2)
+        XCTAssertLessThan(spilled, inMemory / 4)
+    }
+}
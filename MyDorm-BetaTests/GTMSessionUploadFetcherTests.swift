@@ -0,0 +1,428 @@
+//
+//  GTMSessionUploadFetcherTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import GTMSessionFetcher
+
+// An in-process X-Goog-Upload server for upload.test. It keeps the bytes of one upload session, answers the start,
+// upload, finalize and query commands, and fails the chunk requests a test picks after keeping part of their body.
+class ResumableUploadURLProtocol: URLProtocol {
+    struct Chunk {
+        let offset: Int64
+        let length: Int
+        let command: String
+        let contentMD5: String?
+    }
+
+    static let sessionURL = URL(string: "https://upload.test/session")!
+    private static let lock = NSLock()
+    private static var latency: TimeInterval = 0
+    // chunk request number, counting from 0, to the bytes of its body kept before answering 503
+    private static var failures = [Int: Int]()
+    private static var expectedLength: Int64 = 0
+    private static var receivedData = Data()
+    private static var chunkRequests = [Chunk]()
+    private static var queries = 0
+
+    static func reset(latency: TimeInterval = 0, failures: [Int: Int] = [:]) {
+        lock.lock()
+        self.latency = latency
+        self.failures = failures
+        expectedLength = 0
+        receivedData = Data()
+        chunkRequests = []
+        queries = 0
+        lock.unlock()
+    }
+
+    static var received: Data {
+        lock.lock()
+        defer {
+            lock.unlock()
+        }
+        return receivedData
+    }
+
+    static var chunks: [Chunk] {
+        lock.lock()
+        defer {
+            lock.unlock()
+        }
+        return chunkRequests
+    }
+
+    static var queryCount: Int {
+        lock.lock()
+        defer {
+            lock.unlock()
+        }
+        return queries
+    }
+
+    override class func canInit(with request: URLRequest) -> Bool {
+        return request.url?.host == "upload.test"
+    }
+
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+        return request
+    }
+
+    override func startLoading() {
+        let body = ResumableUploadURLProtocol.body(of: request)
+        let (status, headers, data, latency) = ResumableUploadURLProtocol.answer(request, body: body)
+        if latency > 0 {
+            Thread.sleep(forTimeInterval: latency)
+        }
+        let response = HTTPURLResponse(url: request.url!, statusCode: status, httpVersion: "HTTP/1.1", headerFields: headers)!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        if !data.isEmpty {
+            client?.urlProtocol(self, didLoad: data)
+        }
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {
+    }
+
+    // upload tasks hand the protocol their body as a stream
+    private static func body(of request: URLRequest) -> Data {
+        if let body = request.httpBody {
+            return body
+        }
+        guard let stream = request.httpBodyStream else {
+            return Data()
+        }
+        var body = Data()
+        var buffer = [UInt8](repeating: 0, count: 64 * 1024)
+        stream.open()
+        while true {
+            let count = stream.read(&buffer, maxLength: buffer.count)
+            if count <= 0 {
+                break
+            }
+            body.append(buffer, count: count)
+        }
+        stream.close()
+        return body
+    }
+
+    private static func answer(_ request: URLRequest, body: Data) -> (Int, [String: String], Data, TimeInterval) {
+        lock.lock()
+        defer {
+            lock.unlock()
+        }
+        let command = request.value(forHTTPHeaderField: "X-Goog-Upload-Command") ?? ""
+        if command == "start" {
+            expectedLength = Int64(request.value(forHTTPHeaderField: "X-Goog-Upload-Content-Length") ?? "") ?? 0
+            return (200, ["X-Goog-Upload-Status": "active", "X-Goog-Upload-URL": sessionURL.absoluteString], Data(), latency)
+        }
+        if command == "query" {
+            queries += 1
+            let status = Int64(receivedData.count) == expectedLength ? "final" : "active"
+            return (200, ["X-Goog-Upload-Status": status, "X-Goog-Upload-Size-Received": "\(receivedData.count)"], Data(), latency)
+        }
+
+        let offset = Int64(request.value(forHTTPHeaderField: "X-Goog-Upload-Offset") ?? "") ?? -1
+        let chunkNumber = chunkRequests.count
+        chunkRequests.append(Chunk(offset: offset, length: body.count, command: command, contentMD5: request.value(forHTTPHeaderField: "Content-MD5")))
+        // the server only takes the chunk that starts where its bytes end
+        guard offset == Int64(receivedData.count) else {
+            return (400, ["X-Goog-Upload-Status": "active"], Data(), latency)
+        }
+        if let kept = failures[chunkNumber] {
+            receivedData.append(body.subdata(in: 0..<min(kept, body.count)))
+            return (503, ["X-Goog-Upload-Status": "active"], Data(), latency)
+        }
+        receivedData.append(body)
+        if command.contains("finalize") && Int64(receivedData.count) == expectedLength {
+            return (200, ["X-Goog-Upload-Status": "final"], "{}".data(using: .utf8)!, latency)
+        }
+        return (200, ["X-Goog-Upload-Status": "active"], Data(), latency)
+    }
+}
+
+class GTMSessionUploadFetcherTests: XCTestCase {
+    let chunkSize: Int64 = 256 * 1024
+
+    override func setUp() {
+        super.setUp()
+        ResumableUploadURLProtocol.reset()
+    }
+
+    private func bytes(_ count: Int, seed: UInt64) -> Data {
+        var generator = TraceGenerator(seed: seed)
+        var data = Data(count: count)
+        data.withUnsafeMutableBytes { (bytes: UnsafeMutablePointer<UInt8>) in
+            for index in 0..<count {
+                bytes[index] = UInt8(generator.next(256))
+            }
+        }
+        return data
+    }
+
+    private func temporaryFile(with data: Data) -> URL {
+        let url = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent(UUID().uuidString)
+        try! data.write(to: url)
+        return url
+    }
+
+    private func upload(chunkSize: Int64? = nil, configure: (GTMSessionUploadFetcher) -> ()) -> Error? {
+        let request = URLRequest(url: URL(string: "https://upload.test/start")!)
+        let fetcher = GTMSessionUploadFetcher(request: request, uploadMIMEType: "application/octet-stream", chunkSize: chunkSize ?? self.chunkSize, fetcherService: nil)
+        fetcher.isRetryEnabled = true
+        fetcher.configurationBlock = { (_, configuration) in
+            configuration.protocolClasses = [ResumableUploadURLProtocol.self]
+        }
+        configure(fetcher)
+
+        var uploadError: Error?
+        let done = expectation(description: "upload finished")
+        fetcher.beginFetch { (_, error) in
+            uploadError = error
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 60, handler: nil)
+        return uploadError
+    }
+
+    // each chunk starts where the one before ended, and only the last one finalizes
+    private func assertContiguous(_ chunks: [ResumableUploadURLProtocol.Chunk], endingAt length: Int, file: StaticString = #file, line: UInt = #line) {
+        var offset: Int64 = 0
+        for (index, chunk) in chunks.enumerated() {
+            XCTAssertEqual(chunk.offset, offset, file: file, line: line)
+            XCTAssertEqual(chunk.command, index == chunks.count - 1 ? "upload, finalize" : "upload", file: file, line: line)
+            offset += Int64(chunk.length)
+        }
+        XCTAssertEqual(offset, Int64(length), file: file, line: line)
+    }
+
+    func testUploadsEveryByteInOrderedChunks() {
+        let data = bytes(1024 * 1024 + 1000, seed: 25)
+        let error = upload { $0.uploadData = data }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        XCTAssertEqual(ResumableUploadURLProtocol.chunks.count, 4)
+        assertContiguous(ResumableUploadURLProtocol.chunks, endingAt: data.count)
+        XCTAssertEqual(ResumableUploadURLProtocol.queryCount, 0)
+    }
+
+    // the second chunk fails after the server kept part of it, and the fourth fails outright, so the chunks read ahead
+    // for the old offsets are thrown away and the upload goes on from wherever the query says the server is
+    func testResumesAtTheServerOffsetAfterInjectedFailures() {
+        ResumableUploadURLProtocol.reset(failures: [1: 100_000, 3: 0])
+        let data = bytes(1024 * 1024, seed: 503)
+        let fileURL = temporaryFile(with: data)
+        defer {
+            try? FileManager.default.removeItem(at: fileURL)
+        }
+        let error = upload { $0.uploadFileURL = fileURL }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        XCTAssertEqual(ResumableUploadURLProtocol.queryCount, 2)
+        let offsets = ResumableUploadURLProtocol.chunks.map { $0.offset }
+        XCTAssertTrue(offsets.contains(chunkSize + 100_000), "\(offsets)")
+        XCTAssertEqual(ResumableUploadURLProtocol.chunks.filter { $0.offset == chunkSize }.count, 1)
+    }
+
+    func testFileHandleReadsLeaveTheHandlePositionAlone() {
+        ResumableUploadURLProtocol.reset(failures: [2: 5000])
+        let data = bytes(900 * 1024, seed: 7)
+        let fileURL = temporaryFile(with: data)
+        defer {
+            try? FileManager.default.removeItem(at: fileURL)
+        }
+        let handle = try! FileHandle(forReadingFrom: fileURL)
+        handle.seek(toFileOffset: 7)
+        let error = upload { $0.uploadFileHandle = handle }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        XCTAssertEqual(handle.offsetInFile, 7)
+        handle.closeFile()
+    }
+
+    func testDataProviderCallsNeverOverlap() {
+        ResumableUploadURLProtocol.reset(failures: [1: 1000])
+        let data = bytes(1024 * 1024, seed: 11)
+        let lock = NSLock()
+        var callsInFlight = 0
+        var mostCallsInFlight = 0
+        var offsets = [Int64]()
+        let error = upload { (fetcher) in
+            fetcher.setUploadDataLength(Int64(data.count)) { (offset, length, response) in
+                lock.lock()
+                callsInFlight += 1
+                mostCallsInFlight = max(mostCallsInFlight, callsInFlight)
+                offsets.append(offset)
+                lock.unlock()
+                // answer later, from another queue, as a provider reading from disk or the network would
+                DispatchQueue.global().asyncAfter(deadline: .now() + 0.02) {
+                    lock.lock()
+                    callsInFlight -= 1
+                    lock.unlock()
+                    response(data.subdata(in: Int(offset)..<Int(offset + length)), nil)
+                }
+            }
+        }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        lock.lock()
+        XCTAssertEqual(mostCallsInFlight, 1)
+        XCTAssertGreaterThanOrEqual(offsets.count, 4)
+        lock.unlock()
+    }
+
+    func testChunkChecksumsMatchTheChunkBytes() {
+        XCTAssertEqual(GTMSessionUploadFetcherTests.md5Base64(Data()), "1B2M2Y8AsgTpgAmY7PhCfg==")
+        XCTAssertEqual(GTMSessionUploadFetcherTests.md5Base64("abc".data(using: .utf8)!), "kAFQmDzST7DWlj99KOF/cg==")
+
+        let data = bytes(600 * 1024, seed: 5)
+        var error = upload { $0.uploadData = data }
+        XCTAssertNil(error)
+        XCTAssertFalse(ResumableUploadURLProtocol.chunks.contains { $0.contentMD5 != nil })
+
+        ResumableUploadURLProtocol.reset(failures: [1: 12345])
+        error = upload { (fetcher) in
+            fetcher.uploadData = data
+            fetcher.sendsChunkChecksums = true
+        }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        for chunk in ResumableUploadURLProtocol.chunks {
+            let chunkData = data.subdata(in: Int(chunk.offset)..<(Int(chunk.offset) + chunk.length))
+            XCTAssertEqual(chunk.contentMD5, GTMSessionUploadFetcherTests.md5Base64(chunkData), "chunk at \(chunk.offset)")
+        }
+    }
+
+    // each chunk's throughput sizes the chunk right after it, not the one after that; the stub answers so fast
+    // that every step hits the factor of two limit
+    func testAdaptiveSizeAppliesToTheVeryNextChunk() {
+        let data = bytes(4 * 1024 * 1024, seed: 2)
+        let error = upload(chunkSize: 8 * 1024 * 1024) { (fetcher) in
+            fetcher.uploadData = data
+            fetcher.targetChunkDuration = 10
+        }
+        XCTAssertNil(error)
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        XCTAssertEqual(ResumableUploadURLProtocol.chunks.map { $0.length }, [256 * 1024, 512 * 1024, 1024 * 1024, 2048 * 1024, 256 * 1024])
+    }
+
+    // RFC 1321, since Swift 3 cannot import CommonCrypto without a module map
+    static func md5Base64(_ data: Data) -> String {
+        let shifts: [UInt32] = [7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+                                5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+                                4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+                                6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21]
+        let constants = (0..<64).map { UInt32(abs(sin(Double($0 + 1))) * 4294967296) }
+
+        var message = [UInt8](data)
+        let bitLength = UInt64(message.count) * 8
+        message.append(0x80)
+        while message.count % 64 != 56 {
+            message.append(0)
+        }
+        for index in 0..<8 {
+            message.append(UInt8(truncatingBitPattern: bitLength >> UInt64(8 * index)))
+        }
+
+        var state: [UInt32] = [0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476]
+        var words = [UInt32](repeating: 0, count: 16)
+        for block in stride(from: 0, to: message.count, by: 64) {
+            for index in 0..<16 {
+                let byte = block + index * 4
+                words[index] = UInt32(message[byte]) | UInt32(message[byte + 1]) << 8 | UInt32(message[byte + 2]) << 16 | UInt32(message[byte + 3]) << 24
+            }
+            var a = state[0], b = state[1], c = state[2], d = state[3]
+            for round in 0..<64 {
+                var f: UInt32
+                let word: Int
+                switch round {
+                case 0..<16:
+                    f = (b & c) | (~b & d)
+                    word = round
+                case 16..<32:
+                    f = (d & b) | (~d & c)
+                    word = (5 * round + 1) % 16
+                case 32..<48:
+                    f = b ^ c ^ d
+                    word = (3 * round + 5) % 16
+                default:
+                    f = c ^ (b | ~d)
+                    word = (7 * round) % 16
+                }
+                f = f &+ a &+ constants[round] &+ words[word]
+                a = d
+                d = c
+                c = b
+                b = b &+ (f << shifts[round] | f >> (32 - shifts[round]))
+            }
+            state[0] = state[0] &+ a
+            state[1] = state[1] &+ b
+            state[2] = state[2] &+ c
+            state[3] = state[3] &+ d
+        }
+
+        var digest = [UInt8]()
+        for value in state {
+            for index in 0..<4 {
+                digest.append(UInt8(truncatingBitPattern: value >> UInt32(8 * index)))
+            }
+        }
+        return Data(bytes: digest).base64EncodedString()
+    }
+
+/*************************************************/
+/*                   Benchmark                   */
+/*************************************************/
+    // Every request to the stub takes 50 ms and every chunk read takes 30 ms
+    let simulatedLatency = 0.05
+    let simulatedReadCost = 0.03
+
+    // Uploads 2 MB in fixed 256K chunks, or adaptively sized ones. Returns the time taken and the chunk requests sent.
+    private func uploadWithSimulatedLatency(adaptive: Bool) -> (time: CFAbsoluteTime, chunks: Int) {
+        let data = bytes(2 * 1024 * 1024, seed: 50)
+        let readCost = simulatedReadCost
+        let provide = { (offset: Int64, length: Int64, response: @escaping GTMSessionUploadFetcherDataProviderResponse) in
+            Thread.sleep(forTimeInterval: readCost)
+            response(data.subdata(in: Int(offset)..<Int(offset + length)), nil)
+        }
+
+        ResumableUploadURLProtocol.reset(latency: simulatedLatency)
+        let start = CFAbsoluteTimeGetCurrent()
+        XCTAssertNil(upload(chunkSize: adaptive ? Int64(data.count) : nil) { (fetcher) in
+            fetcher.setUploadDataLength(Int64(data.count), provider: provide)
+            if adaptive {
+                fetcher.targetChunkDuration = 0.2
+            }
+        })
+        let time = CFAbsoluteTimeGetCurrent() - start
+        XCTAssertEqual(ResumableUploadURLProtocol.received, data)
+        return (time, ResumableUploadURLProtocol.chunks.count)
+    }
+
+    func testUploadTimeInFixedChunks() {
+        measure {
+            _ = self.uploadWithSimulatedLatency(adaptive: false)
+        }
+    }
+
+    func testUploadTimeInAdaptiveChunks() {
+        measure {
+            _ = self.uploadWithSimulatedLatency(adaptive: true)
+        }
+    }
+
+    // Reading ahead has to hide the read cost behind the requests, and adaptive sizing trades requests for
+    // larger chunks
+    func testReadAheadAndAdaptiveSizingSaveTime() {
+        let (fixedTime, fixedChunks) = uploadWithSimulatedLatency(adaptive: false)
+        // the start request, then a read and a request per chunk
+        let serialTime = simulatedLatency + Double(fixedChunks) * (simulatedLatency + simulatedReadCost)
+        XCTAssertLessThan(fixedTime, serialTime)
+
+        let (adaptiveTime, adaptiveChunks) = uploadWithSimulatedLatency(adaptive: true)
+        XCTAssertLessThan(adaptiveChunks, fixedChunks)
+        XCTAssertLessThan(adaptiveTime, fixedTime)
+    }
+}
@@ -0,0 +1,242 @@
+//
+//  GeocodingServiceTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import CoreLocation
+@testable import MyDorm_Beta
+
+// Holds each lookup until the test answers it, and records what was asked and cancelled
+class FakeRemoteGeocoder: RemoteGeocoder {
+    private(set) var lookups = [(address: String, region: CLRegion?)]()
+    private(set) var cancelCount = 0
+    private var pending: (([GeocodedPlace]?) -> ())?
+
+    func geocode(_ address: String, in region: CLRegion?, complete: @escaping ([GeocodedPlace]?) -> ()) {
+        lookups.append((address, region))
+        pending = complete
+    }
+
+    func cancel() {
+        cancelCount += 1
+    }
+
+    var isWaiting: Bool {
+        return pending != nil
+    }
+
+    func answer(_ places: [GeocodedPlace]?) {
+        let complete = pending
+        pending = nil
+        complete?(places)
+    }
+}
+
+// Stands in for the main queue timer behind the debounce. Time only moves when the test advances it, in
+// milliseconds so keystroke gaps compare exactly with the debounce interval.
+class FakeDebounceClock {
+    private(set) var now = 0
+    private var scheduled = [(time: Int, lookup: DispatchWorkItem)]()
+
+    func schedule(after delay: TimeInterval, _ lookup: DispatchWorkItem) {
+        scheduled.append((now + Int((delay * 1000).rounded()), lookup))
+    }
+
+    // runs every lookup due by then that was not cancelled, earliest first
+    func advance(to time: Int) {
+        now = max(now, time)
+        while let next = scheduled.indices.filter({ scheduled[$0].time <= now }).min(by: { scheduled[$0].time < scheduled[$1].time }) {
+            let lookup = scheduled.remove(at: next).lookup
+            if !lookup.isCancelled {
+                lookup.perform()
+            }
+        }
+    }
+}
+
+class GeocodingServiceTests: XCTestCase {
+    var remote: FakeRemoteGeocoder!
+    var service: GeocodingService!
+    let place = GeocodedPlace(address: "1 Main St, Princeton, NJ 08544", coordinate: nil)
+
+    override func setUp() {
+        super.setUp()
+        remote = FakeRemoteGeocoder()
+        service = GeocodingService(remote: remote, gazetteer: Gazetteer(places: []), cache: GeocodeCache(fileURL: nil))
+        service.debounceInterval = 0.01
+    }
+
+    private func region(_ latitude: Double, _ longitude: Double) -> CLCircularRegion {
+        return CLCircularRegion(center: CLLocationCoordinate2D(latitude: latitude, longitude: longitude), radius: 5000, identifier: "near")
+    }
+
+    func testTypingCoalescesIntoOneLookup() {
+        var answers = [[GeocodedPlace]]()
+        for text in ["1 Ma", "1 Mai", "1 Main"] {
+            service.search(text, in: nil) { answers.append($0) }
+        }
+        drainMainQueue()
+        XCTAssertEqual(remote.lookups.map { $0.address }, ["1 Main"])
+        XCTAssertEqual(service.coalescedCount, 2)
+        XCTAssertEqual(service.remoteCallsAvoided, 2)
+
+        remote.answer([place])
+        XCTAssertEqual(answers.last?.map { $0.address } ?? [], [place.address])
+    }
+
+    func testNewSearchCancelsTheRunningLookup() {
+        service.search("1 Main", in: nil) { _ in }
+        drainMainQueue()
+        let cancelsBefore = remote.cancelCount
+        var answers = [[GeocodedPlace]]()
+        service.search("2 Main", in: nil) { answers.append($0) }
+        XCTAssertEqual(remote.cancelCount, cancelsBefore + 1)
+        // a late answer for the old text is cached but not delivered
+        remote.answer([place])
+        XCTAssertEqual(answers.count, 1)
+        XCTAssertTrue(answers[0].isEmpty)
+    }
+
+    func testCacheHitsAreCountedAndSkipTheRemote() {
+        service.search("1 Main", in: nil) { _ in }
+        drainMainQueue()
+        remote.answer([place])
+        var answer = [GeocodedPlace]()
+        service.search("  1 MAIN ", in: nil) { answer = $0 }
+        XCTAssertEqual(answer.map { $0.address }, [place.address])
+        XCTAssertEqual(remote.lookups.count, 1)
+        XCTAssertEqual(service.cacheHitCount, 1)
+        XCTAssertEqual(service.remoteCallsAvoided, 1)
+    }
+
+    func testRegionIsPartOfTheCacheKey() {
+        service.search("1 Main", in: region(40.34, -74.66)) { _ in }
+        drainMainQueue()
+        remote.answer([place])
+        service.search("1 Main", in: region(41.31, -72.92)) { _ in }
+        drainMainQueue()
+        XCTAssertEqual(remote.lookups.count, 2)
+        XCTAssertEqual(service.cacheHitCount, 0)
+        service.search("1 Main", in: region(40.34, -74.66)) { _ in }
+        XCTAssertEqual(service.cacheHitCount, 1)
+    }
+
+    func testShortAndFailedSearchesAreNotCountedAsAvoided() {
+        service.search("Ma", in: nil) { _ in }
+        drainMainQueue()
+        XCTAssertTrue(remote.lookups.isEmpty)
+        service.search("1 Main", in: nil) { _ in }
+        drainMainQueue()
+        remote.answer(nil)
+        service.search("1 Main", in: nil) { _ in }
+        drainMainQueue()
+        // the failure was not cached, so the second search went out again
+        XCTAssertEqual(remote.lookups.count, 2)
+        XCTAssertEqual(service.searchCount, 3)
+        XCTAssertEqual(service.remoteCallsAvoided, 0)
+    }
+
+/*************************************************/
+/*               Keystroke Sessions              */
+/*************************************************/
+    // a keystroke: milliseconds since the one before, and the text in the field after it
+    typealias Keystroke = (gap: Int, text: String)
+
+    // every prefix of the text, one keystroke each
+    private func typing(_ text: String, every gap: Int, after pause: Int) -> [Keystroke] {
+        return (1...text.characters.count).map { length in
+            (length == 1 ? pause : gap, String(text.characters.prefix(length)))
+        }
+    }
+
+    // Types the session against the fake clock. The remote answers as soon as a lookup reaches it.
+    private func replay(_ session: [Keystroke], clock: FakeDebounceClock) {
+        service.scheduleLookup = { (delay, lookup) in
+            clock.schedule(after: delay, lookup)
+        }
+        for keystroke in session {
+            clock.advance(to: clock.now + keystroke.gap)
+            answerWaitingLookup()
+            service.search(keystroke.text, in: nil) { _ in }
+        }
+        clock.advance(to: clock.now + 60_000)
+        answerWaitingLookup()
+    }
+
+    private func answerWaitingLookup() {
+        if remote.isWaiting, let address = remote.lookups.last?.address {
+            remote.answer([GeocodedPlace(address: address, coordinate: nil)])
+        }
+    }
+
+    // Every keystroke long enough to reach the remote would have made a call without the debounce and cache
+    private func eligibleCount(_ session: [Keystroke]) -> Int {
+        return session.filter { GeocodingService.normalize($0.text).characters.count >= service.minimumRemoteQueryLength }.count
+    }
+
+    func testScriptedSessionOnlyLooksUpWhereTypingPauses() {
+        service.debounceInterval = 0.35
+        let clock = FakeDebounceClock()
+        // types an address, pauses, deletes back to the street and types it again, then types it once more later
+        var session = typing("1 Main St", every: 120, after: 0)
+        session += [(1000, "1 Main S"), (90, "1 Main "), (90, "1 Main S"), (90, "1 Main St")]
+        session += typing("1 Main St", every: 150, after: 5000)
+        replay(session, clock: clock)
+
+        XCTAssertEqual(remote.lookups.map { $0.address }, ["1 Main St"])
+        XCTAssertEqual(service.remoteCallCount, 1)
+        XCTAssertEqual(service.remoteCallsAvoided, eligibleCount(session) - 1)
+        // the second time the address is typed out it comes from the cache
+        XCTAssertGreaterThan(service.cacheHitCount, 0)
+    }
+
+    func testPausesLongerThanTheDebounceEachLookUp() {
+        service.debounceInterval = 0.35
+        let clock = FakeDebounceClock()
+        // hunts and pecks, pausing past the debounce after every word
+        let session: [Keystroke] = [(0, "12 O"), (400, "12 Oa"), (100, "12 Oak"), (500, "12 Oak A"), (80, "12 Oak Av"), (80, "12 Oak Ave")]
+        replay(session, clock: clock)
+        XCTAssertEqual(remote.lookups.map { $0.address }, ["12 O", "12 Oak", "12 Oak Ave"])
+        XCTAssertEqual(service.coalescedCount, 3)
+        XCTAssertEqual(service.remoteCallsAvoided, 3)
+    }
+
+    // Generated sessions against a model: a keystroke reaches the remote when the next one comes at least a
+    // debounce interval later and its text was not looked up before. Every other eligible keystroke is avoided.
+    func testGeneratedSessionsAvoidEveryCallTheModelAvoids() {
+        let addresses = ["1 Main St", "12 Oak Ave", "400 College St", "55 Whitney Ave", "9 Elm St"]
+        var generator = TraceGenerator(seed: 19)
+        for round in 0..<50 {
+            remote = FakeRemoteGeocoder()
+            service = GeocodingService(remote: remote, gazetteer: Gazetteer(places: []), cache: GeocodeCache(fileURL: nil))
+            service.debounceInterval = 0.35
+            let clock = FakeDebounceClock()
+            var session = [Keystroke]()
+            for _ in 0..<(1 + generator.next(5)) {
+                let address = addresses[generator.next(addresses.count)]
+                for keystroke in typing(address, every: 0, after: 0) {
+                    // mostly quick typing, now and then a pause past the debounce
+                    let gap = generator.next(4) == 0 ? 350 + generator.next(1000) : 40 + generator.next(300)
+                    session.append((gap, keystroke.text))
+                }
+            }
+            replay(session, clock: clock)
+
+            var looked = Set<String>()
+            var expectedLookups = [String]()
+            for (index, keystroke) in session.enumerated() {
+                let key = GeocodingService.normalize(keystroke.text)
+                guard key.characters.count >= service.minimumRemoteQueryLength, !looked.contains(key) else {
+                    continue
+                }
+                if index == session.count - 1 || session[index + 1].gap >= 350 {
+                    looked.insert(key)
+                    expectedLookups.append(keystroke.text)
+                }
+            }
+            XCTAssertEqual(remote.lookups.map { $0.address }, expectedLookups, "round \(round)")
+            XCTAssertEqual(service.remoteCallsAvoided, eligibleCount(session) - expectedLookups.count, "round \(round)")
+        }
+    }
+}
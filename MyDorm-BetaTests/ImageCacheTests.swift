@@ -0,0 +1,185 @@
+//
+//  ImageCacheTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+@testable import MyDorm_Beta
+
+// Serves generated PNGs after a short delay and counts every request it gets
+class FakeImageBackend: ImageStorageBackend {
+    private let lock = NSLock()
+    private var _fetchCount = [String: Int]()
+    private var _metadataCount = 0
+    var updatedDate: Date?
+    var failingPaths = Set<String>()
+
+    func fetchCount(_ path: String) -> Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return _fetchCount[path] ?? 0
+    }
+
+    var metadataCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return _metadataCount
+    }
+
+    static func pngData(side: Int) -> Data {
+        UIGraphicsBeginImageContextWithOptions(CGSize(width: side, height: side), true, 1)
+        let image = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+        return UIImagePNGRepresentation(image)!
+    }
+
+    func fetchData(path: String, maxSize: Int64, completion: @escaping (Data?, Error?) -> ()) {
+        lock.lock()
+        _fetchCount[path] = (_fetchCount[path] ?? 0) + 1
+        let fails = failingPaths.contains(path)
+        lock.unlock()
+        DispatchQueue.global().asyncAfter(deadline: .now() + 0.05) {
+            if fails {
+                completion(nil, NSError(domain: "FakeImageBackend", code: 404, userInfo: nil))
+            } else {
+                completion(FakeImageBackend.pngData(side: 8), nil)
+            }
+        }
+    }
+
+    func fetchUpdatedDate(path: String, completion: @escaping (Date?, Error?) -> ()) {
+        lock.lock()
+        _metadataCount += 1
+        let updated = updatedDate
+        lock.unlock()
+        DispatchQueue.global().async {
+            completion(updated, nil)
+        }
+    }
+}
+
+class ImageCacheTests: XCTestCase {
+    var directory: URL!
+    var backend: FakeImageBackend!
+
+    override func setUp() {
+        super.setUp()
+        directory = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent(UUID().uuidString, isDirectory: true)
+        backend = FakeImageBackend()
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(at: directory)
+        super.tearDown()
+    }
+
+    private func load(_ cache: ImageCache, _ path: String) -> (UIImage?, Error?) {
+        var result: (UIImage?, Error?) = (nil, nil)
+        let loaded = expectation(description: "loaded \(path)")
+        cache.image(path: path) { (image, error) in
+            result = (image, error)
+            loaded.fulfill()
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        return result
+    }
+
+    func testConcurrentCallersShareOneDownload() {
+        let cache = ImageCache(backend: backend, diskDirectory: directory)
+        let callbackQueue = DispatchQueue(label: "ImageCacheTests.callbacks")
+        let callbackKey = DispatchSpecificKey<Bool>()
+        callbackQueue.setSpecific(key: callbackKey, value: true)
+
+        let callers = 50
+        let lock = NSLock()
+        var deliveries = 0
+        let allDelivered = expectation(description: "every caller answered")
+        DispatchQueue.concurrentPerform(iterations: callers) { _ in
+            cache.image(path: "desk.jpg", queue: callbackQueue) { (image, error) in
+                XCTAssertNotNil(image)
+                XCTAssertNil(error)
+                XCTAssertEqual(DispatchQueue.getSpecific(key: callbackKey), true)
+                lock.lock()
+                deliveries += 1
+                let done = deliveries == callers
+                lock.unlock()
+                if done {
+                    allDelivered.fulfill()
+                }
+            }
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        XCTAssertEqual(backend.fetchCount("desk.jpg"), 1)
+
+        // a late delivery would show up as an extra count
+        let settled = expectation(description: "settled")
+        DispatchQueue.main.asyncAfter(deadline: .now() + 0.2) {
+            settled.fulfill()
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        XCTAssertEqual(deliveries, callers)
+    }
+
+    func testMemoryHitDoesNotFetchAgain() {
+        let cache = ImageCache(backend: backend, diskDirectory: nil)
+        XCTAssertNotNil(load(cache, "chair.jpg").0)
+        XCTAssertNotNil(load(cache, "chair.jpg").0)
+        XCTAssertEqual(backend.fetchCount("chair.jpg"), 1)
+    }
+
+    func testDiskHitSurvivesANewCache() {
+        XCTAssertNotNil(load(ImageCache(backend: backend, diskDirectory: directory), "lamp.jpg").0)
+        // the disk write is queued behind the download, give it time to land
+        Thread.sleep(forTimeInterval: 0.2)
+        XCTAssertNotNil(load(ImageCache(backend: backend, diskDirectory: directory), "lamp.jpg").0)
+        XCTAssertEqual(backend.fetchCount("lamp.jpg"), 1)
+        XCTAssertEqual(backend.metadataCount, 0)
+    }
+
+    func testFailureIsReportedWithTheBackendError() {
+        backend.failingPaths = ["missing.jpg"]
+        let cache = ImageCache(backend: backend, diskDirectory: directory)
+        let (image, error) = load(cache, "missing.jpg")
+        XCTAssertNil(image)
+        XCTAssertEqual((error as NSError?)?.code, 404)
+    }
+
+    func testDiskTierIsTrimmedToItsByteLimit() {
+        let fileSize = FakeImageBackend.pngData(side: 8).count
+        let limit = fileSize * 4
+        let cache = ImageCache(backend: backend, memoryCostLimit: 0, diskDirectory: directory, diskByteLimit: limit)
+        for index in 0..<10 {
+            XCTAssertNotNil(load(cache, "item\(index).jpg").0)
+        }
+        Thread.sleep(forTimeInterval: 0.2)
+        let files = try! FileManager.default.contentsOfDirectory(at: directory, includingPropertiesForKeys: [.fileSizeKey], options: [])
+        var total = 0
+        for file in files {
+            total += (try? file.resourceValues(forKeys: [.fileSizeKey]))?.fileSize ?? 0
+        }
+        XCTAssertLessThanOrEqual(total, limit)
+        // the most recent download is the last one to go
+        XCTAssertTrue(files.contains { $0.lastPathComponent == "item9.jpg" })
+    }
+
+    func testStaleDiskCopyIsRefetchedWhenTheBackendChanged() {
+        XCTAssertNotNil(load(ImageCache(backend: backend, diskDirectory: directory), "bed.jpg").0)
+        Thread.sleep(forTimeInterval: 0.2)
+        backend.updatedDate = Date().addingTimeInterval(60)
+        let cache = ImageCache(backend: backend, diskDirectory: directory, revalidationInterval: 0)
+        XCTAssertNotNil(load(cache, "bed.jpg").0)
+        XCTAssertEqual(backend.metadataCount, 1)
+        XCTAssertEqual(backend.fetchCount("bed.jpg"), 2)
+    }
+
+    func testStaleDiskCopyIsKeptWhenTheBackendDidNotChange() {
+        XCTAssertNotNil(load(ImageCache(backend: backend, diskDirectory: directory), "sofa.jpg").0)
+        Thread.sleep(forTimeInterval: 0.2)
+        backend.updatedDate = Date().addingTimeInterval(-3600)
+        let cache = ImageCache(backend: backend, diskDirectory: directory, revalidationInterval: 0)
+        XCTAssertNotNil(load(cache, "sofa.jpg").0)
+        XCTAssertEqual(backend.metadataCount, 1)
+        XCTAssertEqual(backend.fetchCount("sofa.jpg"), 1)
+    }
+}
@@ -0,0 +1,240 @@
+//
+//  ListingIndexTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import CoreLocation
+@testable import MyDorm_Beta
+
+// Checks every index answer against a plain filter over all listings, through inserts, updates and deletes
+class ListingIndexTests: XCTestCase {
+    let storageTypes: [StorageType] = [.InHouse, .Basement, .OffLocation]
+    let rentTypes: [RentType] = [.Summer, .Monthly, .Daily]
+    let uids = ["u0", "u1", "u2", "u3"]
+    // New Haven
+    let center = CLLocationCoordinate2D(latitude: 41.31, longitude: -72.92)
+
+    private func randomListing(id: String, _ generator: inout TraceGenerator) -> Listing {
+        var listing = Listing()
+        listing.listingID = id
+        listing.uid = uids[generator.next(uids.count)]
+        listing.storageType = storageTypes[generator.next(storageTypes.count)]
+        listing.rentType = rentTypes[generator.next(rentTypes.count)]
+        // some listings leave the numeric fields and the coordinate out
+        if generator.next(5) != 0 {
+            listing.rent = Decimal(generator.next(200))
+        }
+        if generator.next(5) != 0 {
+            listing.cubicFeet = Double(generator.next(500))
+        }
+        if generator.next(5) != 0 {
+            listing.coordinate = CLLocationCoordinate2D(latitude: center.latitude + Double(generator.next(200) - 100) / 100, longitude: center.longitude + Double(generator.next(200) - 100) / 100)
+        }
+        return listing
+    }
+
+    private func randomQuery(_ generator: inout TraceGenerator) -> ListingQuery {
+        var query = ListingQuery()
+        if generator.next(3) == 0 {
+            query.uid = uids[generator.next(uids.count)]
+        }
+        if generator.next(3) == 0 {
+            query.storageType = storageTypes[generator.next(storageTypes.count)]
+        }
+        if generator.next(3) == 0 {
+            query.rentType = rentTypes[generator.next(rentTypes.count)]
+        }
+        if generator.next(3) == 0 {
+            let low = Double(generator.next(200))
+            query.rent = low...(low + Double(generator.next(100)))
+        }
+        if generator.next(3) == 0 {
+            let low = Double(generator.next(500))
+            query.cubicFeet = low...(low + Double(generator.next(200)))
+        }
+        if generator.next(3) == 0 {
+            query.center = center
+            query.radiusInMiles = Double(generator.next(80))
+        }
+        return query
+    }
+
+    private func matches(_ listing: Listing, _ query: ListingQuery) -> Bool {
+        if let uid = query.uid, listing.uid != uid {
+            return false
+        }
+        if let storageType = query.storageType, listing.storageType != storageType {
+            return false
+        }
+        if let rentType = query.rentType, listing.rentType != rentType {
+            return false
+        }
+        if let range = query.rent {
+            guard let rent = listing.rent.map({ ModelFormats.double(from: $0) }), range.contains(rent) else {
+                return false
+            }
+        }
+        if let range = query.cubicFeet {
+            guard let cubicFeet = listing.cubicFeet, range.contains(cubicFeet) else {
+                return false
+            }
+        }
+        if let center = query.center, let radius = query.radiusInMiles {
+            guard let coordinate = listing.coordinate, ListingIndex.miles(from: center, to: coordinate) <= radius else {
+                return false
+            }
+        }
+        return true
+    }
+
+    private func assertIndex(_ index: ListingIndex, agreesWith listings: [String: Listing], _ generator: inout TraceGenerator) {
+        XCTAssertEqual(index.count, listings.count)
+        for _ in 0..<50 {
+            let query = randomQuery(&generator)
+            let expected = listings.keys.sorted().filter { matches(listings[$0]!, query) }
+            XCTAssertEqual(index.listings(matching: query).map { $0.listingID! }, expected)
+        }
+    }
+
+    func testQueriesMatchAFullScan() {
+        var generator = TraceGenerator(seed: 11)
+        let index = ListingIndex()
+        var listings = [String: Listing]()
+        for number in 0..<300 {
+            let listing = randomListing(id: "l\(number)", &generator)
+            listings[listing.listingID] = listing
+            index.insert(listing)
+        }
+        assertIndex(index, agreesWith: listings, &generator)
+
+        // updates move listings between every index, deletes take them out of all of them
+        var diff = ChildDiff<Listing>()
+        for number in stride(from: 0, to: 300, by: 3) {
+            let listing = randomListing(id: "l\(number)", &generator)
+            diff.updated[listing.listingID] = listing
+            listings[listing.listingID] = listing
+        }
+        for number in stride(from: 1, to: 300, by: 4) {
+            diff.deleted.append("l\(number)")
+            listings.removeValue(forKey: "l\(number)")
+        }
+        for number in 300..<350 {
+            let listing = randomListing(id: "l\(number)", &generator)
+            diff.inserted[listing.listingID] = listing
+            listings[listing.listingID] = listing
+        }
+        index.apply(diff)
+        assertIndex(index, agreesWith: listings, &generator)
+    }
+
+    func testRangeBoundsAreInclusive() {
+        let index = ListingIndex()
+        for (id, rent) in [("a", 10), ("b", 20), ("c", 30)] {
+            var listing = Listing()
+            listing.listingID = id
+            listing.rent = Decimal(rent)
+            index.insert(listing)
+        }
+        XCTAssertEqual(index.listings(matching: ListingQuery(rent: 10...20)).map { $0.listingID! }, ["a", "b"])
+        XCTAssertEqual(index.listings(matching: ListingQuery(rent: 20...20)).map { $0.listingID! }, ["b"])
+        XCTAssertTrue(index.listings(matching: ListingQuery(rent: 31...40)).isEmpty)
+    }
+
+    func testRemoveAllEmptiesEveryIndex() {
+        var generator = TraceGenerator(seed: 3)
+        let index = ListingIndex()
+        for number in 0..<20 {
+            index.insert(randomListing(id: "l\(number)", &generator))
+        }
+        index.removeAll()
+        XCTAssertEqual(index.count, 0)
+        XCTAssertTrue(index.listings(matching: ListingQuery(uid: "u0")).isEmpty)
+        XCTAssertTrue(index.listings(matching: ListingQuery(center: center, radiusInMiles: 1000)).isEmpty)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let benchmarkListingCount = 100_000
+
+    // Listings spread over a few hundred owners and a 2 degree square, most with every field set
+    private func benchmarkListings() -> [Listing] {
+        var generator = TraceGenerator(seed: 13)
+        return (0..<benchmarkListingCount).map { number in
+            var listing = randomListing(id: "l\(number)", &generator)
+            listing.uid = "owner-\(generator.next(500))"
+            return listing
+        }
+    }
+
+    // The filters the home screen sends: an owner, or a short radius, or a narrow rent band, each with a type
+    private func benchmarkQueries() -> [ListingQuery] {
+        var generator = TraceGenerator(seed: 14)
+        return (0..<200).map { _ in
+            var query = ListingQuery(storageType: storageTypes[generator.next(storageTypes.count)])
+            switch generator.next(3) {
+            case 0:
+                query.uid = "owner-\(generator.next(500))"
+            case 1:
+                query.center = CLLocationCoordinate2D(latitude: center.latitude + Double(generator.next(100) - 50) / 100, longitude: center.longitude + Double(generator.next(100) - 50) / 100)
+                query.radiusInMiles = Double(1 + generator.next(5))
+            default:
+                let low = Double(generator.next(200))
+                query.rent = low...(low + 2)
+            }
+            return query
+        }
+    }
+
+    private func benchmarkIndex(_ listings: [Listing]) -> ListingIndex {
+        let index = ListingIndex()
+        for listing in listings {
+            index.insert(listing)
+        }
+        return index
+    }
+
+    // Milliseconds per query
+    private func latencies(_ queries: [ListingQuery], _ answer: (ListingQuery) -> [Listing]) -> [Double] {
+        return queries.map { query in
+            let start = CFAbsoluteTimeGetCurrent()
+            _ = answer(query)
+            return (CFAbsoluteTimeGetCurrent() - start) * 1000
+        }
+    }
+
+    // what the home screen did before the index, a filter over every listing sorted by id
+    private func scan(_ listings: [Listing], _ query: ListingQuery) -> [Listing] {
+        return listings.filter { matches($0, query) }.sorted { $0.listingID! < $1.listingID! }
+    }
+
+    func testIndexedQueryLatency() {
+        let index = benchmarkIndex(benchmarkListings())
+        let queries = benchmarkQueries()
+        measure {
+            _ = self.latencies(queries) { index.listings(matching: $0) }
+        }
+    }
+
+    func testFullScanQueryLatency() {
+        let listings = benchmarkListings()
+        let queries = Array(benchmarkQueries().prefix(20))
+        measure {
+            _ = self.latencies(queries) { self.scan(listings, $0) }
+        }
+    }
+
+    // over 100k listings even the slow indexed queries have to come in well under a typical scan
+    func testIndexedQueriesBeatAFullScan() {
+        let listings = benchmarkListings()
+        let index = benchmarkIndex(listings)
+        let queries = benchmarkQueries()
+        let indexed = latencies(queries) { index.listings(matching: $0) }
+        let scanned = latencies(Array(queries.prefix(20))) { self.scan(listings, $0) }
+        XCTAssertLessThan(percentile(indexed, 0.95), percentile(scanned, 0.5) / 10)
+        // a keystroke or map move has one frame to answer in
+        XCTAssertLessThan(percentile(indexed, 0.5), 16)
+    }
+}
@@ -0,0 +1,167 @@
+//
+//  MessageIngestionTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import JSQMessagesViewController
+@testable import MyDorm_Beta
+
+class MessageIngestionTests: XCTestCase {
+    private func fields(_ sender: String?, _ text: String, name: String? = nil) -> ChatMessageFields {
+        return ChatMessageFields(senderID: sender, senderName: name, text: text, sentAt: Date(timeIntervalSince1970: 0))
+    }
+
+    func testOwnMessagesAreOutgoingAndOthersIncoming() {
+        let ingestor = MessageIngestor(senderID: "me", senderName: "Ada")
+        let ingested = ingestor.prepare([fields("me", "hi"), fields("them", "hello", name: "Grace"), fields(nil, "welcome")], metrics: nil)
+        XCTAssertEqual(ingested.messages.map { $0.senderId }, ["me", "them", "other"])
+        XCTAssertEqual(ingested.messages.map { $0.senderDisplayName }, ["Ada", "Grace", "other"])
+        XCTAssertEqual(ingested.messages.map { $0.text }, ["hi", "hello", "welcome"])
+        XCTAssertTrue(ingested.bubbleSizes.isEmpty)
+    }
+
+    func testBatchesCompleteInOrderOnMain() {
+        let ingestor = MessageIngestor(senderID: "me", senderName: "me")
+        var texts = [String]()
+        let done = expectation(description: "every batch ingested")
+        for batch in 0..<50 {
+            ingestor.ingest((0..<(1 + batch % 7)).map { fields("them", "\(batch).\($0)") }, metrics: nil) { (ingested) in
+                XCTAssertTrue(Thread.isMainThread)
+                texts.append(contentsOf: ingested.messages.map { $0.text })
+                if batch == 49 {
+                    done.fulfill()
+                }
+            }
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        var expected = [String]()
+        for batch in 0..<50 {
+            expected.append(contentsOf: (0..<(1 + batch % 7)).map { "\(batch).\($0)" })
+        }
+        XCTAssertEqual(texts, expected)
+    }
+
+    // what ChatViewController does once SendBird answers with the user's nickname
+    func testResetOnlyRenamesLaterBatches() {
+        let ingestor = MessageIngestor(senderID: "me", senderName: "me")
+        var names = [String]()
+        let done = expectation(description: "both batches ingested")
+        ingestor.ingest([fields("me", "before")], metrics: nil) { (ingested) in
+            names.append(contentsOf: ingested.messages.map { $0.senderDisplayName })
+        }
+        ingestor.reset(senderName: "Ada")
+        ingestor.ingest([fields("me", "after")], metrics: nil) { (ingested) in
+            names.append(contentsOf: ingested.messages.map { $0.senderDisplayName })
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        XCTAssertEqual(names, ["me", "Ada"])
+        XCTAssertEqual(ingestor.senderID, "me")
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let words = ["storage", "box", "pickup", "tomorrow", "at", "the", "dorm", "is", "fine", "thanks", "can", "you", "bring", "tape", "😀", "ok"]
+
+    private func history(_ count: Int) -> [ChatMessageFields] {
+        var generator = TraceGenerator(seed: 20)
+        return (0..<count).map { index in
+            let text = (0..<(1 + generator.next(40))).map { _ in words[generator.next(words.count)] }.joined(separator: " ")
+            let sender = generator.next(2) == 0 ? "me" : "them"
+            return ChatMessageFields(senderID: sender, senderName: sender, text: text, sentAt: Date(timeIntervalSince1970: Double(index) * 60))
+        }
+    }
+
+    // the chat's layout at phone width, which is what the bubble metrics are read from
+    private func metrics() -> BubbleMetrics {
+        let layout = JSQMessagesCollectionViewFlowLayout()
+        let collectionView = JSQMessagesCollectionView(frame: CGRect(x: 0, y: 0, width: 375, height: 667), collectionViewLayout: layout)
+        return BubbleMetrics(layout: collectionView.collectionViewLayout)
+    }
+
+    // Seconds the main thread spends handing the messages over in batches of 100 and taking the results
+    private func mainThreadSecondsIngesting(_ fields: [ChatMessageFields], metrics: BubbleMetrics) -> Double {
+        let ingestor = MessageIngestor(senderID: "me", senderName: "me")
+        let sizes = PrecomputedBubbleSizeCalculator()
+        var mainSeconds = 0.0
+        var received = 0
+        let start = CFAbsoluteTimeGetCurrent()
+        for offset in stride(from: 0, to: fields.count, by: 100) {
+            let batch = Array(fields[offset..<min(offset + 100, fields.count)])
+            ingestor.ingest(batch, metrics: metrics) { (ingested) in
+                let taken = CFAbsoluteTimeGetCurrent()
+                sizes.store(ingested.bubbleSizes)
+                received += ingested.messages.count
+                mainSeconds += CFAbsoluteTimeGetCurrent() - taken
+            }
+        }
+        mainSeconds += CFAbsoluteTimeGetCurrent() - start
+        let deadline = Date().addingTimeInterval(60)
+        while received < fields.count && Date() < deadline {
+            RunLoop.main.run(until: Date().addingTimeInterval(0.001))
+        }
+        XCTAssertEqual(received, fields.count)
+        return mainSeconds
+    }
+
+    // Seconds of main thread work when every message is made and sized on main, as displayMessage did
+    private func mainThreadSecondsInline(_ fields: [ChatMessageFields], metrics: BubbleMetrics) -> Double {
+        let ingestor = MessageIngestor(senderID: "me", senderName: "me")
+        let sizes = PrecomputedBubbleSizeCalculator()
+        let start = CFAbsoluteTimeGetCurrent()
+        for message in fields {
+            sizes.store(ingestor.prepare([message], metrics: metrics).bubbleSizes)
+        }
+        return CFAbsoluteTimeGetCurrent() - start
+    }
+
+    func testIngestingTwoHundredMessages() {
+        let fields = history(200)
+        let metrics = self.metrics()
+        measure {
+            _ = self.mainThreadSecondsIngesting(fields, metrics: metrics)
+        }
+    }
+
+    func testIngestingTwoThousandMessages() {
+        let fields = history(2000)
+        let metrics = self.metrics()
+        measure {
+            _ = self.mainThreadSecondsIngesting(fields, metrics: metrics)
+        }
+    }
+
+    func testIngestingTwentyThousandMessages() {
+        let fields = history(20_000)
+        let metrics = self.metrics()
+        measure {
+            _ = self.mainThreadSecondsIngesting(fields, metrics: metrics)
+        }
+    }
+
+    func testSizingTwoThousandMessagesOnMain() {
+        let fields = history(2000)
+        let metrics = self.metrics()
+        measure {
+            _ = self.mainThreadSecondsInline(fields, metrics: metrics)
+        }
+    }
+
+    // the main thread only takes finished batches, so it has to do a small part of the work of sizing on main
+    // and that part must not grow faster than the history does
+    func testIngestionKeepsWorkOffTheMainThread() {
+        let metrics = self.metrics()
+        var ingesting = [Int: Double]()
+        for count in [200, 2000, 20_000] {
+            let fields = history(count)
+            ingesting[count] = mainThreadSecondsIngesting(fields, metrics: metrics)
+            if count == 2000 {
+                XCTAssertLessThan(ingesting[count]!, mainThreadSecondsInline(fields, metrics: metrics) / 5)
+            }
+        }
+        XCTAssertLessThan(ingesting[20_000]!, ingesting[2000]! * 20)
+    }
+}
@@ -0,0 +1,371 @@
+//
+//  ModelCodingTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import CoreLocation
+@testable import MyDorm_Beta
+
+class ModelCodingTests: XCTestCase {
+    private func sampleListing() -> Listing {
+        var listing = Listing()
+        listing.listingID = "l1"
+        listing.uid = "u1"
+        listing.location = "12 College St"
+        listing.storageType = .OffLocation
+        listing.rentType = .Daily
+        listing.rent = Decimal(string: "19.99")
+        listing.cubicFeet = 62.5
+        listing.date = ModelFormats.date(from: "05/17/17")
+        listing.coordinate = CLLocationCoordinate2D(latitude: 41.3083, longitude: -72.9279)
+        return listing
+    }
+
+    private func assertSameFields(_ decoded: Listing, _ listing: Listing, file: StaticString = #file, line: UInt = #line) {
+        XCTAssertEqual(decoded.listingID, listing.listingID, file: file, line: line)
+        XCTAssertEqual(decoded.uid, listing.uid, file: file, line: line)
+        XCTAssertEqual(decoded.location, listing.location, file: file, line: line)
+        XCTAssertEqual(decoded.storageType, listing.storageType, file: file, line: line)
+        XCTAssertEqual(decoded.rentType, listing.rentType, file: file, line: line)
+        XCTAssertEqual(decoded.rent, listing.rent, file: file, line: line)
+        XCTAssertEqual(decoded.cubicFeet, listing.cubicFeet, file: file, line: line)
+        XCTAssertEqual(decoded.date, listing.date, file: file, line: line)
+        XCTAssertEqual(decoded.coordinate?.latitude, listing.coordinate?.latitude, file: file, line: line)
+        XCTAssertEqual(decoded.coordinate?.longitude, listing.coordinate?.longitude, file: file, line: line)
+    }
+
+/*************************************************/
+/*               Database Round Trips            */
+/*************************************************/
+    func testListingRoundTripsThroughTheDatabaseFormat() {
+        let listing = sampleListing()
+        let decoded = try! Listing(id: "l1", firebase: listing.firebaseValue)
+        assertSameFields(decoded, listing)
+    }
+
+    func testListingWithOnlyRequiredFieldsRoundTrips() {
+        var listing = Listing()
+        listing.listingID = "bare"
+        listing.storageType = .Basement
+        listing.rentType = .Summer
+        let value = listing.firebaseValue
+        XCTAssertEqual(value.keys.sorted(), ["Rent Type", "Storage Type"])
+        assertSameFields(try! Listing(id: "bare", firebase: value), listing)
+    }
+
+    func testListingRejectsMissingAndInvalidFields() {
+        let valid = sampleListing().firebaseValue
+        for field in ["Storage Type", "Rent Type"] {
+            var fields = valid
+            fields.removeValue(forKey: field)
+            XCTAssertThrowsError(try Listing(id: "l1", firebase: fields)) { (error) in
+                guard case ModelDecodingError.missing(let missing)? = error as? ModelDecodingError else {
+                    return XCTFail("\(error)")
+                }
+                XCTAssertEqual(missing, field)
+            }
+        }
+        for (field, text) in [("Storage Type", "Attic"), ("Rent Type", "Yearly"), ("Rent", "cheap"), ("Cubic Feet", "big"), ("Date Available", "2017-05-17")] {
+            var fields = valid
+            fields[field] = text
+            XCTAssertThrowsError(try Listing(id: "l1", firebase: fields)) { (error) in
+                guard case ModelDecodingError.invalid(let invalid, let value)? = error as? ModelDecodingError else {
+                    return XCTFail("\(error)")
+                }
+                XCTAssertEqual(invalid, field)
+                XCTAssertEqual(value, text)
+            }
+        }
+        XCTAssertThrowsError(try Listing(id: "l1", firebase: "not a listing"))
+    }
+
+    func testStorableObjectDecodesNamesAndDimensions() {
+        let named = try! StorableObject.decode(firebase: "Lamp")
+        XCTAssertEqual(named.name, "Lamp")
+        XCTAssertEqual(named.height, 12)
+
+        let sized = try! StorableObject.decode(firebase: ["Name": "Desk", "Height": "30", "Width": 48.0, "Length": "24"] as [String: Any])
+        XCTAssertEqual(sized.name, "Desk")
+        XCTAssertEqual(sized.height, 30)
+        XCTAssertEqual(sized.width, 48)
+        XCTAssertEqual(sized.length, 24)
+
+        XCTAssertThrowsError(try StorableObject.decode(firebase: ["Height": "30"]))
+        XCTAssertThrowsError(try StorableObject.decode(firebase: ["Name": "Desk", "Width": "-1"]))
+        XCTAssertThrowsError(try StorableObject.decode(firebase: 7))
+    }
+
+    func testOrderDecodesDatesAndObjectNames() {
+        let value: [String: Any] = ["Pick Up": "05/01/17", "Drop Off": "08/30/17", "Objects": ["Desk": true, "Lamp": true]]
+        let order = try! Order(id: "o1", uid: "u1", firebase: value)
+        XCTAssertEqual(order.orderID, "o1")
+        XCTAssertEqual(order.uid, "u1")
+        XCTAssertEqual(order.pickup, ModelFormats.date(from: "05/01/17"))
+        XCTAssertEqual(order.dropoff, ModelFormats.date(from: "08/30/17"))
+        XCTAssertEqual(Order.objectNames(firebase: value).sorted(), ["Desk", "Lamp"])
+
+        XCTAssertThrowsError(try Order(id: "o2", uid: "u1", firebase: ["Pick Up": "05/01/17"]))
+        XCTAssertThrowsError(try Order(id: "o3", uid: "u1", firebase: ["Pick Up": "May 1", "Drop Off": "08/30/17"]))
+    }
+
+/*************************************************/
+/*                   Formats                     */
+/*************************************************/
+    func testFormatsRoundTrip() {
+        XCTAssertEqual(ModelFormats.money(from: "$50"), Decimal(50))
+        XCTAssertEqual(ModelFormats.money(from: " 50.5 "), Decimal(string: "50.5"))
+        XCTAssertNil(ModelFormats.money(from: ""))
+        XCTAssertEqual(ModelFormats.string(from: Decimal(string: "19.99")!), "19.99")
+
+        XCTAssertEqual(ModelFormats.string(from: 120.0), "120")
+        XCTAssertEqual(ModelFormats.string(from: 62.5), "62.5")
+        XCTAssertEqual(ModelFormats.number(from: ModelFormats.string(from: 62.5)), 62.5)
+
+        let day = ModelFormats.date(from: "12/31/16")!
+        XCTAssertEqual(ModelFormats.string(from: day), "12/31/16")
+        XCTAssertNil(ModelFormats.date(from: nil))
+    }
+
+/*************************************************/
+/*                 Binary Round Trips            */
+/*************************************************/
+    func testListingRoundTripsThroughTheBinaryFormat() {
+        var listing = sampleListing()
+        listing.description = "dry, lockable, ünïcode"
+        var writer = BinaryWriter()
+        listing.write(to: &writer)
+        var reader = BinaryReader(data: writer.data)
+        guard let decoded = Listing.read(from: &reader) else {
+            return XCTFail("listing did not decode")
+        }
+        assertSameFields(decoded, listing)
+        XCTAssertEqual(decoded.description, listing.description)
+        XCTAssertTrue(reader.isAtEnd)
+    }
+
+    func testUnsetOptionalsStayUnset() {
+        var listing = Listing()
+        listing.listingID = "empty"
+        var writer = BinaryWriter()
+        listing.write(to: &writer)
+        var reader = BinaryReader(data: writer.data)
+        guard let decoded = Listing.read(from: &reader) else {
+            return XCTFail("listing did not decode")
+        }
+        XCTAssertNil(decoded.uid as String?)
+        XCTAssertNil(decoded.rent)
+        XCTAssertNil(decoded.cubicFeet)
+        XCTAssertNil(decoded.date)
+        XCTAssertNil(decoded.coordinate)
+    }
+
+    func testStorableObjectRoundTripsThroughTheBinaryFormat() {
+        let object = StorableObject(name: "Desk")
+        object.height = 30.5
+        var writer = BinaryWriter()
+        object.write(to: &writer)
+        var reader = BinaryReader(data: writer.data)
+        let decoded = StorableObject.read(from: &reader)
+        XCTAssertEqual(decoded?.name, "Desk")
+        XCTAssertEqual(decoded?.height, 30.5)
+        XCTAssertEqual(decoded?.width, 12)
+        XCTAssertTrue(reader.isAtEnd)
+    }
+
+    func testEveryTruncationFailsCleanly() {
+        var writer = BinaryWriter()
+        sampleListing().write(to: &writer)
+        for length in 0..<writer.data.count {
+            var reader = BinaryReader(data: writer.data.subdata(in: 0..<length))
+            XCTAssertNil(Listing.read(from: &reader), "length \(length)")
+        }
+    }
+
+/*************************************************/
+/*              Generated Round Trips            */
+/*************************************************/
+    private let words = ["Desk", "Lamp", "Box", "Elm St", "Branford", "ünïcode", "$5", "12/31/16", "", " "]
+
+    private func randomText(_ generator: inout TraceGenerator) -> String {
+        return (0..<(1 + generator.next(3))).map { _ in words[generator.next(words.count)] }.joined(separator: " ")
+    }
+
+    // every field set or left out at random, values drawn from what the database can hold
+    private func randomListing(_ generator: inout TraceGenerator) -> Listing {
+        let storageTypes: [StorageType] = [.InHouse, .Basement, .OffLocation]
+        let rentTypes: [RentType] = [.Summer, .Monthly, .Daily]
+        var listing = Listing()
+        listing.listingID = "l\(generator.next(100000))"
+        listing.storageType = storageTypes[generator.next(storageTypes.count)]
+        listing.rentType = rentTypes[generator.next(rentTypes.count)]
+        if generator.next(4) != 0 {
+            listing.uid = "u\(generator.next(1000))"
+        }
+        if generator.next(4) != 0 {
+            listing.location = randomText(&generator)
+        }
+        if generator.next(4) != 0 {
+            listing.rent = Decimal(generator.next(100000)) / 100
+        }
+        if generator.next(4) != 0 {
+            listing.cubicFeet = Double(generator.next(4000)) / 8
+        }
+        if generator.next(4) != 0 {
+            // whole UTC days from 2001 into the 2050s, two digit years read back into the same century
+            listing.date = Date(timeIntervalSinceReferenceDate: Double(generator.next(20000)) * 86400)
+        }
+        if generator.next(4) != 0 {
+            listing.coordinate = CLLocationCoordinate2D(latitude: Double(generator.next(180_000_000)) / 1_000_000 - 90, longitude: Double(generator.next(360_000_000)) / 1_000_000 - 180)
+        }
+        listing.description = randomText(&generator)
+        return listing
+    }
+
+    func testGeneratedListingsRoundTripThroughTheDatabaseFormat() {
+        var generator = TraceGenerator(seed: 16)
+        for _ in 0..<2000 {
+            let listing = randomListing(&generator)
+            guard let decoded = try? Listing(id: listing.listingID, firebase: listing.firebaseValue) else {
+                XCTFail("\(listing.firebaseValue) did not decode")
+                continue
+            }
+            assertSameFields(decoded, listing)
+        }
+    }
+
+    func testGeneratedListingsRoundTripThroughTheBinaryFormat() {
+        var generator = TraceGenerator(seed: 17)
+        var writer = BinaryWriter()
+        var listings = [Listing]()
+        for _ in 0..<2000 {
+            let listing = randomListing(&generator)
+            listing.write(to: &writer)
+            listings.append(listing)
+        }
+        // written back to back, each read has to stop exactly where the next listing starts
+        var reader = BinaryReader(data: writer.data)
+        for listing in listings {
+            guard let decoded = Listing.read(from: &reader) else {
+                return XCTFail("listing \(listing.listingID!) did not decode")
+            }
+            assertSameFields(decoded, listing)
+            XCTAssertEqual(decoded.description, listing.description)
+        }
+        XCTAssertTrue(reader.isAtEnd)
+    }
+
+    func testGeneratedStorableObjectsRoundTrip() {
+        var generator = TraceGenerator(seed: 18)
+        for _ in 0..<2000 {
+            let object = StorableObject(name: randomText(&generator))
+            var fields: [String: Any] = ["Name": object.name]
+            for field in ["Height", "Width", "Length"] where generator.next(3) != 0 {
+                let inches = Double(1 + generator.next(960)) / 4
+                // the database has both numbers and text for dimensions
+                fields[field] = generator.next(2) == 0 ? inches as Any : ModelFormats.string(from: inches) as Any
+                switch field {
+                case "Height":
+                    object.height = inches
+                case "Width":
+                    object.width = inches
+                default:
+                    object.length = inches
+                }
+            }
+            let decoded = try? StorableObject.decode(firebase: fields)
+            XCTAssertEqual(decoded?.name, object.name)
+            XCTAssertEqual(decoded?.height, object.height)
+            XCTAssertEqual(decoded?.width, object.width)
+            XCTAssertEqual(decoded?.length, object.length)
+
+            var writer = BinaryWriter()
+            object.write(to: &writer)
+            var reader = BinaryReader(data: writer.data)
+            let read = StorableObject.read(from: &reader)
+            XCTAssertEqual(read?.name, object.name)
+            XCTAssertEqual(read?.height, object.height)
+            XCTAssertTrue(reader.isAtEnd)
+        }
+    }
+
+    func testGeneratedOrdersRoundTrip() {
+        var generator = TraceGenerator(seed: 19)
+        for index in 0..<2000 {
+            let pickup = Date(timeIntervalSinceReferenceDate: Double(generator.next(20000)) * 86400)
+            let dropoff = pickup.addingTimeInterval(Double(generator.next(120)) * 86400)
+            var objects = [String: Any]()
+            for _ in 0..<generator.next(6) {
+                objects["item \(generator.next(50))"] = true
+            }
+            let value: [String: Any] = ["Pick Up": ModelFormats.string(from: pickup), "Drop Off": ModelFormats.string(from: dropoff), "Objects": objects]
+            let order = try? Order(id: "o\(index)", uid: "u1", firebase: value)
+            XCTAssertEqual(order?.pickup, pickup)
+            XCTAssertEqual(order?.dropoff, dropoff)
+            XCTAssertEqual(Order.objectNames(firebase: value).sorted(), objects.keys.sorted())
+        }
+    }
+
+    // damaged snapshot bytes have to fail or decode to some listing, never crash
+    func testGeneratedCorruptionsNeverCrash() {
+        var generator = TraceGenerator(seed: 20)
+        for _ in 0..<2000 {
+            var writer = BinaryWriter()
+            randomListing(&generator).write(to: &writer)
+            var data = writer.data
+            for _ in 0..<(1 + generator.next(4)) {
+                data[generator.next(data.count)] = UInt8(generator.next(256))
+            }
+            var reader = BinaryReader(data: data)
+            _ = Listing.read(from: &reader)
+        }
+    }
+
+/*************************************************/
+/*                   Benchmark                   */
+/*************************************************/
+    private func benchmarkListings() -> [Listing] {
+        var generator = TraceGenerator(seed: 21)
+        return (0..<10_000).map { _ in randomListing(&generator) }
+    }
+
+    // Seconds to turn the database values into listings
+    private func parseSeconds(_ values: [(String, [String: String])]) -> Double {
+        let start = CFAbsoluteTimeGetCurrent()
+        for (id, value) in values {
+            XCTAssertNotNil(try? Listing(id: id, firebase: value))
+        }
+        return CFAbsoluteTimeGetCurrent() - start
+    }
+
+    func testDatabaseParseThroughput() {
+        let values = benchmarkListings().map { ($0.listingID!, $0.firebaseValue) }
+        measure {
+            _ = self.parseSeconds(values)
+        }
+    }
+
+    func testBinaryReadThroughput() {
+        var writer = BinaryWriter()
+        for listing in benchmarkListings() {
+            listing.write(to: &writer)
+        }
+        let data = writer.data
+        measure {
+            var reader = BinaryReader(data: data)
+            while !reader.isAtEnd {
+                XCTAssertNotNil(Listing.read(from: &reader))
+            }
+        }
+    }
+
+    // a snapshot of 10k listings, as the home screen loads on a cold start, has to parse well within a second
+    func testParsingTenThousandListingsIsFast() {
+        let values = benchmarkListings().map { ($0.listingID!, $0.firebaseValue) }
+        var runs = [Double]()
+        for _ in 0..<5 {
+            runs.append(parseSeconds(values))
+        }
+        XCTAssertLessThan(percentile(runs, 0.5), 0.5)
+    }
+}
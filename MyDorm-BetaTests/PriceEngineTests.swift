@@ -0,0 +1,163 @@
+//
+//  PriceEngineTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+@testable import MyDorm_Beta
+
+// Holds the engine to the prices StorageCompany.calculateOrderPrice gives, on random companies and orders
+class PriceEngineTests: XCTestCase {
+    let names = ["Desk", "Lamp", "Chair", "Fridge", "Bed", "Dresser", "Rug", "TV"]
+
+    private func company(_ name: String, prices: [String: Double], discounts: [PriceDiscount] = []) -> StorageCompany {
+        return StorageCompany(name: name, priceIndex: prices, pickupTimes: [DateTime](), dropoffTimes: [DateTime](), image: UIImage(), discounts: discounts)
+    }
+
+    private func randomCompanies(_ generator: inout TraceGenerator) -> [StorageCompany] {
+        var companies = [StorageCompany]()
+        for index in 0..<(1 + generator.next(6)) {
+            var prices = [String: Double]()
+            for name in names where generator.next(3) != 0 {
+                prices[name] = Double(generator.next(10000)) / 100
+            }
+            var discounts = [PriceDiscount]()
+            for _ in 0..<generator.next(3) {
+                let kind: PriceDiscount.Kind = generator.next(2) == 0 ? .tiered : .volume
+                discounts.append(PriceDiscount(kind: kind, minimum: Double(generator.next(8)), percentOff: Double(1 + generator.next(30))))
+            }
+            companies.append(company("company \(index)", prices: prices, discounts: discounts))
+        }
+        return companies
+    }
+
+    private func randomOrder(_ generator: inout TraceGenerator) -> Order {
+        var order = Order()
+        for _ in 0..<generator.next(10) {
+            // some names no company prices
+            let name = generator.next(5) == 0 ? "Unlisted \(generator.next(3))" : names[generator.next(names.count)]
+            order.objects.append(StorableObject(name: name))
+        }
+        return order
+    }
+
+    // the largest discount whose minimum the whole order reaches
+    private func expectedPercentOff(_ company: StorageCompany, _ order: Order) -> Double {
+        let cubicFeet = order.objects.reduce(0) { $0 + StorageMatcher.box(for: $1).volume / 1728 }
+        var percentOff = 0.0
+        for discount in company.discounts {
+            let amount = discount.kind == .tiered ? Double(order.objects.count) : cubicFeet
+            if amount >= discount.minimum {
+                percentOff = max(percentOff, discount.percentOff)
+            }
+        }
+        return percentOff
+    }
+
+    func testQuotesMatchCalculateOrderPrice() {
+        var generator = TraceGenerator(seed: 21)
+        for _ in 0..<200 {
+            let companies = randomCompanies(&generator)
+            let engine = PriceEngine(companies: companies)
+            let order = randomOrder(&generator)
+            let quotes = engine.quotes(for: order)
+            XCTAssertEqual(quotes.count, companies.count)
+            for quote in quotes {
+                // summed in the same order, so exactly equal
+                XCTAssertEqual(quote.subtotal, quote.company.calculateOrderPrice(order: order))
+                let percentOff = expectedPercentOff(quote.company, order)
+                XCTAssertEqual(quote.percentOff, percentOff)
+                XCTAssertEqualWithAccuracy(quote.total, quote.subtotal * (1 - percentOff / 100), 1e-9)
+            }
+            XCTAssertEqual(quotes.map { $0.total }, quotes.map { $0.total }.sorted())
+        }
+    }
+
+    func testTieredDiscountCountsUnpricedItems() {
+        let tiered = company("Tiered", prices: ["Desk": 100], discounts: [PriceDiscount(kind: .tiered, minimum: 3, percentOff: 20)])
+        var order = Order()
+        order.objects = [StorableObject(name: "Desk"), StorableObject(name: "Lamp"), StorableObject(name: "Rug")]
+        let quote = PriceEngine(companies: [tiered]).quotes(for: order).first
+        XCTAssertEqual(quote?.subtotal, 100)
+        XCTAssertEqual(quote?.percentOff, 20)
+        XCTAssertEqual(quote?.total, 80)
+    }
+
+    func testTiesKeepTheCompanyOrder() {
+        let companies = [company("first", prices: ["Desk": 10]), company("second", prices: ["Desk": 10]), company("cheap", prices: ["Desk": 5])]
+        var order = Order()
+        order.objects = [StorableObject(name: "Desk")]
+        XCTAssertEqual(PriceEngine(companies: companies).quotes(for: order).map { $0.company.name }, ["cheap", "first", "second"])
+    }
+
+    func testManyOrdersAreQuotedLikeOne() {
+        var generator = TraceGenerator(seed: 8)
+        let engine = PriceEngine(companies: randomCompanies(&generator))
+        let orders = (0..<20).map { _ in randomOrder(&generator) }
+        let rows = engine.quotes(for: orders)
+        for (order, row) in zip(orders, rows) {
+            XCTAssertEqual(row.map { $0.total }, engine.quotes(for: order).map { $0.total })
+        }
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    private func benchmarkCompanies(_ generator: inout TraceGenerator) -> [StorageCompany] {
+        var companies = [StorageCompany]()
+        while companies.count < 500 {
+            companies += randomCompanies(&generator)
+        }
+        return Array(companies.prefix(500))
+    }
+
+    private func benchmarkOrders(_ generator: inout TraceGenerator) -> [Order] {
+        return (0..<10_000).map { _ in randomOrder(&generator) }
+    }
+
+    // what every company cell did before the engine, one calculateOrderPrice per order and company
+    private func priceEachCell(_ companies: [StorageCompany], _ orders: [Order]) -> Double {
+        var sum = 0.0
+        for order in orders {
+            for company in companies {
+                sum += company.calculateOrderPrice(order: order)
+            }
+        }
+        return sum
+    }
+
+    func testQuotingTenThousandOrdersAgainstFiveHundredCompanies() {
+        var generator = TraceGenerator(seed: 9)
+        let companies = benchmarkCompanies(&generator)
+        let orders = benchmarkOrders(&generator)
+        measure {
+            _ = PriceEngine(companies: companies).quotes(for: orders)
+        }
+    }
+
+    func testPricingEveryCellOfAThousandOrders() {
+        var generator = TraceGenerator(seed: 9)
+        let companies = benchmarkCompanies(&generator)
+        let orders = Array(benchmarkOrders(&generator).prefix(1000))
+        measure {
+            _ = self.priceEachCell(companies, orders)
+        }
+    }
+
+    // the whole matrix, discounts and sorting included, has to cost less than the subtotals priced cell by cell
+    func testEngineBeatsPricingEachCell() {
+        var generator = TraceGenerator(seed: 10)
+        let companies = benchmarkCompanies(&generator)
+        let orders = benchmarkOrders(&generator)
+        var start = CFAbsoluteTimeGetCurrent()
+        let rows = PriceEngine(companies: companies).quotes(for: orders)
+        let engineSeconds = CFAbsoluteTimeGetCurrent() - start
+        start = CFAbsoluteTimeGetCurrent()
+        _ = priceEachCell(companies, orders)
+        let cellSeconds = CFAbsoluteTimeGetCurrent() - start
+        XCTAssertEqual(rows.count, orders.count)
+        XCTAssertEqual(rows.first?.count, companies.count)
+        XCTAssertLessThan(engineSeconds, cellSeconds)
+    }
+}
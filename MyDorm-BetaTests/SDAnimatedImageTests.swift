@@ -0,0 +1,218 @@
+//
+//  SDAnimatedImageTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+import ImageIO
+import MobileCoreServices
+import SDWebImage
+
+// Bytes the process holds in memory, the figure jetsam goes by
+func physicalFootprint() -> Int {
+    var info = task_vm_info_data_t()
+    var count = mach_msg_type_number_t(MemoryLayout<task_vm_info_data_t>.size / MemoryLayout<integer_t>.size)
+    let result = withUnsafeMutablePointer(to: &info) { pointer in
+        pointer.withMemoryRebound(to: integer_t.self, capacity: Int(count)) {
+            task_info(mach_task_self_, task_flavor_t(TASK_VM_INFO), $0, &count)
+        }
+    }
+    return result == KERN_SUCCESS ? Int(info.phys_footprint) : 0
+}
+
+// Builds GIF fixtures with ImageIO, one color per frame and the given delay per frame
+func makeGIF(size: CGSize, delays: [Double], loopCount: Int) -> Data {
+    let data = NSMutableData()
+    let destination = CGImageDestinationCreateWithData(data as CFMutableData, kUTTypeGIF, delays.count, nil)!
+    let fileProperties = [kCGImagePropertyGIFDictionary as String: [kCGImagePropertyGIFLoopCount as String: loopCount]]
+    CGImageDestinationSetProperties(destination, fileProperties as CFDictionary)
+    var generator = TraceGenerator(seed: 17)
+    for (index, delay) in delays.enumerated() {
+        UIGraphicsBeginImageContextWithOptions(size, true, 1)
+        let context = UIGraphicsGetCurrentContext()!
+        UIColor(hue: CGFloat(index % 12) / 12, saturation: 0.6, brightness: 0.9, alpha: 1).setFill()
+        context.fill(CGRect(origin: .zero, size: size))
+        UIColor.black.setFill()
+        for _ in 0..<20 {
+            context.fill(CGRect(x: generator.next(Int(size.width)), y: generator.next(Int(size.height)), width: 12, height: 12))
+        }
+        let frame = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+        let frameProperties = [kCGImagePropertyGIFDictionary as String: [kCGImagePropertyGIFDelayTime as String: delay]]
+        CGImageDestinationAddImage(destination, frame.cgImage!, frameProperties as CFDictionary)
+    }
+    CGImageDestinationFinalize(destination)
+    return data as Data
+}
+
+// Frame count, loop count and delays read from GIF fixtures, frame buffering, and playback in SDAnimatedImageView
+class SDAnimatedImageTests: XCTestCase {
+    let delays = [0.05, 0.2, 0.01, 0.0, 0.07]
+
+    func testReadsFrameCountLoopCountAndDelays() {
+        let image = SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 40, height: 30), delays: delays, loopCount: 3), scale: 2)!
+        XCTAssertEqual(image.frameCount, 5)
+        XCTAssertEqual(image.loopCount, 3)
+        XCTAssertEqual(image.scale, 2)
+        XCTAssertEqual(image.size, CGSize(width: 20, height: 15))
+        // delays of 10ms or less are shown for 100ms like browsers do
+        let expected = [0.05, 0.2, 0.1, 0.1, 0.07]
+        for (index, duration) in expected.enumerated() {
+            XCTAssertEqualWithAccuracy(image.durationOfFrame(at: UInt(index)), duration, accuracy: 0.001, "frame \(index)")
+        }
+        XCTAssertEqual(image.durationOfFrame(at: 5), 0)
+    }
+
+    func testSingleFrameGIFIsNotAnimated() {
+        XCTAssertNil(SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 10, height: 10), delays: [0.1], loopCount: 0), scale: 1))
+        XCTAssertNil(SDAnimatedImage(gifData: Data(bytes: [0x47, 0x49, 0x46]), scale: 1))
+    }
+
+    func testEveryFrameDecodesAtTheImageScale() {
+        let image = SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 40, height: 30), delays: delays, loopCount: 0), scale: 2)!
+        for index in 0..<image.frameCount {
+            let frame = image.frame(at: index)
+            XCTAssertNotNil(frame)
+            XCTAssertEqual(frame?.scale, 2)
+            XCTAssertEqual(frame?.cgImage?.width, 40)
+        }
+        XCTAssertNil(image.frame(at: image.frameCount))
+        XCTAssertNotNil(image.cachedFrame(at: 0))
+    }
+
+    func testFramesAheadGetDecodedInTheBackground() {
+        let image = SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 40, height: 30), delays: delays, loopCount: 0), scale: 1)!
+        _ = image.cachedFrame(at: 0)
+        let deadline = Date(timeIntervalSinceNow: 5)
+        while (1..<image.frameCount).contains(where: { image.cachedFrameIsMissing($0) }) && Date() < deadline {
+            RunLoop.current.run(until: Date(timeIntervalSinceNow: 0.01))
+        }
+        for index in 0..<image.frameCount {
+            XCTAssertFalse(image.cachedFrameIsMissing(index), "frame \(index)")
+        }
+    }
+
+    private func showInWindow(_ image: UIImage) -> (UIWindow, SDAnimatedImageView) {
+        let window = UIWindow(frame: CGRect(x: 0, y: 0, width: 320, height: 480))
+        let view = SDAnimatedImageView(frame: window.bounds)
+        window.addSubview(view)
+        window.isHidden = false
+        view.image = image
+        return (window, view)
+    }
+
+    func testViewStopsAfterTheLastLoop() {
+        let image = SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 40, height: 30), delays: [0.05, 0.05, 0.05], loopCount: 2), scale: 1)!
+        let (window, view) = showInWindow(image)
+        XCTAssertTrue(view.isAnimating)
+        RunLoop.current.run(until: Date(timeIntervalSinceNow: 1))
+        XCTAssertFalse(view.isAnimating)
+        XCTAssertEqual(view.currentFrameIndex, 2)
+        window.isHidden = true
+    }
+
+    func testViewOnlyPlaysWhileVisible() {
+        let image = SDAnimatedImage(gifData: makeGIF(size: CGSize(width: 40, height: 30), delays: delays, loopCount: 0), scale: 1)!
+        let (window, view) = showInWindow(image)
+        XCTAssertTrue(view.isAnimating)
+        view.isHidden = true
+        XCTAssertFalse(view.isAnimating)
+        view.isHidden = false
+        XCTAssertTrue(view.isAnimating)
+        view.removeFromSuperview()
+        XCTAssertFalse(view.isAnimating)
+        window.isHidden = true
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let benchmarkSize = CGSize(width: 400, height: 400)
+    let benchmarkFrameCount = 60
+
+    private func benchmarkGIF() -> Data {
+        return makeGIF(size: benchmarkSize, delays: Array(repeating: 0.03, count: benchmarkFrameCount), loopCount: 0)
+    }
+
+    // Shows every frame once, the way playback does, and returns how far the footprint grew at its highest
+    private func peakFootprintGrowth(_ showFrame: (Int) -> UIImage?) -> Int {
+        let baseline = physicalFootprint()
+        var peak = baseline
+        for index in 0..<benchmarkFrameCount {
+            autoreleasepool {
+                let frame = showFrame(index)
+                XCTAssertNotNil(frame?.cgImage)
+                peak = max(peak, physicalFootprint())
+            }
+        }
+        return peak - baseline
+    }
+
+    func testPlaybackMemoryStaysWithinTheBuffer() {
+        let data = benchmarkGIF()
+        let image = SDAnimatedImage(gifData: data, scale: 1)!
+        image.maxBufferSize = 2 * 1024 * 1024
+        let growth = peakFootprintGrowth { image.frame(at: UInt($0)) }
+        let allFrames = benchmarkFrameCount * Int(benchmarkSize.width * benchmarkSize.height) * 4
+        XCTAssertLessThan(growth, allFrames / 4)
+    }
+
+    func testPlaybackPeakMemoryOfBufferedFrames() {
+        let data = benchmarkGIF()
+        measure {
+            let image = SDAnimatedImage(gifData: data, scale: 1)!
+            image.maxBufferSize = 2 * 1024 * 1024
+            _ = self.peakFootprintGrowth { image.frame(at: UInt($0)) }
+        }
+    }
+
+    func testPlaybackPeakMemoryOfAllFramesDecoded() {
+        let data = benchmarkGIF()
+        measure {
+            let image = UIImage.sd_animatedGIF(with: data)!
+            _ = self.peakFootprintGrowth { index in
+                let frame = image.images![index]
+                // UIImageView draws every frame, which keeps all of them decoded
+                UIGraphicsBeginImageContextWithOptions(CGSize(width: 1, height: 1), true, 1)
+                frame.draw(in: CGRect(x: 0, y: 0, width: 1, height: 1))
+                UIGraphicsEndImageContext()
+                return frame
+            }
+        }
+    }
+
+    // Frame changes in a view on screen have to follow the GIF delays, not the decoding
+    func testPlaybackJitter() {
+        let image = SDAnimatedImage(gifData: benchmarkGIF(), scale: 1)!
+        let (window, view) = showInWindow(image)
+        let recorder = FrameChangeRecorder()
+        view.addObserver(recorder, forKeyPath: "currentFrameIndex", options: [], context: nil)
+        RunLoop.current.run(until: Date(timeIntervalSinceNow: 3))
+        view.removeObserver(recorder, forKeyPath: "currentFrameIndex")
+        window.isHidden = true
+
+        let changes = recorder.times
+        let jitter = zip(changes.dropFirst(), changes).map { abs(($0 - $1) - 0.03) * 1000 }
+        XCTAssertGreaterThan(jitter.count, 50)
+        // one display refresh is 16.7ms
+        XCTAssertLessThan(percentile(jitter, 0.5), 17)
+        XCTAssertLessThan(percentile(jitter, 0.95), 34)
+    }
+}
+
+// Records when the observed value changes
+class FrameChangeRecorder: NSObject {
+    var times = [CFAbsoluteTime]()
+
+    override func observeValue(forKeyPath keyPath: String?, of object: Any?, change: [NSKeyValueChangeKey : Any]?, context: UnsafeMutableRawPointer?) {
+        times.append(CFAbsoluteTimeGetCurrent())
+    }
+}
+
+extension SDAnimatedImage {
+    func cachedFrameIsMissing(_ index: UInt) -> Bool {
+        return cachedFrame(at: index) == nil
+    }
+}
@@ -0,0 +1,176 @@
+//
+//  SDImageCacheEvictionPolicyTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import SDWebImage
+
+// Replays generated traces through SDImageCacheEvictionSimulator for every policy, checks the LFU policy against a
+// straightforward model, and checks that the disk clean up keeps its policy across runs.
+class SDImageCacheEvictionPolicyTests: XCTestCase {
+    let hotKeyCount = 80
+    let capacity = 100
+
+    // Most requests go to a small hot set, the rest are one-off keys like a feed being scrolled once
+    private func scanTrace(seed: UInt64, length: Int) -> [String] {
+        var generator = TraceGenerator(seed: seed)
+        return (0..<length).map { index in
+            if generator.next(10) < 6 {
+                return "hot-\(generator.next(hotKeyCount))"
+            }
+            return "scan-\(index)"
+        }
+    }
+
+    private func policies() -> [(String, SDImageCacheEvictionPolicy)] {
+        return [
+            ("LRU", SDImageCacheLRUPolicy()),
+            ("LFU", SDImageCacheLFUPolicy()),
+            ("TinyLFU", SDImageCacheTinyLFUPolicy(costLimit: UInt(capacity))),
+            ("CostAware", SDImageCacheCostAwarePolicy())
+        ]
+    }
+
+    private func replay(_ keys: [String], _ policy: SDImageCacheEvictionPolicy) -> SDImageCacheEvictionSimulationResult {
+        return SDImageCacheEvictionSimulator.replayKeys(keys, costs: [:], capacity: UInt(capacity), policy: policy)
+    }
+
+    func testEveryPolicyStaysWithinCapacity() {
+        let keys = scanTrace(seed: 1, length: 20000)
+        for (name, policy) in policies() {
+            let result = replay(keys, policy)
+            XCTAssertEqual(result.requests, UInt(keys.count), name)
+            XCTAssertLessThanOrEqual(policy.totalCost(), UInt(capacity), name)
+            // every miss inserts one byte, whatever was not evicted is still resident
+            let misses = result.requests - result.hits
+            XCTAssertEqual(UInt64(misses) - result.bytesEvicted, UInt64(policy.totalCost()), name)
+        }
+    }
+
+    func testFrequencyPoliciesResistScans() {
+        let keys = scanTrace(seed: 2, length: 20000)
+        var hitRatios = [String: Double]()
+        for (name, policy) in policies() {
+            let result = replay(keys, policy)
+            hitRatios[name] = Double(result.hits) / Double(result.requests)
+        }
+        XCTAssertGreaterThan(hitRatios["LFU"]!, hitRatios["LRU"]!)
+        XCTAssertGreaterThan(hitRatios["TinyLFU"]!, hitRatios["LRU"]!)
+        XCTAssertGreaterThan(hitRatios["CostAware"]!, hitRatios["LRU"]!)
+    }
+
+    func testReplayingResetsThePolicy() {
+        let keys = scanTrace(seed: 3, length: 5000)
+        for (name, policy) in policies() {
+            let first = replay(keys, policy)
+            let second = replay(keys, policy)
+            XCTAssertEqual(first.hits, second.hits, name)
+            XCTAssertEqual(first.bytesEvicted, second.bytesEvicted, name)
+        }
+    }
+
+    func testCostAwarePolicyKeepsExpensiveKeys() {
+        var generator = TraceGenerator(seed: 4)
+        let keys = (0..<10000).map { _ in "key-\(generator.next(400))" }
+        let expensive = SDImageCacheCostAwarePolicy()
+        expensive.refetchCostBlock = { (key, bytes) in
+            return key.hasSuffix("7") ? 100 * Double(bytes) : Double(bytes)
+        }
+        _ = replay(keys, expensive)
+        let survivors = Set(expensive.keysToEvict(forCostLimit: 0) as! [String])
+        let expensiveKeys = survivors.filter { $0.hasSuffix("7") }
+        // a tenth of the keys are expensive, they take well over a tenth of the room
+        XCTAssertGreaterThan(expensiveKeys.count, survivors.count / 5)
+    }
+
+    // The LFU policy has to pick the same victims as a model that scans every key for the lowest frequency and
+    // breaks ties by the oldest touch
+    func testLFUMatchesReferenceModel() {
+        let policy = SDImageCacheLFUPolicy()
+        var model = [String: (frequency: Int, touched: Int)]()
+        var clock = 0
+        var generator = TraceGenerator(seed: 5)
+        for _ in 0..<20000 {
+            let key = "key-\(generator.next(64))"
+            clock += 1
+            switch generator.next(10) {
+            case 0..<4:
+                policy.recordInsertion(ofKey: key, cost: 1)
+                model[key] = ((model[key]?.frequency ?? 0) + 1, clock)
+            case 4..<8:
+                policy.recordAccess(ofKey: key)
+                if let entry = model[key] {
+                    model[key] = (entry.frequency + 1, clock)
+                }
+            case 8:
+                policy.recordRemoval(ofKey: key)
+                model[key] = nil
+            default:
+                let limit = generator.next(40)
+                var expected = [String]()
+                while model.count > limit {
+                    let victim = model.min { a, b in
+                        a.value.frequency != b.value.frequency ? a.value.frequency < b.value.frequency : a.value.touched < b.value.touched
+                    }!.key
+                    expected.append(victim)
+                    model[victim] = nil
+                }
+                XCTAssertEqual(policy.keysToEvict(forCostLimit: UInt(limit)) as! [String], expected)
+            }
+            XCTAssertEqual(policy.totalCost(), UInt(model.count))
+        }
+    }
+
+    private func read(_ cache: SDImageCache, _ key: String) {
+        let done = expectation(description: "read")
+        _ = cache.queryDiskCache(forKey: key) { (_, _) in
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 10, handler: nil)
+    }
+
+    private func clean(_ cache: SDImageCache) {
+        let done = expectation(description: "cleaned")
+        cache.cleanDisk {
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 30, handler: nil)
+    }
+
+    // Reads the hot file a few times, cleans up without evicting, then writes more cold files than fit and cleans up
+    // again. The reads from before the first clean up have to still count at the second one.
+    private func hotFileSurvives(_ policy: SDImageCacheEvictionPolicy) -> Bool {
+        let directory = (NSTemporaryDirectory() as NSString).appendingPathComponent(UUID().uuidString)
+        defer {
+            try? FileManager.default.removeItem(atPath: directory)
+        }
+        let cache = SDImageCache(namespace: "eviction", diskCacheDirectory: directory)
+        cache.shouldCacheImagesInMemory = false
+        cache.diskEvictionPolicy = policy
+        let data = Data(count: 8192)
+        cache.maxCacheSize = 8 * 8192
+
+        cache.storeImageData(toDisk: data, forKey: "hot")
+        for index in 0..<5 {
+            cache.storeImageData(toDisk: data, forKey: "cold-\(index)")
+        }
+        for _ in 0..<5 {
+            read(cache, "hot")
+        }
+        clean(cache)
+        XCTAssertTrue(cache.diskImageExists(withKey: "cold-0"))
+
+        for index in 5..<10 {
+            cache.storeImageData(toDisk: data, forKey: "cold-\(index)")
+        }
+        clean(cache)
+        XCTAssertLessThanOrEqual(cache.getSize(), cache.maxCacheSize / 2)
+        return cache.diskImageExists(withKey: "hot")
+    }
+
+    func testDiskCleanUpKeepsFrequencyHistory() {
+        XCTAssertTrue(hotFileSurvives(SDImageCacheLFUPolicy()))
+        XCTAssertFalse(hotFileSurvives(SDImageCacheLRUPolicy()))
+    }
+}
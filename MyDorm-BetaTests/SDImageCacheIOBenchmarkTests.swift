@@ -0,0 +1,142 @@
+//
+//  SDImageCacheIOBenchmarkTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import Foundation
+import SDWebImage
+
+// Replays a trace of large writes mixed with lookups through SDImageCache and measures lookup latency. The baseline
+// is the same cache with every key picked to hash to one IO shard, which funnels all disk work through a single
+// serial queue the way SDImageCache did it before sharding.
+class SDImageCacheIOBenchmarkTests: XCTestCase {
+    let ioQueueCount: UInt = 4
+    let storedKeyCount = 100
+    let operationCount = 200
+    // one write for every this many operations
+    let writeInterval = 5
+    let largeData = Data(count: 1024 * 1024)
+    let smallData = Data(count: 16 * 1024)
+    // store() only needs an image to hand to the memory cache, the disk gets imageData unchanged
+    let placeholder = UIImage()
+
+    var directory: String!
+    var cache: SDImageCache!
+
+    override func setUp() {
+        super.setUp()
+        directory = (NSTemporaryDirectory() as NSString).appendingPathComponent(UUID().uuidString)
+        cache = SDImageCache(namespace: "benchmark", diskCacheDirectory: directory)
+        cache.shouldCacheImagesInMemory = false
+    }
+
+    override func tearDown() {
+        cache = nil
+        try? FileManager.default.removeItem(atPath: directory)
+        super.tearDown()
+    }
+
+    private func shard(of key: String) -> UInt {
+        return UInt(bitPattern: (key as NSString).hash) % ioQueueCount
+    }
+
+    // count keys with the prefix, all on shard 0 when onOneShard is set
+    private func keys(_ prefix: String, _ count: Int, onOneShard: Bool) -> [String] {
+        var keys = [String]()
+        var suffix = 0
+        while keys.count < count {
+            let key = "\(prefix)-\(suffix)"
+            suffix += 1
+            if !onOneShard || shard(of: key) == 0 {
+                keys.append(key)
+            }
+        }
+        return keys
+    }
+
+    private func trace(onOneShard: Bool) -> [(isWrite: Bool, key: String)] {
+        let stored = keys("stored", storedKeyCount, onOneShard: onOneShard)
+        let written = keys("written", operationCount / writeInterval, onOneShard: onOneShard)
+        for key in stored {
+            cache.storeImageData(toDisk: smallData, forKey: key)
+        }
+        var generator = TraceGenerator(seed: 42)
+        return (0..<operationCount).map { index in
+            if index % writeInterval == 0 {
+                return (true, written[index / writeInterval])
+            }
+            return (false, stored[generator.next(storedKeyCount)])
+        }
+    }
+
+    // Lookup latencies in milliseconds. Writes are queued without waiting, each lookup waits for its answer on main.
+    private func replay(_ operations: [(isWrite: Bool, key: String)]) -> [Double] {
+        let cache: SDImageCache = self.cache
+        let placeholder = self.placeholder
+        let largeData = self.largeData
+        var latencies = [Double]()
+        let finished = expectation(description: "trace replayed")
+        DispatchQueue.global().async {
+            let answered = DispatchSemaphore(value: 0)
+            for operation in operations {
+                if operation.isWrite {
+                    cache.store(placeholder, recalculateFromImage: false, imageData: largeData, forKey: operation.key, toDisk: true)
+                } else {
+                    let start = CFAbsoluteTimeGetCurrent()
+                    cache.diskImageExists(withKey: operation.key) { exists in
+                        XCTAssertTrue(exists)
+                        latencies.append((CFAbsoluteTimeGetCurrent() - start) * 1000)
+                        answered.signal()
+                    }
+                    answered.wait()
+                }
+            }
+            DispatchQueue.main.async {
+                finished.fulfill()
+            }
+        }
+        waitForExpectations(timeout: 300, handler: nil)
+        XCTAssertEqual(latencies.count, operationCount - operationCount / writeInterval)
+        return latencies
+    }
+
+    // a lookup queued right after a store for the same key has to see it
+    func testLookupAfterStoreSeesTheWrite() {
+        for index in 0..<20 {
+            let key = "fresh-\(index)"
+            let answered = expectation(description: "lookup answered")
+            cache.store(placeholder, recalculateFromImage: false, imageData: largeData, forKey: key, toDisk: true)
+            cache.diskImageExists(withKey: key) { exists in
+                XCTAssertTrue(exists, key)
+                answered.fulfill()
+            }
+            waitForExpectations(timeout: 10, handler: nil)
+        }
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    func testLookupLatencyWithShardedQueues() {
+        let operations = trace(onOneShard: false)
+        measure {
+            _ = self.replay(operations)
+        }
+    }
+
+    func testLookupLatencyWithOneSerialQueue() {
+        let operations = trace(onOneShard: true)
+        measure {
+            _ = self.replay(operations)
+        }
+    }
+
+    // lookups must not queue up behind large writes to other shards anymore
+    func testShardedLookupsBeatOneSerialQueue() {
+        let serial = replay(trace(onOneShard: true))
+        let sharded = replay(trace(onOneShard: false))
+        XCTAssertLessThan(percentile(sharded, 0.5), percentile(serial, 0.5))
+    }
+}
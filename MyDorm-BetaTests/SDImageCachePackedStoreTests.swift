@@ -0,0 +1,184 @@
+//
+//  SDImageCachePackedStoreTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import SDWebImage
+
+// Simulates the ways a crash can leave the packed store behind and checks that reopening it keeps every intact
+// record and reports the damaged ones as missing.
+class SDImageCachePackedStoreTests: XCTestCase {
+    // magic, length, key hash and checksum written in front of every record
+    let recordHeaderSize = 24
+
+    var directory: String!
+    var store: SDImageCachePackedStore!
+
+    override func setUp() {
+        super.setUp()
+        directory = (NSTemporaryDirectory() as NSString).appendingPathComponent(UUID().uuidString)
+        store = SDImageCachePackedStore(directory: directory)
+    }
+
+    override func tearDown() {
+        store = nil
+        try? FileManager.default.removeItem(atPath: directory)
+        super.tearDown()
+    }
+
+    private func payload(_ index: Int, length: Int = 1000) -> Data {
+        return Data(bytes: (0..<length).map { UInt8(truncatingBitPattern: $0 &* 31 &+ index) })
+    }
+
+    private func segmentPath(_ segmentID: Int) -> String {
+        return (directory as NSString).appendingPathComponent("segment.\(segmentID)")
+    }
+
+    private func reopen() {
+        store = nil
+        store = SDImageCachePackedStore(directory: directory)
+    }
+
+    private func truncateFile(_ path: String, toLength length: UInt64) {
+        let handle = FileHandle(forWritingAtPath: path)!
+        handle.truncateFile(atOffset: length)
+        handle.closeFile()
+    }
+
+    func testRoundTripSurvivesReopen() {
+        for index in 0..<50 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        reopen()
+        XCTAssertEqual(store.totalCount(), 50)
+        XCTAssertEqual(store.totalSize(), 50 * 1000)
+        for index in 0..<50 {
+            XCTAssertEqual(store.data(forKey: "key-\(index)"), payload(index))
+        }
+    }
+
+    func testTruncatedSegmentDropsOnlyTheCutRecords() {
+        for index in 0..<3 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        store = nil
+        // cut the last record in half, as if the app died while it was being written
+        let recordSize = UInt64(recordHeaderSize + 1000)
+        truncateFile(segmentPath(1), toLength: recordSize * 2 + recordSize / 2)
+
+        store = SDImageCachePackedStore(directory: directory)
+        XCTAssertEqual(store.totalCount(), 2)
+        XCTAssertEqual(store.data(forKey: "key-0"), payload(0))
+        XCTAssertEqual(store.data(forKey: "key-1"), payload(1))
+        XCTAssertFalse(store.containsData(forKey: "key-2"))
+        XCTAssertNil(store.data(forKey: "key-2"))
+    }
+
+    func testTruncationAtEveryRecordBoundary() {
+        let recordSize = UInt64(recordHeaderSize + 1000)
+        for cut in 0...5 {
+            store = nil
+            try? FileManager.default.removeItem(atPath: directory)
+            store = SDImageCachePackedStore(directory: directory)
+            for index in 0..<5 {
+                store.setData(payload(index), forKey: "key-\(index)")
+            }
+            store = nil
+            truncateFile(segmentPath(1), toLength: recordSize * UInt64(cut))
+
+            store = SDImageCachePackedStore(directory: directory)
+            XCTAssertEqual(store.totalCount(), UInt(cut))
+            for index in 0..<5 {
+                XCTAssertEqual(store.data(forKey: "key-\(index)"), index < cut ? payload(index) : nil)
+            }
+        }
+    }
+
+    func testTornRecordFailsItsChecksum() {
+        for index in 0..<3 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        store = nil
+        // same length on disk, but the tail of the middle record never made it
+        let handle = FileHandle(forWritingAtPath: segmentPath(1))!
+        handle.seek(toFileOffset: UInt64(recordHeaderSize + 1000 + recordHeaderSize + 900))
+        handle.write(Data(count: 100))
+        handle.closeFile()
+
+        store = SDImageCachePackedStore(directory: directory)
+        XCTAssertEqual(store.data(forKey: "key-0"), payload(0))
+        XCTAssertNil(store.data(forKey: "key-1"))
+        XCTAssertEqual(store.data(forKey: "key-2"), payload(2))
+        // the torn record is dropped from the index once it has been seen
+        XCTAssertEqual(store.totalCount(), 2)
+    }
+
+    func testMissingSegmentDropsItsRecords() {
+        store.maxSegmentSize = 4 * (recordHeaderSize + 1000)
+        for index in 0..<8 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        store = nil
+        try! FileManager.default.removeItem(atPath: segmentPath(1))
+
+        store = SDImageCachePackedStore(directory: directory)
+        XCTAssertEqual(store.totalCount(), 4)
+        for index in 0..<8 {
+            XCTAssertEqual(store.data(forKey: "key-\(index)"), index < 4 ? nil : payload(index))
+        }
+    }
+
+    func testCorruptIndexStartsOver() {
+        store.setData(payload(0), forKey: "key-0")
+        store = nil
+        let indexPath = (directory as NSString).appendingPathComponent("index")
+        try! Data(count: 64).write(to: URL(fileURLWithPath: indexPath))
+
+        store = SDImageCachePackedStore(directory: directory)
+        XCTAssertEqual(store.totalCount(), 0)
+        XCTAssertNil(store.data(forKey: "key-0"))
+        store.setData(payload(1), forKey: "key-1")
+        XCTAssertEqual(store.data(forKey: "key-1"), payload(1))
+    }
+
+    func testWritesAfterRecoveryAppendPastTheCut() {
+        for index in 0..<3 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        store = nil
+        let recordSize = UInt64(recordHeaderSize + 1000)
+        truncateFile(segmentPath(1), toLength: recordSize * 2 + 10)
+
+        store = SDImageCachePackedStore(directory: directory)
+        store.setData(payload(3), forKey: "key-3")
+        reopen()
+        XCTAssertEqual(store.totalCount(), 3)
+        XCTAssertEqual(store.data(forKey: "key-0"), payload(0))
+        XCTAssertEqual(store.data(forKey: "key-1"), payload(1))
+        XCTAssertNil(store.data(forKey: "key-2"))
+        XCTAssertEqual(store.data(forKey: "key-3"), payload(3))
+    }
+
+    func testCompactionKeepsLiveRecordsAndDeletesTheSegment() {
+        store.maxSegmentSize = 4 * (recordHeaderSize + 1000)
+        for index in 0..<8 {
+            store.setData(payload(index), forKey: "key-\(index)")
+        }
+        for index in 0..<3 {
+            store.removeData(forKey: "key-\(index)")
+        }
+        let compacted = expectation(description: "compacted")
+        store.compact {
+            compacted.fulfill()
+        }
+        waitForExpectations(timeout: 10, handler: nil)
+
+        XCTAssertFalse(FileManager.default.fileExists(atPath: segmentPath(1)))
+        reopen()
+        XCTAssertEqual(store.totalCount(), 5)
+        for index in 0..<8 {
+            XCTAssertEqual(store.data(forKey: "key-\(index)"), index < 3 ? nil : payload(index))
+        }
+    }
+}
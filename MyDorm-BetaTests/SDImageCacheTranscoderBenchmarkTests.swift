@@ -0,0 +1,168 @@
+//
+//  SDImageCacheTranscoderBenchmarkTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+import ImageIO
+import MobileCoreServices
+import SDWebImage
+
+// Stores PNG, JPEG, GIF and WebP downloads through SDImageCache three ways: encoding the image again, keeping the
+// downloaded bytes, and through the opt-in JPEG transcoder. Measures the CPU time of the stores and the bytes written.
+class SDImageCacheTranscoderBenchmarkTests: XCTestCase {
+    enum StoreMode {
+        case reencode, keepBytes, jpegTranscoder
+    }
+
+    struct Download {
+        let contentType: String
+        let data: Data
+        let image: UIImage
+    }
+
+    let iterations = 5
+    // 1x1 lossy WebP, ImageIO cannot write WebP, the header is what the cache looks at
+    let webPData = Data(base64Encoded: "UklGRiIAAABXRUJQVlA4IBYAAAAwAQCdASoBAAEADsD+JaQAA3AAAAAA")!
+
+    var directory: String!
+    var downloads = [Download]()
+
+    override func setUp() {
+        super.setUp()
+        directory = (NSTemporaryDirectory() as NSString).appendingPathComponent(UUID().uuidString)
+
+        let size = CGSize(width: 1024, height: 768)
+        UIGraphicsBeginImageContextWithOptions(size, true, 1)
+        let context = UIGraphicsGetCurrentContext()!
+        var generator = TraceGenerator(seed: 11)
+        for _ in 0..<100 {
+            UIColor(hue: CGFloat(generator.next(360)) / 360, saturation: 0.7, brightness: 0.9, alpha: 1).setFill()
+            context.fill(CGRect(x: generator.next(Int(size.width)), y: generator.next(Int(size.height)), width: 200, height: 150))
+        }
+        let image = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+
+        let gifData = NSMutableData()
+        let destination = CGImageDestinationCreateWithData(gifData as CFMutableData, kUTTypeGIF, 1, nil)!
+        CGImageDestinationAddImage(destination, image.cgImage!, nil)
+        CGImageDestinationFinalize(destination)
+
+        downloads = [
+            Download(contentType: "image/png", data: UIImagePNGRepresentation(image)!, image: image),
+            Download(contentType: "image/jpeg", data: UIImageJPEGRepresentation(image, 0.9)!, image: image),
+            Download(contentType: "image/gif", data: gifData as Data, image: image),
+            // stands in for a WebP decoded by the WebP coder, only its bytes reach the disk
+            Download(contentType: "image/webp", data: webPData, image: image)
+        ]
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(atPath: directory)
+        super.tearDown()
+    }
+
+    private func makeCache(_ mode: StoreMode) -> SDImageCache {
+        let cache = SDImageCache(namespace: "transcoder", diskCacheDirectory: directory)
+        cache.shouldCacheImagesInMemory = false
+        if mode == .jpegTranscoder {
+            cache.transcoder = SDImageCacheJPEGTranscoder()
+        }
+        return cache
+    }
+
+    private func waitForWrite(_ cache: SDImageCache, _ key: String) {
+        let written = expectation(description: "written")
+        // the lookup runs after the queued write for the key
+        cache.diskImageExists(withKey: key) { exists in
+            XCTAssertTrue(exists, key)
+            written.fulfill()
+        }
+        waitForExpectations(timeout: 10, handler: nil)
+    }
+
+    // CPU milliseconds spent storing the download, and the bytes that ended up on disk
+    private func store(_ download: Download, _ mode: StoreMode, _ cache: SDImageCache, key: String) -> (cpuMilliseconds: Double, bytes: Int) {
+        let start = clock()
+        cache.store(download.image, recalculateFromImage: mode == .reencode, imageData: download.data, forKey: key, toDisk: true)
+        waitForWrite(cache, key)
+        let cpuMilliseconds = Double(clock() - start) * 1000 / Double(CLOCKS_PER_SEC)
+        let attributes = try? FileManager.default.attributesOfItem(atPath: cache.defaultCachePath(forKey: key))
+        let bytes = (attributes?[.size] as? NSNumber)?.intValue ?? 0
+        return (cpuMilliseconds, bytes)
+    }
+
+    private func storeAll(_ mode: StoreMode) -> [String: (cpuMilliseconds: Double, bytes: Int)] {
+        let cache = makeCache(mode)
+        var results = [String: (cpuMilliseconds: Double, bytes: Int)]()
+        for download in downloads {
+            var cpu = [Double]()
+            var bytes = 0
+            for iteration in 0..<iterations {
+                let result = store(download, mode, cache, key: "\(download.contentType)-\(iteration)")
+                cpu.append(result.cpuMilliseconds)
+                bytes = result.bytes
+            }
+            results[download.contentType] = (percentile(cpu, 0.5), bytes)
+        }
+        cache.clearDisk()
+        return results
+    }
+
+    func testContentTypesAreSniffedFromMagicNumbers() {
+        for download in downloads {
+            XCTAssertEqual(NSData.sd_contentType(forImageData: download.data), download.contentType)
+        }
+        // a lone first byte is no longer enough
+        XCTAssertNil(NSData.sd_contentType(forImageData: Data(bytes: [0xFF, 0x00, 0x00, 0x00])))
+        XCTAssertNil(NSData.sd_contentType(forImageData: Data(bytes: Array("RIFF0000WAVE".utf8))))
+    }
+
+    func testKeptBytesAreWrittenUnchanged() {
+        let results = storeAll(.keepBytes)
+        for download in downloads {
+            XCTAssertEqual(results[download.contentType]!.bytes, download.data.count, download.contentType)
+        }
+    }
+
+    func testJPEGTranscoderNeverWritesMoreThanTheDownload() {
+        let results = storeAll(.jpegTranscoder)
+        for download in downloads {
+            XCTAssertLessThanOrEqual(results[download.contentType]!.bytes, download.data.count, download.contentType)
+        }
+        // an opaque PNG photo is worth turning into a JPEG
+        XCTAssertLessThan(results["image/png"]!.bytes, downloads[0].data.count)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    func testStoreReencoding() {
+        measure {
+            _ = self.storeAll(.reencode)
+        }
+    }
+
+    func testStoreKeepingDownloadedBytes() {
+        measure {
+            _ = self.storeAll(.keepBytes)
+        }
+    }
+
+    func testStoreWithJPEGTranscoder() {
+        measure {
+            _ = self.storeAll(.jpegTranscoder)
+        }
+    }
+
+    // keeping the bytes has to cost less CPU than encoding again for every format
+    func testKeepingBytesBeatsReencoding() {
+        let reencoded = storeAll(.reencode)
+        let kept = storeAll(.keepBytes)
+        for download in downloads {
+            XCTAssertLessThan(kept[download.contentType]!.cpuMilliseconds, reencoded[download.contentType]!.cpuMilliseconds, download.contentType)
+        }
+    }
+}
@@ -0,0 +1,128 @@
+//
+//  SDWebImageDecodeBenchmarkTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+import SDWebImage
+
+// Compares what the downloader used to do for a thumbnail, a full size decode followed by a second decode at the
+// target size, with the single downsampled decode it does now, and checks how the cache keeps downsampled images.
+class SDWebImageDecodeBenchmarkTests: XCTestCase {
+    let sourcePixelSize = CGSize(width: 4000, height: 3000)
+    let targetPixelSize = CGSize(width: 300, height: 300)
+    let iterations = 10
+
+    var jpegData: Data!
+
+    override func setUp() {
+        super.setUp()
+        UIGraphicsBeginImageContextWithOptions(sourcePixelSize, true, 1)
+        let context = UIGraphicsGetCurrentContext()!
+        var generator = TraceGenerator(seed: 7)
+        for _ in 0..<200 {
+            UIColor(hue: CGFloat(generator.next(360)) / 360, saturation: 0.8, brightness: 0.9, alpha: 1).setFill()
+            context.fill(CGRect(x: generator.next(Int(sourcePixelSize.width)), y: generator.next(Int(sourcePixelSize.height)), width: 400, height: 300))
+        }
+        let image = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+        jpegData = UIImageJPEGRepresentation(image, 0.8)
+    }
+
+    private func bitmapBytes(_ image: UIImage) -> Int {
+        guard let cgImage = image.cgImage else {
+            return 0
+        }
+        return cgImage.bytesPerRow * cgImage.height
+    }
+
+    private func measureDecode(_ decode: () -> UIImage?) -> (milliseconds: Double, bytes: Int) {
+        var durations = [Double]()
+        var bytes = 0
+        for _ in 0..<iterations {
+            autoreleasepool {
+                let start = CFAbsoluteTimeGetCurrent()
+                let image = decode()
+                durations.append((CFAbsoluteTimeGetCurrent() - start) * 1000)
+                bytes = image.map(bitmapBytes) ?? 0
+            }
+        }
+        return (percentile(durations, 0.5), bytes)
+    }
+
+    private func fullDecodeThenDownsample() -> UIImage? {
+        let fullSize = UIImage.decodedImage(with: UIImage.sd_image(with: jpegData))
+        XCTAssertEqual(fullSize?.cgImage?.width, Int(sourcePixelSize.width))
+        return UIImage.decodedImage(with: jpegData, scale: 1, targetPixelSize: targetPixelSize)
+    }
+
+    private func downsampledDecode() -> UIImage? {
+        return UIImage.decodedImage(with: jpegData, scale: 1, targetPixelSize: targetPixelSize)
+    }
+
+    func testFullDecodeThenDownsample() {
+        measure {
+            autoreleasepool {
+                _ = self.fullDecodeThenDownsample()
+            }
+        }
+    }
+
+    func testSingleDownsampledDecode() {
+        measure {
+            autoreleasepool {
+                _ = self.downsampledDecode()
+            }
+        }
+    }
+
+    // the single decode has to stay faster than the two step one and keep only the small bitmap
+    func testSingleDecodeBeatsFullDecodeThenDownsample() {
+        let full = measureDecode { fullDecodeThenDownsample() }
+        let single = measureDecode { downsampledDecode() }
+        // aspect fill of 300x300 from 4:3 is 400x300
+        XCTAssertLessThanOrEqual(single.bytes, 400 * 4 * 300 * 2)
+        XCTAssertEqual(single.bytes, full.bytes)
+        XCTAssertLessThan(single.bytes, Int(sourcePixelSize.width * sourcePixelSize.height) * 4)
+        XCTAssertLessThan(single.milliseconds, full.milliseconds)
+    }
+
+    private func query(_ cache: SDImageCache, _ key: String, targetPixelSize: CGSize) -> UIImage? {
+        var found: UIImage?
+        let done = expectation(description: "query answered")
+        _ = cache.queryDiskCache(forKey: key, targetPixelSize: targetPixelSize) { (image, _) in
+            found = image
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 10, handler: nil)
+        return found
+    }
+
+    func testRemovingAKeyDropsItsDownsampledImages() {
+        let cache = SDImageCache(namespace: UUID().uuidString)
+        let image = downsampledDecode()!
+        let otherSize = CGSize(width: 100, height: 100)
+        cache.store(image, recalculateFromImage: false, imageData: jpegData, forKey: "photo", targetPixelSize: targetPixelSize, toDisk: false)
+        cache.store(image, recalculateFromImage: false, imageData: jpegData, forKey: "photo", targetPixelSize: otherSize, toDisk: false)
+        XCTAssertNotNil(query(cache, "photo", targetPixelSize: targetPixelSize))
+
+        cache.removeImage(forKey: "photo", fromDisk: false)
+        XCTAssertNil(query(cache, "photo", targetPixelSize: targetPixelSize))
+        XCTAssertNil(query(cache, "photo", targetPixelSize: otherSize))
+    }
+
+    // a downsampled decode from disk takes its scale from the key, like the full size decode does
+    func testDownsampledDiskImagesTakeTheScaleOfTheKey() {
+        let cache = SDImageCache(namespace: UUID().uuidString)
+        defer {
+            cache.clearDisk()
+        }
+        cache.storeImageData(toDisk: jpegData, forKey: "https://example.com/photo@2x.jpg")
+        cache.storeImageData(toDisk: jpegData, forKey: "https://example.com/photo.jpg")
+        XCTAssertEqual(query(cache, "https://example.com/photo@2x.jpg", targetPixelSize: targetPixelSize)?.scale, 2)
+        XCTAssertEqual(query(cache, "https://example.com/photo@2x.jpg", targetPixelSize: .zero)?.scale, 2)
+        XCTAssertEqual(query(cache, "https://example.com/photo.jpg", targetPixelSize: targetPixelSize)?.scale, 1)
+        XCTAssertEqual(query(cache, "https://example.com/photo.jpg", targetPixelSize: .zero)?.scale, 1)
+    }
+}
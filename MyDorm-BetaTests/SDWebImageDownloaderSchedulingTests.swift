@@ -0,0 +1,253 @@
+//
+//  SDWebImageDownloaderSchedulingTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import SDWebImage
+
+// Holds every gated:// request open until the test finishes it, so tests decide when a download slot frees up.
+// Records the order requests started in, how many ran at once and which were stopped.
+class GatedImageURLProtocol: URLProtocol {
+    private static let lock = NSLock()
+    private static var open = [String: GatedImageURLProtocol]()
+    private static var started = [String]()
+    private static var stopped = [String]()
+    private static var maxRunning = 0
+
+    static func reset() {
+        lock.lock()
+        open = [:]
+        started = []
+        stopped = []
+        maxRunning = 0
+        lock.unlock()
+    }
+
+    static var startedPaths: [String] {
+        lock.lock()
+        defer { lock.unlock() }
+        return started
+    }
+
+    static var stoppedPaths: [String] {
+        lock.lock()
+        defer { lock.unlock() }
+        return stopped
+    }
+
+    static var maxRunningCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return maxRunning
+    }
+
+    // Answers the open request for the path with a small PNG
+    static func finish(_ path: String) {
+        lock.lock()
+        let request = open.removeValue(forKey: path)
+        lock.unlock()
+        request?.respond()
+    }
+
+    override class func canInit(with request: URLRequest) -> Bool {
+        return request.url?.scheme == "gated"
+    }
+
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+        return request
+    }
+
+    private var path: String {
+        return request.url!.path
+    }
+
+    override func startLoading() {
+        GatedImageURLProtocol.lock.lock()
+        GatedImageURLProtocol.open[path] = self
+        GatedImageURLProtocol.started.append(path)
+        GatedImageURLProtocol.maxRunning = max(GatedImageURLProtocol.maxRunning, GatedImageURLProtocol.open.count)
+        GatedImageURLProtocol.lock.unlock()
+    }
+
+    override func stopLoading() {
+        GatedImageURLProtocol.lock.lock()
+        if GatedImageURLProtocol.open.removeValue(forKey: path) != nil {
+            GatedImageURLProtocol.stopped.append(path)
+        }
+        GatedImageURLProtocol.lock.unlock()
+    }
+
+    private func respond() {
+        let body = ChunkedImageURLProtocol.body
+        let response = HTTPURLResponse(url: request.url!, statusCode: 200, httpVersion: "HTTP/1.1", headerFields: ["Content-Length": "\(body.count)"])!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        client?.urlProtocol(self, didLoad: body)
+        client?.urlProtocolDidFinishLoading(self)
+    }
+}
+
+// Drives SDWebImageDownloader against the gated stub: start order by priority and execution order, the
+// concurrency limit, and requests for one URL sharing a download until the last of them is cancelled
+class SDWebImageDownloaderSchedulingTests: XCTestCase {
+    var downloader: SDWebImageDownloader!
+
+    override func setUp() {
+        super.setUp()
+        GatedImageURLProtocol.reset()
+        URLProtocol.registerClass(GatedImageURLProtocol.self)
+        // created after the protocol is registered so its session configuration picks it up
+        downloader = SDWebImageDownloader()
+        downloader.shouldDecompressImages = false
+    }
+
+    override func tearDown() {
+        downloader.cancelAllDownloads()
+        downloader = nil
+        URLProtocol.unregisterClass(GatedImageURLProtocol.self)
+        super.tearDown()
+    }
+
+    private func waitUntil(_ description: String, _ condition: () -> Bool) {
+        let deadline = Date(timeIntervalSinceNow: 10)
+        while !condition() && Date() < deadline {
+            RunLoop.current.run(until: Date(timeIntervalSinceNow: 0.01))
+        }
+        XCTAssertTrue(condition(), description)
+    }
+
+    // gives the downloader the chance to start more than it should
+    private func settle() {
+        RunLoop.current.run(until: Date(timeIntervalSinceNow: 0.2))
+    }
+
+    // Without a priority the downloader picks one from the options
+    @discardableResult
+    private func download(_ path: String, priority: SDWebImageDownloaderPriority? = nil, options: SDWebImageDownloaderOptions = [], completed: SDWebImageDownloaderCompletedBlock? = nil) -> SDWebImageDownloadToken {
+        let url = URL(string: "gated://images\(path)")
+        let completedBlock: SDWebImageDownloaderCompletedBlock = { image, data, error, finished in
+            completed?(image, data, error, finished)
+        }
+        if let priority = priority {
+            return downloader.downloadImage(with: url, options: options, priority: priority, progress: nil, completed: completedBlock)
+        }
+        return downloader.downloadImage(with: url, options: options, progress: nil, completed: completedBlock) as! SDWebImageDownloadToken
+    }
+
+    // Queues the downloads while suspended, then lets them through one at a time
+    private func startOrder(_ executionOrder: SDWebImageDownloaderExecutionOrder) -> [String] {
+        downloader.maxConcurrentDownloads = 1
+        downloader.executionOrder = executionOrder
+        downloader.setSuspended(true)
+        download("/background", priority: .background)
+        download("/prefetch", priority: .prefetch)
+        download("/visible-1")
+        download("/urgent", options: .highPriority)
+        download("/visible-2")
+        download("/prefetch-option", options: .lowPriority)
+        downloader.setSuspended(false)
+
+        for count in 1...6 {
+            waitUntil("download \(count) started") { GatedImageURLProtocol.startedPaths.count == count }
+            GatedImageURLProtocol.finish(GatedImageURLProtocol.startedPaths[count - 1])
+        }
+        return GatedImageURLProtocol.startedPaths
+    }
+
+    func testDownloadsStartByPriorityInFIFOOrder() {
+        XCTAssertEqual(startOrder(.fifoExecutionOrder), ["/urgent", "/visible-1", "/visible-2", "/prefetch", "/prefetch-option", "/background"])
+    }
+
+    func testDownloadsStartByPriorityInLIFOOrder() {
+        XCTAssertEqual(startOrder(.lifoExecutionOrder), ["/urgent", "/visible-2", "/visible-1", "/prefetch-option", "/prefetch", "/background"])
+    }
+
+    func testRaisingATokenPriorityMovesItsDownloadAhead() {
+        downloader.maxConcurrentDownloads = 1
+        downloader.setSuspended(true)
+        download("/visible")
+        let token = download("/background", priority: .background)
+        token.priority = .visible
+        let raised = download("/raised-later", priority: .prefetch)
+        raised.priority = .visible
+        downloader.setSuspended(false)
+
+        for count in 1...3 {
+            waitUntil("download \(count) started") { GatedImageURLProtocol.startedPaths.count == count }
+            GatedImageURLProtocol.finish(GatedImageURLProtocol.startedPaths[count - 1])
+        }
+        XCTAssertEqual(GatedImageURLProtocol.startedPaths, ["/visible", "/background", "/raised-later"])
+    }
+
+    func testNoMoreThanMaxConcurrentDownloadsRun() {
+        downloader.maxConcurrentDownloads = 3
+        for index in 0..<10 {
+            download("/\(index)")
+        }
+        var finished = 0
+        while finished < 10 {
+            waitUntil("next downloads started") { GatedImageURLProtocol.startedPaths.count == min(10, finished + 3) }
+            settle()
+            XCTAssertEqual(GatedImageURLProtocol.startedPaths.count, min(10, finished + 3))
+            GatedImageURLProtocol.finish(GatedImageURLProtocol.startedPaths[finished])
+            finished += 1
+        }
+        XCTAssertEqual(GatedImageURLProtocol.maxRunningCount, 3)
+        waitUntil("all downloads done") { self.downloader.currentDownloadCount == 0 }
+    }
+
+    func testCancellingOneTokenKeepsTheSharedDownload() {
+        var cancelledCompletions = 0
+        let delivered = expectation(description: "remaining token completed")
+        let cancelled = download("/shared") { _, _, _, _ in
+            cancelledCompletions += 1
+        }
+        download("/shared") { image, _, error, finished in
+            XCTAssertNotNil(image)
+            XCTAssertNil(error)
+            XCTAssertTrue(finished)
+            delivered.fulfill()
+        }
+        waitUntil("shared download started") { GatedImageURLProtocol.startedPaths == ["/shared"] }
+
+        cancelled.cancel()
+        settle()
+        XCTAssertEqual(GatedImageURLProtocol.stoppedPaths, [])
+
+        GatedImageURLProtocol.finish("/shared")
+        waitForExpectations(timeout: 10, handler: nil)
+        XCTAssertEqual(cancelledCompletions, 0)
+        XCTAssertEqual(GatedImageURLProtocol.startedPaths, ["/shared"])
+    }
+
+    func testCancellingTheLastTokenCancelsTheDownload() {
+        var completions = 0
+        let first = download("/shared") { _, _, _, _ in
+            completions += 1
+        }
+        let second = download("/shared") { _, _, _, _ in
+            completions += 1
+        }
+        waitUntil("shared download started") { GatedImageURLProtocol.startedPaths == ["/shared"] }
+
+        first.cancel()
+        second.cancel()
+        waitUntil("shared download stopped") { GatedImageURLProtocol.stoppedPaths == ["/shared"] }
+        waitUntil("slot given back") { self.downloader.currentDownloadCount == 0 }
+        settle()
+        XCTAssertEqual(completions, 0)
+    }
+
+    func testCancellingAWaitingDownloadNeverStartsIt() {
+        downloader.maxConcurrentDownloads = 1
+        download("/running")
+        let waiting = download("/waiting")
+        download("/next")
+        waitUntil("first download started") { GatedImageURLProtocol.startedPaths == ["/running"] }
+
+        waiting.cancel()
+        GatedImageURLProtocol.finish("/running")
+        waitUntil("next download started") { GatedImageURLProtocol.startedPaths.count == 2 }
+        XCTAssertEqual(GatedImageURLProtocol.startedPaths, ["/running", "/next"])
+    }
+}
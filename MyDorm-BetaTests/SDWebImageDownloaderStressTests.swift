@@ -0,0 +1,116 @@
+//
+//  SDWebImageDownloaderStressTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+import SDWebImage
+
+// Serves every stub:// request from memory, in many small chunks so each download makes the session call
+// didReceiveData: over and over
+class ChunkedImageURLProtocol: URLProtocol {
+    static let chunkCount = 64
+    static let chunkSize = 256
+    static var body: Data = {
+        UIGraphicsBeginImageContextWithOptions(CGSize(width: 4, height: 4), true, 1)
+        let image = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+        var data = UIImagePNGRepresentation(image)!
+        // trailing bytes are ignored by the PNG decoder
+        data.append(Data(count: max(0, chunkCount * chunkSize - data.count)))
+        return data
+    }()
+
+    override class func canInit(with request: URLRequest) -> Bool {
+        return request.url?.scheme == "stub"
+    }
+
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+        return request
+    }
+
+    override func startLoading() {
+        let body = ChunkedImageURLProtocol.body
+        let response = HTTPURLResponse(url: request.url!, statusCode: 200, httpVersion: "HTTP/1.1", headerFields: ["Content-Length": "\(body.count)"])!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        var offset = 0
+        while offset < body.count {
+            let end = min(offset + ChunkedImageURLProtocol.chunkSize, body.count)
+            client?.urlProtocol(self, didLoad: body.subdata(in: offset..<end))
+            offset = end
+        }
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {
+    }
+}
+
+// Queues up to a thousand downloads at once and measures what each session delegate call costs the downloader
+class SDWebImageDownloaderStressTests: XCTestCase {
+    let downloadCount = 1000
+
+    override func setUp() {
+        super.setUp()
+        URLProtocol.registerClass(ChunkedImageURLProtocol.self)
+    }
+
+    override func tearDown() {
+        URLProtocol.unregisterClass(ChunkedImageURLProtocol.self)
+        super.tearDown()
+    }
+
+    // Microseconds per delegate call for downloading count images queued all at once
+    private func delegateCallCost(downloadCount count: Int) -> Double {
+        // created after the protocol is registered so its session configuration picks it up
+        let downloader = SDWebImageDownloader()
+        downloader.maxConcurrentDownloads = 32
+        downloader.shouldDecompressImages = false
+
+        let group = DispatchGroup()
+        var failures = 0
+        let start = CFAbsoluteTimeGetCurrent()
+        for index in 0..<count {
+            group.enter()
+            _ = downloader.downloadImage(with: URL(string: "stub://images/\(index)"), options: [], progress: nil) { image, data, error, finished in
+                if finished {
+                    if error != nil {
+                        failures += 1
+                    }
+                    group.leave()
+                }
+            }
+        }
+        let finished = expectation(description: "all downloads finished")
+        group.notify(queue: .main) {
+            finished.fulfill()
+        }
+        waitForExpectations(timeout: 120, handler: nil)
+        let elapsed = CFAbsoluteTimeGetCurrent() - start
+
+        XCTAssertEqual(failures, 0)
+        XCTAssertEqual(downloader.currentDownloadCount, 0)
+        // a response, the chunks and the completion per download
+        let delegateCalls = count * (ChunkedImageURLProtocol.chunkCount + 2)
+        return elapsed * 1_000_000 / Double(delegateCalls)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    func testDelegateDispatchCostWithThousandQueuedDownloads() {
+        measure {
+            _ = self.delegateCallCost(downloadCount: self.downloadCount)
+        }
+    }
+
+    // Finding the operation for a task must not get slower as more downloads are queued. Scanning the operation
+    // queue made a call ten times more expensive with ten times the downloads.
+    func testDelegateDispatchCostDoesNotGrowWithQueuedDownloads() {
+        let few = delegateCallCost(downloadCount: downloadCount / 10)
+        let many = delegateCallCost(downloadCount: downloadCount)
+        XCTAssertLessThan(many, few * 3)
+    }
+}
@@ -0,0 +1,206 @@
+//
+//  SDWebImageProgressiveDecoderTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import UIKit
+import ImageIO
+import MobileCoreServices
+import SDWebImage
+
+// Serves drip:// requests in 1KB chunks with a short pause between them, like a slow connection
+class DripImageURLProtocol: URLProtocol {
+    static let chunkSize = 1024
+    static var body = Data()
+
+    override class func canInit(with request: URLRequest) -> Bool {
+        return request.url?.scheme == "drip"
+    }
+
+    override class func canonicalRequest(for request: URLRequest) -> URLRequest {
+        return request
+    }
+
+    override func startLoading() {
+        let body = DripImageURLProtocol.body
+        let response = HTTPURLResponse(url: request.url!, statusCode: 200, httpVersion: "HTTP/1.1", headerFields: ["Content-Length": "\(body.count)"])!
+        client?.urlProtocol(self, didReceive: response, cacheStoragePolicy: .notAllowed)
+        var offset = 0
+        while offset < body.count {
+            let end = min(offset + DripImageURLProtocol.chunkSize, body.count)
+            client?.urlProtocol(self, didLoad: body.subdata(in: offset..<end))
+            offset = end
+            usleep(500)
+        }
+        client?.urlProtocolDidFinishLoading(self)
+    }
+
+    override func stopLoading() {
+    }
+}
+
+// Feeds baseline and progressive JPEGs to SDWebImageProgressiveDecoder in 1 byte and 1KB chunks and checks that
+// progressive JPEGs only render when a scan completes
+class SDWebImageProgressiveDecoderTests: XCTestCase {
+    var baselineData: Data!
+    var progressiveData: Data!
+
+    override func setUp() {
+        super.setUp()
+        let size = CGSize(width: 320, height: 240)
+        UIGraphicsBeginImageContextWithOptions(size, true, 1)
+        let context = UIGraphicsGetCurrentContext()!
+        var generator = TraceGenerator(seed: 13)
+        for _ in 0..<60 {
+            UIColor(hue: CGFloat(generator.next(360)) / 360, saturation: 0.8, brightness: 0.9, alpha: 1).setFill()
+            context.fillEllipse(in: CGRect(x: generator.next(Int(size.width)), y: generator.next(Int(size.height)), width: 80, height: 60))
+        }
+        let image = UIGraphicsGetImageFromCurrentImageContext()!
+        UIGraphicsEndImageContext()
+
+        baselineData = UIImageJPEGRepresentation(image, 0.8)
+        let progressive = NSMutableData()
+        let destination = CGImageDestinationCreateWithData(progressive as CFMutableData, kUTTypeJPEG, 1, nil)!
+        let properties: [String: Any] = [
+            kCGImageDestinationLossyCompressionQuality as String: 0.8,
+            kCGImagePropertyJFIFDictionary as String: [kCGImagePropertyJFIFIsProgressive as String: true]
+        ]
+        CGImageDestinationAddImage(destination, image.cgImage!, properties as CFDictionary)
+        CGImageDestinationFinalize(destination)
+        progressiveData = progressive as Data
+    }
+
+    // Start of scan markers in the file. Entropy coded data escapes 0xFF, so FF DA only ever starts a scan
+    private func scanCount(_ data: Data) -> Int {
+        var count = 0
+        for i in 0..<(data.count - 1) where data[i] == 0xFF && data[i + 1] == 0xDA {
+            count += 1
+        }
+        return count
+    }
+
+    // Feeds growing prefixes of the data without copying it. Returns the scan count at every render.
+    private func feed(_ data: Data, chunkSize: Int, decoder: SDWebImageProgressiveDecoder) -> [Int] {
+        var scansAtRenders = [Int]()
+        data.withUnsafeBytes { (bytes: UnsafePointer<UInt8>) in
+            var length = 0
+            while length < data.count {
+                length = min(length + chunkSize, data.count)
+                let prefix = NSData(bytesNoCopy: UnsafeMutableRawPointer(mutating: bytes), length: length, freeWhenDone: false)
+                if decoder.copyPartialImage(with: prefix as Data) != nil {
+                    scansAtRenders.append(Int(decoder.completedScanCount))
+                }
+            }
+        }
+        return scansAtRenders
+    }
+
+    private func unthrottledDecoder() -> SDWebImageProgressiveDecoder {
+        let decoder = SDWebImageProgressiveDecoder()
+        decoder.minimumBytesBetweenRenders = 0
+        decoder.minimumIntervalBetweenRenders = 0
+        return decoder
+    }
+
+    private func assertRendersFollowScans(chunkSize: Int) {
+        let scans = scanCount(progressiveData)
+        XCTAssertGreaterThan(scans, 1, "ImageIO wrote a baseline JPEG")
+
+        let decoder = unthrottledDecoder()
+        let scansAtRenders = feed(progressiveData, chunkSize: chunkSize, decoder: decoder)
+        XCTAssertEqual(Int(decoder.completedScanCount), scans)
+        XCTAssertFalse(scansAtRenders.isEmpty)
+        // every render shows at least one more complete scan than the one before
+        XCTAssertEqual(scansAtRenders, Array(Set(scansAtRenders)).sorted())
+        XCTAssertGreaterThan(scansAtRenders.first ?? 0, 0)
+        XCTAssertLessThanOrEqual(scansAtRenders.count, scans)
+    }
+
+    func testProgressiveJPEGRendersOncePerScanInOneByteChunks() {
+        assertRendersFollowScans(chunkSize: 1)
+    }
+
+    func testProgressiveJPEGRendersOncePerScanInOneKilobyteChunks() {
+        assertRendersFollowScans(chunkSize: 1024)
+    }
+
+    private func assertBaselineRendersByBytes(chunkSize: Int) {
+        XCTAssertEqual(scanCount(baselineData), 1)
+        let decoder = unthrottledDecoder()
+        decoder.minimumBytesBetweenRenders = 1024
+        let renders = feed(baselineData, chunkSize: chunkSize, decoder: decoder).count
+        // a baseline JPEG has a single scan, it renders as bytes arrive instead of waiting for it
+        XCTAssertEqual(decoder.completedScanCount, 1)
+        XCTAssertGreaterThan(renders, 1)
+        XCTAssertLessThanOrEqual(renders, baselineData.count / 1024 + 1)
+    }
+
+    func testBaselineJPEGRendersByBytesInOneByteChunks() {
+        assertBaselineRendersByBytes(chunkSize: 1)
+    }
+
+    func testBaselineJPEGRendersByBytesInOneKilobyteChunks() {
+        assertBaselineRendersByBytes(chunkSize: 1024)
+    }
+
+    func testThrottlingHoldsBackRenders() {
+        let decoder = SDWebImageProgressiveDecoder()
+        decoder.minimumBytesBetweenRenders = 0
+        decoder.minimumIntervalBetweenRenders = 60
+        XCTAssertEqual(feed(baselineData, chunkSize: 1024, decoder: decoder).count, 1)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    private func dripDownload(_ body: Data, options: SDWebImageDownloaderOptions) {
+        DripImageURLProtocol.body = body
+        URLProtocol.registerClass(DripImageURLProtocol.self)
+        defer {
+            URLProtocol.unregisterClass(DripImageURLProtocol.self)
+        }
+        // created after the protocol is registered so its session configuration picks it up
+        let downloader = SDWebImageDownloader()
+        downloader.shouldDecompressImages = false
+        let done = expectation(description: "downloaded")
+        _ = downloader.downloadImage(with: URL(string: "drip://images/photo.jpg"), options: options, progress: nil) { image, _, error, finished in
+            if finished {
+                XCTAssertNotNil(image)
+                XCTAssertNil(error)
+                done.fulfill()
+            }
+        }
+        waitForExpectations(timeout: 60, handler: nil)
+    }
+
+    func testProgressiveDownloadOfProgressiveJPEG() {
+        measure {
+            self.dripDownload(self.progressiveData, options: .progressiveDownload)
+        }
+    }
+
+    func testProgressiveDownloadOfBaselineJPEG() {
+        measure {
+            self.dripDownload(self.baselineData, options: .progressiveDownload)
+        }
+    }
+
+    func testPlainDownloadOfProgressiveJPEG() {
+        measure {
+            self.dripDownload(self.progressiveData, options: [])
+        }
+    }
+
+    // partial renders must cost a bounded share of the CPU, not grow with every chunk received
+    func testProgressiveDownloadCPU() {
+        var start = clock()
+        dripDownload(progressiveData, options: [])
+        let plain = clock() - start
+        start = clock()
+        dripDownload(progressiveData, options: .progressiveDownload)
+        let progressive = clock() - start
+        XCTAssertLessThan(Double(progressive), Double(plain) * 4)
+    }
+}
@@ -0,0 +1,190 @@
+//
+//  SearchIndexTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+@testable import MyDorm_Beta
+
+class SearchIndexTests: XCTestCase {
+    let names = ["Desk", "Desk Lamp", "Standing Desk", "Lamp", "Floor Lamp", "Café Table", "Mini Fridge", "Bookshelf", "Bedside Table", "TV Stand"]
+
+    func testMatchesAreRankedByWhereTheyStart() {
+        let index = SearchIndex(items: names) { $0 }
+        // the name starts with it, then a word does, then it is inside a word
+        XCTAssertEqual(index.search("desk"), ["Desk", "Desk Lamp", "Standing Desk"])
+        XCTAssertEqual(index.search("amp"), ["Lamp", "Desk Lamp", "Floor Lamp"])
+        XCTAssertEqual(index.search(""), names)
+    }
+
+    func testShortQueriesOnlyMatchWordStarts() {
+        let index = SearchIndex(items: names) { $0 }
+        XCTAssertEqual(index.search("t"), ["TV Stand", "Café Table", "Bedside Table"])
+        XCTAssertTrue(index.search("sk").isEmpty)
+    }
+
+    func testCaseAndAccentsAreIgnored() {
+        let index = SearchIndex(items: names) { $0 }
+        XCTAssertEqual(index.search("CAFE"), ["Café Table"])
+        XCTAssertEqual(index.search("café"), ["Café Table"])
+    }
+
+    func testTyposMatchAfterExactResults() {
+        let index = SearchIndex(items: names) { $0 }
+        XCTAssertEqual(index.search("fridg"), ["Mini Fridge"])
+        XCTAssertEqual(index.search("frdge"), ["Mini Fridge"])
+        XCTAssertEqual(index.search("bookshlef"), ["Bookshelf"])
+        XCTAssertTrue(index.search("xylophone").isEmpty)
+    }
+
+    // every name holding the query comes back, ahead of anything matched by typo
+    func testExactMatchesAgreeWithAFullScan() {
+        var generator = TraceGenerator(seed: 17)
+        let letters = Array("abcdeilnorst ")
+        var items = [String]()
+        for _ in 0..<2000 {
+            items.append(String((0..<(3 + generator.next(12))).map { _ in letters[generator.next(letters.count)] }))
+        }
+        let index = SearchIndex(items: items) { $0 }
+        for _ in 0..<200 {
+            let query = String((0..<(3 + generator.next(3))).map { _ in letters[generator.next(letters.count - 1)] })
+            let results = index.search(query)
+            let exactCount = results.index { !$0.contains(query) } ?? results.count
+            XCTAssertEqual(Set(results.prefix(exactCount)), Set(items.enumerated().filter { $0.element.contains(query) }.map { $0.element }), query)
+            XCTAssertFalse(results.dropFirst(exactCount).contains { $0.contains(query) }, query)
+        }
+    }
+
+    func testSessionDeliversOnlyTheNewestSearch() {
+        let session = SearchSession<String>()
+        session.setItems(names) { $0 }
+        var delivered = [[String]]()
+        let done = expectation(description: "newest search delivered")
+        for query in ["l", "la", "lam"] {
+            session.search(query) { (results) in
+                delivered.append(results)
+            }
+        }
+        session.search("lamp") { (results) in
+            delivered.append(results)
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        drainMainQueue()
+        XCTAssertEqual(delivered.last ?? [], ["Lamp", "Desk Lamp", "Floor Lamp"])
+        XCTAssertEqual(delivered.count, 1)
+    }
+
+    // what ObjectListVC relies on when objects change while the user is searching
+    func testSearchAfterNewItemsSeesThem() {
+        let session = SearchSession<String>()
+        session.setItems(names) { $0 }
+        session.setItems(names + ["Lava Lamp"]) { $0 }
+        var results = [String]()
+        let done = expectation(description: "searched")
+        session.search("lamp") {
+            results = $0
+            done.fulfill()
+        }
+        waitForExpectations(timeout: 5, handler: nil)
+        XCTAssertEqual(results, ["Lamp", "Desk Lamp", "Lava Lamp", "Floor Lamp"])
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let benchmarkWords = ["Desk", "Lamp", "Table", "Chair", "Fridge", "Mini", "Floor", "Standing", "Bedside", "Shelf", "Book", "Café", "Rug", "Mirror", "Dresser", "Futon", "Storage", "Bin", "Cart", "Stool"]
+
+    private func benchmarkItems() -> [String] {
+        var generator = TraceGenerator(seed: 18)
+        return (0..<50_000).map { index in
+            let words = (0..<(1 + generator.next(3))).map { _ in benchmarkWords[generator.next(benchmarkWords.count)] }
+            return words.joined(separator: " ") + " \(index)"
+        }
+    }
+
+    // Each query typed a letter at a time, the way the search bar sends them
+    private func keystrokes() -> [String] {
+        var typed = [String]()
+        for word in ["desk", "lamp", "bedside table", "fridg", "frdge", "cafe", "stora"] {
+            for length in 1...word.characters.count {
+                typed.append(String(word.characters.prefix(length)))
+            }
+        }
+        return typed
+    }
+
+    // Milliseconds per keystroke
+    private func latencies(_ search: (String) -> [String]) -> [Double] {
+        return keystrokes().map { query in
+            let start = CFAbsoluteTimeGetCurrent()
+            _ = search(query)
+            return (CFAbsoluteTimeGetCurrent() - start) * 1000
+        }
+    }
+
+    // what ObjectListVC did on every keystroke before the index
+    private func scan(_ items: [String], _ query: String) -> [String] {
+        let lowered = query.lowercased()
+        return items.filter { $0.lowercased().contains(lowered) }
+    }
+
+    // Milliseconds from each keystroke to its results on main, waiting for one before typing the next
+    private func sessionLatencies(_ items: [String]) -> [Double] {
+        let session = SearchSession<String>()
+        session.setItems(items) { $0 }
+        // the first search waits for the index to be built
+        let built = expectation(description: "index built")
+        session.search("") { _ in built.fulfill() }
+        waitForExpectations(timeout: 30, handler: nil)
+
+        return keystrokes().map { query in
+            let delivered = expectation(description: query)
+            let start = CFAbsoluteTimeGetCurrent()
+            var end = start
+            session.search(query) { _ in
+                end = CFAbsoluteTimeGetCurrent()
+                delivered.fulfill()
+            }
+            waitForExpectations(timeout: 10, handler: nil)
+            return (end - start) * 1000
+        }
+    }
+
+    func testIndexedKeystrokeLatency() {
+        let index = SearchIndex(items: benchmarkItems()) { $0 }
+        measure {
+            _ = self.latencies { index.search($0) }
+        }
+    }
+
+    func testFullScanKeystrokeLatency() {
+        let items = benchmarkItems()
+        measure {
+            _ = self.latencies { self.scan(items, $0) }
+        }
+    }
+
+    func testSessionKeystrokeLatency() {
+        let items = benchmarkItems()
+        measure {
+            _ = self.sessionLatencies(items)
+        }
+    }
+
+    // over 50k items a keystroke has to be answered within a frame, and well under what the scan took. One
+    // letter queries match a large share of the items and get a few frames.
+    func testKeystrokesAreAnsweredWithinAFrame() {
+        let items = benchmarkItems()
+        let index = SearchIndex(items: items) { $0 }
+        let indexed = latencies { index.search($0) }
+        let scanned = latencies { self.scan(items, $0) }
+        XCTAssertLessThan(percentile(indexed, 0.5), percentile(scanned, 0.5) / 5)
+        XCTAssertLessThan(percentile(indexed, 0.5), 16)
+        XCTAssertLessThan(percentile(indexed, 0.95), 50)
+        let delivered = sessionLatencies(items)
+        XCTAssertLessThan(percentile(delivered, 0.5), 16)
+        XCTAssertLessThan(percentile(delivered, 0.95), 50)
+    }
+}
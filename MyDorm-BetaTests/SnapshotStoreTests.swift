@@ -0,0 +1,206 @@
+//
+//  SnapshotStoreTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import CoreLocation
+@testable import MyDorm_Beta
+
+class SnapshotStoreTests: XCTestCase {
+    var fileURL: URL!
+
+    override func setUp() {
+        super.setUp()
+        fileURL = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent(UUID().uuidString)
+    }
+
+    override func tearDown() {
+        try? FileManager.default.removeItem(at: fileURL)
+        super.tearDown()
+    }
+
+    private func sampleSnapshot() -> ModelSnapshot {
+        var listing = Listing()
+        listing.listingID = "l1"
+        listing.uid = "u1"
+        listing.location = "12 College St"
+        listing.storageType = .Basement
+        listing.rentType = .Monthly
+        listing.rent = Decimal(string: "45.50")
+        listing.cubicFeet = 120
+        listing.date = Date(timeIntervalSinceReferenceDate: 500_000_000)
+        listing.description = "dry, lockable"
+        listing.coordinate = CLLocationCoordinate2D(latitude: 41.31, longitude: -72.92)
+
+        let desk = StorableObject(name: "Desk")
+        desk.height = 30
+        desk.width = 48
+        desk.length = 24
+
+        let company = StorageCompany(name: "Boxes Inc", priceIndex: ["Desk": 40, "Lamp": 5], pickupTimes: [DateTime](), dropoffTimes: [DateTime](), image: UIImage(), discounts: [PriceDiscount(kind: .tiered, minimum: 5, percentOff: 10)])
+
+        var snapshot = ModelSnapshot()
+        snapshot.listings = ["l1": listing]
+        snapshot.companies = ["c1": company]
+        snapshot.storableObjects = ["o1": desk]
+        snapshot.users = ["u1": User(uid: "u1", userInfo: ["First Name": "Ada", "Last Name": "Byron", "Email": "ada@example.com", "Dorm": "Branford"])]
+        return snapshot
+    }
+
+    func testRoundTrip() {
+        guard let decoded = SnapshotStore.decode(SnapshotStore.encode(sampleSnapshot())), let listing = decoded.listings["l1"] else {
+            return XCTFail("snapshot did not round trip")
+        }
+        XCTAssertEqual(listing.uid, "u1")
+        XCTAssertEqual(listing.location, "12 College St")
+        XCTAssertEqual(listing.storageType, .Basement)
+        XCTAssertEqual(listing.rentType, .Monthly)
+        XCTAssertEqual(listing.rent, Decimal(string: "45.50"))
+        XCTAssertEqual(listing.cubicFeet, 120)
+        XCTAssertEqual(listing.date, Date(timeIntervalSinceReferenceDate: 500_000_000))
+        XCTAssertEqual(listing.description, "dry, lockable")
+        XCTAssertEqual(listing.coordinate?.latitude, 41.31)
+        XCTAssertEqual(listing.coordinate?.longitude, -72.92)
+
+        let company = decoded.companies["c1"]
+        XCTAssertEqual(company?.name, "Boxes Inc")
+        XCTAssertEqual(company?.priceIndex ?? [:], ["Desk": 40, "Lamp": 5])
+        XCTAssertEqual(company?.discounts.count, 1)
+        XCTAssertEqual(company?.discounts.first?.kind, .tiered)
+        XCTAssertEqual(company?.discounts.first?.percentOff, 10)
+
+        let desk = decoded.storableObjects["o1"]
+        XCTAssertEqual(desk?.name, "Desk")
+        XCTAssertEqual(desk?.height, 30)
+        XCTAssertEqual(desk?.width, 48)
+        XCTAssertEqual(desk?.length, 24)
+
+        XCTAssertEqual(decoded.users["u1"]?.details ?? [:], sampleSnapshot().users["u1"]!.details)
+    }
+
+    func testEmptySnapshotRoundTrips() {
+        let decoded = SnapshotStore.decode(SnapshotStore.encode(ModelSnapshot()))
+        XCTAssertNotNil(decoded)
+        XCTAssertEqual(decoded?.listings.count, 0)
+        XCTAssertEqual(decoded?.users.count, 0)
+    }
+
+    func testCorruptedPayloadIsRejected() {
+        var data = SnapshotStore.encode(sampleSnapshot())
+        data[data.count - 3] ^= 0xFF
+        XCTAssertNil(SnapshotStore.decode(data))
+    }
+
+    func testTruncatedFileIsRejected() {
+        let data = SnapshotStore.encode(sampleSnapshot())
+        for length in [0, 8, 16, data.count / 2, data.count - 1] {
+            XCTAssertNil(SnapshotStore.decode(data.subdata(in: 0..<length)), "length \(length)")
+        }
+    }
+
+    func testOtherSchemaVersionIsRejected() {
+        var data = SnapshotStore.encode(sampleSnapshot())
+        // the version follows the 4 byte magic, little endian
+        data[4] = UInt8(truncatingBitPattern: SnapshotStore.schemaVersion + 1)
+        XCTAssertNil(SnapshotStore.decode(data))
+    }
+
+    func testSaveThenLoad() {
+        let store = SnapshotStore(fileURL: fileURL)
+        XCTAssertNil(store.load())
+        store.save(sampleSnapshot())
+        // the write happens in the background
+        let deadline = Date().addingTimeInterval(5)
+        while !FileManager.default.fileExists(atPath: fileURL.path) && Date() < deadline {
+            Thread.sleep(forTimeInterval: 0.01)
+        }
+        Thread.sleep(forTimeInterval: 0.05)
+        XCTAssertEqual(SnapshotStore(fileURL: fileURL).load()?.listings["l1"]?.location, "12 College St")
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let listingCount = 5000
+
+    private func generatedListings() -> [String: Listing] {
+        var generator = TraceGenerator(seed: 12)
+        let storageTypes: [StorageType] = [.InHouse, .Basement, .OffLocation]
+        let rentTypes: [RentType] = [.Summer, .Monthly, .Daily]
+        var listings = [String: Listing]()
+        for index in 0..<listingCount {
+            var listing = Listing()
+            listing.listingID = "listing-\(index)"
+            listing.uid = "user-\(generator.next(500))"
+            listing.location = "\(generator.next(400)) College St"
+            listing.storageType = storageTypes[generator.next(storageTypes.count)]
+            listing.rentType = rentTypes[generator.next(rentTypes.count)]
+            listing.rent = Decimal(generator.next(20000)) / 100
+            listing.cubicFeet = Double(generator.next(500))
+            listing.date = Date(timeIntervalSinceReferenceDate: 500_000_000 + Double(generator.next(365)) * 86400)
+            listing.coordinate = CLLocationCoordinate2D(latitude: 41 + Double(generator.next(1000)) / 1000, longitude: -73 + Double(generator.next(1000)) / 1000)
+            listings[listing.listingID] = listing
+        }
+        return listings
+    }
+
+    // Seconds from creating the data service until its listings are all there. Cold starts have no snapshot and
+    // parse every listing the database sends, warm starts read the snapshot and the database has not answered yet.
+    private func timeToListings(warm: Bool, listings: [String: Listing]) -> Double {
+        let source = FakeChildEventSource()
+        for (key, listing) in listings {
+            source.set(listing.firebaseValue, key: key, path: "Listings")
+        }
+        // set sends its events on the main queue, none of them belong to the start being timed
+        drainMainQueue()
+        source.deliversInitialLoad = !warm
+        try? FileManager.default.removeItem(at: fileURL)
+        if warm {
+            var snapshot = ModelSnapshot()
+            snapshot.listings = listings
+            try! SnapshotStore.encode(snapshot).write(to: fileURL)
+        }
+
+        let start = CFAbsoluteTimeGetCurrent()
+        let service = DataService(source: source, snapshotStore: SnapshotStore(fileURL: fileURL))
+        var shown = service.listings.count
+        service.getListings { (current, _) in
+            shown = current.count
+        }
+        let deadline = Date().addingTimeInterval(30)
+        while shown < listings.count && Date() < deadline {
+            RunLoop.main.run(until: Date().addingTimeInterval(0.001))
+        }
+        let elapsed = CFAbsoluteTimeGetCurrent() - start
+        XCTAssertEqual(shown, listings.count)
+        return elapsed
+    }
+
+    func testColdStart() {
+        let listings = generatedListings()
+        measure {
+            _ = self.timeToListings(warm: false, listings: listings)
+        }
+    }
+
+    func testWarmStart() {
+        let listings = generatedListings()
+        measure {
+            _ = self.timeToListings(warm: true, listings: listings)
+        }
+    }
+
+    // the snapshot is there to show listings sooner than parsing the database answer does
+    func testWarmStartBeatsColdStart() {
+        let listings = generatedListings()
+        var cold = [Double]()
+        var warm = [Double]()
+        for _ in 0..<5 {
+            cold.append(timeToListings(warm: false, listings: listings))
+            warm.append(timeToListings(warm: true, listings: listings))
+        }
+        XCTAssertLessThan(percentile(warm, 0.5), percentile(cold, 0.5) / 2)
+    }
+}
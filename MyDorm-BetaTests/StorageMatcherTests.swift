@@ -0,0 +1,254 @@
+//
+//  StorageMatcherTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+import CoreLocation
+@testable import MyDorm_Beta
+
+// Compares topMatches with trying every combination of up to three listings, on random orders and listings
+class StorageMatcherTests: XCTestCase {
+    let origin = CLLocationCoordinate2D(latitude: 41.31, longitude: -72.92)
+
+    private func object(_ name: String, _ width: Double, _ length: Double, _ height: Double) -> StorableObject {
+        let object = StorableObject(name: name)
+        object.width = width
+        object.length = length
+        object.height = height
+        return object
+    }
+
+    private func listing(_ id: String, cubicFeet: Double?, rent: Int = 0) -> Listing {
+        var listing = Listing()
+        listing.listingID = id
+        listing.cubicFeet = cubicFeet
+        listing.rent = Decimal(rent)
+        return listing
+    }
+
+    private func randomOrder(_ generator: inout TraceGenerator) -> Order {
+        var order = Order()
+        for index in 0..<(1 + generator.next(5)) {
+            order.objects.append(object("item \(index)", Double(6 + generator.next(30)), Double(6 + generator.next(30)), Double(6 + generator.next(30))))
+        }
+        if generator.next(2) == 0 {
+            order.pickup = Date(timeIntervalSinceReferenceDate: Double(generator.next(10)) * 86400)
+        }
+        return order
+    }
+
+    private func randomListings(_ generator: inout TraceGenerator) -> [Listing] {
+        var listings = [Listing]()
+        for index in 0..<(2 + generator.next(8)) {
+            var listing = self.listing("l\(index)", cubicFeet: generator.next(6) == 0 ? nil : Double(1 + generator.next(40)), rent: generator.next(200))
+            if generator.next(3) == 0 {
+                listing.date = Date(timeIntervalSinceReferenceDate: Double(generator.next(10)) * 86400)
+            }
+            if generator.next(4) == 0 {
+                listing.restrictedItems = [StorableObject(name: "item \(generator.next(5))")]
+            }
+            if generator.next(2) == 0 {
+                listing.coordinate = CLLocationCoordinate2D(latitude: origin.latitude + Double(generator.next(100)) / 100, longitude: origin.longitude)
+            }
+            listings.append(listing)
+        }
+        return listings
+    }
+
+    // every qualifying single listing and every combination of 2 or 3 that the items can be shared across
+    private func bruteForceCosts(_ matcher: StorageMatcher, order: Order, listings: [Listing], k: Int) -> [Double] {
+        let items = order.objects.map { StorageMatcher.box(for: $0) }
+        let itemVolume = items.reduce(0) { $0 + $1.volume } / 1728
+        let names = Set(order.objects.map { $0.name })
+
+        var eligible = [(space: PackingBox, cost: Double)]()
+        for listing in listings {
+            guard let space = StorageMatcher.space(for: listing) else {
+                continue
+            }
+            if listing.restrictedItems.contains(where: { names.contains($0.name) }) {
+                continue
+            }
+            if let pickup = order.pickup, let available = listing.date, available > pickup {
+                continue
+            }
+            var cost = matcher.weights.perDollar * ModelFormats.double(from: listing.rent!)
+            if let coordinate = listing.coordinate {
+                cost += matcher.weights.perMile * ListingIndex.miles(from: origin, to: coordinate)
+            }
+            eligible.append((space, cost))
+        }
+
+        var costs = [Double]()
+        for candidate in eligible where BoxPacker.fits(items, in: candidate.space) {
+            costs.append(candidate.cost + matcher.weights.perWastedCubicFoot * (candidate.space.volume / 1728 - itemVolume))
+        }
+        var combinations = [[Int]]()
+        if items.count > 1 {
+            for a in 0..<eligible.count {
+                for b in (a + 1)..<max(a + 1, eligible.count) {
+                    combinations.append([a, b])
+                    for c in (b + 1)..<max(b + 1, eligible.count) {
+                        combinations.append([a, b, c])
+                    }
+                }
+            }
+        }
+        let sortedItems = items.sorted { $0.volume > $1.volume }
+        for combination in combinations {
+            let spaces = combination.map { eligible[$0].space }
+            let capacity = spaces.reduce(0) { $0 + $1.volume } / 1728
+            if capacity >= itemVolume && StorageMatcher.assign(sortedItems, to: spaces) {
+                costs.append(combination.reduce(0) { $0 + eligible[$1].cost } + matcher.weights.perWastedCubicFoot * (capacity - itemVolume))
+            }
+        }
+        return Array(costs.sorted().prefix(k))
+    }
+
+    func testTopMatchesAgreeWithBruteForce() {
+        var generator = TraceGenerator(seed: 5)
+        let matcher = StorageMatcher()
+        matcher.splitCandidateLimit = 100
+        for _ in 0..<200 {
+            let order = randomOrder(&generator)
+            let listings = randomListings(&generator)
+            let k = 1 + generator.next(6)
+            let matches = matcher.topMatches(order: order, listings: listings, k: k, origin: origin)
+            let expected = bruteForceCosts(matcher, order: order, listings: listings, k: k)
+            XCTAssertEqual(matches.count, expected.count)
+            for (match, cost) in zip(matches, expected) {
+                XCTAssertEqualWithAccuracy(match.cost, cost, 1e-6)
+            }
+            XCTAssertEqual(matches.map { $0.cost }, matches.map { $0.cost }.sorted())
+        }
+    }
+
+    func testItemWithoutDimensionsStillTakesSpace() {
+        var order = Order()
+        order.objects = [object("Mystery Box", 0, 0, 0)]
+        // about 10 inches on a side, smaller than the 12 inch default
+        let small = listing("small", cubicFeet: 0.6)
+        let large = listing("large", cubicFeet: 2)
+        let matches = StorageMatcher().topMatches(order: order, listings: [small, large], k: 5)
+        XCTAssertEqual(matches.flatMap { $0.listings.map { $0.listingID! } }, ["large"])
+        XCTAssertEqualWithAccuracy(matches.first?.wastedCubicFeet ?? 0, 1, 1e-9)
+    }
+
+    func testRestrictedItemsAndLateListingsAreSkipped() {
+        var order = Order()
+        order.objects = [object("Fridge", 24, 24, 36)]
+        order.pickup = Date(timeIntervalSinceReferenceDate: 0)
+        var restricted = listing("restricted", cubicFeet: 50)
+        restricted.restrictedItems = [StorableObject(name: "Fridge")]
+        var late = listing("late", cubicFeet: 50)
+        late.date = Date(timeIntervalSinceReferenceDate: 86400)
+        let open = listing("open", cubicFeet: 50)
+        let matches = StorageMatcher().topMatches(order: order, listings: [restricted, late, open], k: 5)
+        XCTAssertEqual(matches.flatMap { $0.listings.map { $0.listingID! } }, ["open"])
+    }
+
+    func testPackerFillsAnExactTiling() {
+        let cube = PackingBox(width: 10, depth: 10, height: 10)
+        let container = PackingBox(width: 20, depth: 20, height: 20)
+        XCTAssertTrue(BoxPacker.fits([PackingBox](repeating: cube, count: 8), in: container))
+        XCTAssertFalse(BoxPacker.fits([PackingBox](repeating: cube, count: 9), in: container))
+        // too long in every rotation
+        XCTAssertFalse(BoxPacker.fits([PackingBox(width: 25, depth: 1, height: 1)], in: container))
+        // fits only when turned
+        XCTAssertTrue(BoxPacker.fits([PackingBox(width: 30, depth: 5, height: 5)], in: PackingBox(width: 5, depth: 5, height: 30)))
+    }
+
+    func testOrderIsSplitWhenNoSingleListingHoldsIt() {
+        var order = Order()
+        order.objects = [object("Desk", 24, 24, 24), object("Dresser", 24, 24, 24)]
+        // each holds one 8 cubic foot item, neither holds both
+        let listings = [listing("a", cubicFeet: 9, rent: 10), listing("b", cubicFeet: 9, rent: 20)]
+        let matches = StorageMatcher().topMatches(order: order, listings: listings, k: 3)
+        XCTAssertEqual(matches.count, 1)
+        XCTAssertEqual(matches.first?.listings.map { $0.listingID! } ?? [], ["a", "b"])
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    private func benchmarkListings(count: Int, _ generator: inout TraceGenerator) -> [Listing] {
+        return (0..<count).map { index in
+            var listing = self.listing("l\(index)", cubicFeet: Double(1 + generator.next(60)), rent: generator.next(200))
+            listing.coordinate = CLLocationCoordinate2D(latitude: origin.latitude + Double(generator.next(100)) / 100, longitude: origin.longitude)
+            return listing
+        }
+    }
+
+    // Orders of a dorm room's worth of items, about half of them too big for most single listings
+    private func benchmarkOrders(_ generator: inout TraceGenerator) -> [Order] {
+        return (0..<20).map { _ in
+            var order = Order()
+            for index in 0..<(2 + generator.next(7)) {
+                order.objects.append(object("item \(index)", Double(12 + generator.next(30)), Double(12 + generator.next(30)), Double(12 + generator.next(30))))
+            }
+            return order
+        }
+    }
+
+    // Milliseconds per order
+    private func matchTimes(_ matcher: StorageMatcher, orders: [Order], listings: [Listing]) -> [Double] {
+        return orders.map { order in
+            let start = CFAbsoluteTimeGetCurrent()
+            _ = matcher.topMatches(order: order, listings: listings, k: 20, origin: origin)
+            return (CFAbsoluteTimeGetCurrent() - start) * 1000
+        }
+    }
+
+    func testMatchingAgainstTwoThousandListings() {
+        var generator = TraceGenerator(seed: 6)
+        let listings = benchmarkListings(count: 2000, &generator)
+        let orders = benchmarkOrders(&generator)
+        let matcher = StorageMatcher()
+        measure {
+            _ = self.matchTimes(matcher, orders: orders, listings: listings)
+        }
+    }
+
+    func testMatchingWithoutSplits() {
+        var generator = TraceGenerator(seed: 6)
+        let listings = benchmarkListings(count: 2000, &generator)
+        let orders = benchmarkOrders(&generator)
+        let matcher = StorageMatcher()
+        matcher.maxListingsPerMatch = 1
+        measure {
+            _ = self.matchTimes(matcher, orders: orders, listings: listings)
+        }
+    }
+
+    // splitting searches combinations of the cheapest listings, pruning has to keep that a small part of the
+    // work of packing every listing
+    func testSplitSearchStaysCheap() {
+        var generator = TraceGenerator(seed: 7)
+        let listings = benchmarkListings(count: 2000, &generator)
+        let orders = benchmarkOrders(&generator)
+        let matcher = StorageMatcher()
+        let withSplits = matchTimes(matcher, orders: orders, listings: listings)
+        matcher.maxListingsPerMatch = 1
+        let singles = matchTimes(matcher, orders: orders, listings: listings)
+        XCTAssertLessThan(percentile(withSplits, 0.5), percentile(singles, 0.5) * 3)
+        XCTAssertLessThan(percentile(withSplits, 0.95), 100)
+    }
+
+    // branch and bound has to beat packing every combination of the same candidates
+    func testBranchAndBoundBeatsTryingEveryCombination() {
+        var generator = TraceGenerator(seed: 8)
+        let listings = benchmarkListings(count: 24, &generator)
+        let orders = benchmarkOrders(&generator)
+        let matcher = StorageMatcher()
+        matcher.splitCandidateLimit = listings.count
+        let searched = matchTimes(matcher, orders: orders, listings: listings)
+        let tried = orders.map { order -> Double in
+            let start = CFAbsoluteTimeGetCurrent()
+            _ = bruteForceCosts(matcher, order: order, listings: listings, k: 20)
+            return (CFAbsoluteTimeGetCurrent() - start) * 1000
+        }
+        XCTAssertLessThan(percentile(searched, 0.5), percentile(tried, 0.5))
+    }
+}
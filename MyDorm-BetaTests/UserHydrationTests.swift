@@ -0,0 +1,202 @@
+//
+//  UserHydrationTests.swift
+//  MyDorm-BetaTests
+//
+
+import XCTest
+@testable import MyDorm_Beta
+
+// Answers from a fixed catalog and records every request. With a latency it answers on the main queue that
+// much later, like a round trip to the database.
+class FakeStorableObjectBackend: StorableObjectBackend {
+    var catalog = [String: StorableObject]()
+    var latency: TimeInterval = 0
+    private(set) var requests = [Set<String>]()
+    private(set) var objectsSent = 0
+
+    func storableObjects(named names: Set<String>, complete: @escaping ([String : StorableObject]) -> ()) {
+        requests.append(names)
+        var objects = [String: StorableObject]()
+        for name in names {
+            objects[name] = catalog[name]
+        }
+        objectsSent += objects.count
+        if latency > 0 {
+            DispatchQueue.main.asyncAfter(deadline: .now() + latency) {
+                complete(objects)
+            }
+        } else {
+            complete(objects)
+        }
+    }
+}
+
+class UserHydrationTests: XCTestCase {
+    private func userInfo(orders: [String: [String]]) -> [String: Any] {
+        var stored = [String: Any]()
+        for (id, names) in orders {
+            var objects = [String: Any]()
+            for name in names {
+                objects[name] = true
+            }
+            stored[id] = ["Pick Up": "05/01/17", "Drop Off": "08/30/17", "Objects": objects] as [String: Any]
+        }
+        return ["First Name": "Ada", "Orders": stored]
+    }
+
+    func testEveryOrderIsFilledFromOneRequest() {
+        let backend = FakeStorableObjectBackend()
+        for name in ["Desk", "Lamp", "Chair"] {
+            backend.catalog[name] = StorableObject(name: name)
+        }
+        let user = User(uid: "u1", userInfo: userInfo(orders: ["o1": ["Desk", "Lamp"], "o2": ["Lamp", "Chair"], "o3": ["Desk", "Gone"]]))
+        var completions = 0
+        user.hydrateOrders(from: backend) { (hydrated) in
+            completions += 1
+            XCTAssertTrue(hydrated === user)
+        }
+        XCTAssertEqual(completions, 1)
+        XCTAssertEqual(backend.requests, [["Desk", "Lamp", "Chair", "Gone"]])
+        XCTAssertEqual(user.orders.map { $0.orderID! }, ["o1", "o2", "o3"])
+        XCTAssertEqual(user.orders[0].objects.map { $0.name }.sorted(), ["Desk", "Lamp"])
+        XCTAssertEqual(user.orders[1].objects.map { $0.name }.sorted(), ["Chair", "Lamp"])
+        // names the catalog no longer has are left out
+        XCTAssertEqual(user.orders[2].objects.map { $0.name }, ["Desk"])
+    }
+
+    func testUserWithoutOrdersMakesNoRequest() {
+        let backend = FakeStorableObjectBackend()
+        let user = User(uid: "u1", userInfo: ["First Name": "Ada"])
+        var completions = 0
+        user.hydrateOrders(from: backend) { _ in completions += 1 }
+        XCTAssertEqual(completions, 1)
+        XCTAssertTrue(backend.requests.isEmpty)
+    }
+
+    func testOrdersWithBadDatesAreSkipped() {
+        var info = userInfo(orders: ["o1": ["Desk"]])
+        var orders = info["Orders"] as! [String: Any]
+        orders["broken"] = ["Pick Up": "someday", "Drop Off": "08/30/17"]
+        info["Orders"] = orders
+        let user = User(uid: "u1", userInfo: info)
+        XCTAssertEqual(user.orders.map { $0.orderID! }, ["o1"])
+    }
+
+    func testDataServiceAnswersOnceTheObjectsHaveLoaded() {
+        let source = FakeChildEventSource()
+        source.set("Desk", key: "a", path: "Storable Objects")
+        source.set(["Name": "Lamp", "Height": "20"], key: "b", path: "Storable Objects")
+        let snapshotURL = URL(fileURLWithPath: NSTemporaryDirectory()).appendingPathComponent(UUID().uuidString)
+        defer {
+            try? FileManager.default.removeItem(at: snapshotURL)
+        }
+        let service = DataService(source: source, snapshotStore: SnapshotStore(fileURL: snapshotURL))
+
+        var answers = [[String: StorableObject]]()
+        service.storableObjects(named: ["Lamp", "Missing"]) { answers.append($0) }
+        XCTAssertTrue(answers.isEmpty)
+        drainMainQueue()
+        XCTAssertEqual(answers.count, 1)
+        XCTAssertEqual(answers.first?.keys.sorted() ?? [], ["Lamp"])
+        XCTAssertEqual(answers.first?["Lamp"]?.height, 20)
+
+        // later requests are answered from what is already synced
+        service.storableObjects(named: ["Desk"]) { answers.append($0) }
+        XCTAssertEqual(answers.count, 2)
+        XCTAssertEqual(source.observations.count, 1)
+    }
+
+    /*************************************************/
+    /*                   Benchmark                   */
+    /*************************************************/
+
+    let catalogSize = 300
+
+    private func latentBackend() -> FakeStorableObjectBackend {
+        let backend = FakeStorableObjectBackend()
+        for index in 0..<catalogSize {
+            backend.catalog["object \(index)"] = StorableObject(name: "object \(index)")
+        }
+        backend.latency = 0.02
+        return backend
+    }
+
+    private func orders(_ count: Int) -> [String: [String]] {
+        var generator = TraceGenerator(seed: 17)
+        var orders = [String: [String]]()
+        for index in 0..<count {
+            orders["o\(index)"] = (0..<(1 + generator.next(8))).map { _ in "object \(generator.next(catalogSize))" }
+        }
+        return orders
+    }
+
+    // Seconds until the user is handed back with every order filled in
+    private func hydrationSeconds(orderCount: Int, backend: FakeStorableObjectBackend) -> Double {
+        let user = User(uid: "u1", userInfo: userInfo(orders: orders(orderCount)))
+        let start = CFAbsoluteTimeGetCurrent()
+        var done = false
+        user.hydrateOrders(from: backend) { _ in done = true }
+        let deadline = Date().addingTimeInterval(10)
+        while !done && Date() < deadline {
+            RunLoop.main.run(until: Date().addingTimeInterval(0.001))
+        }
+        XCTAssertTrue(done)
+        XCTAssertEqual(user.orders.count, orderCount)
+        return CFAbsoluteTimeGetCurrent() - start
+    }
+
+    // What User.init did before, one request per order for the whole object tree. Returns when the last answer is in.
+    private func perOrderSeconds(orderCount: Int, backend: FakeStorableObjectBackend) -> Double {
+        let everything = Set(backend.catalog.keys)
+        let start = CFAbsoluteTimeGetCurrent()
+        var answered = 0
+        for _ in 0..<orderCount {
+            backend.storableObjects(named: everything) { _ in answered += 1 }
+        }
+        let deadline = Date().addingTimeInterval(10)
+        while answered < orderCount && Date() < deadline {
+            RunLoop.main.run(until: Date().addingTimeInterval(0.001))
+        }
+        return CFAbsoluteTimeGetCurrent() - start
+    }
+
+    func testHydratingOneOrder() {
+        measure {
+            _ = self.hydrationSeconds(orderCount: 1, backend: self.latentBackend())
+        }
+    }
+
+    func testHydratingTenOrders() {
+        measure {
+            _ = self.hydrationSeconds(orderCount: 10, backend: self.latentBackend())
+        }
+    }
+
+    func testHydratingAHundredOrders() {
+        measure {
+            _ = self.hydrationSeconds(orderCount: 100, backend: self.latentBackend())
+        }
+    }
+
+    func testRequestingTheObjectTreeForEachOfAHundredOrders() {
+        measure {
+            _ = self.perOrderSeconds(orderCount: 100, backend: self.latentBackend())
+        }
+    }
+
+    // one round trip however many orders, and only the objects the orders use cross it
+    func testHydrationCostDoesNotGrowWithOrders() {
+        var seconds = [Int: Double]()
+        for count in [1, 10, 100] {
+            let backend = latentBackend()
+            seconds[count] = hydrationSeconds(orderCount: count, backend: backend)
+            XCTAssertEqual(backend.requests.count, 1)
+            XCTAssertLessThanOrEqual(backend.objectsSent, min(catalogSize, count * 8))
+        }
+        XCTAssertLessThan(seconds[100]!, seconds[1]! * 2)
+
+        let perOrder = latentBackend()
+        _ = perOrderSeconds(orderCount: 100, backend: perOrder)
+        XCTAssertEqual(perOrder.objectsSent, 100 * catalogSize)
+    }
+}
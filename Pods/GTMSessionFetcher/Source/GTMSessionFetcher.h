@@ -257,6 +257,16 @@
 //    // current error domain and code values.
 //    response(suggestedWillRetry);
 //  };
+//
+// Fetchers that failed together retry together with plain exponential backoff.
+// A retry policy spreads the retries with jitter and honors the server's
+// Retry-After header:
+//
+//  myFetcher.retryPolicy =
+//      [GTMSessionFetcherBackoffRetryPolicy policyWithJitter:GTMSessionFetcherBackoffJitterFull];
+//
+// Fetchers created by a GTMSessionFetcherService also share per-host retry
+// budgets and circuit breakers; see GTMSessionFetcherService.h.
 
 
 #import <Foundation/Foundation.h>
@@ -479,6 +489,7 @@ typedef NS_ENUM(NSInteger, GTMSessionFetcherError) {
   GTMSessionFetcherErrorBackgroundFetchFailed = -4,
   GTMSessionFetcherErrorInsecureRequest = -5,
   GTMSessionFetcherErrorTaskCreationFailed = -6,
+  GTMSessionFetcherErrorHostUnavailable = -7,
 };
 
 typedef NS_ENUM(NSInteger, GTMSessionFetcherStatus) {
@@ -497,6 +508,7 @@ typedef NS_ENUM(NSInteger, GTMSessionFetcherStatus) {
 #define kGTMSessionFetcherErrorBackgroundFetchFailed  GTMSessionFetcherErrorBackgroundFetchFailed
 #define kGTMSessionFetcherErrorInsecureRequest        GTMSessionFetcherErrorInsecureRequest
 #define kGTMSessionFetcherErrorTaskCreationFailed     GTMSessionFetcherErrorTaskCreationFailed
+#define kGTMSessionFetcherErrorHostUnavailable        GTMSessionFetcherErrorHostUnavailable
 
 #define kGTMSessionFetcherStatusNotModified        GTMSessionFetcherStatusNotModified
 #define kGTMSessionFetcherStatusBadRequest         GTMSessionFetcherStatusBadRequest
@@ -640,6 +652,16 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 // Methods for compatibility with the old GTMHTTPFetcher.
 @property(readonly, strong, GTM_NULLABLE) NSOperationQueue *delegateQueue;
 
+@optional
+// Host health shared between the service's fetchers.
+//
+// fetcherShouldAttemptFetch: is called before every attempt, including retries, and returns NO
+// to fail the fetch at once while the host is considered unavailable.  fetcherShouldRetry: is
+// called when a retry is about to be scheduled and returns NO to end the fetch instead.
+- (BOOL)fetcherShouldAttemptFetch:(GTMSessionFetcher *)fetcher;
+- (BOOL)fetcherShouldRetry:(GTMSessionFetcher *)fetcher;
+- (void)fetcher:(GTMSessionFetcher *)fetcher didFinishAttemptWithHostFailure:(BOOL)hostFailed;
+
 @end  // @protocol GTMSessionFetcherServiceProtocol
 
 #ifndef GTM_FETCHER_AUTHORIZATION_PROTOCOL
@@ -696,6 +718,24 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 @end
 #endif
 
+// A retry policy chooses how long a fetcher waits before each retry.  A policy may be shared by
+// many fetchers and is called on their delegate queues, so implementations must be thread-safe.
+@protocol GTMSessionFetcherRetryPolicy <NSObject>
+
+// Returns the delay before retry number |retryNumber| (1 for the first retry), or a negative
+// value if no more retries should be attempted.
+//
+// |previousInterval| is the delay that preceded the previous retry, or 0.  |retryAfterInterval|
+// is the delay requested by the server's Retry-After header, or a negative value if there was
+// none.  |minInterval| and |maxInterval| are the fetcher's minRetryInterval and maxRetryInterval.
+- (NSTimeInterval)retryIntervalForRetryNumber:(NSUInteger)retryNumber
+                             previousInterval:(NSTimeInterval)previousInterval
+                           retryAfterInterval:(NSTimeInterval)retryAfterInterval
+                                  minInterval:(NSTimeInterval)minInterval
+                                  maxInterval:(NSTimeInterval)maxInterval;
+
+@end
+
 #pragma mark -
 
 // GTMSessionFetcher objects are used for async retrieval of an http get or post
@@ -922,8 +962,9 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 // Lower values are higher priority; the default is 0, and values may
 // be negative or positive. This priority affects only the start order of
 // fetchers that are being delayed by a fetcher service when the running fetchers
-// exceeds the service's maxRunningFetchersPerHost.  A priority of NSIntegerMin will
-// exempt this fetcher from delay.
+// exceeds the service's maxRunningFetchersPerHost or maxRunningFetchers.  Negative values
+// are treated as interactive and positive values as background; see the service's
+// priorityAgingInterval.  A priority of NSIntegerMin will exempt this fetcher from delay.
 @property(atomic, assign) NSInteger servicePriority;
 
 // The delegate's optional didReceiveResponse block may be used to inspect or alter
@@ -971,6 +1012,16 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 // This is called on the callback queue.
 @property(atomic, copy, GTM_NULLABLE) GTMSessionFetcherReceivedProgressBlock receivedProgressBlock;
 
+// The shortest interval between calls to the received progress block. Buffers arriving
+// sooner are reported together by the next call, and any unreported bytes are reported
+// before the fetch completes. Zero reports every buffer. Default is 0.05 seconds.
+@property(atomic, assign) NSTimeInterval minimumReceivedProgressInterval;
+
+// Once more than this many bytes have been received, the fetcher keeps the downloaded data
+// in a temporary file instead of memory, and downloadedData maps that file. A fetch with a
+// destinationFileURL moves the file there. Zero, the default, keeps the data in memory.
+@property(atomic, assign) int64_t downloadSpillThreshold;
+
 // The delegate's optional downloadProgress block may be used to monitor download
 // progress in writing to disk.
 //
@@ -1012,6 +1063,10 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 // Number of retries attempted.
 @property(atomic, readonly) NSUInteger retryCount;
 
+// Policy choosing the delay before each retry.  When nil, the delay starts at minRetryInterval
+// and is multiplied by retryFactor for each retry.
+@property(atomic, strong, GTM_NULLABLE) id<GTMSessionFetcherRetryPolicy> retryPolicy;
+
 // Interval delay to precede next retry.
 @property(atomic, readonly) NSTimeInterval nextRetryInterval;
 
@@ -1205,6 +1260,10 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 // implement all the public methods ourselves.  This stores cookies only in
 // memory.  Additional methods are provided for testing.
 //
+// Cookies are matched to requests following RFC 6265: a cookie whose domain has a leading "."
+// is sent to that domain and its subdomains, and one without is sent only to that exact host.
+// Path matching requires the cookie path to end at a "/" in the request path.
+//
 // iOS 9/OS X 10.11 added +[NSHTTPCookieStorage sharedCookieStorageForGroupContainerIdentifier:]
 // which may also be used to create cookie storage.
 @interface GTMSessionCookieStorage : NSHTTPCookieStorage
@@ -1217,6 +1276,39 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
 
 @end
 
+// Backoff shapes for GTMSessionFetcherBackoffRetryPolicy.
+//
+// None waits minInterval * factor^(n - 1) before retry n, like fetchers without a policy.
+// Full jitter waits a random time up to that delay.  Decorrelated jitter waits a random time
+// between minInterval and three times the previous delay.  Both keep fetchers that failed
+// together from retrying together.
+typedef NS_ENUM(NSInteger, GTMSessionFetcherBackoffJitter) {
+  GTMSessionFetcherBackoffJitterNone = 0,
+  GTMSessionFetcherBackoffJitterFull,
+  GTMSessionFetcherBackoffJitterDecorrelated
+};
+
+// Exponential backoff with optional jitter.
+//
+// Retries stop once the unjittered delay reaches maxInterval, so a policy allows as many retries
+// as the fetcher would without one.  A Retry-After delay sent with a 429 or 503 status is waited
+// for, plus up to minInterval of jitter, unless it exceeds maxInterval, in which case the fetch
+// is not retried.
+@interface GTMSessionFetcherBackoffRetryPolicy : NSObject <GTMSessionFetcherRetryPolicy>
+
++ (instancetype)policyWithJitter:(GTMSessionFetcherBackoffJitter)jitter;
+
+@property(atomic, assign) GTMSessionFetcherBackoffJitter jitter;
+
+// Multiplier for the unjittered delay, default 2.0.
+@property(atomic, assign) double factor;
+
+// Returns a random value in [0, 1).  nil uses arc4random; tests may substitute a deterministic
+// source.
+@property(atomic, copy, GTM_NULLABLE) double (^randomBlock)(void);
+
+@end
+
 // Macros to monitor synchronization blocks in debug builds.
 // These report problems using GTMSessionCheckDebug.
 //
@@ -19,7 +19,9 @@
 
 #import "GTMSessionFetcher.h"
 
+#import <fcntl.h>
 #import <sys/utsname.h>
+#import <unistd.h>
 
 #ifndef STRIP_GTM_FETCH_LOGGING
   #error GTMSessionFetcher headers should have defaulted this if it wasn't already defined.
@@ -52,6 +54,7 @@ static NSString *const kGTMSessionIdentifierBodyFileURLMetadataKey        = @"_b
 static const NSTimeInterval kUnsetMaxRetryInterval = -1.0;
 static const NSTimeInterval kDefaultMaxDownloadRetryInterval = 60.0;
 static const NSTimeInterval kDefaultMaxUploadRetryInterval = 60.0 * 10.;
+static const NSTimeInterval kDefaultMinimumReceivedProgressInterval = 0.05;
 
 #ifdef GTMSESSION_PERSISTED_DESTINATION_KEY
 // Projects using unique class names should also define a unique persisted destination key.
@@ -81,6 +84,28 @@ GTM_ASSUME_NONNULL_END
   #endif
 #endif
 
+// Collects received buffers without copying them. Each buffer is retained as a dispatch_data_t
+// segment and the segments are concatenated without being flattened, so the data is handed out
+// as one non-contiguous NSData. Past the spill threshold the bytes are moved to a temporary
+// file and later buffers are written straight to it. All methods are thread-safe.
+@interface GTMSessionFetcherDataAccumulator : NSObject
+
+- (instancetype)initWithSpillThreshold:(int64_t)spillThreshold;
+
+@property(atomic, readonly) int64_t length;
+
+- (void)appendData:(GTM_NULLABLE NSData *)data;
+
+// The bytes received so far, or nil if none. Spilled data is mapped from the file.
+- (GTM_NULLABLE NSData *)data;
+
+// Moves the spill file to the URL, or writes the bytes there if they are still in memory.
+- (BOOL)writeToURL:(NSURL *)url error:(NSError **)error;
+
+- (void)reset;
+
+@end
+
 @interface GTMSessionFetcher ()
 
 @property(atomic, strong, readwrite, GTM_NULLABLE) NSData *downloadedData;
@@ -139,7 +164,11 @@ static GTMSessionFetcherTestBlock GTM_NULLABLE_TYPE gGlobalTestBlock;
   NSString *_sessionIdentifierUUID;
   BOOL _userRequestedBackgroundSession;
   BOOL _usingBackgroundSession;
-  NSMutableData * GTM_NULLABLE_TYPE _downloadedData;
+  GTMSessionFetcherDataAccumulator * GTM_NULLABLE_TYPE _downloadAccumulator;
+  int64_t _downloadSpillThreshold;
+  NSTimeInterval _minimumReceivedProgressInterval;
+  CFAbsoluteTime _lastReceivedProgressTime;
+  int64_t _unreportedReceivedLength;  // bytes received since the last received progress call
   NSError *_downloadFinishedError;
   NSData *_downloadResumeData;  // immutable after construction
   NSURL *_destinationFileURL;
@@ -170,6 +199,9 @@ static GTMSessionFetcherTestBlock GTM_NULLABLE_TYPE gGlobalTestBlock;
   NSTimeInterval _minRetryInterval; // random between 1 and 2 seconds
   NSTimeInterval _retryFactor;      // default interval multiplier is 2
   NSTimeInterval _lastRetryInterval;
+  id<GTMSessionFetcherRetryPolicy> _retryPolicy;
+  NSTimeInterval _pendingRetryInterval;  // the policy's answer for the next retry, if computed
+  BOOL _hasPendingRetryInterval;
   NSDate *_initialBeginFetchDate;   // date that beginFetch was first invoked; immutable after initial beginFetch
   NSDate *_initialRequestDate;      // date of first request to the target server (ignoring auth)
   BOOL _hasAttemptedAuthRefresh;    // accessed only in shouldRetryNowForStatus:
@@ -309,6 +341,8 @@ static GTMSessionFetcherTestBlock GTM_NULLABLE_TYPE gGlobalTestBlock;
 
     _taskPriority = -1.0f;  // Valid values if set are 0.0...1.0.
 
+    _minimumReceivedProgressInterval = kDefaultMinimumReceivedProgressInterval;
+
 #if !STRIP_GTM_FETCH_LOGGING
     // Encourage developers to set the comment property or use
     // setCommentWithFormat: by providing a default string.
@@ -442,6 +476,16 @@ static GTMSessionFetcherTestBlock GTM_NULLABLE_TYPE gGlobalTestBlock;
     return;
   }
 
+  // Only the initial call for each attempt may delay; calls after authorization or from the
+  // service's queue are part of the same attempt.
+  if (mayDelay && [_service respondsToSelector:@selector(fetcherShouldAttemptFetch:)]) {
+    if (![_service fetcherShouldAttemptFetch:self]) {
+      // The service has seen the host failing repeatedly, so don't add to its load.
+      [self failToBeginFetchWithError:beginFailureError(GTMSessionFetcherErrorHostUnavailable)];
+      return;
+    }
+  }
+
   // We'll respect the user's request for a background session (unless this is
   // an upload fetcher, which does its initial request foreground.)
   self.usingBackgroundSession = self.useBackgroundSession && [self canFetchWithBackgroundSession];
@@ -1101,7 +1145,17 @@ NSData * GTM_NULLABLE_TYPE GTMDataFromInputStream(NSInputStream *inputStream, NS
           }];
         }
       } else {
-        _downloadedData = [responseData mutableCopy];
+        // A session hands a body over in several buffers; append it in the same pieces the
+        // simulated progress reports so the accumulator and any spill see more than one buffer.
+        _downloadAccumulator =
+            [[GTMSessionFetcherDataAccumulator alloc] initWithSpillThreshold:_downloadSpillThreshold];
+        int64_t totalLength = (int64_t)responseData.length;
+        int64_t pieceLength = totalLength / 3 + 1;
+        for (int64_t offset = 0; offset < totalLength; offset += pieceLength) {
+          NSRange pieceRange = NSMakeRange((NSUInteger)offset,
+                                           (NSUInteger)MIN(pieceLength, totalLength - offset));
+          [_downloadAccumulator appendData:[responseData subdataWithRange:pieceRange]];
+        }
       }
 
       if (receivedProgressBlock) {
@@ -2052,8 +2106,9 @@ didReceiveResponse:(NSURLResponse *)response
 
         BOOL hadPreviousData = _downloadedLength > 0;
 
-        [_downloadedData setLength:0];
+        [_downloadAccumulator reset];
         _downloadedLength = 0;
+        _unreportedReceivedLength = 0;
 
         if (hadPreviousData && (dispositionValue != NSURLSessionResponseCancel)) {
           // Tell the accumulate block to discard prior data.
@@ -2441,6 +2496,7 @@ totalBytesExpectedToSend:(int64_t)totalBytesExpectedToSend {
     // Observed on completing an out-of-process upload.
     return;
   }
+  GTMSessionFetcherDataAccumulator *accumulator = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
@@ -2452,39 +2508,70 @@ totalBytesExpectedToSend:(int64_t)totalBytesExpectedToSend {
           accumulateBlock(data);
       }];
     } else if (!_userStoppedFetching) {
-      // Append to the mutable data buffer unless the fetch has been cancelled.
+      // Append to the accumulator unless the fetch has been cancelled.
 
       // Resumed upload tasks may not yet have a data buffer.
-      if (_downloadedData == nil) {
+      if (_downloadAccumulator == nil) {
         // Using NSClassFromString for iOS 6 compatibility.
         GTMSESSION_ASSERT_DEBUG(
             ![dataTask isKindOfClass:NSClassFromString(@"NSURLSessionDownloadTask")],
             @"Resumed download tasks should not receive data bytes");
-        _downloadedData = [[NSMutableData alloc] init];
+        _downloadAccumulator =
+            [[GTMSessionFetcherDataAccumulator alloc] initWithSpillThreshold:_downloadSpillThreshold];
       }
+      accumulator = _downloadAccumulator;
+    }
+  }  // @synchronized(self)
 
-      [_downloadedData appendData:data];
-      _downloadedLength = (int64_t)_downloadedData.length;
+  if (accumulator == nil) {
+    return;
+  }
+  // The buffer is retained rather than copied, and a write to the spill file happens here,
+  // outside the fetcher's lock.
+  [accumulator appendData:data];
 
-      // We won't hold on to receivedProgressBlock here; it's ok to not send
-      // it if the transfer finishes.
-      if (_receivedProgressBlock) {
-        [self invokeOnCallbackQueueUnlessStopped:^{
-            GTMSessionFetcherReceivedProgressBlock progressBlock;
-            @synchronized(self) {
-              GTMSessionMonitorSynchronized(self);
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
 
-              progressBlock = _receivedProgressBlock;
-            }
-            if (progressBlock) {
-              progressBlock((int64_t)bufferLength, _downloadedLength);
-            }
-        }];
+    // A redirect may have reset the accumulator while the buffer was appended; the buffer
+    // then belongs to the discarded response.
+    if (accumulator == _downloadAccumulator) {
+      _downloadedLength = accumulator.length;
+      if (_receivedProgressBlock) {
+        _unreportedReceivedLength += (int64_t)bufferLength;
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (now - _lastReceivedProgressTime >= _minimumReceivedProgressInterval) {
+          [self reportUnreportedReceivedLength];
+        }
       }
     }
   }  // @synchronized(self)
 }
 
+// Calls the received progress block with the bytes received since its last call.
+- (void)reportUnreportedReceivedLength {
+  GTMSessionCheckSynchronized(self);
+
+  int64_t bytesReceived = _unreportedReceivedLength;
+  int64_t totalBytesReceived = _downloadedLength;
+  if (bytesReceived == 0) {
+    return;
+  }
+  _unreportedReceivedLength = 0;
+  _lastReceivedProgressTime = CFAbsoluteTimeGetCurrent();
+  [self invokeOnCallbackQueueUnlessStopped:^{
+      GTMSessionFetcherReceivedProgressBlock progressBlock;
+      @synchronized(self) {
+        GTMSessionMonitorSynchronized(self);
+
+        progressBlock = _receivedProgressBlock;
+      }
+      if (progressBlock) {
+        progressBlock(bytesReceived, totalBytesReceived);
+      }
+  }];
+}
+
 - (void)URLSession:(NSURLSession *)session
           dataTask:(NSURLSessionDataTask *)dataTask
  willCacheResponse:(NSCachedURLResponse *)proposedResponse
@@ -2747,6 +2834,11 @@ didCompleteWithError:(NSError *)error {
 
   BOOL fetchSucceeded = (error == nil && status >= 0 && status < 300);
 
+  if ([_service respondsToSelector:@selector(fetcher:didFinishAttemptWithHostFailure:)]) {
+    BOOL hostFailed = !fetchSucceeded && [self isHostFailureStatus:status error:error];
+    [_service fetcher:self didFinishAttemptWithHostFailure:hostFailed];
+  }
+
 #if !STRIP_GTM_FETCH_LOGGING
   if (!fetchSucceeded) {
     if (!shouldDeferLogging && !self.hasLoggedError) {
@@ -2762,9 +2854,12 @@ didCompleteWithError:(NSError *)error {
 #if !STRIP_GTM_FETCH_LOGGING
     shouldDeferLogging = _deferResponseBodyLogging;
 #endif
+    // Progress coalesced since the last call is reported before the fetch callbacks.
+    [self reportUnreportedReceivedLength];
+
     if (fetchSucceeded) {
       // Success
-      if ((_downloadedData.length > 0) && (destinationURL != nil)) {
+      if ((_downloadAccumulator.length > 0) && (destinationURL != nil)) {
         // Overwrite any previous file at the destination URL.
         NSFileManager *fileMgr = [NSFileManager defaultManager];
         [fileMgr removeItemAtURL:destinationURL
@@ -2775,17 +2870,16 @@ didCompleteWithError:(NSError *)error {
               withIntermediateDirectories:YES
                                attributes:nil
                                     error:&error]) {
-          didMoveDownload = [_downloadedData writeToURL:destinationURL
-                                                options:NSDataWritingAtomic
-                                                  error:&error];
+          didMoveDownload = [_downloadAccumulator writeToURL:destinationURL
+                                                       error:&error];
         }
         if (didMoveDownload) {
-          _downloadedData = nil;
+          _downloadAccumulator = nil;
         } else {
           _downloadFinishedError = error;
         }
       }
-      downloadedData = _downloadedData;
+      downloadedData = [_downloadAccumulator data];
     } else {
       // Unsuccessful with error or status over 300. Retry or notify the delegate of failure
       if (shouldRetry) {
@@ -2796,8 +2890,9 @@ didCompleteWithError:(NSError *)error {
         if (error == nil) {
           // Create an error.
           NSDictionary *userInfo = nil;
-          if (_downloadedData.length > 0) {
-            userInfo = @{ kGTMSessionFetcherStatusDataKey : _downloadedData };
+          NSData *statusData = [_downloadAccumulator data];
+          if (statusData.length > 0) {
+            userInfo = @{ kGTMSessionFetcherStatusDataKey : statusData };
           }
           error = [NSError errorWithDomain:kGTMSessionFetcherStatusDomain
                                       code:status
@@ -2816,8 +2911,8 @@ didCompleteWithError:(NSError *)error {
             }
           }
         }
-        if (_downloadedData.length > 0) {
-          downloadedData = _downloadedData;
+        if (_downloadAccumulator.length > 0) {
+          downloadedData = [_downloadAccumulator data];
         }
         // If the error occurred after retries, report the number and duration of the
         // retries. This provides a clue to a developer looking at the error description
@@ -2913,6 +3008,21 @@ didCompleteWithError:(NSError *)error {
   return NO;
 }
 
+// Failures that say the host is overloaded or unreachable, as opposed to a problem with the
+// request itself.  These feed the service's circuit breaker.
+- (BOOL)isHostFailureStatus:(NSInteger)status error:(GTM_NULLABLE NSError *)error {
+  if (status == 429) {  // too many requests
+    return YES;
+  }
+  if (error != nil && [self isRetryError:error]) {
+    return YES;
+  }
+  NSError *statusError = [NSError errorWithDomain:kGTMSessionFetcherStatusDomain
+                                             code:status
+                                         userInfo:nil];
+  return [self isRetryError:statusError];
+}
+
 // shouldRetryNowForStatus:error: responds with YES if the user has enabled retries
 // and the status or error is one that is suitable for retrying.  "Suitable"
 // means either the isRetryError:'s list contains the status or error, or the
@@ -2947,14 +3057,36 @@ didCompleteWithError:(NSError *)error {
     [self updateRequestValue:nil forHTTPHeaderField:@"Authorization"];
   }
 
+  // Retries because of the host's health are charged to the service's retry budget for the host;
+  // retries to refresh authorization or restore a header are not.
+  id<GTMSessionFetcherServiceProtocol> service = _service;
+  if (!shouldRetryForAuthRefresh && !forceAssumeRetry
+      && [service respondsToSelector:@selector(fetcherShouldRetry:)]) {
+    GTMSessionFetcherRetryResponse unbudgetedResponse = response;
+    response = ^(BOOL shouldRetry) {
+      if (shouldRetry && ![service fetcherShouldRetry:self]) {
+        shouldRetry = NO;
+      }
+      unbudgetedResponse(shouldRetry);
+    };
+  }
+
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
+    // The next retry interval depends on this failure's response.
+    _hasPendingRetryInterval = NO;
+
     BOOL shouldDoRetry = [self isRetryEnabledUnsynchronized];
-    if (shouldDoRetry && ![self hasRetryAfterInterval]) {
+    if (shouldDoRetry && (_retryPolicy != nil || ![self hasRetryAfterInterval])) {
 
-      // Determine if we're doing exponential backoff retries
-      shouldDoRetry = [self nextRetryIntervalUnsynchronized] < _maxRetryInterval;
+      // Determine if we're doing exponential backoff retries.  A retry policy decides when to
+      // stop itself, and accounts for Retry-After.
+      if (_retryPolicy != nil) {
+        shouldDoRetry = [self nextRetryIntervalUnsynchronized] >= 0;
+      } else {
+        shouldDoRetry = [self nextRetryIntervalUnsynchronized] < _maxRetryInterval;
+      }
 
       if (shouldDoRetry) {
         // If an explicit max retry interval was set, we expect repeated backoffs to take
@@ -2974,8 +3106,9 @@ didCompleteWithError:(NSError *)error {
     BOOL canRetry = shouldRetryForAuthRefresh || forceAssumeRetry || shouldDoRetry;
     if (canRetry) {
       NSDictionary *userInfo = nil;
-      if (_downloadedData.length > 0) {
-        userInfo = @{ kGTMSessionFetcherStatusDataKey : _downloadedData };
+      NSData *statusData = [_downloadAccumulator data];
+      if (statusData.length > 0) {
+        userInfo = @{ kGTMSessionFetcherStatusDataKey : statusData };
       }
       NSError *statusError = [NSError errorWithDomain:kGTMSessionFetcherStatusDomain
                                                  code:status
@@ -3046,6 +3179,11 @@ didCompleteWithError:(NSError *)error {
     GTMSessionMonitorSynchronized(self);
 
     NSTimeInterval nextInterval = [self nextRetryIntervalUnsynchronized];
+    if (nextInterval < 0) {
+      // The retry policy would have stopped, but the retry block chose to retry.
+      nextInterval = _minRetryInterval;
+    }
+    _hasPendingRetryInterval = NO;
     NSTimeInterval maxInterval = _maxRetryInterval;
     NSTimeInterval newInterval = MIN(nextInterval, (maxInterval > 0 ? maxInterval : DBL_MAX));
     NSTimeInterval newIntervalTolerance = (newInterval / 10) > 1.0 ?: 1.0;
@@ -3123,6 +3261,23 @@ didCompleteWithError:(NSError *)error {
   GTMSessionCheckSynchronized(self);
 
   NSInteger statusCode = [self statusCodeUnsynchronized];
+  if (_retryPolicy != nil) {
+    // Jittered intervals are random, so ask the policy once per failure and keep its answer
+    // until the retry timer begins.
+    if (!_hasPendingRetryInterval) {
+      NSTimeInterval retryAfter = -1;
+      if ((statusCode == 503 || statusCode == 429) && [self hasRetryAfterInterval]) {
+        retryAfter = [self retryAfterInterval];
+      }
+      _pendingRetryInterval = [_retryPolicy retryIntervalForRetryNumber:_retryCount + 1
+                                                       previousInterval:_lastRetryInterval
+                                                     retryAfterInterval:retryAfter
+                                                            minInterval:_minRetryInterval
+                                                            maxInterval:_maxRetryInterval];
+      _hasPendingRetryInterval = YES;
+    }
+    return _pendingRetryInterval;
+  }
   if ((statusCode == 503) && [self hasRetryAfterInterval]) {
     NSTimeInterval secs = [self retryAfterInterval];
     return secs;
@@ -3287,6 +3442,8 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
             serviceHost = _serviceHost,
             accumulateDataBlock = _accumulateDataBlock,
             receivedProgressBlock = _receivedProgressBlock,
+            minimumReceivedProgressInterval = _minimumReceivedProgressInterval,
+            downloadSpillThreshold = _downloadSpillThreshold,
             downloadProgressBlock = _downloadProgressBlock,
             resumeDataBlock = _resumeDataBlock,
             didReceiveResponseBlock = _didReceiveResponseBlock,
@@ -3296,6 +3453,7 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
             willCacheURLResponseBlock = _willCacheURLResponseBlock,
             retryBlock = _retryBlock,
             retryFactor = _retryFactor,
+            retryPolicy = _retryPolicy,
             allowedInsecureSchemes = _allowedInsecureSchemes,
             allowLocalhostRequest = _allowLocalhostRequest,
             allowInvalidServerCertificates = _allowInvalidServerCertificates,
@@ -3508,7 +3666,7 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    return _downloadedData;
+    return [_downloadAccumulator data];
   }  // @synchronized(self)
 }
 
@@ -3516,7 +3674,14 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    _downloadedData = [data mutableCopy];
+    if (data) {
+      _downloadAccumulator =
+          [[GTMSessionFetcherDataAccumulator alloc] initWithSpillThreshold:_downloadSpillThreshold];
+      [_downloadAccumulator appendData:data];
+    } else {
+      _downloadAccumulator = nil;
+    }
+    _unreportedReceivedLength = 0;
   }  // @synchronized(self)
 }
 
@@ -3887,15 +4052,280 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
 
 @end
 
+@class GTMSessionCookieDomainNode;
+
+// A stored cookie.  The sequence orders cookies by creation time, and is kept when a cookie
+// replaces one with the same name, domain and path, as RFC 6265 section 5.3 asks.
+@interface GTMSessionCookieEntry : NSObject
+
+@property(atomic, strong) NSHTTPCookie *cookie;
+@property(atomic, assign) uint64_t sequence;
+@property(atomic, assign, getter=isHostOnly) BOOL hostOnly;
+
+// Seconds since the reference date.  Only used by cookies in the expiration heap.
+@property(atomic, assign) NSTimeInterval expiration;
+
+// Position in the expiration heap, or NSNotFound for session cookies.
+@property(atomic, assign) NSUInteger heapIndex;
+
+@property(atomic, unsafe_unretained, GTM_NULLABLE) GTMSessionCookieDomainNode *node;
+
+@end
+
+@implementation GTMSessionCookieEntry
+
+@synthesize cookie = _cookie,
+            sequence = _sequence,
+            hostOnly = _hostOnly,
+            expiration = _expiration,
+            heapIndex = _heapIndex,
+            node = _node;
+
+@end
+
+// A node of the domain trie.  Nodes are keyed by domain label from the top-level domain down,
+// so the cookies for a host and for each of its parent domains lie on one path from the root.
+@interface GTMSessionCookieDomainNode : NSObject
+
+- (instancetype)initWithLabel:(GTM_NULLABLE NSString *)label
+                       parent:(GTM_NULLABLE GTMSessionCookieDomainNode *)parent;
+
+@property(atomic, readonly, GTM_NULLABLE) NSString *label;
+@property(atomic, readonly, unsafe_unretained, GTM_NULLABLE) GTMSessionCookieDomainNode *parent;
+@property(atomic, readonly) NSMutableDictionary *children;
+
+// Longest path first, then oldest first, the order RFC 6265 section 5.4 sends cookies in.
+@property(atomic, readonly) NSArray *entries;
+
+- (void)insertEntry:(GTMSessionCookieEntry *)entry;
+- (void)removeEntry:(GTMSessionCookieEntry *)entry;
+
+// Cookies before this index have paths too long to match a request path of the given length.
+- (NSUInteger)indexOfFirstEntryWithPathLengthAtMost:(NSUInteger)pathLength;
+
+- (void)addEntriesOfSubtreeToArray:(NSMutableArray *)array;
+
+@end
+
+@implementation GTMSessionCookieDomainNode {
+  NSMutableArray *_entries;
+}
+
+@synthesize label = _label,
+            parent = _parent,
+            children = _children;
+
+- (instancetype)initWithLabel:(GTM_NULLABLE NSString *)label
+                       parent:(GTM_NULLABLE GTMSessionCookieDomainNode *)parent {
+  self = [super init];
+  if (self) {
+    _label = [label copy];
+    _parent = parent;
+    _children = [[NSMutableDictionary alloc] init];
+    _entries = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (NSArray *)entries {
+  return _entries;
+}
+
+- (void)insertEntry:(GTMSessionCookieEntry *)entry {
+  NSUInteger pathLength = entry.cookie.path.length;
+  uint64_t sequence = entry.sequence;
+  NSUInteger low = 0;
+  NSUInteger high = _entries.count;
+  while (low < high) {
+    NSUInteger mid = low + (high - low) / 2;
+    GTMSessionCookieEntry *midEntry = _entries[mid];
+    NSUInteger midPathLength = midEntry.cookie.path.length;
+    if (midPathLength > pathLength
+        || (midPathLength == pathLength && midEntry.sequence < sequence)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  [_entries insertObject:entry atIndex:low];
+  entry.node = self;
+}
+
+- (void)removeEntry:(GTMSessionCookieEntry *)entry {
+  [_entries removeObjectIdenticalTo:entry];
+  entry.node = nil;
+}
+
+- (NSUInteger)indexOfFirstEntryWithPathLengthAtMost:(NSUInteger)pathLength {
+  NSUInteger low = 0;
+  NSUInteger high = _entries.count;
+  while (low < high) {
+    NSUInteger mid = low + (high - low) / 2;
+    GTMSessionCookieEntry *midEntry = _entries[mid];
+    if (midEntry.cookie.path.length > pathLength) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+- (void)addEntriesOfSubtreeToArray:(NSMutableArray *)array {
+  [array addObjectsFromArray:_entries];
+  for (GTMSessionCookieDomainNode *child in [_children objectEnumerator]) {
+    [child addEntriesOfSubtreeToArray:array];
+  }
+}
+
+@end
+
+// Cookies with an expiration date, soonest first, so expired cookies are removed without
+// scanning the storage.
+@interface GTMSessionCookieExpirationHeap : NSObject
+
+@property(atomic, readonly, GTM_NULLABLE) GTMSessionCookieEntry *firstEntry;
+
+- (void)addEntry:(GTMSessionCookieEntry *)entry;
+- (void)removeEntry:(GTMSessionCookieEntry *)entry;
+- (void)removeAllEntries;
+
+@end
+
+@implementation GTMSessionCookieExpirationHeap {
+  NSMutableArray *_entries;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _entries = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (GTM_NULLABLE GTMSessionCookieEntry *)firstEntry {
+  return _entries.firstObject;
+}
+
+- (void)addEntry:(GTMSessionCookieEntry *)entry {
+  NSUInteger index = _entries.count;
+  entry.heapIndex = index;
+  [_entries addObject:entry];
+  [self siftUpFromIndex:index];
+}
+
+- (void)removeEntry:(GTMSessionCookieEntry *)entry {
+  NSUInteger index = entry.heapIndex;
+  NSUInteger lastIndex = _entries.count - 1;
+  GTMSESSION_ASSERT_DEBUG(index <= lastIndex && _entries[index] == entry,
+                          @"cookie not in the expiration heap: %@", entry.cookie);
+  if (index != lastIndex) {
+    [self swapIndex:index withIndex:lastIndex];
+  }
+  [_entries removeLastObject];
+  entry.heapIndex = NSNotFound;
+  if (index < lastIndex) {
+    [self siftDownFromIndex:index];
+    [self siftUpFromIndex:index];
+  }
+}
+
+- (void)removeAllEntries {
+  for (GTMSessionCookieEntry *entry in _entries) {
+    entry.heapIndex = NSNotFound;
+  }
+  [_entries removeAllObjects];
+}
+
+- (NSTimeInterval)expirationAtIndex:(NSUInteger)index {
+  GTMSessionCookieEntry *entry = _entries[index];
+  return entry.expiration;
+}
+
+- (void)swapIndex:(NSUInteger)firstIndex withIndex:(NSUInteger)secondIndex {
+  GTMSessionCookieEntry *firstEntry = _entries[firstIndex];
+  GTMSessionCookieEntry *secondEntry = _entries[secondIndex];
+  [_entries exchangeObjectAtIndex:firstIndex withObjectAtIndex:secondIndex];
+  firstEntry.heapIndex = secondIndex;
+  secondEntry.heapIndex = firstIndex;
+}
+
+- (void)siftUpFromIndex:(NSUInteger)index {
+  while (index > 0) {
+    NSUInteger parentIndex = (index - 1) / 2;
+    if ([self expirationAtIndex:parentIndex] <= [self expirationAtIndex:index]) break;
+
+    [self swapIndex:index withIndex:parentIndex];
+    index = parentIndex;
+  }
+}
+
+- (void)siftDownFromIndex:(NSUInteger)index {
+  NSUInteger count = _entries.count;
+  while (YES) {
+    NSUInteger soonestIndex = index;
+    NSUInteger leftIndex = 2 * index + 1;
+    NSUInteger rightIndex = leftIndex + 1;
+    if (leftIndex < count
+        && [self expirationAtIndex:leftIndex] < [self expirationAtIndex:soonestIndex]) {
+      soonestIndex = leftIndex;
+    }
+    if (rightIndex < count
+        && [self expirationAtIndex:rightIndex] < [self expirationAtIndex:soonestIndex]) {
+      soonestIndex = rightIndex;
+    }
+    if (soonestIndex == index) break;
+
+    [self swapIndex:index withIndex:soonestIndex];
+    index = soonestIndex;
+  }
+}
+
+@end
+
+// Labels of a lowercased domain, top-level domain first.  An IP address is kept as one label,
+// since RFC 6265 only lets a cookie domain match an IP address exactly.
+static NSArray *CookieDomainLabels(NSString *domain) {
+  static NSCharacterSet *gNonIPv4Characters;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    gNonIPv4Characters =
+        [[NSCharacterSet characterSetWithCharactersInString:@"0123456789."] invertedSet];
+  });
+  BOOL isIPAddress = ([domain rangeOfString:@":"].location != NSNotFound
+                      || [domain rangeOfCharacterFromSet:gNonIPv4Characters].location == NSNotFound);
+  if (isIPAddress) {
+    return @[ domain ];
+  }
+  return [[domain componentsSeparatedByString:@"."] reverseObjectEnumerator].allObjects;
+}
+
+// RFC 6265 section 5.1.4: the paths are equal, or the cookie path is a prefix of the request
+// path ending at a "/".
+static BOOL CookiePathMatches(NSString *cookiePath, NSString *requestPath) {
+  if (![requestPath hasPrefix:cookiePath]) return NO;
+
+  NSUInteger cookiePathLength = cookiePath.length;
+  return (requestPath.length == cookiePathLength
+          || [cookiePath hasSuffix:@"/"]
+          || [requestPath characterAtIndex:cookiePathLength] == '/');
+}
+
+// Cookies are indexed by domain in a trie and by expiration in a heap, so finding the cookies
+// for a request visits only the nodes of the request's host and its parent domains.
 @implementation GTMSessionCookieStorage {
-  NSMutableArray *_cookies;
+  GTMSessionCookieDomainNode *_rootNode;
+  GTMSessionCookieExpirationHeap *_expirationHeap;
+  uint64_t _nextSequence;
   NSHTTPCookieAcceptPolicy _policy;
 }
 
 - (id)init {
   self = [super init];
   if (self != nil) {
-    _cookies = [[NSMutableArray alloc] init];
+    _rootNode = [[GTMSessionCookieDomainNode alloc] initWithLabel:nil parent:nil];
+    _expirationHeap = [[GTMSessionCookieExpirationHeap alloc] init];
   }
   return self;
 }
@@ -3904,7 +4334,14 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    return [_cookies copy];
+    NSMutableArray *entries = [NSMutableArray array];
+    [_rootNode addEntriesOfSubtreeToArray:entries];
+    [entries sortUsingComparator:^NSComparisonResult(GTMSessionCookieEntry *entry1,
+                                                     GTMSessionCookieEntry *entry2) {
+      if (entry1.sequence == entry2.sequence) return NSOrderedSame;
+      return (entry1.sequence < entry2.sequence) ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    return [entries valueForKey:@"cookie"];
   }  // @synchronized(self)
 }
 
@@ -3931,14 +4368,30 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   GTMSESSION_ASSERT_DEBUG(isValidCookie, @"invalid cookie: %@", newCookie);
 
   if (isValidCookie) {
-    // Remove the cookie if it's currently in the array.
-    NSHTTPCookie *oldCookie = [self cookieMatchingCookie:newCookie];
-    if (oldCookie) {
-      [_cookies removeObjectIdenticalTo:oldCookie];
+    // Remove the cookie if it's currently stored.
+    GTMSessionCookieEntry *oldEntry = [self entryMatchingCookie:newCookie];
+    if (oldEntry) {
+      [self removeEntry:oldEntry];
     }
 
     if (![[self class] hasCookieExpired:newCookie]) {
-      [_cookies addObject:newCookie];
+      GTMSessionCookieEntry *newEntry = [[GTMSessionCookieEntry alloc] init];
+      newEntry.cookie = newCookie;
+      newEntry.sequence = oldEntry ? oldEntry.sequence : _nextSequence++;
+      newEntry.heapIndex = NSNotFound;
+
+      BOOL isHostOnly;
+      NSString *domainKey = [[self class] domainKeyForCookie:newCookie isHostOnly:&isHostOnly];
+      newEntry.hostOnly = isHostOnly;
+
+      GTMSessionCookieDomainNode *node = [self nodeForDomainKey:domainKey create:YES];
+      [node insertEntry:newEntry];
+
+      NSDate *expiresDate = [[self class] expiresDateForCookie:newCookie];
+      if (expiresDate) {
+        newEntry.expiration = expiresDate.timeIntervalSinceReferenceDate;
+        [_expirationHeap addEntry:newEntry];
+      }
     }
   }
 }
@@ -3946,7 +4399,7 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
 // Add all cookies in the new cookie array to the storage,
 // replacing stored cookies as appropriate.
 //
-// Side effect: removes expired cookies from the storage array.
+// Side effect: removes expired cookies from the storage.
 - (void)setCookies:(GTM_NULLABLE NSArray *)newCookies {
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
@@ -3984,16 +4437,21 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    NSHTTPCookie *foundCookie = [self cookieMatchingCookie:cookie];
-    if (foundCookie) {
-      [_cookies removeObjectIdenticalTo:foundCookie];
+    GTMSessionCookieEntry *foundEntry = [self entryMatchingCookie:cookie];
+    if (foundEntry) {
+      [self removeEntry:foundEntry];
     }
   }  // @synchronized(self)
 }
 
 // Retrieve all cookies appropriate for the given URL, considering
 // domain, path, cookie name, expiration, security setting.
-// Side effect: removed expired cookies from the storage array.
+//
+// Matching follows RFC 6265: a cookie whose domain has a leading "." is sent to that domain
+// and its subdomains, and one without is sent only to that exact host.  Cookies are returned
+// longest path first, then oldest first.
+//
+// Side effect: removes expired cookies from the storage.
 - (GTM_NULLABLE NSArray *)cookiesForURL:(NSURL *)theURL {
   NSMutableArray *foundCookies = nil;
 
@@ -4002,61 +4460,101 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
 
     [self removeExpiredCookies];
 
-    // We'll prepend "." to the desired domain, since we want the
-    // actual domain "nytimes.com" to still match the cookie domain
-    // ".nytimes.com" when we check it below with hasSuffix.
     NSString *host = theURL.host.lowercaseString;
-    NSString *path = theURL.path;
     NSString *scheme = [theURL scheme];
+    BOOL isSecureOK = ([scheme caseInsensitiveCompare:@"https"] == NSOrderedSame);
 
-    NSString *requestingDomain = nil;
-    BOOL isLocalhostRetrieval = NO;
-
-    if (IsLocalhost(host)) {
-      isLocalhostRetrieval = YES;
-    } else {
-      if (host.length > 0) {
-        requestingDomain = [@"." stringByAppendingString:host];
-      }
+    // NSURL's path drops a trailing "/", which path matching needs.
+    NSString *path = CFBridgingRelease(CFURLCopyPath((__bridge CFURLRef)theURL));
+    if (![path hasPrefix:@"/"]) {
+      path = @"/";
     }
 
-    for (NSHTTPCookie *storedCookie in _cookies) {
-      NSString *cookieDomain = storedCookie.domain.lowercaseString;
-      NSString *cookiePath = storedCookie.path;
-      BOOL cookieIsSecure = [storedCookie isSecure];
+    NSMutableArray *foundEntries = [NSMutableArray array];
+    NSUInteger numberOfMatchedNodes = 0;
 
-      BOOL isDomainOK;
-
-      if (isLocalhostRetrieval) {
-        // Prior to 10.5.6, the domain stored into NSHTTPCookies for localhost
-        // is "localhost.local"
-        isDomainOK = (IsLocalhost(cookieDomain)
-                      || [cookieDomain isEqual:@"localhost.local"]);
-      } else {
-        // Ensure we're matching exact domain names. We prepended a dot to the
-        // requesting domain, so we can also prepend one here if needed before
-        // checking if the request contains the cookie domain.
-        if (![cookieDomain hasPrefix:@"."]) {
-          cookieDomain = [@"." stringByAppendingString:cookieDomain];
+    if (IsLocalhost(host)) {
+      // Prior to 10.5.6, the domain stored into NSHTTPCookies for localhost
+      // is "localhost.local"
+      for (NSString *localhostDomain in @[ @"localhost", @"::1", @"127.0.0.1",
+                                           @"localhost.local" ]) {
+        GTMSessionCookieDomainNode *node = [self nodeForDomainKey:localhostDomain create:NO];
+        if (node) {
+          [self addEntriesOfNode:node
+                     matchingPath:path
+                       isSecureOK:isSecureOK
+                     isHostOnlyOK:YES
+                          toArray:foundEntries];
+          numberOfMatchedNodes++;
         }
-        isDomainOK = [requestingDomain hasSuffix:cookieDomain];
       }
+    } else if (host.length > 0) {
+      // Walk from the top-level domain to the host.  Domain cookies match at every node along
+      // the way, and host-only cookies only at the host itself.
+      NSArray *labels = CookieDomainLabels(host);
+      NSUInteger numberOfLabels = labels.count;
+      GTMSessionCookieDomainNode *node = _rootNode;
+      for (NSUInteger idx = 0; idx < numberOfLabels; idx++) {
+        node = node.children[labels[idx]];
+        if (!node) break;
+
+        [self addEntriesOfNode:node
+                   matchingPath:path
+                     isSecureOK:isSecureOK
+                   isHostOnlyOK:(idx == numberOfLabels - 1)
+                        toArray:foundEntries];
+        numberOfMatchedNodes++;
+      }
+    }
 
-      BOOL isPathOK = [cookiePath isEqual:@"/"] || [path hasPrefix:cookiePath];
-      BOOL isSecureOK = (!cookieIsSecure
-                         || [scheme caseInsensitiveCompare:@"https"] == NSOrderedSame);
-
-      if (isDomainOK && isPathOK && isSecureOK) {
-        if (foundCookies == nil) {
-          foundCookies = [NSMutableArray array];
-        }
-        [foundCookies addObject:storedCookie];
+    if (foundEntries.count > 0) {
+      // Each node's entries are already in order; only cookies from several nodes need sorting.
+      if (numberOfMatchedNodes > 1) {
+        [foundEntries sortUsingComparator:^NSComparisonResult(GTMSessionCookieEntry *entry1,
+                                                              GTMSessionCookieEntry *entry2) {
+          NSUInteger pathLength1 = entry1.cookie.path.length;
+          NSUInteger pathLength2 = entry2.cookie.path.length;
+          if (pathLength1 != pathLength2) {
+            return (pathLength1 > pathLength2) ? NSOrderedAscending : NSOrderedDescending;
+          }
+          if (entry1.sequence == entry2.sequence) return NSOrderedSame;
+          return (entry1.sequence < entry2.sequence) ? NSOrderedAscending : NSOrderedDescending;
+        }];
+      }
+      foundCookies = [NSMutableArray arrayWithCapacity:foundEntries.count];
+      for (GTMSessionCookieEntry *entry in foundEntries) {
+        [foundCookies addObject:entry.cookie];
       }
     }
   }  // @synchronized(self)
   return foundCookies;
 }
 
+// Note: this should only be called from inside a @synchronized(self) block
+- (void)addEntriesOfNode:(GTMSessionCookieDomainNode *)node
+            matchingPath:(NSString *)path
+              isSecureOK:(BOOL)isSecureOK
+            isHostOnlyOK:(BOOL)isHostOnlyOK
+                 toArray:(NSMutableArray *)foundEntries {
+  GTMSessionCheckSynchronized(self);
+
+  NSArray *entries = node.entries;
+  NSUInteger count = entries.count;
+  for (NSUInteger idx = [node indexOfFirstEntryWithPathLengthAtMost:path.length];
+       idx < count;
+       idx++) {
+    GTMSessionCookieEntry *entry = entries[idx];
+    if (entry.hostOnly && !isHostOnlyOK) continue;
+
+    NSHTTPCookie *storedCookie = entry.cookie;
+    if ([storedCookie isSecure] && !isSecureOK) continue;
+
+    if (CookiePathMatches(storedCookie.path, path)) {
+      [foundEntries addObject:entry];
+    }
+  }
+}
+
 // Override methods from the NSHTTPCookieStorage (NSURLSessionTaskAdditions) category.
 - (void)storeCookies:(NSArray *)cookies forTask:(NSURLSessionTask *)task {
   NSURLRequest *currentRequest = task.currentRequest;
@@ -4073,14 +4571,42 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   }
 }
 
-// Return a cookie from the array with the same name, domain, and path as the
+// The lowercased cookie domain without its leading ".", which is the key of the cookie's
+// trie node.  A domain without the leading "." is host-only.
++ (NSString *)domainKeyForCookie:(NSHTTPCookie *)cookie isHostOnly:(BOOL *)outIsHostOnly {
+  NSString *domain = cookie.domain.lowercaseString;
+  BOOL isHostOnly = ![domain hasPrefix:@"."];
+  *outIsHostOnly = isHostOnly;
+  return isHostOnly ? domain : [domain substringFromIndex:1];
+}
+
+// Note: this should only be called from inside a @synchronized(self) block
+- (GTM_NULLABLE GTMSessionCookieDomainNode *)nodeForDomainKey:(NSString *)domainKey
+                                                       create:(BOOL)shouldCreate {
+  GTMSessionCheckSynchronized(self);
+
+  GTMSessionCookieDomainNode *node = _rootNode;
+  for (NSString *label in CookieDomainLabels(domainKey)) {
+    GTMSessionCookieDomainNode *child = node.children[label];
+    if (!child) {
+      if (!shouldCreate) return nil;
+
+      child = [[GTMSessionCookieDomainNode alloc] initWithLabel:label parent:node];
+      node.children[label] = child;
+    }
+    node = child;
+  }
+  return node;
+}
+
+// Return the entry of a stored cookie with the same name, domain, and path as the
 // given cookie, or else return nil if none found.
 //
-// Both the cookie being tested and all cookies in the storage array should
+// Both the cookie being tested and all stored cookies should
 // be valid (non-nil name, domains, paths).
 //
 // Note: this should only be called from inside a @synchronized(self) block
-- (GTM_NULLABLE NSHTTPCookie *)cookieMatchingCookie:(NSHTTPCookie *)cookie {
+- (GTM_NULLABLE GTMSessionCookieEntry *)entryMatchingCookie:(NSHTTPCookie *)cookie {
   GTMSessionCheckSynchronized(self);
 
   NSString *name = cookie.name;
@@ -4090,33 +4616,56 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   GTMSESSION_ASSERT_DEBUG(name && domain && path,
                           @"Invalid stored cookie (name:%@ domain:%@ path:%@)", name, domain, path);
 
-  for (NSHTTPCookie *storedCookie in _cookies) {
+  BOOL isHostOnly;
+  NSString *domainKey = [[self class] domainKeyForCookie:cookie isHostOnly:&isHostOnly];
+  GTMSessionCookieDomainNode *node = [self nodeForDomainKey:domainKey create:NO];
+  for (GTMSessionCookieEntry *entry in node.entries) {
+    NSHTTPCookie *storedCookie = entry.cookie;
     if ([storedCookie.name isEqual:name]
         && [storedCookie.domain isEqual:domain]
         && [storedCookie.path isEqual:path]) {
-      return storedCookie;
+      return entry;
     }
   }
   return nil;
 }
 
-// Internal routine to remove any expired cookies from the array, excluding
+// Removes the entry from its trie node and the expiration heap, and prunes trie nodes left
+// with no cookies.
+//
+// Note: this should only be called from inside a @synchronized(self) block
+- (void)removeEntry:(GTMSessionCookieEntry *)entry {
+  GTMSessionCheckSynchronized(self);
+
+  if (entry.heapIndex != NSNotFound) {
+    [_expirationHeap removeEntry:entry];
+  }
+  GTMSessionCookieDomainNode *node = entry.node;
+  [node removeEntry:entry];
+
+  while (node != nil && node != _rootNode
+         && node.entries.count == 0 && node.children.count == 0) {
+    GTMSessionCookieDomainNode *parent = node.parent;
+    [parent.children removeObjectForKey:(NSString *)node.label];
+    node = parent;
+  }
+}
+
+// Internal routine to remove any expired cookies from the storage, excluding
 // cookies with nil expirations.
 //
 // Note: this should only be called from inside a @synchronized(self) block
 - (void)removeExpiredCookies {
   GTMSessionCheckSynchronized(self);
 
-  // Count backwards since we're deleting items from the array
-  for (NSInteger idx = (NSInteger)_cookies.count - 1; idx >= 0; idx--) {
-    NSHTTPCookie *storedCookie = [_cookies objectAtIndex:(NSUInteger)idx];
-    if ([[self class] hasCookieExpired:storedCookie]) {
-      [_cookies removeObjectAtIndex:(NSUInteger)idx];
-    }
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  GTMSessionCookieEntry *entry;
+  while ((entry = _expirationHeap.firstEntry) != nil && entry.expiration < now) {
+    [self removeEntry:entry];
   }
 }
 
-+ (BOOL)hasCookieExpired:(NSHTTPCookie *)cookie {
++ (GTM_NULLABLE NSDate *)expiresDateForCookie:(NSHTTPCookie *)cookie {
   NSDate *expiresDate = [cookie expiresDate];
   if (expiresDate == nil) {
     // Cookies seem to have a Expires property even when the expiresDate method returns nil.
@@ -4125,6 +4674,11 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
       expiresDate = expiresVal;
     }
   }
+  return expiresDate;
+}
+
++ (BOOL)hasCookieExpired:(NSHTTPCookie *)cookie {
+  NSDate *expiresDate = [self expiresDateForCookie:cookie];
   BOOL hasExpired = (expiresDate != nil && [expiresDate timeIntervalSinceNow] < 0);
   return hasExpired;
 }
@@ -4133,7 +4687,8 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    [_cookies removeAllObjects];
+    _rootNode = [[GTMSessionCookieDomainNode alloc] initWithLabel:nil parent:nil];
+    [_expirationHeap removeAllEntries];
   }  // @synchronized(self)
 }
 
@@ -4155,6 +4710,279 @@ static NSMutableDictionary *gSystemCompletionHandlers = nil;
 
 @end
 
+@implementation GTMSessionFetcherDataAccumulator {
+  int64_t _spillThreshold;  // immutable after init; zero never spills
+  dispatch_data_t _segments;  // in-memory bytes, nil once spilled
+  int64_t _length;
+  NSURL *_spillFileURL;  // set once spilled
+  int _spillFileDescriptor;
+}
+
+- (instancetype)initWithSpillThreshold:(int64_t)spillThreshold {
+  self = [super init];
+  if (self) {
+    _spillThreshold = spillThreshold;
+    _segments = dispatch_data_empty;
+    _spillFileDescriptor = -1;
+  }
+  return self;
+}
+
+- (instancetype)init {
+  return [self initWithSpillThreshold:0];
+}
+
+- (void)dealloc {
+  [self removeSpillFile];
+}
+
+- (int64_t)length {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    return _length;
+  }  // @synchronized(self)
+}
+
+- (void)appendData:(GTM_NULLABLE NSData *)data {
+  NSUInteger dataLength = data.length;
+  if (dataLength == 0) {
+    return;
+  }
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    // The session may hand over non-contiguous data; walk its byte ranges rather than asking
+    // for -bytes, which would flatten it into a new buffer.
+    if (_spillFileURL) {
+      __block BOOL didWrite = YES;
+      [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+          didWrite = [self writeBytes:bytes length:byteRange.length];
+          *stop = !didWrite;
+      }];
+      if (didWrite) {
+        _length += (int64_t)dataLength;
+        return;
+      }
+      // Writing failed; keep everything in memory from here on. Part of this buffer may have
+      // reached the file, so cut it back before reloading and append the whole buffer below.
+      ftruncate(_spillFileDescriptor, (off_t)_length);
+      [self loadSpillFile];
+    }
+    // Each range becomes a segment that keeps the immutable buffer alive instead of copying
+    // its bytes.
+    NSData *buffer = [data copy];
+    __block dispatch_data_t segments = _segments;
+    [buffer enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        dispatch_data_t segment = dispatch_data_create(bytes, byteRange.length, NULL, ^{
+            [buffer self];
+        });
+        segments = dispatch_data_create_concat(segments, segment);
+    }];
+    _segments = segments;
+    _length += (int64_t)dataLength;
+
+    if (_spillThreshold > 0 && _length > _spillThreshold && _segments) {
+      [self spill];
+    }
+  }  // @synchronized(self)
+}
+
+- (GTM_NULLABLE NSData *)data {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_length == 0) {
+      return nil;
+    }
+    if (_spillFileURL) {
+      return [NSData dataWithContentsOfURL:(NSURL *)_spillFileURL
+                                   options:NSDataReadingMappedIfSafe
+                                     error:NULL];
+    }
+    // dispatch_data_t is bridged to NSData; the segments stay non-contiguous.
+    return (NSData *)_segments;
+  }  // @synchronized(self)
+}
+
+- (BOOL)writeToURL:(NSURL *)url error:(NSError **)error {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_spillFileURL) {
+      [self closeSpillFile];
+      NSURL *spillFileURL = _spillFileURL;
+      if (![[NSFileManager defaultManager] moveItemAtURL:(NSURL *)spillFileURL
+                                                   toURL:url
+                                                   error:error]) {
+        return NO;
+      }
+      _spillFileURL = nil;
+      _segments = dispatch_data_empty;
+      _length = 0;
+      return YES;
+    }
+    return [(NSData *)_segments writeToURL:url
+                                   options:NSDataWritingAtomic
+                                     error:error];
+  }  // @synchronized(self)
+}
+
+- (void)reset {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    [self removeSpillFile];
+    _segments = dispatch_data_empty;
+    _length = 0;
+  }  // @synchronized(self)
+}
+
+// Moves the in-memory segments to a new temporary file. If the file can't be written the
+// segments stay in memory and spilling is not tried again.
+- (void)spill {
+  GTMSessionCheckSynchronized(self);
+
+  NSString *fileName = [NSString stringWithFormat:@"GTMSessionFetcher-%@",
+                           [[NSUUID UUID] UUIDString]];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:fileName];
+  int fileDescriptor = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fileDescriptor < 0) {
+    _spillThreshold = 0;
+    return;
+  }
+  _spillFileDescriptor = fileDescriptor;
+  _spillFileURL = [NSURL fileURLWithPath:path];
+
+  __block BOOL didWrite = YES;
+  dispatch_data_apply(_segments, ^bool(dispatch_data_t region, size_t offset,
+                                       const void *buffer, size_t size) {
+      didWrite = [self writeBytes:buffer length:size];
+      return didWrite;
+  });
+  if (didWrite) {
+    _segments = nil;
+  } else {
+    [self removeSpillFile];
+    _spillThreshold = 0;
+  }
+}
+
+// Reads a spill file that can no longer be written back into memory.
+- (void)loadSpillFile {
+  GTMSessionCheckSynchronized(self);
+
+  [self closeSpillFile];
+  NSData *spilled = [NSData dataWithContentsOfURL:(NSURL *)_spillFileURL];
+  [self removeSpillFile];
+  _spillThreshold = 0;
+  _segments = dispatch_data_empty;
+  _length = 0;
+  if (spilled.length > 0) {
+    _segments = dispatch_data_create(spilled.bytes, spilled.length, NULL, ^{
+        [spilled self];
+    });
+    _length = (int64_t)spilled.length;
+  }
+}
+
+- (BOOL)writeBytes:(const void *)bytes length:(size_t)length {
+  const char *remaining = bytes;
+  while (length > 0) {
+    ssize_t written = write(_spillFileDescriptor, remaining, length);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return NO;
+    }
+    remaining += written;
+    length -= (size_t)written;
+  }
+  return YES;
+}
+
+- (void)closeSpillFile {
+  if (_spillFileDescriptor >= 0) {
+    close(_spillFileDescriptor);
+    _spillFileDescriptor = -1;
+  }
+}
+
+- (void)removeSpillFile {
+  [self closeSpillFile];
+  if (_spillFileURL) {
+    [[NSFileManager defaultManager] removeItemAtURL:(NSURL *)_spillFileURL error:NULL];
+    _spillFileURL = nil;
+  }
+}
+
+@end
+
+static double RandomUnitInterval(void) {
+  return (double)arc4random() / ((double)UINT32_MAX + 1.0);
+}
+
+@implementation GTMSessionFetcherBackoffRetryPolicy
+
+@synthesize jitter = _jitter,
+            factor = _factor,
+            randomBlock = _randomBlock;
+
++ (instancetype)policyWithJitter:(GTMSessionFetcherBackoffJitter)jitter {
+  GTMSessionFetcherBackoffRetryPolicy *policy = [[self alloc] init];
+  policy.jitter = jitter;
+  return policy;
+}
+
+- (instancetype)init {
+  self = [super init];
+  if (self) {
+    _factor = 2.0;
+  }
+  return self;
+}
+
+- (NSTimeInterval)retryIntervalForRetryNumber:(NSUInteger)retryNumber
+                             previousInterval:(NSTimeInterval)previousInterval
+                           retryAfterInterval:(NSTimeInterval)retryAfterInterval
+                                  minInterval:(NSTimeInterval)minInterval
+                                  maxInterval:(NSTimeInterval)maxInterval {
+  double (^randomBlock)(void) = self.randomBlock;
+  double random = randomBlock ? randomBlock() : RandomUnitInterval();
+  BOOL hasMaxInterval = (maxInterval > 0);
+
+  // The unjittered delay limits the number of retries, as it does for fetchers without a policy.
+  double exponent = (retryNumber > 0) ? (double)(retryNumber - 1) : 0;
+  NSTimeInterval ceiling = minInterval * pow(self.factor, exponent);
+  if (hasMaxInterval && ceiling >= maxInterval) {
+    return -1;
+  }
+
+  if (retryAfterInterval >= 0) {
+    // Don't retry sooner than the server asked, and don't wait longer than the fetcher allows.
+    if (hasMaxInterval && retryAfterInterval > maxInterval) {
+      return -1;
+    }
+    return retryAfterInterval + random * minInterval;
+  }
+
+  switch (self.jitter) {
+    case GTMSessionFetcherBackoffJitterFull:
+      return random * ceiling;
+
+    case GTMSessionFetcherBackoffJitterDecorrelated: {
+      NSTimeInterval upper = MAX(previousInterval, minInterval) * 3;
+      NSTimeInterval interval = minInterval + random * (upper - minInterval);
+      return hasMaxInterval ? MIN(interval, maxInterval) : interval;
+    }
+
+    case GTMSessionFetcherBackoffJitterNone:
+    default:
+      return ceiling;
+  }
+}
+
+@end
+
 void GTMSessionFetcherAssertValidSelector(id GTM_NULLABLE_TYPE obj, SEL GTM_NULLABLE_TYPE sel, ...) {
   // Verify that the object's selector is implemented with the proper
   // number and type of arguments
@@ -47,6 +47,21 @@ extern NSString *const kGTMSessionFetcherServiceSessionKey;
 // not resurrected on an app relaunch, delayed fetchers would effectively be abandoned.
 @property(atomic, assign) NSUInteger maxRunningFetchersPerHost;
 
+// The limit on simultaneous fetchers across all hosts, applied on top of the per-host limit.
+// The default of 0 means no limit.  Like the per-host limit, this does not apply to fetchers
+// using background sessions.  A freed slot goes first to the stopped fetcher's host, then to
+// the other hosts with delayed fetchers in turn.
+@property(atomic, assign) NSUInteger maxRunningFetchers;
+
+// Delayed fetchers for a host start by priority class: fetchers with a negative servicePriority
+// are interactive, 0 is normal, and positive values are background.  Within a class, lower
+// servicePriority values start first, then fetchers in the order they were delayed.
+//
+// A delayed fetcher is treated as one class higher for each priorityAgingInterval it has waited,
+// so a steady stream of interactive fetchers cannot starve background ones.  The default is
+// 10 seconds; 0 disables aging.
+@property(atomic, assign) NSTimeInterval priorityAgingInterval;
+
 // Properties to be applied to each fetcher; see GTMSessionFetcher.h for descriptions
 @property(atomic, strong, GTM_NULLABLE) NSURLSessionConfiguration *configuration;
 @property(atomic, copy, GTM_NULLABLE) GTMSessionFetcherConfigurationBlock configurationBlock;
@@ -62,6 +77,7 @@ extern NSString *const kGTMSessionFetcherServiceSessionKey;
 @property(atomic, copy, GTM_NULLABLE) GTMSessionFetcherRetryBlock retryBlock;
 @property(atomic, assign) NSTimeInterval maxRetryInterval;
 @property(atomic, assign) NSTimeInterval minRetryInterval;
+@property(atomic, strong, GTM_NULLABLE) id<GTMSessionFetcherRetryPolicy> retryPolicy;
 @property(atomic, copy, GTM_NULLABLE) GTM_NSDictionaryOf(NSString *, id) *properties;
 
 #if GTM_BACKGROUND_TASK_FETCHING
@@ -102,6 +118,35 @@ extern NSString *const kGTMSessionFetcherServiceSessionKey;
 // fetchers begin.
 - (void)resetSession;
 
+// Host health
+//
+// The service's fetchers share what they learn about each host, so that a burst of failures
+// does not turn into a burst of retries.
+//
+// Retry budget: each host has a bucket holding up to retryBudgetCapacity retry tokens, which
+// starts full.  Every new fetch to the host adds retryBudgetRatio tokens and every retry takes
+// one; a fetch whose retry finds less than one token fails instead.  Once the initial tokens are
+// spent, retries add at most retryBudgetRatio to the requests sent to a failing host.
+// A capacity of 0, the default, disables retry budgets.
+@property(atomic, assign) double retryBudgetCapacity;
+@property(atomic, assign) double retryBudgetRatio;  // default 0.1
+
+// Circuit breaker: after circuitBreakerFailureThreshold consecutive attempts to a host fail with
+// a retryable status or network error, or a 429 status, new attempts to the host fail at once with
+// GTMSessionFetcherErrorHostUnavailable.  Every circuitBreakerOpenInterval seconds one attempt is
+// let through to probe the host, and any successful attempt closes the circuit again.
+// A threshold of 0, the default, disables the circuit breaker.
+@property(atomic, assign) NSUInteger circuitBreakerFailureThreshold;
+@property(atomic, assign) NSTimeInterval circuitBreakerOpenInterval;  // default 30 seconds
+
+// Requests sent to the host per fetch begun, counting retries, or for all hosts when host is nil.
+// 1.0 means no fetch was retried; below 1.0, the circuit breaker failed fetches without sending
+// them.
+- (double)requestAmplificationForHost:(GTM_NULLABLE NSString *)host;
+
+// Forgets the retry budgets, circuits and counts of all hosts.
+- (void)resetHostHealth;
+
 // Create a fetcher
 //
 // These methods will return a fetcher. If successfully created, the connection
@@ -149,6 +194,10 @@ extern NSString *const kGTMSessionFetcherServiceSessionKey;
 // determine which fetcher is being faked.
 @property(atomic, copy, GTM_NULLABLE) GTMSessionFetcherTestBlock testBlock;
 
+// The clock read by the circuit breaker and for priority aging, in seconds.  nil uses the
+// system clock; tests may substitute a fake clock.
+@property(atomic, copy, GTM_NULLABLE) NSTimeInterval (^clockBlock)(void);
+
 @end
 
 @interface GTMSessionFetcherService (TestingSupport)
@@ -31,10 +31,83 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 @end
 #endif  // !GTMSESSION_BUILD_COMBINED_SOURCES
 
-@interface GTMSessionFetcherService ()
+// Priority classes for delayed fetchers, from the fetcher's servicePriority.
+typedef NS_ENUM(NSInteger, GTMSessionFetcherPriorityClass) {
+  GTMSessionFetcherPriorityClassInteractive = 0,
+  GTMSessionFetcherPriorityClassNormal,
+  GTMSessionFetcherPriorityClassBackground,
+  GTMSessionFetcherPriorityClassCount
+};
+
+// A fetcher's entry in the scheduler.  The node is linked into its host's running list or into
+// the delayed list for its priority class, so it can be unlinked in constant time.  Links are
+// unretained; the service's node table owns the nodes.
+@interface GTMSessionFetcherSchedulerNode : NSObject
+
+- (instancetype)initWithFetcher:(GTMSessionFetcher *)fetcher
+                           host:(NSString *)host
+                       priority:(NSInteger)priority
+         usingBackgroundSession:(BOOL)usingBackgroundSession;
+
+@property(atomic, readonly) GTMSessionFetcher *fetcher;
+@property(atomic, readonly) NSString *host;
+@property(atomic, readonly) NSInteger priority;
+@property(atomic, readonly) GTMSessionFetcherPriorityClass priorityClass;
+@property(atomic, readonly) BOOL usingBackgroundSession;
+@property(atomic, assign, getter=isRunning) BOOL running;
+@property(atomic, assign) NSTimeInterval delayedTime;
+@property(atomic, unsafe_unretained) GTMSessionFetcherSchedulerNode *previous;
+@property(atomic, unsafe_unretained) GTMSessionFetcherSchedulerNode *next;
 
-@property(atomic, strong, readwrite) NSDictionary *delayedFetchersByHost;
-@property(atomic, strong, readwrite) NSDictionary *runningFetchersByHost;
+@end
+
+// A doubly linked list of scheduler nodes.
+@interface GTMSessionFetcherSchedulerList : NSObject
+
+@property(atomic, readonly, unsafe_unretained) GTMSessionFetcherSchedulerNode *first;
+@property(atomic, readonly) NSUInteger count;
+
+- (void)appendNode:(GTMSessionFetcherSchedulerNode *)node;
+// Inserts after the last node with an equal or lower priority value.  Equal priorities, the
+// common case, are appended without walking the list.
+- (void)insertNodeByPriority:(GTMSessionFetcherSchedulerNode *)node;
+- (void)removeNode:(GTMSessionFetcherSchedulerNode *)node;
+- (NSArray *)fetchers;
+
+@end
+
+// The running and delayed fetchers for one host.
+@interface GTMSessionFetcherHostQueue : NSObject
+
+- (instancetype)initWithHost:(NSString *)host;
+
+@property(atomic, readonly) NSString *host;
+@property(atomic, readonly) GTMSessionFetcherSchedulerList *runningList;
+// Running fetchers not using background sessions, which count against the limits.
+@property(atomic, assign) NSUInteger foregroundRunningCount;
+@property(atomic, readonly) NSUInteger delayedCount;
+
+- (GTMSessionFetcherSchedulerList *)delayedListForPriorityClass:(GTMSessionFetcherPriorityClass)priorityClass;
+
+// The delayed node to start next.  Each list's first node moves up one class for every
+// agingInterval it has waited; among equals, the one delayed longest wins.
+- (GTMSessionFetcherSchedulerNode *)nextDelayedNodeAtTime:(NSTimeInterval)now
+                                            agingInterval:(NSTimeInterval)agingInterval;
+- (NSArray *)delayedFetchers;
+
+@end
+
+// Retry budget and circuit breaker state for one host.  Accessed only within the service's
+// @synchronized scopes.
+@interface GTMSessionFetcherHostHealth : NSObject
+
+@property(atomic, assign) double retryTokens;
+@property(atomic, assign) NSUInteger consecutiveFailures;
+@property(atomic, assign, getter=isCircuitOpen) BOOL circuitOpen;
+// When the circuit opened or last let a probe through.
+@property(atomic, assign) NSTimeInterval circuitOpenedTime;
+@property(atomic, assign) NSUInteger fetchCount;
+@property(atomic, assign) NSUInteger requestCount;
 
 @end
 
@@ -73,9 +146,22 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 
 
 @implementation GTMSessionFetcherService {
-  NSMutableDictionary *_delayedFetchersByHost;
-  NSMutableDictionary *_runningFetchersByHost;
+  // GTMSessionFetcherHostQueue objects keyed by host, for hosts with running or delayed fetchers.
+  NSMutableDictionary *_hostQueues;
+  // GTMSessionFetcherSchedulerNode objects keyed by fetcher identity.
+  NSMapTable *_schedulerNodes;
+  // Hosts with delayed fetchers held back only by maxRunningFetchers, in the order they
+  // get the next free slot.
+  NSMutableOrderedSet *_hostsWaitingForGlobalSlot;
+  NSUInteger _runningFetcherCount;
+  NSUInteger _foregroundRunningFetcherCount;
+  NSUInteger _delayedFetcherCount;
   NSUInteger _maxRunningFetchersPerHost;
+  NSUInteger _maxRunningFetchers;
+  NSTimeInterval _priorityAgingInterval;
+
+  // GTMSessionFetcherHostHealth objects keyed by host.
+  NSMutableDictionary *_hostHealthByHost;
 
   // When this ivar is nil, the service will not reuse sessions.
   GTMSessionFetcherSessionDelegateDispatcher *_delegateDispatcher;
@@ -107,6 +193,8 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 }
 
 @synthesize maxRunningFetchersPerHost = _maxRunningFetchersPerHost,
+            maxRunningFetchers = _maxRunningFetchers,
+            priorityAgingInterval = _priorityAgingInterval,
             configuration = _configuration,
             configurationBlock = _configurationBlock,
             cookieStorage = _cookieStorage,
@@ -121,6 +209,12 @@ NSString *const kGTMSessionFetcherServiceSessionKey
             retryBlock = _retryBlock,
             maxRetryInterval = _maxRetryInterval,
             minRetryInterval = _minRetryInterval,
+            retryPolicy = _retryPolicy,
+            retryBudgetCapacity = _retryBudgetCapacity,
+            retryBudgetRatio = _retryBudgetRatio,
+            circuitBreakerFailureThreshold = _circuitBreakerFailureThreshold,
+            circuitBreakerOpenInterval = _circuitBreakerOpenInterval,
+            clockBlock = _clockBlock,
             properties = _properties,
             unusedSessionTimeout = _unusedSessionTimeout,
             testBlock = _testBlock;
@@ -132,9 +226,17 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 - (instancetype)init {
   self = [super init];
   if (self) {
-    _delayedFetchersByHost = [[NSMutableDictionary alloc] init];
-    _runningFetchersByHost = [[NSMutableDictionary alloc] init];
+    _hostQueues = [[NSMutableDictionary alloc] init];
+    _schedulerNodes =
+        [NSMapTable mapTableWithKeyOptions:(NSPointerFunctionsStrongMemory
+                                            | NSPointerFunctionsObjectPointerPersonality)
+                              valueOptions:NSPointerFunctionsStrongMemory];
+    _hostsWaitingForGlobalSlot = [[NSMutableOrderedSet alloc] init];
     _maxRunningFetchersPerHost = 10;
+    _priorityAgingInterval = 10.0;
+    _hostHealthByHost = [[NSMutableDictionary alloc] init];
+    _retryBudgetRatio = 0.1;
+    _circuitBreakerOpenInterval = 30.0;
     _cookieStorageMethod = -1;
     _unusedSessionTimeout = 60.0;
     _delegateDispatcher =
@@ -186,6 +288,7 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   fetcher.retryBlock = self.retryBlock;
   fetcher.maxRetryInterval = self.maxRetryInterval;
   fetcher.minRetryInterval = self.minRetryInterval;
+  fetcher.retryPolicy = self.retryPolicy;
   fetcher.properties = self.properties;
   fetcher.service = self;
   if (self.cookieStorageMethod >= 0) {
@@ -280,42 +383,121 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 
 #pragma mark Queue Management
 
-- (void)addRunningFetcher:(GTMSessionFetcher *)fetcher
-                  forHost:(NSString *)host {
-  // Add to the array of running fetchers for this host, creating the array if needed.
-  NSMutableArray *runningForHost = [_runningFetchersByHost objectForKey:host];
-  if (runningForHost == nil) {
-    runningForHost = [NSMutableArray arrayWithObject:fetcher];
-    [_runningFetchersByHost setObject:runningForHost forKey:host];
-  } else {
-    [runningForHost addObject:fetcher];
+- (NSTimeInterval)currentTime {
+  NSTimeInterval (^clockBlock)(void) = self.clockBlock;
+  return clockBlock ? clockBlock() : [NSDate timeIntervalSinceReferenceDate];
+}
+
+- (GTMSessionFetcherHostQueue *)hostQueueForHost:(NSString *)host {
+  GTMSessionCheckSynchronized(self);
+
+  GTMSessionFetcherHostQueue *hostQueue = [_hostQueues objectForKey:host];
+  if (hostQueue == nil) {
+    hostQueue = [[GTMSessionFetcherHostQueue alloc] initWithHost:host];
+    [_hostQueues setObject:hostQueue forKey:host];
   }
+  return hostQueue;
 }
 
-- (void)addDelayedFetcher:(GTMSessionFetcher *)fetcher
-                  forHost:(NSString *)host {
-  // Add to the array of delayed fetchers for this host, creating the array if needed.
-  NSMutableArray *delayedForHost = [_delayedFetchersByHost objectForKey:host];
-  if (delayedForHost == nil) {
-    delayedForHost = [NSMutableArray arrayWithObject:fetcher];
-    [_delayedFetchersByHost setObject:delayedForHost forKey:host];
+- (BOOL)hostQueueHasRoom:(GTMSessionFetcherHostQueue *)hostQueue {
+  GTMSessionCheckSynchronized(self);
+
+  return (_maxRunningFetchersPerHost == 0
+          || hostQueue.foregroundRunningCount < _maxRunningFetchersPerHost);
+}
+
+- (BOOL)hasRoomForRunningFetcher {
+  GTMSessionCheckSynchronized(self);
+
+  return (_maxRunningFetchers == 0 || _foregroundRunningFetcherCount < _maxRunningFetchers);
+}
+
+- (void)addRunningNode:(GTMSessionFetcherSchedulerNode *)node
+           toHostQueue:(GTMSessionFetcherHostQueue *)hostQueue {
+  GTMSessionCheckSynchronized(self);
+
+  node.running = YES;
+  [hostQueue.runningList appendNode:node];
+  _runningFetcherCount++;
+  if (!node.usingBackgroundSession) {
+    hostQueue.foregroundRunningCount += 1;
+    _foregroundRunningFetcherCount++;
+  }
+}
+
+- (void)addDelayedNode:(GTMSessionFetcherSchedulerNode *)node
+           toHostQueue:(GTMSessionFetcherHostQueue *)hostQueue
+                  time:(NSTimeInterval)now {
+  GTMSessionCheckSynchronized(self);
+
+  node.running = NO;
+  node.delayedTime = now;
+  [[hostQueue delayedListForPriorityClass:node.priorityClass] insertNodeByPriority:node];
+  _delayedFetcherCount++;
+}
+
+// Unlinks the node from its host's lists and forgets it.
+- (void)removeNode:(GTMSessionFetcherSchedulerNode *)node
+     fromHostQueue:(GTMSessionFetcherHostQueue *)hostQueue {
+  GTMSessionCheckSynchronized(self);
+
+  if (node.running) {
+    [hostQueue.runningList removeNode:node];
+    _runningFetcherCount--;
+    if (!node.usingBackgroundSession) {
+      hostQueue.foregroundRunningCount -= 1;
+      _foregroundRunningFetcherCount--;
+    }
   } else {
-    [delayedForHost addObject:fetcher];
+    [[hostQueue delayedListForPriorityClass:node.priorityClass] removeNode:node];
+    _delayedFetcherCount--;
   }
+  [_schedulerNodes removeObjectForKey:node.fetcher];
+}
+
+// A host waits for a global slot when it has delayed fetchers and room of its own.
+- (void)updateGlobalSlotWaitForHostQueue:(GTMSessionFetcherHostQueue *)hostQueue {
+  GTMSessionCheckSynchronized(self);
+
+  NSString *host = hostQueue.host;
+  BOOL isWaiting = (hostQueue.delayedCount > 0 && [self hostQueueHasRoom:hostQueue]);
+  if (!isWaiting) {
+    [_hostsWaitingForGlobalSlot removeObject:host];
+  } else if (![_hostsWaitingForGlobalSlot containsObject:host]) {
+    [_hostsWaitingForGlobalSlot addObject:host];
+  }
+}
+
+// Moves up to |limit| of the host's delayed fetchers to running while the limits allow, adding
+// them to fetchersToStart so they can be started outside of the synchronized block.
+- (void)promoteDelayedFetchersOfHostQueue:(GTMSessionFetcherHostQueue *)hostQueue
+                                    limit:(NSUInteger)limit
+                                     time:(NSTimeInterval)now
+                          fetchersToStart:(NSMutableArray *)fetchersToStart {
+  GTMSessionCheckSynchronized(self);
+
+  NSUInteger numberStarted = 0;
+  while (numberStarted < limit
+         && hostQueue.delayedCount > 0
+         && [self hostQueueHasRoom:hostQueue]
+         && [self hasRoomForRunningFetcher]) {
+    GTMSessionFetcherSchedulerNode *node =
+        [hostQueue nextDelayedNodeAtTime:now agingInterval:_priorityAgingInterval];
+    [[hostQueue delayedListForPriorityClass:node.priorityClass] removeNode:node];
+    _delayedFetcherCount--;
+    [self addRunningNode:node toHostQueue:hostQueue];
+    [fetchersToStart addObject:node.fetcher];
+    numberStarted++;
+  }
+  [self updateGlobalSlotWaitForHostQueue:hostQueue];
 }
 
 - (BOOL)isDelayingFetcher:(GTMSessionFetcher *)fetcher {
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    NSString *host = fetcher.request.URL.host;
-    if (host == nil) {
-      return NO;
-    }
-    NSArray *delayedForHost = [_delayedFetchersByHost objectForKey:host];
-    NSUInteger idx = [delayedForHost indexOfObjectIdenticalTo:fetcher];
-    BOOL isDelayed = (delayedForHost != nil) && (idx != NSNotFound);
-    return isDelayed;
+    GTMSessionFetcherSchedulerNode *node = [_schedulerNodes objectForKey:fetcher];
+    return (node != nil && !node.running);
   }
 }
 
@@ -336,26 +518,38 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   }
 
   BOOL shouldBeginResult;
+  NSInteger priority = fetcher.servicePriority;
+  BOOL isUsingBackgroundSession = fetcher.usingBackgroundSession;
+  NSTimeInterval now = [self currentTime];
 
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    NSMutableArray *runningForHost = [_runningFetchersByHost objectForKey:host];
-    if (runningForHost != nil
-        && [runningForHost indexOfObjectIdenticalTo:fetcher] != NSNotFound) {
-      GTMSESSION_ASSERT_DEBUG(NO, @"%@ was already running", fetcher);
-      return YES;
+    GTMSessionFetcherSchedulerNode *existingNode = [_schedulerNodes objectForKey:fetcher];
+    if (existingNode != nil) {
+      GTMSESSION_ASSERT_DEBUG(NO, @"%@ was already %@", fetcher,
+                              existingNode.running ? @"running" : @"delayed");
+      return existingNode.running;
     }
 
-    BOOL shouldRunNow = (fetcher.usingBackgroundSession
-                         || _maxRunningFetchersPerHost == 0
-                         || _maxRunningFetchersPerHost >
-                         [[self class] numberOfNonBackgroundSessionFetchers:runningForHost]);
+    GTMSessionFetcherSchedulerNode *node =
+        [[GTMSessionFetcherSchedulerNode alloc] initWithFetcher:fetcher
+                                                           host:host
+                                                       priority:priority
+                                         usingBackgroundSession:isUsingBackgroundSession];
+    [_schedulerNodes setObject:node forKey:fetcher];
+
+    // Fetchers using background sessions are never delayed, since services are not resurrected
+    // on an app relaunch.
+    GTMSessionFetcherHostQueue *hostQueue = [self hostQueueForHost:host];
+    BOOL shouldRunNow = (isUsingBackgroundSession
+                         || ([self hostQueueHasRoom:hostQueue] && [self hasRoomForRunningFetcher]));
     if (shouldRunNow) {
-      [self addRunningFetcher:fetcher forHost:host];
+      [self addRunningNode:node toHostQueue:hostQueue];
       shouldBeginResult = YES;
     } else {
-      [self addDelayedFetcher:fetcher forHost:host];
+      [self addDelayedNode:node toHostQueue:hostQueue time:now];
+      [self updateGlobalSlotWaitForHostQueue:hostQueue];
       shouldBeginResult = NO;
     }
   }  // @synchronized(self)
@@ -460,7 +654,8 @@ NSString *const kGTMSessionFetcherServiceSessionKey
       [self delegateDispatcherForFetcher:fetcher];
   [delegateDispatcher removeFetcher:fetcher];
 
-  NSMutableArray *fetchersToStart;
+  NSMutableArray *fetchersToStart = [NSMutableArray array];
+  NSTimeInterval now = [self currentTime];
 
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
@@ -469,45 +664,37 @@ NSString *const kGTMSessionFetcherServiceSessionKey
     // to invoke its callbacks on the callback queue.
     [_stoppedFetchersToWaitFor addObject:fetcher];
 
-    NSMutableArray *runningForHost = [_runningFetchersByHost objectForKey:host];
-    [runningForHost removeObject:fetcher];
-
-    NSMutableArray *delayedForHost = [_delayedFetchersByHost objectForKey:host];
-    [delayedForHost removeObject:fetcher];
-
-    while (delayedForHost.count > 0
-           && [[self class] numberOfNonBackgroundSessionFetchers:runningForHost]
-              < _maxRunningFetchersPerHost) {
-      // Start another delayed fetcher running, scanning for the minimum
-      // priority value, defaulting to FIFO for equal priorities
-      GTMSessionFetcher *nextFetcher = nil;
-      for (GTMSessionFetcher *delayedFetcher in delayedForHost) {
-        if (nextFetcher == nil
-            || delayedFetcher.servicePriority < nextFetcher.servicePriority) {
-          nextFetcher = delayedFetcher;
-        }
-      }
-
-      if (nextFetcher) {
-        [self addRunningFetcher:nextFetcher forHost:host];
-        runningForHost = [_runningFetchersByHost objectForKey:host];
-
-        [delayedForHost removeObjectIdenticalTo:nextFetcher];
-
-        if (!fetchersToStart) {
-          fetchersToStart = [NSMutableArray array];
-        }
-        [fetchersToStart addObject:nextFetcher];
-      }
+    GTMSessionFetcherHostQueue *hostQueue = [_hostQueues objectForKey:host];
+    GTMSessionFetcherSchedulerNode *node = [_schedulerNodes objectForKey:fetcher];
+    if (node != nil && hostQueue != nil) {
+      [self removeNode:node fromHostQueue:hostQueue];
     }
 
-    if (runningForHost.count == 0) {
-      // None left; remove the empty array
-      [_runningFetchersByHost removeObjectForKey:host];
+    // Start the host's next delayed fetchers, then give any global slot still free to the
+    // hosts waiting for one, a fetcher at a time.
+    if (hostQueue != nil) {
+      [self promoteDelayedFetchersOfHostQueue:hostQueue
+                                        limit:NSUIntegerMax
+                                         time:now
+                              fetchersToStart:fetchersToStart];
+    }
+    while (_hostsWaitingForGlobalSlot.count > 0 && [self hasRoomForRunningFetcher]) {
+      NSString *waitingHost = _hostsWaitingForGlobalSlot.firstObject;
+      [_hostsWaitingForGlobalSlot removeObjectAtIndex:0];
+      GTMSessionFetcherHostQueue *waitingQueue = [_hostQueues objectForKey:waitingHost];
+      if (waitingQueue != nil) {
+        // Re-added at the end if it still has fetchers waiting.
+        [self promoteDelayedFetchersOfHostQueue:waitingQueue
+                                          limit:1
+                                           time:now
+                                fetchersToStart:fetchersToStart];
+      }
     }
 
-    if (delayedForHost.count == 0) {
-      [_delayedFetchersByHost removeObjectForKey:host];
+    if (hostQueue != nil && hostQueue.runningList.count == 0 && hostQueue.delayedCount == 0) {
+      // None left; remove the empty queue
+      [_hostQueues removeObjectForKey:host];
+      [_hostsWaitingForGlobalSlot removeObject:host];
     }
   }  // @synchronized(self)
 
@@ -521,6 +708,125 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   fetcher.serviceHost = nil;
 }
 
+#pragma mark Host Health
+
+// Returns the host's record, creating it with a full retry budget if needed.
+- (GTMSessionFetcherHostHealth *)hostHealthForHost:(NSString *)host {
+  GTMSessionCheckSynchronized(self);
+
+  GTMSessionFetcherHostHealth *health = [_hostHealthByHost objectForKey:host];
+  if (health == nil) {
+    health = [[GTMSessionFetcherHostHealth alloc] init];
+    health.retryTokens = _retryBudgetCapacity;
+    [_hostHealthByHost setObject:health forKey:host];
+  }
+  return health;
+}
+
+- (BOOL)fetcherShouldAttemptFetch:(GTMSessionFetcher *)fetcher {
+  // Entry point from the fetcher
+  NSString *host = fetcher.request.URL.host;
+  if (host.length == 0) {
+    return YES;
+  }
+  BOOL isRetry = (fetcher.retryCount > 0);
+  NSTimeInterval now = [self currentTime];
+
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    GTMSessionFetcherHostHealth *health = [self hostHealthForHost:host];
+    if (!isRetry) {
+      health.fetchCount += 1;
+      health.retryTokens = MIN(health.retryTokens + _retryBudgetRatio, _retryBudgetCapacity);
+    }
+    if (health.circuitOpen && _circuitBreakerFailureThreshold > 0) {
+      if (now - health.circuitOpenedTime < _circuitBreakerOpenInterval) {
+        return NO;
+      }
+      // Let this attempt probe the host; others keep failing fast until an attempt succeeds
+      // or the interval passes again.
+      health.circuitOpenedTime = now;
+    }
+    health.requestCount += 1;
+    return YES;
+  }  // @synchronized(self)
+}
+
+- (BOOL)fetcherShouldRetry:(GTMSessionFetcher *)fetcher {
+  // Entry point from the fetcher
+  NSString *host = fetcher.request.URL.host;
+  if (host.length == 0) {
+    return YES;
+  }
+
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_retryBudgetCapacity <= 0) {
+      return YES;
+    }
+    GTMSessionFetcherHostHealth *health = [self hostHealthForHost:host];
+    if (health.retryTokens < 1) {
+      return NO;
+    }
+    health.retryTokens -= 1;
+    return YES;
+  }  // @synchronized(self)
+}
+
+- (void)fetcher:(GTMSessionFetcher *)fetcher didFinishAttemptWithHostFailure:(BOOL)hostFailed {
+  // Entry point from the fetcher
+  NSString *host = fetcher.request.URL.host;
+  if (host.length == 0) {
+    return;
+  }
+  NSTimeInterval now = [self currentTime];
+
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    GTMSessionFetcherHostHealth *health = [self hostHealthForHost:host];
+    if (!hostFailed) {
+      health.consecutiveFailures = 0;
+      health.circuitOpen = NO;
+      return;
+    }
+    health.consecutiveFailures += 1;
+    if (_circuitBreakerFailureThreshold > 0
+        && !health.circuitOpen
+        && health.consecutiveFailures >= _circuitBreakerFailureThreshold) {
+      health.circuitOpen = YES;
+      health.circuitOpenedTime = now;
+    }
+  }  // @synchronized(self)
+}
+
+- (double)requestAmplificationForHost:(NSString *)host {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    NSUInteger fetchCount = 0;
+    NSUInteger requestCount = 0;
+    for (NSString *healthHost in _hostHealthByHost) {
+      if (host == nil || [healthHost isEqual:host]) {
+        GTMSessionFetcherHostHealth *health = [_hostHealthByHost objectForKey:healthHost];
+        fetchCount += health.fetchCount;
+        requestCount += health.requestCount;
+      }
+    }
+    return (fetchCount > 0) ? (double)requestCount / (double)fetchCount : 1.0;
+  }  // @synchronized(self)
+}
+
+- (void)resetHostHealth {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    [_hostHealthByHost removeAllObjects];
+  }  // @synchronized(self)
+}
+
 - (NSUInteger)numberOfFetchers {
   NSUInteger running = [self numberOfRunningFetchers];
   NSUInteger delayed = [self numberOfDelayedFetchers];
@@ -531,12 +837,7 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    NSUInteger sum = 0;
-    for (NSString *host in _runningFetchersByHost) {
-      NSArray *fetchers = [_runningFetchersByHost objectForKey:host];
-      sum += fetchers.count;
-    }
-    return sum;
+    return _runningFetcherCount;
   }
 }
 
@@ -544,12 +845,7 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    NSUInteger sum = 0;
-    for (NSString *host in _delayedFetchersByHost) {
-      NSArray *fetchers = [_delayedFetchersByHost objectForKey:host];
-      sum += fetchers.count;
-    }
-    return sum;
+    return _delayedFetcherCount;
   }
 }
 
@@ -558,17 +854,16 @@ NSString *const kGTMSessionFetcherServiceSessionKey
     GTMSessionMonitorSynchronized(self);
 
     NSMutableArray *allFetchers = [NSMutableArray array];
-    void (^accumulateFetchers)(id, id, BOOL *) = ^(NSString *host,
-                                                   NSArray *fetchersForHost,
-                                                   BOOL *stop) {
-        [allFetchers addObjectsFromArray:fetchersForHost];
-    };
-    [_runningFetchersByHost enumerateKeysAndObjectsUsingBlock:accumulateFetchers];
-    [_delayedFetchersByHost enumerateKeysAndObjectsUsingBlock:accumulateFetchers];
-
-    GTMSESSION_ASSERT_DEBUG(allFetchers.count == [NSSet setWithArray:allFetchers].count,
-                            @"Fetcher appears multiple times\n running: %@\n delayed: %@",
-                            _runningFetchersByHost, _delayedFetchersByHost);
+    for (GTMSessionFetcherHostQueue *hostQueue in _hostQueues.objectEnumerator) {
+      [allFetchers addObjectsFromArray:[hostQueue.runningList fetchers]];
+    }
+    for (GTMSessionFetcherHostQueue *hostQueue in _hostQueues.objectEnumerator) {
+      [allFetchers addObjectsFromArray:[hostQueue delayedFetchers]];
+    }
+
+    GTMSESSION_ASSERT_DEBUG(allFetchers.count == _runningFetcherCount + _delayedFetcherCount,
+                            @"Scheduler counts %tu running, %tu delayed, but found %tu fetchers",
+                            _runningFetcherCount, _delayedFetcherCount, allFetchers.count);
 
     return allFetchers.count > 0 ? allFetchers : nil;
   }
@@ -596,38 +891,39 @@ NSString *const kGTMSessionFetcherServiceSessionKey
 }
 
 - (void)stopAllFetchers {
-  NSArray *delayedFetchersByHost;
-  NSArray *runningFetchersByHost;
+  NSMutableArray *delayedFetchers = [NSMutableArray array];
+  NSMutableArray *runningFetchers = [NSMutableArray array];
 
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
     // Set the time barrier so fetchers know not to call back even if
     // the stop calls below occur after the fetchers naturally
-    // stopped and so were removed from _runningFetchersByHost,
+    // stopped and so were removed from the scheduler,
     // but while the callbacks were already enqueued before stopAllFetchers
     // was invoked.
     _stoppedAllFetchersDate = [[NSDate alloc] init];
 
-    // Remove fetchers from the delayed list to avoid fetcherDidStop: from
+    // Empty the scheduler to avoid fetcherDidStop: from
     // starting more fetchers running as a side effect of stopping one
-    delayedFetchersByHost = _delayedFetchersByHost.allValues;
-    [_delayedFetchersByHost removeAllObjects];
-
-    runningFetchersByHost = _runningFetchersByHost.allValues;
-    [_runningFetchersByHost removeAllObjects];
+    for (GTMSessionFetcherHostQueue *hostQueue in _hostQueues.objectEnumerator) {
+      [delayedFetchers addObjectsFromArray:[hostQueue delayedFetchers]];
+      [runningFetchers addObjectsFromArray:[hostQueue.runningList fetchers]];
+    }
+    [_hostQueues removeAllObjects];
+    [_hostsWaitingForGlobalSlot removeAllObjects];
+    [_schedulerNodes removeAllObjects];
+    _runningFetcherCount = 0;
+    _foregroundRunningFetcherCount = 0;
+    _delayedFetcherCount = 0;
   }
 
-  for (NSArray *delayedForHost in delayedFetchersByHost) {
-    for (GTMSessionFetcher *fetcher in delayedForHost) {
-      [self stopFetcher:fetcher];
-    }
+  for (GTMSessionFetcher *fetcher in delayedFetchers) {
+    [self stopFetcher:fetcher];
   }
 
-  for (NSArray *runningForHost in runningFetchersByHost) {
-    for (GTMSessionFetcher *fetcher in runningForHost) {
-      [self stopFetcher:fetcher];
-    }
+  for (GTMSessionFetcher *fetcher in runningFetchers) {
+    [self stopFetcher:fetcher];
   }
 }
 
@@ -738,19 +1034,20 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   [_delegateDispatcher abandon];
 }
 
+// The by-host dictionaries are snapshots built from the scheduler's queues.
 - (NSDictionary *)runningFetchersByHost {
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    return [_runningFetchersByHost copy];
-  }
-}
-
-- (void)setRunningFetchersByHost:(NSDictionary *)dict {
-  @synchronized(self) {
-    GTMSessionMonitorSynchronized(self);
-
-    _runningFetchersByHost = [dict mutableCopy];
+    NSMutableDictionary *runningFetchersByHost = [NSMutableDictionary dictionary];
+    [_hostQueues enumerateKeysAndObjectsUsingBlock:^(NSString *host,
+                                                     GTMSessionFetcherHostQueue *hostQueue,
+                                                     BOOL *stop) {
+      if (hostQueue.runningList.count > 0) {
+        [runningFetchersByHost setObject:[hostQueue.runningList fetchers] forKey:host];
+      }
+    }];
+    return runningFetchersByHost;
   }
 }
 
@@ -758,15 +1055,15 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
-    return [_delayedFetchersByHost copy];
-  }
-}
-
-- (void)setDelayedFetchersByHost:(NSDictionary *)dict {
-  @synchronized(self) {
-    GTMSessionMonitorSynchronized(self);
-
-    _delayedFetchersByHost = [dict mutableCopy];
+    NSMutableDictionary *delayedFetchersByHost = [NSMutableDictionary dictionary];
+    [_hostQueues enumerateKeysAndObjectsUsingBlock:^(NSString *host,
+                                                     GTMSessionFetcherHostQueue *hostQueue,
+                                                     BOOL *stop) {
+      if (hostQueue.delayedCount > 0) {
+        [delayedFetchersByHost setObject:[hostQueue delayedFetchers] forKey:host];
+      }
+    }];
+    return delayedFetchersByHost;
   }
 }
 
@@ -858,16 +1155,6 @@ NSString *const kGTMSessionFetcherServiceSessionKey
   return nil;
 }
 
-+ (NSUInteger)numberOfNonBackgroundSessionFetchers:(NSArray *)fetchers {
-  NSUInteger sum = 0;
-  for (GTMSessionFetcher *fetcher in fetchers) {
-    if (!fetcher.usingBackgroundSession) {
-      ++sum;
-    }
-  }
-  return sum;
-}
-
 @end
 
 @implementation GTMSessionFetcherService (TestingSupport)
@@ -1350,3 +1637,186 @@ expectedTotalBytes:(int64_t)expectedTotalBytes {
 }
 
 @end
+
+@implementation GTMSessionFetcherHostHealth
+
+@synthesize retryTokens = _retryTokens,
+            consecutiveFailures = _consecutiveFailures,
+            circuitOpen = _circuitOpen,
+            circuitOpenedTime = _circuitOpenedTime,
+            fetchCount = _fetchCount,
+            requestCount = _requestCount;
+
+@end
+
+@implementation GTMSessionFetcherSchedulerNode
+
+@synthesize fetcher = _fetcher,
+            host = _host,
+            priority = _priority,
+            priorityClass = _priorityClass,
+            usingBackgroundSession = _usingBackgroundSession,
+            running = _running,
+            delayedTime = _delayedTime,
+            previous = _previous,
+            next = _next;
+
+- (instancetype)initWithFetcher:(GTMSessionFetcher *)fetcher
+                           host:(NSString *)host
+                       priority:(NSInteger)priority
+         usingBackgroundSession:(BOOL)usingBackgroundSession {
+  self = [super init];
+  if (self) {
+    _fetcher = fetcher;
+    _host = [host copy];
+    _priority = priority;
+    _usingBackgroundSession = usingBackgroundSession;
+    if (priority < 0) {
+      _priorityClass = GTMSessionFetcherPriorityClassInteractive;
+    } else if (priority == 0) {
+      _priorityClass = GTMSessionFetcherPriorityClassNormal;
+    } else {
+      _priorityClass = GTMSessionFetcherPriorityClassBackground;
+    }
+  }
+  return self;
+}
+
+@end
+
+@implementation GTMSessionFetcherSchedulerList {
+  GTMSessionFetcherSchedulerNode *__unsafe_unretained _first;
+  GTMSessionFetcherSchedulerNode *__unsafe_unretained _last;
+  NSUInteger _count;
+}
+
+@synthesize first = _first,
+            count = _count;
+
+- (void)appendNode:(GTMSessionFetcherSchedulerNode *)node {
+  node.previous = _last;
+  node.next = nil;
+  if (_last) {
+    _last.next = node;
+  } else {
+    _first = node;
+  }
+  _last = node;
+  _count++;
+}
+
+- (void)insertNodeByPriority:(GTMSessionFetcherSchedulerNode *)node {
+  NSInteger priority = node.priority;
+  GTMSessionFetcherSchedulerNode *previous = _last;
+  while (previous != nil && previous.priority > priority) {
+    previous = previous.previous;
+  }
+  if (previous == _last) {
+    [self appendNode:node];
+    return;
+  }
+  GTMSessionFetcherSchedulerNode *next = previous ? previous.next : _first;
+  node.previous = previous;
+  node.next = next;
+  next.previous = node;
+  if (previous) {
+    previous.next = node;
+  } else {
+    _first = node;
+  }
+  _count++;
+}
+
+- (void)removeNode:(GTMSessionFetcherSchedulerNode *)node {
+  GTMSessionFetcherSchedulerNode *previous = node.previous;
+  GTMSessionFetcherSchedulerNode *next = node.next;
+  if (previous) {
+    previous.next = next;
+  } else {
+    _first = next;
+  }
+  if (next) {
+    next.previous = previous;
+  } else {
+    _last = previous;
+  }
+  node.previous = nil;
+  node.next = nil;
+  _count--;
+}
+
+- (NSArray *)fetchers {
+  NSMutableArray *fetchers = [NSMutableArray arrayWithCapacity:_count];
+  for (GTMSessionFetcherSchedulerNode *node = _first; node != nil; node = node.next) {
+    [fetchers addObject:node.fetcher];
+  }
+  return fetchers;
+}
+
+@end
+
+@implementation GTMSessionFetcherHostQueue {
+  NSArray *_delayedLists;  // one GTMSessionFetcherSchedulerList per priority class
+}
+
+@synthesize host = _host,
+            runningList = _runningList,
+            foregroundRunningCount = _foregroundRunningCount;
+
+- (instancetype)initWithHost:(NSString *)host {
+  self = [super init];
+  if (self) {
+    _host = [host copy];
+    _runningList = [[GTMSessionFetcherSchedulerList alloc] init];
+    NSMutableArray *delayedLists = [NSMutableArray array];
+    for (NSInteger idx = 0; idx < GTMSessionFetcherPriorityClassCount; idx++) {
+      [delayedLists addObject:[[GTMSessionFetcherSchedulerList alloc] init]];
+    }
+    _delayedLists = delayedLists;
+  }
+  return self;
+}
+
+- (GTMSessionFetcherSchedulerList *)delayedListForPriorityClass:(GTMSessionFetcherPriorityClass)priorityClass {
+  return [_delayedLists objectAtIndex:(NSUInteger)priorityClass];
+}
+
+- (NSUInteger)delayedCount {
+  NSUInteger count = 0;
+  for (GTMSessionFetcherSchedulerList *list in _delayedLists) {
+    count += list.count;
+  }
+  return count;
+}
+
+- (GTMSessionFetcherSchedulerNode *)nextDelayedNodeAtTime:(NSTimeInterval)now
+                                            agingInterval:(NSTimeInterval)agingInterval {
+  GTMSessionFetcherSchedulerNode *nextNode = nil;
+  NSInteger nextClass = NSIntegerMax;
+  for (GTMSessionFetcherSchedulerList *list in _delayedLists) {
+    GTMSessionFetcherSchedulerNode *node = list.first;
+    if (node == nil) continue;
+
+    NSInteger effectiveClass = node.priorityClass;
+    if (agingInterval > 0) {
+      NSInteger promotions = (NSInteger)((now - node.delayedTime) / agingInterval);
+      effectiveClass = MAX(effectiveClass - MAX(promotions, 0), 0);
+    }
+    if (effectiveClass < nextClass
+        || (effectiveClass == nextClass && node.delayedTime < nextNode.delayedTime)) {
+      nextNode = node;
+      nextClass = effectiveClass;
+    }
+  }
+  return nextNode;
+}
+
+- (NSArray *)delayedFetchers {
+  NSMutableArray *fetchers = [NSMutableArray array];
+  for (GTMSessionFetcherSchedulerList *list in _delayedLists) {
+    [fetchers addObjectsFromArray:[list fetchers]];
+  }
+  return fetchers;
+}
+
+@end
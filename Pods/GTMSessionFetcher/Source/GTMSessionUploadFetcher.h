@@ -29,6 +29,10 @@
 //
 // Chunk fetchers are discarded as soon as they have completed.
 //
+// While a chunk uploads, the data for the next chunk is read, so the next chunk fetcher can
+// start as soon as the server acknowledges the current one.  The resumable upload protocol
+// accepts chunks only in order, so just one chunk is uploaded at a time.
+//
 
 // Note: Unlike the fetcher superclass, the methods of GTMSessionUploadFetcher should
 // only be used from the main thread until further work is done to make this subclass
@@ -56,6 +60,9 @@ extern NSString *const kGTMSessionFetcherUploadLocationObtainedNotification;
 // and released after the response block returns.
 //
 // Pass nil as the data (and optionally an NSError) for a failure.
+//
+// The provider is called on a background queue, one call at a time; the next call waits until
+// the previous one has responded.
 typedef void (^GTMSessionUploadFetcherDataProviderResponse)(NSData * GTM_NULLABLE_TYPE data,
                                                             NSError * GTM_NULLABLE_TYPE error);
 typedef void (^GTMSessionUploadFetcherDataProvider)(int64_t offset, int64_t length,
@@ -98,6 +105,16 @@ typedef void (^GTMSessionUploadFetcherDataProvider)(int64_t offset, int64_t leng
 @property(atomic, copy, readonly, GTM_NULLABLE) GTMSessionUploadFetcherDataProvider uploadDataProvider;
 @property(atomic, copy) NSString *uploadMIMEType;
 @property(atomic, assign) int64_t chunkSize;
+
+// When non-zero, chunk sizes adapt to the measured upload throughput so that each chunk takes
+// about this long.  Sizes start at 256K, or the server's chunk granularity if larger, and never
+// exceed chunkSize.  Defaults to zero, which uploads chunks of chunkSize.
+@property(atomic, assign) NSTimeInterval targetChunkDuration;
+
+// When YES, each chunk read into memory is sent with a Content-MD5 header, computed while the
+// chunk is read ahead.  A file URL uploaded whole in one chunk is sent without one.
+// Defaults to NO.
+@property(atomic, assign) BOOL sendsChunkChecksums;
 @property(atomic, readonly, assign) int64_t currentOffset;
 
 // The fetcher for the current data chunk, if any
@@ -19,6 +19,9 @@
 
 #import "GTMSessionUploadFetcher.h"
 
+#import <CommonCrypto/CommonDigest.h>
+#import <unistd.h>
+
 static NSString *const kGTMSessionIdentifierIsUploadChunkFetcherMetadataKey = @"_upChunk";
 static NSString *const kGTMSessionIdentifierUploadFileURLMetadataKey        = @"_upFileURL";
 static NSString *const kGTMSessionIdentifierUploadFileLengthMetadataKey     = @"_upFileLen";
@@ -42,6 +45,9 @@ static NSString *const kGTMSessionUploadFetcherChunkParentKey = @"_uploadFetcher
 
 int64_t const kGTMSessionUploadFetcherStandardChunkSize = (int64_t)LLONG_MAX;
 
+// Adaptive chunk sizes start here, or at the server's chunk granularity if that is larger.
+static int64_t const kGTMSessionUploadFetcherMinimumAdaptiveChunkSize = 256 * 1024;
+
 #if TARGET_OS_IPHONE
 int64_t const kGTMSessionUploadFetcherMaximumDemandBufferSize = 10 * 1024 * 1024;  // 10 MB for iOS
 #else
@@ -79,6 +85,35 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 @end
 #endif  // !GTMSESSION_BUILD_COMBINED_SOURCES
 
+// A chunk read, and for file URL uploads written to a temporary file, ahead of its upload.
+@interface GTMSessionUploadFetcherPreparedChunk : NSObject
+
+- (instancetype)initWithOffset:(int64_t)offset length:(int64_t)length;
+
+@property(atomic, readonly) int64_t offset;
+@property(atomic, readonly) int64_t length;
+
+// Set once the chunk is ready.  A chunk has either data or a file URL, or else an error.
+@property(atomic, readonly, GTM_NULLABLE) NSData *data;
+@property(atomic, readonly, GTM_NULLABLE) NSURL *fileURL;
+@property(atomic, readonly, GTM_NULLABLE) NSError *error;
+
+// The base64 MD5 of the chunk bytes, when sendsChunkChecksums is set.
+@property(atomic, readonly, GTM_NULLABLE) NSString *contentMD5;
+
+// Calls the block once the chunk is ready, right away if it already is.
+- (void)performWhenReady:(void (^)(GTMSessionUploadFetcherPreparedChunk *chunk))block;
+
+- (void)finishWithData:(GTM_NULLABLE NSData *)data
+               fileURL:(GTM_NULLABLE NSURL *)fileURL
+            contentMD5:(GTM_NULLABLE NSString *)contentMD5
+                 error:(GTM_NULLABLE NSError *)error;
+
+// Drops a chunk that will not be uploaded, removing its temporary file now or once it is ready.
+- (void)discard;
+
+@end
+
 @interface GTMSessionUploadFetcher ()
 
 // Changing readonly to readwrite.
@@ -135,6 +170,24 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
   // is in progress.
   GTMSessionFetcher *_fetcherInFlight;
   BOOL _isSubdataGenerating;
+
+  // The next chunk, read while the current chunk uploads.
+  GTMSessionUploadFetcherPreparedChunk *_preparedChunk;
+
+  // Serial queue for reading chunk data, so reads of the upload file handle and calls to the
+  // upload data provider never overlap.
+  dispatch_queue_t _chunkDataQueue;
+  BOOL _sendsChunkChecksums;
+
+  // Chunk sizing from measured throughput, when targetChunkDuration is set.
+  NSTimeInterval _targetChunkDuration;
+  int64_t _adaptiveChunkSize;
+  NSTimeInterval _chunkBeginTime;
+
+  // With adaptive sizing, the next chunk is read once the current chunk's body is sent and its
+  // throughput recorded, so the read uses the updated size.  Zero when there is no such chunk.
+  int64_t _readAheadOffset;
+  BOOL _hasRecordedChunkUpload;
 }
 
 + (void)load {
@@ -441,6 +494,50 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
   }
 }
 
+- (void)setTargetChunkDuration:(NSTimeInterval)targetChunkDuration {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    _targetChunkDuration = targetChunkDuration;
+  }
+}
+
+- (NSTimeInterval)targetChunkDuration {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    return _targetChunkDuration;
+  }
+}
+
+- (void)setSendsChunkChecksums:(BOOL)sendsChunkChecksums {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    _sendsChunkChecksums = sendsChunkChecksums;
+  }
+}
+
+- (BOOL)sendsChunkChecksums {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    return _sendsChunkChecksums;
+  }
+}
+
+- (dispatch_queue_t)chunkDataQueue {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (!_chunkDataQueue) {
+      _chunkDataQueue = dispatch_queue_create("com.google.GTMSessionUploadFetcher.chunkData",
+                                              DISPATCH_QUEUE_SERIAL);
+    }
+    return _chunkDataQueue;
+  }
+}
+
 - (void)setupRequestHeaders {
   GTMSessionCheckNotSynchronized(self);
 
@@ -560,71 +657,107 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 }
 
 // Make a subdata of the upload data.
+//
+// Every source is read on the chunk data queue, one chunk at a time.  The upload data provider is
+// called there as well, and the next read waits for its response.
 - (void)generateChunkSubdataWithOffset:(int64_t)offset
                                 length:(int64_t)length
                               response:(GTMSessionUploadFetcherDataProviderResponse)response {
+  // Take the source now, since the callbacks may be released before the queue gets to the read.
   GTMSessionUploadFetcherDataProvider uploadDataProvider = self.uploadDataProvider;
-  if (uploadDataProvider) {
-    uploadDataProvider(offset, length, response);
-    return;
-  }
-
   NSData *uploadData = self.uploadData;
-  if (uploadData) {
-    // NSData provided.
-    NSData *resultData;
-    if (offset == 0 && length == (int64_t)uploadData.length) {
-      resultData = uploadData;
-    } else {
-      int64_t dataLength = (int64_t)uploadData.length;
-      // Ensure our range is valid.  b/18007814
-      if (offset + length > dataLength) {
-        NSString *errorMessage = [NSString stringWithFormat:
-                                  @"Range invalid for upload data.  offset: %lld\tlength: %lld\tdataLength: %lld",
-                                  offset, length, dataLength];
-        GTMSESSION_ASSERT_DEBUG(NO, @"%@", errorMessage);
-        response(nil, [self uploadChunkUnavailableErrorWithDescription:errorMessage]);
-        return;
-      }
-      NSRange range = NSMakeRange((NSUInteger)offset, (NSUInteger)length);
-      resultData = [uploadData subdataWithRange:range];
-    }
-    response(resultData, nil);
-    return;
-  }
   NSURL *uploadFileURL = self.uploadFileURL;
-  if (uploadFileURL) {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+  NSFileHandle *uploadFileHandle = self.uploadFileHandle;
+  GTMSESSION_ASSERT_DEBUG(uploadDataProvider || uploadData || uploadFileURL || uploadFileHandle,
+                          @"Unexpectedly missing upload data package");
+
+  dispatch_async([self chunkDataQueue], ^{
+    if (uploadDataProvider) {
+      dispatch_semaphore_t providerResponded = dispatch_semaphore_create(0);
+      uploadDataProvider(offset, length, ^(NSData *data, NSError *error) {
+        response(data, error);
+        dispatch_semaphore_signal(providerResponded);
+      });
+      dispatch_semaphore_wait(providerResponded, DISPATCH_TIME_FOREVER);
+    } else if (uploadData) {
+      [self generateChunkSubdataFromData:uploadData
+                                  offset:offset
+                                  length:length
+                                response:response];
+    } else if (uploadFileURL) {
       [self generateChunkSubdataFromFileURL:uploadFileURL
                                      offset:offset
                                      length:length
                                    response:response];
-    });
-    return;
-  }
-  GTMSESSION_ASSERT_DEBUG(_uploadFileHandle, @"Unexpectedly missing upload data package");
-  NSFileHandle *uploadFileHandle = self.uploadFileHandle;
-  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-    [self generateChunkSubdataFromFileHandle:uploadFileHandle
-                                      offset:offset
-                                      length:length
-                                    response:response];
+    } else {
+      [self generateChunkSubdataFromFileHandle:uploadFileHandle
+                                        offset:offset
+                                        length:length
+                                      response:response];
+    }
   });
 }
 
+- (void)generateChunkSubdataFromData:(NSData *)uploadData
+                              offset:(int64_t)offset
+                              length:(int64_t)length
+                            response:(GTMSessionUploadFetcherDataProviderResponse)response {
+  NSData *resultData;
+  if (offset == 0 && length == (int64_t)uploadData.length) {
+    resultData = uploadData;
+  } else {
+    int64_t dataLength = (int64_t)uploadData.length;
+    // Ensure our range is valid.  b/18007814
+    if (offset + length > dataLength) {
+      NSString *errorMessage = [NSString stringWithFormat:
+                                @"Range invalid for upload data.  offset: %lld\tlength: %lld\tdataLength: %lld",
+                                offset, length, dataLength];
+      GTMSESSION_ASSERT_DEBUG(NO, @"%@", errorMessage);
+      response(nil, [self uploadChunkUnavailableErrorWithDescription:errorMessage]);
+      return;
+    }
+    NSRange range = NSMakeRange((NSUInteger)offset, (NSUInteger)length);
+    resultData = [uploadData subdataWithRange:range];
+  }
+  response(resultData, nil);
+}
+
 - (void)generateChunkSubdataFromFileHandle:(NSFileHandle *)fileHandle
                                     offset:(int64_t)offset
                                     length:(int64_t)length
                                   response:(GTMSessionUploadFetcherDataProviderResponse)response {
-  NSData *resultData;
+  // pread leaves the handle's file position alone, so the client's own use of the handle
+  // cannot move a read.
+  NSMutableData *resultData;
   NSError *error;
   @try {
-    [fileHandle seekToFileOffset:(unsigned long long)offset];
-    resultData = [fileHandle readDataOfLength:(NSUInteger)length];
+    int fileDescriptor = fileHandle.fileDescriptor;
+    resultData = [NSMutableData dataWithLength:(NSUInteger)length];
+    int64_t totalRead = 0;
+    while (totalRead < length) {
+      ssize_t bytesRead = pread(fileDescriptor,
+                                (char *)resultData.mutableBytes + totalRead,
+                                (size_t)(length - totalRead),
+                                (off_t)(offset + totalRead));
+      if (bytesRead < 0 && errno == EINTR) continue;
+      if (bytesRead < 0) {
+        NSString *errorMessage = [NSString stringWithFormat:@"pread failed at offset %lld: %s",
+                                  offset + totalRead, strerror(errno)];
+        GTMSESSION_ASSERT_DEBUG(NO, @"uploadFileHandle failed to read, %@", errorMessage);
+        error = [self uploadChunkUnavailableErrorWithDescription:errorMessage];
+        resultData = nil;
+        break;
+      }
+      // Like readDataOfLength:, stop short at the end of the file.
+      if (bytesRead == 0) break;
+      totalRead += bytesRead;
+    }
+    resultData.length = (NSUInteger)totalRead;
   }
   @catch (NSException *exception) {
     GTMSESSION_ASSERT_DEBUG(NO, @"uploadFileHandle failed to read, %@", exception);
     error = [self uploadChunkUnavailableErrorWithDescription:exception.description];
+    resultData = nil;
   }
   // The response always re-dispatches to the main thread, so we skip doing that here.
   response(resultData, error);
@@ -955,6 +1088,8 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 - (void)invokeFinalCallbackWithData:(NSData *)data
                               error:(NSError *)error
            shouldInvalidateLocation:(BOOL)shouldInvalidateLocation {
+  [self discardPreparedChunk];
+
   @synchronized(self) {
     GTMSessionMonitorSynchronized(self);
 
@@ -1113,49 +1248,32 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 
   BOOL isUploadingFileURL = (self.uploadFileURL != nil);
 
-  // Upload another chunk, meeting server-required granularity.
-  int64_t chunkSize = self.chunkSize;
-
   int64_t fullUploadLength = [self fullUploadLength];
 
-  BOOL isUploadingFullFile = (offset == 0 && chunkSize >= fullUploadLength);
-  if (!isUploadingFileURL || !isUploadingFullFile) {
-    // We're not uploading the entire file and given the file URL.  Since we'll be
-    // allocating a subdata block for a chunk, we need to bound it to something that
-    // won't blow the process's memory.
-    if (chunkSize > kGTMSessionUploadFetcherMaximumDemandBufferSize) {
-      chunkSize = kGTMSessionUploadFetcherMaximumDemandBufferSize;
-    }
-  }
+  GTMSESSION_ASSERT_DEBUG(offset < fullUploadLength || fullUploadLength == 0,
+                          @"offset %lld exceeds data length %lld", offset, fullUploadLength);
 
   int64_t granularity = self.uploadGranularity;
   if (granularity > 0) {
-    if (chunkSize < granularity) {
-      chunkSize = granularity;
-    } else {
-      chunkSize = chunkSize - (chunkSize % granularity);
-    }
+    offset = offset - (offset % granularity);
   }
 
-  GTMSESSION_ASSERT_DEBUG(offset < fullUploadLength || fullUploadLength == 0,
-                          @"offset %lld exceeds data length %lld", offset, fullUploadLength);
+  BOOL isFinalChunk;
+  int64_t thisChunkSize = [self chunkLengthWithOffset:offset
+                                     fullUploadLength:fullUploadLength
+                                         isFinalChunk:&isFinalChunk];
 
-  if (granularity > 0) {
-    offset = offset - (offset % granularity);
+  // Use the chunk read ahead while the previous chunk uploaded, if it starts at this offset and
+  // still has this chunk's size.  Adaptive sizing can change the size after the read when the
+  // previous chunk reported no send progress, so its throughput was recorded only now.
+  GTMSessionUploadFetcherPreparedChunk *preparedChunk = [self takePreparedChunkWithOffset:offset];
+  if (preparedChunk && preparedChunk.length != thisChunkSize) {
+    [preparedChunk discard];
+    preparedChunk = nil;
   }
 
-  // If the chunk size is bigger than the remaining data, or else
-  // it's close enough in size to the remaining data that we'd rather
-  // avoid having a whole extra http fetch for the leftover bit, then make
-  // this chunk size exactly match the remaining data size
   NSString *command;
-  int64_t thisChunkSize = chunkSize;
-
-  BOOL isChunkTooBig = (thisChunkSize >= (fullUploadLength - offset));
-  BOOL isChunkAlmostBigEnough = (fullUploadLength - offset - 2500 < thisChunkSize);
-  BOOL isFinalChunk = isChunkTooBig || isChunkAlmostBigEnough;
   if (isFinalChunk) {
-    thisChunkSize = fullUploadLength - offset;
     if (thisChunkSize > 0) {
       command = @"upload, finalize";
     } else {
@@ -1177,64 +1295,292 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
    baseComment ? baseComment : @"upload", offset, MAX(0, offset + thisChunkSize - 1)];
 
   // The chunk size may have changed, so determine again if we're uploading the full file.
-  isUploadingFullFile = (offset == 0 && thisChunkSize >= fullUploadLength);
+  BOOL isUploadingFullFile = (offset == 0 && thisChunkSize >= fullUploadLength);
   if (isUploadingFullFile && isUploadingFileURL) {
     // The data is the full upload file URL.
     chunkFetcher.bodyFileURL = self.uploadFileURL;
     [self beginChunkFetcher:chunkFetcher
                      offset:offset];
   } else {
-    // Make an NSData for the subset for this upload chunk.
+    // Make an NSData for the subset for this upload chunk, unless it was read ahead.
+    if (!preparedChunk) {
+      preparedChunk = [[GTMSessionUploadFetcherPreparedChunk alloc] initWithOffset:offset
+                                                                           length:thisChunkSize];
+      [self generateDataForPreparedChunk:preparedChunk];
+    }
     self.subdataGenerating = YES;
-    [self generateChunkSubdataWithOffset:offset
-                                  length:thisChunkSize
-                                response:^(NSData *chunkData, NSError *chunkError) {
-      // The subdata methods may leave us on a background thread.
-      dispatch_async(dispatch_get_main_queue(), ^{
-        self.subdataGenerating = NO;
-        if (chunkData == nil) {
-          NSError *responseError = chunkError;
-          if (!responseError) {
-            responseError = [self uploadChunkUnavailableErrorWithDescription:@"chunkData is nil"];
-          }
-          [self invokeFinalCallbackWithData:nil
-                                      error:responseError
-                   shouldInvalidateLocation:YES];
-          return;
-        }
+    [preparedChunk performWhenReady:^(GTMSessionUploadFetcherPreparedChunk *readyChunk) {
+      self.subdataGenerating = NO;
+      NSError *chunkError = readyChunk.error;
+      if (chunkError) {
+        [self invokeFinalCallbackWithData:nil
+                                    error:chunkError
+                 shouldInvalidateLocation:YES];
+        return;
+      }
+      if (readyChunk.fileURL) {
+        chunkFetcher.bodyFileURL = readyChunk.fileURL;
+      } else {
+        chunkFetcher.bodyData = readyChunk.data;
+      }
+      NSString *contentMD5 = readyChunk.contentMD5;
+      if (contentMD5) {
+        [chunkFetcher setRequestValue:contentMD5 forHTTPHeaderField:@"Content-MD5"];
+      }
 
-        BOOL didWriteFile = NO;
-        if (isUploadingFileURL) {
-          // Make a temporary file with the data subset.
-          NSString *tempName =
-              [NSString stringWithFormat:@"GTMUpload_temp_%@", [[NSUUID UUID] UUIDString]];
-          NSString *tempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:tempName];
-          NSError *writeError;
-          didWriteFile = [chunkData writeToFile:tempPath
-                                        options:NSDataWritingAtomic
-                                          error:&writeError];
-          if (didWriteFile) {
-            chunkFetcher.bodyFileURL = [NSURL fileURLWithPath:tempPath];
-          } else {
-            GTMSESSION_LOG_DEBUG(@"writeToFile failed: %@\n%@", writeError, tempPath);
-          }
-        }
-        if (!didWriteFile) {
-          chunkFetcher.bodyData = [chunkData copy];
-        }
-        [self beginChunkFetcher:chunkFetcher
-                         offset:offset];
-      });
+      // Read the next chunk while this one uploads.  With adaptive sizing, the read waits until
+      // this chunk's body is sent and its throughput has set the next chunk's size.
+      int64_t nextOffset = isFinalChunk ? 0 : offset + thisChunkSize;
+      BOOL shouldDeferReadAhead = (nextOffset > 0 && self.targetChunkDuration > 0);
+      @synchronized(self) {
+        GTMSessionMonitorSynchronized(self);
+
+        _readAheadOffset = shouldDeferReadAhead ? nextOffset : 0;
+      }  // @synchronized(self)
+
+      [self beginChunkFetcher:chunkFetcher
+                       offset:offset];
+
+      if (nextOffset > 0 && !shouldDeferReadAhead) {
+        [self prepareChunkWithOffset:nextOffset];
+      }
     }];
   }
 }
 
+// The length of the chunk starting at offset, meeting server-required granularity.
+- (int64_t)chunkLengthWithOffset:(int64_t)offset
+                fullUploadLength:(int64_t)fullUploadLength
+                    isFinalChunk:(BOOL *)outIsFinalChunk {
+  BOOL isUploadingFileURL = (self.uploadFileURL != nil);
+
+  int64_t chunkSize = [self currentChunkSize];
+
+  BOOL isUploadingFullFile = (offset == 0 && chunkSize >= fullUploadLength);
+  if (!isUploadingFileURL || !isUploadingFullFile) {
+    // We're not uploading the entire file and given the file URL.  Since we'll be
+    // allocating a subdata block for a chunk, we need to bound it to something that
+    // won't blow the process's memory.
+    if (chunkSize > kGTMSessionUploadFetcherMaximumDemandBufferSize) {
+      chunkSize = kGTMSessionUploadFetcherMaximumDemandBufferSize;
+    }
+  }
+
+  int64_t granularity = self.uploadGranularity;
+  if (granularity > 0) {
+    if (chunkSize < granularity) {
+      chunkSize = granularity;
+    } else {
+      chunkSize = chunkSize - (chunkSize % granularity);
+    }
+  }
+
+  // If the chunk size is bigger than the remaining data, or else
+  // it's close enough in size to the remaining data that we'd rather
+  // avoid having a whole extra http fetch for the leftover bit, then make
+  // this chunk size exactly match the remaining data size
+  int64_t thisChunkSize = chunkSize;
+
+  BOOL isChunkTooBig = (thisChunkSize >= (fullUploadLength - offset));
+  BOOL isChunkAlmostBigEnough = (fullUploadLength - offset - 2500 < thisChunkSize);
+  BOOL isFinalChunk = isChunkTooBig || isChunkAlmostBigEnough;
+  if (isFinalChunk) {
+    thisChunkSize = fullUploadLength - offset;
+  }
+  *outIsFinalChunk = isFinalChunk;
+  return thisChunkSize;
+}
+
+// The chunk size to aim for: the adaptive size when targetChunkDuration is set, or else chunkSize.
+- (int64_t)currentChunkSize {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_targetChunkDuration > 0) {
+      if (_adaptiveChunkSize <= 0) {
+        _adaptiveChunkSize = [self minimumAdaptiveChunkSizeUnsynchronized];
+      }
+      return MIN(_adaptiveChunkSize, _chunkSize);
+    }
+    return _chunkSize;
+  }  // @synchronized(self)
+}
+
+- (int64_t)minimumAdaptiveChunkSizeUnsynchronized {
+  GTMSessionCheckSynchronized(self);
+
+  return MAX(_uploadGranularity, kGTMSessionUploadFetcherMinimumAdaptiveChunkSize);
+}
+
+// Moves the adaptive chunk size toward the size that would upload in targetChunkDuration at the
+// throughput of the chunk just sent.
+- (void)recordChunkUploadOfLength:(int64_t)length duration:(NSTimeInterval)duration {
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_targetChunkDuration <= 0 || length <= 0 || duration <= 0) return;
+
+    double bytesPerSecond = (double)length / duration;
+    int64_t idealChunkSize = (int64_t)(bytesPerSecond * _targetChunkDuration);
+
+    // Change by at most a factor of two per chunk, so one unusually slow or fast chunk
+    // does not swing the size.
+    int64_t previousChunkSize = (_adaptiveChunkSize > 0) ? _adaptiveChunkSize : length;
+    idealChunkSize = MAX(previousChunkSize / 2, MIN(previousChunkSize * 2, idealChunkSize));
+
+    int64_t minimumChunkSize = [self minimumAdaptiveChunkSizeUnsynchronized];
+    _adaptiveChunkSize = MAX(minimumChunkSize, MIN(_chunkSize, idealChunkSize));
+  }  // @synchronized(self)
+}
+
+// Records the throughput of the chunk in flight once, when its body has been sent or else when the
+// server responds, then starts the read-ahead that was waiting for the new chunk size.
+- (void)chunkBodyWasSentWithLength:(int64_t)length {
+  GTMSessionCheckNotSynchronized(self);
+
+  NSTimeInterval duration;
+  int64_t readAheadOffset;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    if (_hasRecordedChunkUpload) return;
+    _hasRecordedChunkUpload = YES;
+
+    duration = [NSDate timeIntervalSinceReferenceDate] - _chunkBeginTime;
+    readAheadOffset = _readAheadOffset;
+    _readAheadOffset = 0;
+  }  // @synchronized(self)
+
+  [self recordChunkUploadOfLength:length duration:duration];
+  if (readAheadOffset > 0) {
+    [self prepareChunkWithOffset:readAheadOffset];
+  }
+}
+
+// Starts reading the chunk at the offset, replacing any chunk read ahead before.
+- (void)prepareChunkWithOffset:(int64_t)offset {
+  GTMSessionCheckNotSynchronized(self);
+
+  if ([self isPaused]) return;
+
+  int64_t fullUploadLength = [self fullUploadLength];
+  if (offset >= fullUploadLength) return;
+
+  BOOL isFinalChunk;
+  int64_t length = [self chunkLengthWithOffset:offset
+                              fullUploadLength:fullUploadLength
+                                  isFinalChunk:&isFinalChunk];
+  GTMSessionUploadFetcherPreparedChunk *chunk =
+      [[GTMSessionUploadFetcherPreparedChunk alloc] initWithOffset:offset
+                                                            length:length];
+  GTMSessionUploadFetcherPreparedChunk *oldChunk;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    oldChunk = _preparedChunk;
+    _preparedChunk = chunk;
+  }  // @synchronized(self)
+  [oldChunk discard];
+
+  [self generateDataForPreparedChunk:chunk];
+}
+
+// Returns the chunk read ahead if it starts at the offset.  Any other read-ahead chunk is
+// discarded, since the server asked for different bytes.
+- (GTM_NULLABLE GTMSessionUploadFetcherPreparedChunk *)takePreparedChunkWithOffset:(int64_t)offset {
+  GTMSessionUploadFetcherPreparedChunk *chunk;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    chunk = _preparedChunk;
+    _preparedChunk = nil;
+    _readAheadOffset = 0;
+  }  // @synchronized(self)
+
+  if (chunk && chunk.offset != offset) {
+    [chunk discard];
+    chunk = nil;
+  }
+  return chunk;
+}
+
+- (void)discardPreparedChunk {
+  GTMSessionUploadFetcherPreparedChunk *chunk;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    chunk = _preparedChunk;
+    _preparedChunk = nil;
+    _readAheadOffset = 0;
+  }  // @synchronized(self)
+  [chunk discard];
+}
+
+- (void)generateDataForPreparedChunk:(GTMSessionUploadFetcherPreparedChunk *)chunk {
+  BOOL isUploadingFileURL = (self.uploadFileURL != nil);
+  BOOL sendsChunkChecksums = self.sendsChunkChecksums;
+  [self generateChunkSubdataWithOffset:chunk.offset
+                                length:chunk.length
+                              response:^(NSData *chunkData, NSError *chunkError) {
+    // The subdata methods may leave us on a background thread, where the checksum is
+    // computed and the temporary file is written.
+    NSURL *chunkFileURL;
+    NSData *chunkBodyData;
+    NSString *contentMD5;
+    NSError *responseError;
+    if (chunkData == nil) {
+      responseError = chunkError;
+      if (!responseError) {
+        responseError = [self uploadChunkUnavailableErrorWithDescription:@"chunkData is nil"];
+      }
+    } else {
+      if (sendsChunkChecksums) {
+        unsigned char digest[CC_MD5_DIGEST_LENGTH];
+        CC_MD5(chunkData.bytes, (CC_LONG)chunkData.length, digest);
+        contentMD5 = [[NSData dataWithBytes:digest length:sizeof(digest)]
+                         base64EncodedStringWithOptions:0];
+      }
+      if (isUploadingFileURL) {
+        // Make a temporary file with the data subset.
+        NSString *tempName =
+            [NSString stringWithFormat:@"GTMUpload_temp_%@", [[NSUUID UUID] UUIDString]];
+        NSString *tempPath = [NSTemporaryDirectory() stringByAppendingPathComponent:tempName];
+        NSError *writeError;
+        BOOL didWriteFile = [chunkData writeToFile:tempPath
+                                           options:NSDataWritingAtomic
+                                             error:&writeError];
+        if (didWriteFile) {
+          chunkFileURL = [NSURL fileURLWithPath:tempPath];
+        } else {
+          GTMSESSION_LOG_DEBUG(@"writeToFile failed: %@\n%@", writeError, tempPath);
+        }
+      }
+      if (!chunkFileURL) {
+        chunkBodyData = [chunkData copy];
+      }
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [chunk finishWithData:chunkBodyData
+                    fileURL:chunkFileURL
+                 contentMD5:contentMD5
+                      error:responseError];
+    });
+  }];
+}
+
 - (void)beginChunkFetcher:(GTMSessionFetcher *)chunkFetcher
                    offset:(int64_t)offset {
 
   // Track the current offset for progress reporting
   self.currentOffset = offset;
 
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    _chunkBeginTime = [NSDate timeIntervalSinceReferenceDate];
+    _hasRecordedChunkUpload = NO;
+  }  // @synchronized(self)
+
   // Hang on to the fetcher in case we need to cancel it.  We set these before beginning the
   // chunk fetch so the observers notified of chunk fetches can inspect the upload fetcher to
   // match to the chunk.
@@ -1260,6 +1606,10 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
     [self invokeDelegateWithDidSendBytes:bytesSent
                           totalBytesSent:totalSent
                 totalBytesExpectedToSend:totalExpected];
+
+    if (totalBytesExpectedToSend > 0 && totalBytesSent >= totalBytesExpectedToSend) {
+      [self chunkBodyWasSentWithLength:totalBytesExpectedToSend];
+    }
   };
 }
 
@@ -1448,6 +1798,9 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
       // Start the next chunk.
       self.currentOffset = newOffset;
 
+      // Does nothing if the throughput was recorded when the body finished sending.
+      [self chunkBodyWasSentWithLength:previousContentLength];
+
       // We want to destroy this chunk fetcher before creating the next one, but
       // we want to pass on its properties
       NSDictionary *props = [chunkFetcher properties];
@@ -1556,6 +1909,7 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
   // We won't try to cancel the initial data upload, but rather will check
   // for being paused in beginChunkFetches.
   [self destroyChunkFetcher];
+  [self discardPreparedChunk];
 }
 
 - (void)resumeFetching {
@@ -1576,6 +1930,7 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 - (void)stopFetching {
   // Overrides the superclass
   [self destroyChunkFetcher];
+  [self discardPreparedChunk];
 
   // If we think the server is waiting for more data, then tell it there won't be more.
   if (self.uploadLocationURL) {
@@ -1782,6 +2137,97 @@ NSString *const kGTMSessionFetcherUploadLocationObtainedNotification =
 
 @end
 
+@implementation GTMSessionUploadFetcherPreparedChunk {
+  void (^_readyBlock)(GTMSessionUploadFetcherPreparedChunk *chunk);
+  BOOL _isReady;
+  BOOL _isDiscarded;
+}
+
+@synthesize offset = _offset,
+            length = _length,
+            data = _data,
+            fileURL = _fileURL,
+            contentMD5 = _contentMD5,
+            error = _error;
+
+- (instancetype)initWithOffset:(int64_t)offset length:(int64_t)length {
+  self = [super init];
+  if (self) {
+    _offset = offset;
+    _length = length;
+  }
+  return self;
+}
+
+- (void)performWhenReady:(void (^)(GTMSessionUploadFetcherPreparedChunk *chunk))block {
+  BOOL isReady;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    isReady = _isReady;
+    if (!isReady) {
+      _readyBlock = [block copy];
+    }
+  }  // @synchronized(self)
+
+  if (isReady) {
+    block(self);
+  }
+}
+
+- (void)finishWithData:(GTM_NULLABLE NSData *)data
+               fileURL:(GTM_NULLABLE NSURL *)fileURL
+            contentMD5:(GTM_NULLABLE NSString *)contentMD5
+                 error:(GTM_NULLABLE NSError *)error {
+  void (^readyBlock)(GTMSessionUploadFetcherPreparedChunk *chunk);
+  BOOL isDiscarded;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    _data = data;
+    _fileURL = fileURL;
+    _contentMD5 = contentMD5;
+    _error = error;
+    _isReady = YES;
+    isDiscarded = _isDiscarded;
+    readyBlock = _readyBlock;
+    _readyBlock = nil;
+  }  // @synchronized(self)
+
+  if (isDiscarded) {
+    [self removeTemporaryFile];
+  } else if (readyBlock) {
+    readyBlock(self);
+  }
+}
+
+- (void)discard {
+  BOOL isReady;
+  @synchronized(self) {
+    GTMSessionMonitorSynchronized(self);
+
+    _isDiscarded = YES;
+    _readyBlock = nil;
+    isReady = _isReady;
+  }  // @synchronized(self)
+
+  if (isReady) {
+    [self removeTemporaryFile];
+  }
+}
+
+- (void)removeTemporaryFile {
+  NSURL *fileURL = self.fileURL;
+  if (!fileURL) return;
+
+  NSError *error;
+  if (![[NSFileManager defaultManager] removeItemAtURL:fileURL error:&error]) {
+    GTMSESSION_LOG_DEBUG(@"removingItemAtURL failed: %@\n%@", error, fileURL);
+  }
+}
+
+@end
+
 @implementation GTMSessionFetcher (GTMSessionUploadFetcherMethods)
 
 - (GTMSessionUploadFetcher *)parentUploadFetcher {
@@ -5,34 +5,43 @@
 
 #import "NSData+ImageContentType.h"
 
+static BOOL SDDataHasBytesAtOffset(NSData *data, NSUInteger offset, const uint8_t *bytes, NSUInteger length) {
+    if ([data length] < offset + length) {
+        return NO;
+    }
+    uint8_t buffer[12];
+    [data getBytes:buffer range:NSMakeRange(offset, length)];
+    return memcmp(buffer, bytes, length) == 0;
+}
 
 @implementation NSData (ImageContentType)
 
 + (NSString *)sd_contentTypeForImageData:(NSData *)data {
-    uint8_t c;
-    [data getBytes:&c length:1];
-    switch (c) {
-        case 0xFF:
-            return @"image/jpeg";
-        case 0x89:
-            return @"image/png";
-        case 0x47:
-            return @"image/gif";
-        case 0x49:
-        case 0x4D:
-            return @"image/tiff";
-        case 0x52:
-            // R as RIFF for WEBP
-            if ([data length] < 12) {
-                return nil;
-            }
-
-            NSString *testString = [[NSString alloc] initWithData:[data subdataWithRange:NSMakeRange(0, 12)] encoding:NSASCIIStringEncoding];
-            if ([testString hasPrefix:@"RIFF"] && [testString hasSuffix:@"WEBP"]) {
-                return @"image/webp";
-            }
-
-            return nil;
+    // Match the whole signature of each format, a single leading byte also matches plenty of non image payloads
+    static const uint8_t jpeg[] = {0xFF, 0xD8, 0xFF};
+    static const uint8_t png[] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+    static const uint8_t gif87[] = {'G', 'I', 'F', '8', '7', 'a'};
+    static const uint8_t gif89[] = {'G', 'I', 'F', '8', '9', 'a'};
+    static const uint8_t tiffLittleEndian[] = {0x49, 0x49, 0x2A, 0x00};
+    static const uint8_t tiffBigEndian[] = {0x4D, 0x4D, 0x00, 0x2A};
+    static const uint8_t riff[] = {'R', 'I', 'F', 'F'};
+    static const uint8_t webp[] = {'W', 'E', 'B', 'P'};
+
+    if (SDDataHasBytesAtOffset(data, 0, jpeg, sizeof(jpeg))) {
+        return @"image/jpeg";
+    }
+    if (SDDataHasBytesAtOffset(data, 0, png, sizeof(png))) {
+        return @"image/png";
+    }
+    if (SDDataHasBytesAtOffset(data, 0, gif87, sizeof(gif87)) || SDDataHasBytesAtOffset(data, 0, gif89, sizeof(gif89))) {
+        return @"image/gif";
+    }
+    if (SDDataHasBytesAtOffset(data, 0, tiffLittleEndian, sizeof(tiffLittleEndian)) || SDDataHasBytesAtOffset(data, 0, tiffBigEndian, sizeof(tiffBigEndian))) {
+        return @"image/tiff";
+    }
+    // RIFF container, 4 bytes of length, then WEBP
+    if (SDDataHasBytesAtOffset(data, 0, riff, sizeof(riff)) && SDDataHasBytesAtOffset(data, 8, webp, sizeof(webp))) {
+        return @"image/webp";
     }
     return nil;
 }
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * An animated GIF that decodes its frames on demand instead of all of them up front. Decoded frames are kept in
+ * a small buffer sized by a memory budget, and the frames after the one being shown are decoded ahead of time on
+ * a background queue. Each frame keeps its own delay from the GIF properties.
+ *
+ * The image itself is the first frame, so anything that does not know about animated images shows a still image.
+ * Use SDAnimatedImageView to play it.
+ */
+@interface SDAnimatedImage : UIImage
+
+/**
+ * Number of frames
+ */
+@property (assign, nonatomic, readonly) NSUInteger frameCount;
+
+/**
+ * Number of times the animation plays, 0 means forever
+ */
+@property (assign, nonatomic, readonly) NSUInteger loopCount;
+
+/**
+ * The GIF data the frames are decoded from
+ */
+@property (strong, nonatomic, readonly) NSData *animatedImageData;
+
+/**
+ * Memory budget in bytes for decoded frames. At least one frame is buffered even when a single frame is larger.
+ * All frames stay decoded when they fit in the budget [defaults to 10MB]
+ */
+@property (assign, nonatomic) NSUInteger maxBufferSize;
+
+/**
+ * Creates an animated image from GIF data
+ *
+ * @param data  The GIF data
+ * @param scale The scale of the frames
+ *
+ * @return The animated image, or nil if the data does not hold more than one frame
+ */
++ (instancetype)animatedImageWithGIFData:(NSData *)data scale:(CGFloat)scale;
+
+/**
+ * How long the frame is shown, in seconds
+ */
+- (NSTimeInterval)durationOfFrameAtIndex:(NSUInteger)index;
+
+/**
+ * Returns the frame if it is decoded already, or nil. Never blocks, and starts decoding the frames from this one on
+ * in the background, so call it again on the next refresh.
+ */
+- (UIImage *)cachedFrameAtIndex:(NSUInteger)index;
+
+/**
+ * Returns the frame, decoding it right away if needed
+ */
+- (UIImage *)frameAtIndex:(NSUInteger)index;
+
+@end
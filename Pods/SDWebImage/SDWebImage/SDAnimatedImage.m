@@ -0,0 +1,261 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDAnimatedImage.h"
+#import <ImageIO/ImageIO.h>
+
+@interface SDAnimatedImage ()
+
+@property (assign, nonatomic, readwrite) NSUInteger frameCount;
+@property (assign, nonatomic, readwrite) NSUInteger loopCount;
+@property (strong, nonatomic, readwrite) NSData *animatedImageData;
+
+@end
+
+@implementation SDAnimatedImage {
+    CGImageSourceRef _source;
+    CGFloat _frameScale;
+    NSTimeInterval *_frameDurations;
+    NSUInteger _bytesPerFrame;
+    // Decoded frames by index, guarded by @synchronized(self)
+    NSMutableDictionary *_bufferedFrames;
+    // First frame of the window of buffered frames, the last one requested
+    NSUInteger _windowStart;
+    // Frames being decoded in the background
+    NSMutableIndexSet *_decodingFrames;
+    dispatch_queue_t _decodingQueue;
+}
+
++ (instancetype)animatedImageWithGIFData:(NSData *)data scale:(CGFloat)scale {
+    if (!data) {
+        return nil;
+    }
+
+    CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+    if (!source) {
+        return nil;
+    }
+    if (CGImageSourceGetCount(source) <= 1) {
+        CFRelease(source);
+        return nil;
+    }
+
+    CGImageRef posterImageRef = [self copyFrameAtIndex:0 source:source];
+    if (!posterImageRef) {
+        CFRelease(source);
+        return nil;
+    }
+
+    SDAnimatedImage *animatedImage = [[self alloc] initWithCGImage:posterImageRef scale:scale orientation:UIImageOrientationUp];
+    CGImageRelease(posterImageRef);
+    [animatedImage setUpWithSource:source data:data scale:scale];
+    CFRelease(source);
+    return animatedImage;
+}
+
++ (CGImageRef)copyFrameAtIndex:(NSUInteger)index source:(CGImageSourceRef)source CF_RETURNS_RETAINED {
+    // Decode right away, on the calling queue, rather than when Core Animation first draws the frame
+    NSDictionary *options = @{(__bridge NSString *)kCGImageSourceShouldCacheImmediately: @YES};
+    return CGImageSourceCreateImageAtIndex(source, index, (__bridge CFDictionaryRef)options);
+}
+
+- (void)setUpWithSource:(CGImageSourceRef)source data:(NSData *)data scale:(CGFloat)scale {
+    _source = (CGImageSourceRef)CFRetain(source);
+    _frameScale = scale;
+    _animatedImageData = data;
+    _frameCount = CGImageSourceGetCount(source);
+    _maxBufferSize = 10 * 1024 * 1024;
+    _bufferedFrames = [NSMutableDictionary new];
+    _decodingFrames = [NSMutableIndexSet new];
+    _decodingQueue = dispatch_queue_create("com.hackemist.SDAnimatedImage", DISPATCH_QUEUE_SERIAL);
+    _bytesPerFrame = MAX((NSUInteger)1, (NSUInteger)(CGImageGetBytesPerRow(self.CGImage) * CGImageGetHeight(self.CGImage)));
+
+    NSDictionary *properties = (__bridge_transfer NSDictionary *)CGImageSourceCopyProperties(source, NULL);
+    _loopCount = [properties[(__bridge NSString *)kCGImagePropertyGIFDictionary][(__bridge NSString *)kCGImagePropertyGIFLoopCount] unsignedIntegerValue];
+
+    _frameDurations = calloc(_frameCount, sizeof(NSTimeInterval));
+    for (NSUInteger i = 0; i < _frameCount; i++) {
+        _frameDurations[i] = [[self class] frameDurationAtIndex:i source:source];
+    }
+
+    // The first frame is decoded already
+    _bufferedFrames[@0] = [UIImage imageWithCGImage:self.CGImage scale:scale orientation:UIImageOrientationUp];
+
+#if TARGET_OS_IPHONE
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(didReceiveMemoryWarning:)
+                                                 name:UIApplicationDidReceiveMemoryWarningNotification
+                                               object:nil];
+#endif
+}
+
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+    if (_source) {
+        CFRelease(_source);
+    }
+    free(_frameDurations);
+    SDDispatchQueueRelease(_decodingQueue);
+}
+
++ (NSTimeInterval)frameDurationAtIndex:(NSUInteger)index source:(CGImageSourceRef)source {
+    NSTimeInterval frameDuration = 0.1;
+    NSDictionary *frameProperties = (__bridge_transfer NSDictionary *)CGImageSourceCopyPropertiesAtIndex(source, index, NULL);
+    NSDictionary *gifProperties = frameProperties[(__bridge NSString *)kCGImagePropertyGIFDictionary];
+
+    NSNumber *delayTime = gifProperties[(__bridge NSString *)kCGImagePropertyGIFUnclampedDelayTime] ?: gifProperties[(__bridge NSString *)kCGImagePropertyGIFDelayTime];
+    if (delayTime) {
+        frameDuration = [delayTime doubleValue];
+    }
+
+    // Same as browsers, frames of 10ms or less are shown for 100ms, see +[UIImage sd_frameDurationAtIndex:source:]
+    if (frameDuration < 0.011) {
+        frameDuration = 0.1;
+    }
+    return frameDuration;
+}
+
+- (NSTimeInterval)durationOfFrameAtIndex:(NSUInteger)index {
+    if (index >= self.frameCount) {
+        return 0;
+    }
+    return _frameDurations[index];
+}
+
+#pragma mark Frame buffer
+
+- (NSUInteger)bufferCapacity {
+    NSUInteger capacity = self.maxBufferSize / _bytesPerFrame;
+    return MIN(MAX(capacity, (NSUInteger)1), self.frameCount);
+}
+
+- (UIImage *)cachedFrameAtIndex:(NSUInteger)index {
+    if (index >= self.frameCount) {
+        return nil;
+    }
+    UIImage *frame;
+    @synchronized (self) {
+        frame = _bufferedFrames[@(index)];
+        [self moveWindowToIndex:index];
+    }
+    [self decodeFramesAheadOfIndex:index];
+    return frame;
+}
+
+- (UIImage *)frameAtIndex:(NSUInteger)index {
+    if (index >= self.frameCount) {
+        return nil;
+    }
+    UIImage *frame = [self cachedFrameAtIndex:index];
+    if (!frame) {
+        frame = [self decodeFrameAtIndex:index];
+    }
+    return frame;
+}
+
+- (UIImage *)decodeFrameAtIndex:(NSUInteger)index {
+    CGImageRef imageRef = [[self class] copyFrameAtIndex:index source:_source];
+    if (!imageRef) {
+        return nil;
+    }
+    UIImage *frame = [UIImage imageWithCGImage:imageRef scale:_frameScale orientation:UIImageOrientationUp];
+    CGImageRelease(imageRef);
+
+    @synchronized (self) {
+        if ([self isIndexInWindow:index]) {
+            _bufferedFrames[@(index)] = frame;
+        }
+    }
+    return frame;
+}
+
+// Must be called inside @synchronized(self)
+- (BOOL)isIndexInWindow:(NSUInteger)index {
+    NSUInteger distance = (index + self.frameCount - _windowStart) % self.frameCount;
+    return distance < [self bufferCapacity];
+}
+
+// Must be called inside @synchronized(self)
+- (void)moveWindowToIndex:(NSUInteger)index {
+    if (_windowStart == index) {
+        return;
+    }
+    _windowStart = index;
+    if (_bufferedFrames.count <= [self bufferCapacity]) {
+        return;
+    }
+    // Drop the frames that fell behind, the window wraps around to the first frame
+    for (NSNumber *frameIndex in [_bufferedFrames allKeys]) {
+        if (![self isIndexInWindow:[frameIndex unsignedIntegerValue]]) {
+            [_bufferedFrames removeObjectForKey:frameIndex];
+        }
+    }
+}
+
+- (void)decodeFramesAheadOfIndex:(NSUInteger)index {
+    NSMutableIndexSet *framesToDecode = [NSMutableIndexSet new];
+    @synchronized (self) {
+        NSUInteger capacity = [self bufferCapacity];
+        for (NSUInteger i = 0; i < capacity; i++) {
+            NSUInteger frameIndex = (index + i) % self.frameCount;
+            if (!_bufferedFrames[@(frameIndex)] && ![_decodingFrames containsIndex:frameIndex]) {
+                [framesToDecode addIndex:frameIndex];
+            }
+        }
+        [_decodingFrames addIndexes:framesToDecode];
+    }
+    if (framesToDecode.count == 0) {
+        return;
+    }
+
+    __weak __typeof(self)wself = self;
+    dispatch_async(_decodingQueue, ^{
+        // Decode in playback order, from the requested frame on
+        NSMutableArray *orderedIndexes = [NSMutableArray new];
+        [framesToDecode enumerateIndexesUsingBlock:^(NSUInteger frameIndex, BOOL *stop) {
+            [orderedIndexes addObject:@(frameIndex)];
+        }];
+        [orderedIndexes sortUsingComparator:^NSComparisonResult(NSNumber *a, NSNumber *b) {
+            NSUInteger frameCount = wself.frameCount;
+            NSUInteger distanceA = ([a unsignedIntegerValue] + frameCount - index) % frameCount;
+            NSUInteger distanceB = ([b unsignedIntegerValue] + frameCount - index) % frameCount;
+            return distanceA < distanceB ? NSOrderedAscending : (distanceA > distanceB ? NSOrderedDescending : NSOrderedSame);
+        }];
+
+        for (NSNumber *frameIndex in orderedIndexes) {
+            __strong __typeof(wself)sself = wself;
+            if (!sself) {
+                return;
+            }
+            @autoreleasepool {
+                BOOL stillNeeded;
+                @synchronized (sself) {
+                    stillNeeded = [sself isIndexInWindow:[frameIndex unsignedIntegerValue]];
+                }
+                if (stillNeeded) {
+                    [sself decodeFrameAtIndex:[frameIndex unsignedIntegerValue]];
+                }
+                @synchronized (sself) {
+                    [sself->_decodingFrames removeIndex:[frameIndex unsignedIntegerValue]];
+                }
+            }
+        }
+    });
+}
+
+- (void)didReceiveMemoryWarning:(NSNotification *)notification {
+    @synchronized (self) {
+        UIImage *currentFrame = _bufferedFrames[@(_windowStart)];
+        [_bufferedFrames removeAllObjects];
+        if (currentFrame) {
+            _bufferedFrames[@(_windowStart)] = currentFrame;
+        }
+    }
+}
+
+@end
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageCompat.h"
+
+#if TARGET_OS_IPHONE
+
+#import <UIKit/UIKit.h>
+#import "SDAnimatedImage.h"
+
+/**
+ * An image view that plays SDAnimatedImage frames as they get decoded, each for its own delay. Playback starts
+ * when the view is visible in a window and stops when it is not. Other images are shown like UIImageView does.
+ */
+@interface SDAnimatedImageView : UIImageView
+
+/**
+ * The animated image being played, nil when the image is not an SDAnimatedImage
+ */
+@property (strong, nonatomic, readonly) SDAnimatedImage *animatedImage;
+
+/**
+ * Index of the frame on screen
+ */
+@property (assign, nonatomic, readonly) NSUInteger currentFrameIndex;
+
+/**
+ * The run loop mode of the display link, use NSRunLoopCommonModes to keep playing while scrolling
+ * [defaults to NSDefaultRunLoopMode]
+ */
+@property (copy, nonatomic) NSString *runLoopMode;
+
+@end
+
+#endif
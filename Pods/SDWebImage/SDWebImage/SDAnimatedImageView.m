@@ -0,0 +1,218 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDAnimatedImageView.h"
+
+#if TARGET_OS_IPHONE
+
+#import <QuartzCore/QuartzCore.h>
+
+// The display link retains its target, this keeps it from retaining the view
+@interface SDAnimatedImageViewDisplayLinkTarget : NSObject
+
+@property (weak, nonatomic) SDAnimatedImageView *imageView;
+
+@end
+
+@interface SDAnimatedImageView ()
+
+@property (strong, nonatomic, readwrite) SDAnimatedImage *animatedImage;
+@property (assign, nonatomic, readwrite) NSUInteger currentFrameIndex;
+@property (strong, nonatomic) UIImage *currentFrame;
+@property (strong, nonatomic) CADisplayLink *displayLink;
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink;
+
+@end
+
+@implementation SDAnimatedImageViewDisplayLinkTarget
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink {
+    [self.imageView displayDidRefresh:displayLink];
+}
+
+@end
+
+@implementation SDAnimatedImageView {
+    NSTimeInterval _accumulatedTime;
+    CFTimeInterval _lastTimestamp;
+    NSUInteger _loopsPlayed;
+    BOOL _animating;
+}
+
+- (void)dealloc {
+    [_displayLink invalidate];
+}
+
+- (NSString *)runLoopMode {
+    return _runLoopMode ?: NSDefaultRunLoopMode;
+}
+
+- (void)setRunLoopMode:(NSString *)runLoopMode {
+    if (self.displayLink) {
+        [self.displayLink removeFromRunLoop:[NSRunLoop mainRunLoop] forMode:self.runLoopMode];
+        [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:runLoopMode ?: NSDefaultRunLoopMode];
+    }
+    _runLoopMode = [runLoopMode copy];
+}
+
+- (void)setImage:(UIImage *)image {
+    if (image == self.image) {
+        return;
+    }
+
+    [self stopDisplayLink];
+    self.animatedImage = [image isKindOfClass:[SDAnimatedImage class]] ? (SDAnimatedImage *)image : nil;
+    self.currentFrameIndex = 0;
+    self.currentFrame = nil;
+    _accumulatedTime = 0;
+    _loopsPlayed = 0;
+
+    [super setImage:image];
+
+    if (self.animatedImage) {
+        self.currentFrame = [self.animatedImage cachedFrameAtIndex:0] ?: self.animatedImage;
+        _animating = YES;
+        [self.layer setNeedsDisplay];
+    }
+    [self updateDisplayLink];
+}
+
+#pragma mark Playback
+
+- (void)startAnimating {
+    if (self.animatedImage) {
+        _animating = YES;
+        [self updateDisplayLink];
+    }
+    else {
+        [super startAnimating];
+    }
+}
+
+- (void)stopAnimating {
+    if (self.animatedImage) {
+        _animating = NO;
+        [self updateDisplayLink];
+    }
+    else {
+        [super stopAnimating];
+    }
+}
+
+- (BOOL)isAnimating {
+    if (self.animatedImage) {
+        return self.displayLink != nil;
+    }
+    return [super isAnimating];
+}
+
+- (void)didMoveToWindow {
+    [super didMoveToWindow];
+    [self updateDisplayLink];
+}
+
+- (void)didMoveToSuperview {
+    [super didMoveToSuperview];
+    [self updateDisplayLink];
+}
+
+- (void)setHidden:(BOOL)hidden {
+    [super setHidden:hidden];
+    [self updateDisplayLink];
+}
+
+- (void)setAlpha:(CGFloat)alpha {
+    [super setAlpha:alpha];
+    [self updateDisplayLink];
+}
+
+- (BOOL)shouldPlay {
+    return self.animatedImage && _animating && self.window && self.superview && !self.hidden && self.alpha > 0;
+}
+
+- (void)updateDisplayLink {
+    if ([self shouldPlay]) {
+        if (!self.displayLink) {
+            SDAnimatedImageViewDisplayLinkTarget *target = [SDAnimatedImageViewDisplayLinkTarget new];
+            target.imageView = self;
+            self.displayLink = [CADisplayLink displayLinkWithTarget:target selector:@selector(displayDidRefresh:)];
+            [self.displayLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:self.runLoopMode];
+            _lastTimestamp = 0;
+        }
+    }
+    else {
+        [self stopDisplayLink];
+    }
+}
+
+- (void)stopDisplayLink {
+    [self.displayLink invalidate];
+    self.displayLink = nil;
+}
+
+- (void)displayDidRefresh:(CADisplayLink *)displayLink {
+    SDAnimatedImage *animatedImage = self.animatedImage;
+    if (!animatedImage) {
+        [self stopDisplayLink];
+        return;
+    }
+
+    if (_lastTimestamp > 0) {
+        _accumulatedTime += displayLink.timestamp - _lastTimestamp;
+    }
+    _lastTimestamp = displayLink.timestamp;
+
+    NSUInteger frameCount = animatedImage.frameCount;
+    BOOL frameChanged = NO;
+    // Catch up on every frame whose delay is over, but never wait on a frame still being decoded:
+    // it stays on screen a bit longer instead of blocking the main thread
+    while (_accumulatedTime >= [animatedImage durationOfFrameAtIndex:self.currentFrameIndex]) {
+        NSUInteger nextIndex = (self.currentFrameIndex + 1) % frameCount;
+        if (nextIndex == 0 && animatedImage.loopCount > 0 && _loopsPlayed + 1 >= animatedImage.loopCount) {
+            _animating = NO;
+            [self stopDisplayLink];
+            break;
+        }
+
+        UIImage *nextFrame = [animatedImage cachedFrameAtIndex:nextIndex];
+        if (!nextFrame) {
+            // Do not let the wait pile up into a burst of skipped frames once decoding catches up
+            _accumulatedTime = MIN(_accumulatedTime, [animatedImage durationOfFrameAtIndex:self.currentFrameIndex]);
+            break;
+        }
+
+        _accumulatedTime -= [animatedImage durationOfFrameAtIndex:self.currentFrameIndex];
+        if (nextIndex == 0) {
+            _loopsPlayed++;
+        }
+        self.currentFrameIndex = nextIndex;
+        self.currentFrame = nextFrame;
+        frameChanged = YES;
+    }
+
+    if (frameChanged) {
+        [self.layer setNeedsDisplay];
+    }
+}
+
+#pragma mark Drawing
+
+- (void)displayLayer:(CALayer *)layer {
+    if (self.animatedImage && self.currentFrame) {
+        layer.contentsScale = self.currentFrame.scale;
+        layer.contents = (__bridge id)self.currentFrame.CGImage;
+    }
+    else if ([UIImageView instancesRespondToSelector:@selector(displayLayer:)]) {
+        [super displayLayer:layer];
+    }
+}
+
+@end
+
+#endif
@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 #import "SDWebImageCompat.h"
+#import "SDImageCacheEvictionPolicy.h"
+#import "SDImageCacheTranscoder.h"
 
 typedef NS_ENUM(NSInteger, SDImageCacheType) {
     /**
@@ -30,6 +32,59 @@ typedef void(^SDWebImageCheckCacheCompletionBlock)(BOOL isInCache);
 
 typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger totalSize);
 
+/**
+ * A disk backend replaces the default one-file-per-image layout of SDImageCache with a different storage format.
+ * SDImageCache calls into the backend from several IO queues at once, so implementations must be thread safe.
+ */
+@protocol SDImageCacheDiskBackend <NSObject>
+
+/**
+ * Returns the stored data for the key, or nil if there is none
+ */
+- (NSData *)dataForKey:(NSString *)key;
+
+/**
+ * Returns YES if data is stored for the key, without reading it
+ */
+- (BOOL)containsDataForKey:(NSString *)key;
+
+/**
+ * Stores the data for the key, replacing any previous data
+ */
+- (void)setData:(NSData *)data forKey:(NSString *)key;
+
+/**
+ * Removes the data stored for the key
+ */
+- (void)removeDataForKey:(NSString *)key;
+
+/**
+ * Removes everything stored by the backend
+ */
+- (void)removeAllData;
+
+/**
+ * Removes every entry that was last read or written before the given date
+ */
+- (void)removeDataLastAccessedBefore:(NSDate *)date;
+
+/**
+ * Removes the least recently used entries until the total size is at most the given number of bytes
+ */
+- (void)trimToSize:(NSUInteger)size;
+
+/**
+ * Total size in bytes of the stored data
+ */
+- (NSUInteger)totalSize;
+
+/**
+ * Number of stored entries
+ */
+- (NSUInteger)totalCount;
+
+@end
+
 /**
  * SDImageCache maintains a memory cache and an optional disk cache. Disk cache write operations are performed
  * asynchronous so it doesn’t add unnecessary latency to the UI.
@@ -72,6 +127,44 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  */
 @property (assign, nonatomic) NSUInteger maxCacheSize;
 
+/**
+ * Storage used for the disk cache. Defaults to nil, which stores one file per image in the disk cache directory.
+ * Set this right after creating the cache, before any image is stored. diskEvictionPolicy does not apply to a backend.
+ * @see SDImageCachePackedStore
+ */
+@property (strong, nonatomic) id<SDImageCacheDiskBackend> diskBackend;
+
+/**
+ * Decides which files the disk clean up removes once the cache is over maxCacheSize. Recency and frequency come from
+ * disk reads, which are tracked in memory and persisted in batches. The policy keeps its state between clean ups,
+ * so frequency based policies see the whole read history. Defaults to an SDImageCacheLRUPolicy.
+ * Not used when diskBackend is set, a backend trims by its own least recently accessed order.
+ */
+@property (strong, nonatomic) id<SDImageCacheEvictionPolicy> diskEvictionPolicy;
+
+/**
+ * When set, the memory cache evicts by this policy once maxMemoryCost is reached instead of leaving it to NSCache,
+ * which may still purge everything on memory warnings. Setting it empties the memory cache. Defaults to nil.
+ */
+@property (strong, nonatomic) id<SDImageCacheEvictionPolicy> memoryEvictionPolicy;
+
+/**
+ * Rewrites image data before it is written to disk. Defaults to nil, which stores the downloaded bytes as they are
+ * and only encodes images that come without data or were transformed.
+ * @see SDImageCacheJPEGTranscoder
+ */
+@property (strong, nonatomic) id<SDImageCacheTranscoder> transcoder;
+
+/**
+ * Number of memory cache lookups that found an image
+ */
+@property (assign, nonatomic, readonly) NSUInteger memoryCacheHitCount;
+
+/**
+ * Number of memory cache lookups that found nothing
+ */
+@property (assign, nonatomic, readonly) NSUInteger memoryCacheMissCount;
+
 /**
  * Returns global shared cache instance
  *
@@ -128,12 +221,27 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  * @param recalculate BOOL indicates if imageData can be used or a new data should be constructed from the UIImage
  * @param imageData   The image data as returned by the server, this representation will be used for disk storage
  *                    instead of converting the given image object into a storable/compressed image format in order
- *                    to save quality and CPU
+ *                    to save quality and CPU. When the image has to be encoded, it also picks PNG or JPEG
  * @param key         The unique image cache key, usually it's image absolute URL
  * @param toDisk      Store the image to disk cache if YES
  */
 - (void)storeImage:(UIImage *)image recalculateFromImage:(BOOL)recalculate imageData:(NSData *)imageData forKey:(NSString *)key toDisk:(BOOL)toDisk;
 
+/**
+ * Store an image decoded for a target size into memory and optionally disk cache at the given key.
+ * The image is kept in memory apart from the full size image and from other sizes. Since it is a scaled down copy,
+ * only the original imageData is ever written to disk.
+ *
+ * @param image           The image to store
+ * @param recalculate     BOOL indicates if imageData does not match the image anymore, e.g. it was transformed.
+ *                        The image is then only kept in memory
+ * @param imageData       The image data as returned by the server
+ * @param key             The unique image cache key, usually it's image absolute URL
+ * @param targetPixelSize The size in pixels the image was decoded for, CGSizeZero for a full size image
+ * @param toDisk          Store the image data to disk cache if YES
+ */
+- (void)storeImage:(UIImage *)image recalculateFromImage:(BOOL)recalculate imageData:(NSData *)imageData forKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize toDisk:(BOOL)toDisk;
+
 /**
  * Store image NSData into disk cache at the given key.
  *
@@ -149,6 +257,16 @@ typedef void(^SDWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger tot
  */
 - (NSOperation *)queryDiskCacheForKey:(NSString *)key done:(SDWebImageQueryCompletedBlock)doneBlock;
 
+/**
+ * Query the disk cache asynchronously for an image decoded for a target size. Disk data is decoded straight to
+ * that size, see `+[UIImage decodedImageWithData:scale:targetPixelSize:]`.
+ *
+ * @param key             The unique key used to store the wanted image
+ * @param targetPixelSize The size in pixels the image will be displayed at, CGSizeZero for a full size image
+ * @param doneBlock       The block called once the image is found or not
+ */
+- (NSOperation *)queryDiskCacheForKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize done:(SDWebImageQueryCompletedBlock)doneBlock;
+
 /**
  * Query the memory cache synchronously.
  *
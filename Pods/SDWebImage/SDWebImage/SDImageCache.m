@@ -9,18 +9,41 @@
 #import "SDImageCache.h"
 #import "SDWebImageDecoder.h"
 #import "UIImage+MultiFormat.h"
+#import "NSData+ImageContentType.h"
 #import <CommonCrypto/CommonDigest.h>
 
+// What AutoPurgeCache stores in NSCache, so an object NSCache evicts on its own can be traced back to its key
+@interface SDMemoryCacheEntry : NSObject
+
+@property (copy, nonatomic) NSString *key;
+@property (strong, nonatomic) id object;
+
+@end
+
+@implementation SDMemoryCacheEntry
+@end
+
 // See https://github.com/rs/SDWebImage/pull/1141 for discussion
-@interface AutoPurgeCache : NSCache
+@interface AutoPurgeCache : NSCache <NSCacheDelegate>
+
+@property (strong, nonatomic) id<SDImageCacheEvictionPolicy> evictionPolicy;
+@property (assign, nonatomic, readonly) NSUInteger hitCount;
+@property (assign, nonatomic, readonly) NSUInteger missCount;
+
 @end
 
-@implementation AutoPurgeCache
+@implementation AutoPurgeCache {
+    NSUInteger _costLimit;
+    // key -> the entry currently stored for it, to tell a replaced entry from an evicted one
+    NSMapTable *_currentEntries;
+}
 
 - (id)init
 {
     self = [super init];
     if (self) {
+        _currentEntries = [NSMapTable strongToWeakObjectsMapTable];
+        self.delegate = self;
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(removeAllObjects) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
     }
     return self;
@@ -32,42 +55,152 @@
 
 }
 
-@end
+- (void)setEvictionPolicy:(id<SDImageCacheEvictionPolicy>)evictionPolicy {
+    // objects already cached are unknown to the new policy, start from scratch
+    [super removeAllObjects];
+    @synchronized (self) {
+        [evictionPolicy removeAllKeys];
+        if ([evictionPolicy respondsToSelector:@selector(setCostLimit:)]) {
+            [evictionPolicy setCostLimit:_costLimit];
+        }
+        _evictionPolicy = evictionPolicy;
+    }
+    // with a policy the cost limit is enforced here, NSCache would evict on its own otherwise
+    [super setTotalCostLimit:evictionPolicy ? 0 : _costLimit];
+}
 
-static const NSInteger kDefaultCacheMaxCacheAge = 60 * 60 * 24 * 7; // 1 week
-// PNG signature bytes and data (below)
-static unsigned char kPNGSignatureBytes[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
-static NSData *kPNGSignatureData = nil;
+- (void)setTotalCostLimit:(NSUInteger)totalCostLimit {
+    @synchronized (self) {
+        _costLimit = totalCostLimit;
+        if ([_evictionPolicy respondsToSelector:@selector(setCostLimit:)]) {
+            [_evictionPolicy setCostLimit:totalCostLimit];
+        }
+    }
+    [super setTotalCostLimit:self.evictionPolicy ? 0 : totalCostLimit];
+}
+
+- (NSUInteger)totalCostLimit {
+    return _costLimit;
+}
+
+- (id)objectForKey:(id)key {
+    id object = [(SDMemoryCacheEntry *)[super objectForKey:key] object];
+    @synchronized (self) {
+        if (object) {
+            _hitCount++;
+            [_evictionPolicy recordAccessOfKey:key];
+        } else {
+            _missCount++;
+        }
+    }
+    return object;
+}
 
-BOOL ImageDataHasPNGPreffix(NSData *data);
+- (void)setObject:(id)obj forKey:(id)key {
+    [self setObject:obj forKey:key cost:0];
+}
 
-BOOL ImageDataHasPNGPreffix(NSData *data) {
-    NSUInteger pngSignatureLength = [kPNGSignatureData length];
-    if ([data length] >= pngSignatureLength) {
-        if ([[data subdataWithRange:NSMakeRange(0, pngSignatureLength)] isEqualToData:kPNGSignatureData]) {
-            return YES;
+- (void)setObject:(id)obj forKey:(id)key cost:(NSUInteger)g {
+    SDMemoryCacheEntry *entry = [SDMemoryCacheEntry new];
+    entry.key = key;
+    entry.object = obj;
+    // registered before NSCache lets go of the entry it replaces, so that one is not taken for an eviction
+    @synchronized (self) {
+        [_currentEntries setObject:entry forKey:key];
+    }
+    [super setObject:entry forKey:key cost:g];
+    NSArray *evictedKeys = nil;
+    @synchronized (self) {
+        if (_evictionPolicy) {
+            [_evictionPolicy recordInsertionOfKey:key cost:g];
+            if (_costLimit > 0) {
+                evictedKeys = [_evictionPolicy keysToEvictForCostLimit:_costLimit];
+            }
         }
     }
+    for (id evictedKey in evictedKeys) {
+        [super removeObjectForKey:evictedKey];
+    }
+}
+
+- (void)removeObjectForKey:(id)key {
+    [super removeObjectForKey:key];
+    @synchronized (self) {
+        [_evictionPolicy recordRemovalOfKey:key];
+    }
+}
 
-    return NO;
+- (void)removeAllObjects {
+    [super removeAllObjects];
+    @synchronized (self) {
+        [_evictionPolicy removeAllKeys];
+    }
 }
 
+#pragma mark NSCacheDelegate
+
+// NSCache evicts on its own under memory pressure and past countLimit without going through removeObjectForKey:,
+// keep the policy in step with what is actually cached
+- (void)cache:(NSCache *)cache willEvictObject:(id)obj {
+    SDMemoryCacheEntry *entry = obj;
+    @synchronized (self) {
+        if ([_currentEntries objectForKey:entry.key] != entry) {
+            return;
+        }
+        [_currentEntries removeObjectForKey:entry.key];
+        [_evictionPolicy recordRemovalOfKey:entry.key];
+    }
+}
+
+@end
+
+static const NSInteger kDefaultCacheMaxCacheAge = 60 * 60 * 24 * 7; // 1 week
+// Number of serial IO queues disk writes and removals are spread over, chosen by key
+static const NSUInteger kCacheIOQueueCount = 4;
+// Disk reads recorded in memory before they are written to the access log
+static const NSUInteger kAccessLogFlushThreshold = 64;
+// Reads replayed into the eviction policy per file, enough for frequency based policies to tell files apart
+static const NSUInteger kAccessLogMaxReplayedReads = 16;
 FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     return image.size.height * image.size.width * image.scale * image.scale;
 }
 
+FOUNDATION_STATIC_INLINE BOOL SDTargetPixelSizeIsSet(CGSize targetPixelSize) {
+    return targetPixelSize.width > 0 && targetPixelSize.height > 0;
+}
+
+// Images decoded for a target size live next to the full size image in the memory cache, under their own key
+FOUNDATION_STATIC_INLINE NSString *SDMemoryCacheKeyForKey(NSString *key, CGSize targetPixelSize) {
+    if (!SDTargetPixelSizeIsSet(targetPixelSize)) {
+        return key;
+    }
+    return [NSString stringWithFormat:@"%@#%.0fx%.0f", key, targetPixelSize.width, targetPixelSize.height];
+}
+
 @interface SDImageCache ()
 
-@property (strong, nonatomic) NSCache *memCache;
+@property (strong, nonatomic) AutoPurgeCache *memCache;
 @property (strong, nonatomic) NSString *diskCachePath;
 @property (strong, nonatomic) NSMutableArray *customPaths;
-@property (SDDispatchQueueSetterSementics, nonatomic) dispatch_queue_t ioQueue;
+@property (SDDispatchQueueSetterSementics, nonatomic) dispatch_queue_t readQueue;
+@property (SDDispatchQueueSetterSementics, nonatomic) dispatch_queue_t maintenanceQueue;
 
 @end
 
 
 @implementation SDImageCache {
     NSFileManager *_fileManager;
+    dispatch_queue_t _ioQueues[kCacheIOQueueCount];
+    // Disk reads not yet merged into the access log, cache file name -> @[last read time, read count]
+    NSMutableDictionary *_pendingAccesses;
+    // Persisted disk reads, only touched on the maintenance queue
+    NSMutableDictionary *_accessLog;
+    // The disk eviction policy that is kept up to date and the cost it tracks per file name, maintenance queue only.
+    // The policy is filled from the cache directory once and then follows writes, reads and removals.
+    id<SDImageCacheEvictionPolicy> _trackingDiskPolicy;
+    NSMutableDictionary *_diskPolicyCosts;
+    // key -> memory cache keys of the images decoded from it for a target size, so removing the key removes them too
+    NSMutableDictionary *_sizedMemoryKeys;
 }
 
 + (SDImageCache *)sharedImageCache {
@@ -92,14 +225,26 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     if ((self = [super init])) {
         NSString *fullNamespace = [@"com.hackemist.SDWebImageCache." stringByAppendingString:ns];
 
-        // initialise PNG signature data
-        kPNGSignatureData = [NSData dataWithBytes:kPNGSignatureBytes length:8];
+        // Create IO serial queues, one per shard. Writes and removals for a key always land on the same
+        // queue so they stay ordered, while a large write no longer holds up work for unrelated keys.
+        // The shard index is part of the label so each queue can be told apart in traces and crash logs
+        for (NSUInteger i = 0; i < kCacheIOQueueCount; i++) {
+            NSString *label = [NSString stringWithFormat:@"com.hackemist.SDWebImageCache.io.%lu", (unsigned long)i];
+            _ioQueues[i] = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+        }
+
+        // Reads never mutate the disk cache so they can run concurrently
+        _readQueue = dispatch_queue_create("com.hackemist.SDWebImageCache.read", DISPATCH_QUEUE_CONCURRENT);
 
-        // Create IO serial queue
-        _ioQueue = dispatch_queue_create("com.hackemist.SDWebImageCache", DISPATCH_QUEUE_SERIAL);
+        // Expiration and size calculation walk the whole cache directory, keep them off the lookup path
+        _maintenanceQueue = dispatch_queue_create("com.hackemist.SDWebImageCache.maintenance", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_maintenanceQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
 
         // Init default values
         _maxCacheAge = kDefaultCacheMaxCacheAge;
+        _diskEvictionPolicy = [SDImageCacheLRUPolicy new];
+        _pendingAccesses = [NSMutableDictionary new];
+        _sizedMemoryKeys = [NSMutableDictionary new];
 
         // Init the memory cache
         _memCache = [[AutoPurgeCache alloc] init];
@@ -122,9 +267,8 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
         // Disable iCloud
         _shouldDisableiCloud = YES;
 
-        dispatch_sync(_ioQueue, ^{
-            _fileManager = [NSFileManager new];
-        });
+        // the file manager has no delegate, so it is safe to share between the IO queues
+        _fileManager = [NSFileManager new];
 
 #if TARGET_OS_IOS
         // Subscribe to app events
@@ -150,7 +294,11 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 - (void)dealloc {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
-    SDDispatchQueueRelease(_ioQueue);
+    for (NSUInteger i = 0; i < kCacheIOQueueCount; i++) {
+        SDDispatchQueueRelease(_ioQueues[i]);
+    }
+    SDDispatchQueueRelease(_readQueue);
+    SDDispatchQueueRelease(_maintenanceQueue);
 }
 
 - (void)addReadOnlyCachePath:(NSString *)path {
@@ -174,6 +322,43 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 #pragma mark SDImageCache (private)
 
+- (dispatch_queue_t)ioQueueForKey:(NSString *)key {
+    return _ioQueues[[key hash] % kCacheIOQueueCount];
+}
+
+// Runs a read for the key on the concurrent read queue once every write and removal already queued on the key's
+// shard has finished, so a lookup issued right after a store sees it. Only the hand-off waits on the shard, the
+// read itself still runs alongside other reads
+- (void)dispatchReadForKey:(NSString *)key block:(dispatch_block_t)block {
+    dispatch_queue_t readQueue = self.readQueue;
+    dispatch_async([self ioQueueForKey:key], ^{
+        dispatch_async(readQueue, block);
+    });
+}
+
+// Waits for every write and removal queued so far, call from the maintenance queue only
+- (void)drainIOQueues {
+    for (NSUInteger i = 0; i < kCacheIOQueueCount; i++) {
+        dispatch_sync(_ioQueues[i], ^{});
+    }
+}
+
+- (void)storeImageInMemory:(UIImage *)image forKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize {
+    NSString *memoryKey = SDMemoryCacheKeyForKey(key, targetPixelSize);
+    if (SDTargetPixelSizeIsSet(targetPixelSize)) {
+        @synchronized (_sizedMemoryKeys) {
+            NSMutableSet *memoryKeys = _sizedMemoryKeys[key];
+            if (!memoryKeys) {
+                memoryKeys = [NSMutableSet new];
+                _sizedMemoryKeys[key] = memoryKeys;
+            }
+            [memoryKeys addObject:memoryKey];
+        }
+    }
+    NSUInteger cost = SDCacheCostForImage(image);
+    [self.memCache setObject:image forKey:memoryKey cost:cost];
+}
+
 - (NSString *)cachedFileNameForKey:(NSString *)key {
     const char *str = [key UTF8String];
     if (str == NULL) {
@@ -197,48 +382,38 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (void)storeImage:(UIImage *)image recalculateFromImage:(BOOL)recalculate imageData:(NSData *)imageData forKey:(NSString *)key toDisk:(BOOL)toDisk {
+    [self storeImage:image recalculateFromImage:recalculate imageData:imageData forKey:key targetPixelSize:CGSizeZero toDisk:toDisk];
+}
+
+- (void)storeImage:(UIImage *)image recalculateFromImage:(BOOL)recalculate imageData:(NSData *)imageData forKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize toDisk:(BOOL)toDisk {
     if (!image || !key) {
         return;
     }
     // if memory cache is enabled
     if (self.shouldCacheImagesInMemory) {
-        NSUInteger cost = SDCacheCostForImage(image);
-        [self.memCache setObject:image forKey:key cost:cost];
+        [self storeImageInMemory:image forKey:key targetPixelSize:targetPixelSize];
+    }
+
+    // Encoding a scaled down image would serve the small copy to full size requests later on
+    if (SDTargetPixelSizeIsSet(targetPixelSize) && (recalculate || !imageData)) {
+        toDisk = NO;
     }
 
     if (toDisk) {
-        dispatch_async(self.ioQueue, ^{
+        dispatch_async([self ioQueueForKey:key], ^{
+            // The bytes as downloaded are stored unchanged, decoding and encoding them again costs CPU
+            // and usually makes the file larger and lossier. Only images without usable bytes get encoded.
             NSData *data = imageData;
+            if (recalculate || !data) {
+                data = [self encodedDataForImage:image originalData:imageData];
+            }
 
-            if (image && (recalculate || !data)) {
-#if TARGET_OS_IPHONE
-                // We need to determine if the image is a PNG or a JPEG
-                // PNGs are easier to detect because they have a unique signature (http://www.w3.org/TR/PNG-Structure.html)
-                // The first eight bytes of a PNG file always contain the following (decimal) values:
-                // 137 80 78 71 13 10 26 10
-
-                // If the imageData is nil (i.e. if trying to save a UIImage directly or the image was transformed on download)
-                // and the image has an alpha channel, we will consider it PNG to avoid losing the transparency
-                int alphaInfo = CGImageGetAlphaInfo(image.CGImage);
-                BOOL hasAlpha = !(alphaInfo == kCGImageAlphaNone ||
-                                  alphaInfo == kCGImageAlphaNoneSkipFirst ||
-                                  alphaInfo == kCGImageAlphaNoneSkipLast);
-                BOOL imageIsPng = hasAlpha;
-
-                // But if we have an image data, we will look at the preffix
-                if ([imageData length] >= [kPNGSignatureData length]) {
-                    imageIsPng = ImageDataHasPNGPreffix(imageData);
-                }
-
-                if (imageIsPng) {
-                    data = UIImagePNGRepresentation(image);
+            id<SDImageCacheTranscoder> transcoder = self.transcoder;
+            if (transcoder && data) {
+                NSData *transcodedData = [transcoder cacheDataForImage:image originalData:data];
+                if (transcodedData) {
+                    data = transcodedData;
                 }
-                else {
-                    data = UIImageJPEGRepresentation(image, (CGFloat)1.0);
-                }
-#else
-                data = [NSBitmapImageRep representationOfImageRepsInArray:image.representations usingType: NSJPEGFileType properties:nil];
-#endif
             }
 
             [self storeImageDataToDisk:data forKey:key];
@@ -246,6 +421,31 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     }
 }
 
+- (NSData *)encodedDataForImage:(UIImage *)image originalData:(NSData *)imageData {
+#if TARGET_OS_IPHONE
+    // Keep the format of the original bytes when there are some. Otherwise (i.e. if trying to save a UIImage directly
+    // or the image was transformed on download) an image with an alpha channel is stored as PNG to keep the transparency
+    NSString *contentType = [NSData sd_contentTypeForImageData:imageData];
+    BOOL imageIsPng;
+    if (contentType) {
+        imageIsPng = [contentType isEqualToString:@"image/png"];
+    }
+    else {
+        int alphaInfo = CGImageGetAlphaInfo(image.CGImage);
+        imageIsPng = !(alphaInfo == kCGImageAlphaNone ||
+                       alphaInfo == kCGImageAlphaNoneSkipFirst ||
+                       alphaInfo == kCGImageAlphaNoneSkipLast);
+    }
+
+    if (imageIsPng) {
+        return UIImagePNGRepresentation(image);
+    }
+    return UIImageJPEGRepresentation(image, (CGFloat)1.0);
+#else
+    return [NSBitmapImageRep representationOfImageRepsInArray:image.representations usingType: NSJPEGFileType properties:nil];
+#endif
+}
+
 - (void)storeImage:(UIImage *)image forKey:(NSString *)key {
     [self storeImage:image recalculateFromImage:YES imageData:nil forKey:key toDisk:YES];
 }
@@ -259,6 +459,11 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     if (!imageData) {
         return;
     }
+
+    if (self.diskBackend) {
+        [self.diskBackend setData:imageData forKey:key];
+        return;
+    }
     
     if (![_fileManager fileExistsAtPath:_diskCachePath]) {
         [_fileManager createDirectoryAtPath:_diskCachePath withIntermediateDirectories:YES attributes:nil error:NULL];
@@ -279,8 +484,12 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 - (BOOL)diskImageExistsWithKey:(NSString *)key {
     BOOL exists = NO;
+
+    if (self.diskBackend) {
+        return [self.diskBackend containsDataForKey:key];
+    }
     
-    // this is an exception to access the filemanager on another queue than ioQueue, but we are using the shared instance
+    // this is an exception to access the filemanager outside of the IO queues, but we are using the shared instance
     // from apple docs on NSFileManager: The methods of the shared NSFileManager object can be called from multiple threads safely.
     exists = [[NSFileManager defaultManager] fileExistsAtPath:[self defaultCachePathForKey:key]];
 
@@ -294,12 +503,17 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (void)diskImageExistsWithKey:(NSString *)key completion:(SDWebImageCheckCacheCompletionBlock)completionBlock {
-    dispatch_async(_ioQueue, ^{
-        BOOL exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key]];
+    [self dispatchReadForKey:key block:^{
+        BOOL exists = NO;
+        if (self.diskBackend) {
+            exists = [self.diskBackend containsDataForKey:key];
+        } else {
+            exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key]];
+        }
 
         // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
         // checking the key with and without the extension
-        if (!exists) {
+        if (!exists && !self.diskBackend) {
             exists = [_fileManager fileExistsAtPath:[[self defaultCachePathForKey:key] stringByDeletingPathExtension]];
         }
 
@@ -308,7 +522,7 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                 completionBlock(exists);
             });
         }
-    });
+    }];
 }
 
 - (UIImage *)imageFromMemoryCacheForKey:(NSString *)key {
@@ -334,17 +548,26 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (NSData *)diskImageDataBySearchingAllPathsForKey:(NSString *)key {
-    NSString *defaultPath = [self defaultCachePathForKey:key];
-    NSData *data = [NSData dataWithContentsOfFile:defaultPath];
-    if (data) {
-        return data;
-    }
+    if (self.diskBackend) {
+        NSData *data = [self.diskBackend dataForKey:key];
+        if (data) {
+            return data;
+        }
+    } else {
+        NSString *defaultPath = [self defaultCachePathForKey:key];
+        NSData *data = [NSData dataWithContentsOfFile:defaultPath];
+        if (data) {
+            [self recordDiskAccessOfFileName:[defaultPath lastPathComponent]];
+            return data;
+        }
 
-    // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
-    // checking the key with and without the extension
-    data = [NSData dataWithContentsOfFile:[defaultPath stringByDeletingPathExtension]];
-    if (data) {
-        return data;
+        // fallback because of https://github.com/rs/SDWebImage/pull/976 that added the extension to the disk file name
+        // checking the key with and without the extension
+        data = [NSData dataWithContentsOfFile:[defaultPath stringByDeletingPathExtension]];
+        if (data) {
+            [self recordDiskAccessOfFileName:[[defaultPath stringByDeletingPathExtension] lastPathComponent]];
+            return data;
+        }
     }
 
     NSArray *customPaths = [self.customPaths copy];
@@ -367,8 +590,15 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (UIImage *)diskImageForKey:(NSString *)key {
+    return [self diskImageForKey:key targetPixelSize:CGSizeZero];
+}
+
+- (UIImage *)diskImageForKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize {
     NSData *data = [self diskImageDataBySearchingAllPathsForKey:key];
-    if (data) {
+    if (data && SDTargetPixelSizeIsSet(targetPixelSize)) {
+        return [UIImage decodedImageWithData:data scale:SDImageScaleForKey(key) targetPixelSize:targetPixelSize];
+    }
+    else if (data) {
         UIImage *image = [UIImage sd_imageWithData:data];
         image = [self scaledImageForKey:key image:image];
         if (self.shouldDecompressImages) {
@@ -386,6 +616,10 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (NSOperation *)queryDiskCacheForKey:(NSString *)key done:(SDWebImageQueryCompletedBlock)doneBlock {
+    return [self queryDiskCacheForKey:key targetPixelSize:CGSizeZero done:doneBlock];
+}
+
+- (NSOperation *)queryDiskCacheForKey:(NSString *)key targetPixelSize:(CGSize)targetPixelSize done:(SDWebImageQueryCompletedBlock)doneBlock {
     if (!doneBlock) {
         return nil;
     }
@@ -396,30 +630,30 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     }
 
     // First check the in-memory cache...
-    UIImage *image = [self imageFromMemoryCacheForKey:key];
+    NSString *memoryKey = SDMemoryCacheKeyForKey(key, targetPixelSize);
+    UIImage *image = [self imageFromMemoryCacheForKey:memoryKey];
     if (image) {
         doneBlock(image, SDImageCacheTypeMemory);
         return nil;
     }
 
     NSOperation *operation = [NSOperation new];
-    dispatch_async(self.ioQueue, ^{
+    [self dispatchReadForKey:key block:^{
         if (operation.isCancelled) {
             return;
         }
 
         @autoreleasepool {
-            UIImage *diskImage = [self diskImageForKey:key];
+            UIImage *diskImage = [self diskImageForKey:key targetPixelSize:targetPixelSize];
             if (diskImage && self.shouldCacheImagesInMemory) {
-                NSUInteger cost = SDCacheCostForImage(diskImage);
-                [self.memCache setObject:diskImage forKey:key cost:cost];
+                [self storeImageInMemory:diskImage forKey:key targetPixelSize:targetPixelSize];
             }
 
             dispatch_async(dispatch_get_main_queue(), ^{
                 doneBlock(diskImage, SDImageCacheTypeDisk);
             });
         }
-    });
+    }];
 
     return operation;
 }
@@ -445,10 +679,22 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     if (self.shouldCacheImagesInMemory) {
         [self.memCache removeObjectForKey:key];
     }
+    NSSet *sizedMemoryKeys;
+    @synchronized (_sizedMemoryKeys) {
+        sizedMemoryKeys = _sizedMemoryKeys[key];
+        [_sizedMemoryKeys removeObjectForKey:key];
+    }
+    for (NSString *memoryKey in sizedMemoryKeys) {
+        [self.memCache removeObjectForKey:memoryKey];
+    }
 
     if (fromDisk) {
-        dispatch_async(self.ioQueue, ^{
-            [_fileManager removeItemAtPath:[self defaultCachePathForKey:key] error:nil];
+        dispatch_async([self ioQueueForKey:key], ^{
+            if (self.diskBackend) {
+                [self.diskBackend removeDataForKey:key];
+            } else {
+                [_fileManager removeItemAtPath:[self defaultCachePathForKey:key] error:nil];
+            }
             
             if (completion) {
                 dispatch_async(dispatch_get_main_queue(), ^{
@@ -462,6 +708,19 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     
 }
 
+- (void)setMemoryEvictionPolicy:(id<SDImageCacheEvictionPolicy>)memoryEvictionPolicy {
+    _memoryEvictionPolicy = memoryEvictionPolicy;
+    self.memCache.evictionPolicy = memoryEvictionPolicy;
+}
+
+- (NSUInteger)memoryCacheHitCount {
+    return self.memCache.hitCount;
+}
+
+- (NSUInteger)memoryCacheMissCount {
+    return self.memCache.missCount;
+}
+
 - (void)setMaxMemoryCost:(NSUInteger)maxMemoryCost {
     self.memCache.totalCostLimit = maxMemoryCost;
 }
@@ -480,6 +739,9 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 - (void)clearMemory {
     [self.memCache removeAllObjects];
+    @synchronized (_sizedMemoryKeys) {
+        [_sizedMemoryKeys removeAllObjects];
+    }
 }
 
 - (void)clearDisk {
@@ -488,12 +750,25 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 
 - (void)clearDiskOnCompletion:(SDWebImageNoParamsBlock)completion
 {
-    dispatch_async(self.ioQueue, ^{
-        [_fileManager removeItemAtPath:self.diskCachePath error:nil];
-        [_fileManager createDirectoryAtPath:self.diskCachePath
-                withIntermediateDirectories:YES
-                                 attributes:nil
-                                      error:NULL];
+    dispatch_async(self.maintenanceQueue, ^{
+        [self drainIOQueues];
+        if (self.diskBackend) {
+            [self.diskBackend removeAllData];
+        } else {
+            [_fileManager removeItemAtPath:self.diskCachePath error:nil];
+            [_fileManager createDirectoryAtPath:self.diskCachePath
+                    withIntermediateDirectories:YES
+                                     attributes:nil
+                                          error:NULL];
+            @synchronized (_pendingAccesses) {
+                [_pendingAccesses removeAllObjects];
+            }
+            _accessLog = [NSMutableDictionary new];
+            [_fileManager removeItemAtPath:[self accessLogPath] error:nil];
+            [_trackingDiskPolicy removeAllKeys];
+            _trackingDiskPolicy = nil;
+            _diskPolicyCosts = nil;
+        }
 
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
@@ -508,7 +783,17 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (void)cleanDiskWithCompletionBlock:(SDWebImageNoParamsBlock)completionBlock {
-    dispatch_async(self.ioQueue, ^{
+    dispatch_async(self.maintenanceQueue, ^{
+        if (self.diskBackend) {
+            [self cleanDiskBackend];
+            if (completionBlock) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completionBlock();
+                });
+            }
+            return;
+        }
+
         NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
         NSArray *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey];
 
@@ -518,13 +803,16 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                                                                       options:NSDirectoryEnumerationSkipsHiddenFiles
                                                                  errorHandler:NULL];
 
-        NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:-self.maxCacheAge];
+        NSTimeInterval expirationTime = [[NSDate dateWithTimeIntervalSinceNow:-self.maxCacheAge] timeIntervalSinceReferenceDate];
         NSMutableDictionary *cacheFiles = [NSMutableDictionary dictionary];
         NSUInteger currentCacheSize = 0;
 
+        // Reads since the last flush count towards recency too
+        [self flushAccessLog];
+
         // Enumerate all of the files in the cache directory.  This loop has two purposes:
         //
-        //  1. Removing files that are older than the expiration date.
+        //  1. Removing files that were neither written nor read since the expiration date.
         //  2. Storing file attributes for the size-based cleanup pass.
         NSMutableArray *urlsToDelete = [[NSMutableArray alloc] init];
         for (NSURL *fileURL in fileEnumerator) {
@@ -535,9 +823,13 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
                 continue;
             }
 
+            // A file is as recent as its last write or its last logged read, whichever came later
+            NSTimeInterval lastAccess = [resourceValues[NSURLContentModificationDateKey] timeIntervalSinceReferenceDate];
+            NSArray *access = _accessLog[[fileURL lastPathComponent]];
+            lastAccess = MAX(lastAccess, [access[0] doubleValue]);
+
             // Remove files that are older than the expiration date;
-            NSDate *modificationDate = resourceValues[NSURLContentModificationDateKey];
-            if ([[modificationDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
+            if (lastAccess <= expirationTime) {
                 [urlsToDelete addObject:fileURL];
                 continue;
             }
@@ -545,38 +837,46 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
             // Store a reference to this file and account for its total size.
             NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
             currentCacheSize += [totalAllocatedSize unsignedIntegerValue];
-            [cacheFiles setObject:resourceValues forKey:fileURL];
+            [cacheFiles setObject:@[@(lastAccess), @([access[1] unsignedIntegerValue]), totalAllocatedSize ?: @0] forKey:fileURL];
         }
         
         for (NSURL *fileURL in urlsToDelete) {
             [_fileManager removeItemAtURL:fileURL error:nil];
         }
 
+        NSMutableSet *remainingFileNames = [NSMutableSet setWithCapacity:cacheFiles.count];
+        NSMutableDictionary *filesByName = [NSMutableDictionary dictionaryWithCapacity:cacheFiles.count];
+        for (NSURL *fileURL in cacheFiles) {
+            [remainingFileNames addObject:[fileURL lastPathComponent]];
+            filesByName[[fileURL lastPathComponent]] = fileURL;
+        }
+
+        id<SDImageCacheEvictionPolicy> policy = self.diskEvictionPolicy;
+        if (policy) {
+            [self updateDiskPolicy:policy withFiles:cacheFiles];
+        }
+
         // If our remaining disk cache exceeds a configured maximum size, perform a second
-        // size-based cleanup pass.  We delete the oldest files first.
-        if (self.maxCacheSize > 0 && currentCacheSize > self.maxCacheSize) {
+        // size-based cleanup pass.  The eviction policy picks the files to delete.
+        if (self.maxCacheSize > 0 && currentCacheSize > self.maxCacheSize && policy) {
             // Target half of our maximum cache size for this cleanup pass.
             const NSUInteger desiredCacheSize = self.maxCacheSize / 2;
 
-            // Sort the remaining cache files by their last modification time (oldest first).
-            NSArray *sortedFiles = [cacheFiles keysSortedByValueWithOptions:NSSortConcurrent
-                                                            usingComparator:^NSComparisonResult(id obj1, id obj2) {
-                                                                return [obj1[NSURLContentModificationDateKey] compare:obj2[NSURLContentModificationDateKey]];
-                                                            }];
-
-            // Delete files until we fall below our desired cache size.
-            for (NSURL *fileURL in sortedFiles) {
-                if ([_fileManager removeItemAtURL:fileURL error:nil]) {
-                    NSDictionary *resourceValues = cacheFiles[fileURL];
-                    NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
-                    currentCacheSize -= [totalAllocatedSize unsignedIntegerValue];
-
-                    if (currentCacheSize < desiredCacheSize) {
-                        break;
-                    }
-                }
+            for (NSString *fileName in [policy keysToEvictForCostLimit:desiredCacheSize]) {
+                [_fileManager removeItemAtURL:filesByName[fileName] error:nil];
+                [remainingFileNames removeObject:fileName];
+                [_diskPolicyCosts removeObjectForKey:fileName];
+            }
+        }
+
+        // Forget reads of files that are gone
+        for (NSString *fileName in [_accessLog allKeys]) {
+            if (![remainingFileNames containsObject:fileName]) {
+                [_accessLog removeObjectForKey:fileName];
             }
         }
+        [self writeAccessLog];
+
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completionBlock();
@@ -585,6 +885,120 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
     });
 }
 
+#pragma mark Access log
+
+- (NSString *)accessLogPath {
+    return [self.diskCachePath stringByAppendingPathExtension:@"accesslog"];
+}
+
+// Disk reads are only counted in memory here, the maintenance queue merges them into the log in batches
+// instead of touching file attributes on every read
+- (void)recordDiskAccessOfFileName:(NSString *)fileName {
+    BOOL shouldFlush = NO;
+    @synchronized (_pendingAccesses) {
+        NSArray *access = _pendingAccesses[fileName];
+        _pendingAccesses[fileName] = @[@([NSDate timeIntervalSinceReferenceDate]), @([access[1] unsignedIntegerValue] + 1)];
+        shouldFlush = _pendingAccesses.count == kAccessLogFlushThreshold;
+    }
+    if (shouldFlush) {
+        dispatch_async(self.maintenanceQueue, ^{
+            [self flushAccessLog];
+            [self writeAccessLog];
+        });
+    }
+}
+
+// Brings the disk eviction policy in line with the files left after expiration, call from the maintenance queue only.
+// A policy seen for the first time gets every file replayed from least to most recently used along with its logged
+// reads. After that only files written or removed since the last clean up are passed on, reads reach the policy as
+// the access log is flushed, so frequency based policies keep their history across clean ups.
+- (void)updateDiskPolicy:(id<SDImageCacheEvictionPolicy>)policy withFiles:(NSDictionary *)cacheFiles {
+    if (policy != _trackingDiskPolicy) {
+        [_trackingDiskPolicy removeAllKeys];
+        [policy removeAllKeys];
+        _trackingDiskPolicy = policy;
+        _diskPolicyCosts = [NSMutableDictionary dictionaryWithCapacity:cacheFiles.count];
+    }
+
+    NSMutableSet *fileNames = [NSMutableSet setWithCapacity:cacheFiles.count];
+    for (NSURL *fileURL in cacheFiles) {
+        [fileNames addObject:[fileURL lastPathComponent]];
+    }
+    for (NSString *fileName in [_diskPolicyCosts allKeys]) {
+        if (![fileNames containsObject:fileName]) {
+            [policy recordRemovalOfKey:fileName];
+            [_diskPolicyCosts removeObjectForKey:fileName];
+        }
+    }
+
+    NSArray *sortedFiles = [cacheFiles keysSortedByValueWithOptions:NSSortConcurrent
+                                                    usingComparator:^NSComparisonResult(id obj1, id obj2) {
+                                                        return [obj1[0] compare:obj2[0]];
+                                                    }];
+    for (NSURL *fileURL in sortedFiles) {
+        NSString *fileName = [fileURL lastPathComponent];
+        NSArray *file = cacheFiles[fileURL];
+        NSNumber *trackedCost = _diskPolicyCosts[fileName];
+        if ([trackedCost isEqualToNumber:file[2]]) {
+            continue;
+        }
+        // a rewritten file counts as one more access, a new one brings along the reads logged before it was tracked
+        [policy recordInsertionOfKey:fileName cost:[file[2] unsignedIntegerValue]];
+        _diskPolicyCosts[fileName] = file[2];
+        if (!trackedCost) {
+            NSUInteger reads = MIN([file[1] unsignedIntegerValue], kAccessLogMaxReplayedReads);
+            for (NSUInteger i = 0; i < reads; i++) {
+                [policy recordAccessOfKey:fileName];
+            }
+        }
+    }
+}
+
+// Call from the maintenance queue only
+- (void)flushAccessLog {
+    if (!_accessLog) {
+        NSData *data = [NSData dataWithContentsOfFile:[self accessLogPath]];
+        id log = data ? [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListMutableContainers format:NULL error:NULL] : nil;
+        _accessLog = [log isKindOfClass:[NSMutableDictionary class]] ? log : [NSMutableDictionary new];
+    }
+
+    NSDictionary *pending;
+    @synchronized (_pendingAccesses) {
+        pending = [_pendingAccesses copy];
+        [_pendingAccesses removeAllObjects];
+    }
+    // oldest reads first so recency based policies see them in order
+    NSArray *fileNames = [pending keysSortedByValueUsingComparator:^NSComparisonResult(id obj1, id obj2) {
+        return [obj1[0] compare:obj2[0]];
+    }];
+    for (NSString *fileName in fileNames) {
+        NSArray *access = pending[fileName];
+        NSUInteger reads = [_accessLog[fileName][1] unsignedIntegerValue] + [access[1] unsignedIntegerValue];
+        _accessLog[fileName] = @[access[0], @(reads)];
+
+        if (_diskPolicyCosts[fileName]) {
+            NSUInteger replayedReads = MIN([access[1] unsignedIntegerValue], kAccessLogMaxReplayedReads);
+            for (NSUInteger i = 0; i < replayedReads; i++) {
+                [_trackingDiskPolicy recordAccessOfKey:fileName];
+            }
+        }
+    }
+}
+
+// Call from the maintenance queue only
+- (void)writeAccessLog {
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:_accessLog format:NSPropertyListBinaryFormat_v1_0 options:0 error:NULL];
+    [data writeToFile:[self accessLogPath] atomically:YES];
+}
+
+// Same policy as the file based clean up: expire old entries, then trim down to half of maxCacheSize
+- (void)cleanDiskBackend {
+    [self.diskBackend removeDataLastAccessedBefore:[NSDate dateWithTimeIntervalSinceNow:-self.maxCacheAge]];
+    if (self.maxCacheSize > 0 && [self.diskBackend totalSize] > self.maxCacheSize) {
+        [self.diskBackend trimToSize:self.maxCacheSize / 2];
+    }
+}
+
 - (void)backgroundCleanDisk {
     Class UIApplicationClass = NSClassFromString(@"UIApplication");
     if(!UIApplicationClass || ![UIApplicationClass respondsToSelector:@selector(sharedApplication)]) {
@@ -606,8 +1020,12 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (NSUInteger)getSize {
+    if (self.diskBackend) {
+        return [self.diskBackend totalSize];
+    }
+
     __block NSUInteger size = 0;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync(self.maintenanceQueue, ^{
         NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
         for (NSString *fileName in fileEnumerator) {
             NSString *filePath = [self.diskCachePath stringByAppendingPathComponent:fileName];
@@ -619,8 +1037,12 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 }
 
 - (NSUInteger)getDiskCount {
+    if (self.diskBackend) {
+        return [self.diskBackend totalCount];
+    }
+
     __block NSUInteger count = 0;
-    dispatch_sync(self.ioQueue, ^{
+    dispatch_sync(self.maintenanceQueue, ^{
         NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
         count = [[fileEnumerator allObjects] count];
     });
@@ -630,10 +1052,21 @@ FOUNDATION_STATIC_INLINE NSUInteger SDCacheCostForImage(UIImage *image) {
 - (void)calculateSizeWithCompletionBlock:(SDWebImageCalculateSizeBlock)completionBlock {
     NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
 
-    dispatch_async(self.ioQueue, ^{
+    dispatch_async(self.maintenanceQueue, ^{
         NSUInteger fileCount = 0;
         NSUInteger totalSize = 0;
 
+        if (self.diskBackend) {
+            fileCount = [self.diskBackend totalCount];
+            totalSize = [self.diskBackend totalSize];
+            if (completionBlock) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completionBlock(fileCount, totalSize);
+                });
+            }
+            return;
+        }
+
         NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtURL:diskCacheURL
                                                    includingPropertiesForKeys:@[NSFileSize]
                                                                       options:NSDirectoryEnumerationSkipsHiddenFiles
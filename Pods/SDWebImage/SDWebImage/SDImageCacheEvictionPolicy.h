@@ -0,0 +1,130 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ * An eviction policy decides which cache entries go first once a cache is over its cost limit.
+ * Policies only track keys and costs, they never hold the cached objects. They are not thread safe,
+ * callers serialize access to them.
+ */
+@protocol SDImageCacheEvictionPolicy <NSObject>
+
+/**
+ * Starts tracking a key, or updates its cost if it is tracked already. Counts as an access.
+ */
+- (void)recordInsertionOfKey:(NSString *)key cost:(NSUInteger)cost;
+
+/**
+ * Records a cache hit for a tracked key
+ */
+- (void)recordAccessOfKey:(NSString *)key;
+
+/**
+ * Stops tracking a key
+ */
+- (void)recordRemovalOfKey:(NSString *)key;
+
+/**
+ * Picks the keys to evict so that the total cost of the remaining keys is at most `limit`.
+ * The returned keys are no longer tracked.
+ */
+- (NSArray *)keysToEvictForCostLimit:(NSUInteger)limit;
+
+/**
+ * Stops tracking every key
+ */
+- (void)removeAllKeys;
+
+/**
+ * Total cost of the tracked keys
+ */
+- (NSUInteger)totalCost;
+
+@optional
+
+/**
+ * The limit the cache is going to pass to keysToEvictForCostLimit:, for policies that size internal segments by it.
+ * Caches set it as soon as they know their limit, before any key is tracked.
+ */
+- (void)setCostLimit:(NSUInteger)limit;
+
+@end
+
+/**
+ * Evicts the least recently used keys first
+ */
+@interface SDImageCacheLRUPolicy : NSObject <SDImageCacheEvictionPolicy>
+@end
+
+/**
+ * Evicts the least frequently used keys first, least recently used among equal frequencies
+ */
+@interface SDImageCacheLFUPolicy : NSObject <SDImageCacheEvictionPolicy>
+@end
+
+/**
+ * W-TinyLFU: new keys enter a small LRU window. Keys leaving the window only displace an entry of the main
+ * segmented LRU if a count-min sketch of recent access frequencies says they are used more often,
+ * which keeps one-off images from flushing a hot working set.
+ */
+@interface SDImageCacheTinyLFUPolicy : NSObject <SDImageCacheEvictionPolicy>
+
+/**
+ * Share of the cost limit given to the admission window [defaults to 0.01]
+ */
+@property (assign, nonatomic) double windowRatio;
+
+/**
+ * Cost limit the window and protected segments are sized by. Also updated by every keysToEvictForCostLimit: call.
+ */
+@property (assign, nonatomic) NSUInteger costLimit;
+
+/**
+ * Creates a policy sized for the given cost limit
+ */
+- (id)initWithCostLimit:(NSUInteger)costLimit;
+
+@end
+
+/**
+ * Cost aware GreedyDual-Size-Frequency: keeps the keys whose misses would be most expensive per byte held.
+ * A key's priority is its hit count times its refetch cost divided by its size, aged by the priority of the last victim.
+ */
+@interface SDImageCacheCostAwarePolicy : NSObject <SDImageCacheEvictionPolicy>
+
+/**
+ * Returns the cost of fetching the key again after a miss. Defaults to nil, which uses the number of bytes,
+ * i.e. a refetch cost of 1 per byte for every key.
+ */
+@property (copy, nonatomic) double (^refetchCostBlock)(NSString *key, NSUInteger bytes);
+
+@end
+
+typedef struct {
+    NSUInteger requests;
+    NSUInteger hits;
+    unsigned long long bytesEvicted;
+} SDImageCacheEvictionSimulationResult;
+
+/**
+ * Replays recorded key streams against an eviction policy to compare hit ratios and evicted bytes without a real cache
+ */
+@interface SDImageCacheEvictionSimulator : NSObject
+
+/**
+ * Replays a trace through an empty cache with the given capacity
+ *
+ * @param keys     The requested keys, in order
+ * @param costs    Size in bytes of each key, keys missing from it count as 1 byte
+ * @param capacity The cache capacity in bytes
+ * @param policy   The policy deciding evictions, it is reset before the replay
+ */
++ (SDImageCacheEvictionSimulationResult)replayKeys:(NSArray *)keys costs:(NSDictionary *)costs capacity:(NSUInteger)capacity policy:(id<SDImageCacheEvictionPolicy>)policy;
+
+@end
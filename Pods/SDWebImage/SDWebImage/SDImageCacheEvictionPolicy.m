@@ -0,0 +1,657 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDImageCacheEvictionPolicy.h"
+
+typedef NS_ENUM(NSInteger, SDEvictionSegment) {
+    SDEvictionSegmentWindow,
+    SDEvictionSegmentProbation,
+    SDEvictionSegmentProtected
+};
+
+@interface SDEvictionEntry : NSObject
+
+@property (copy, nonatomic) NSString *key;
+@property (assign, nonatomic) NSUInteger cost;
+@property (assign, nonatomic) NSUInteger frequency;
+@property (assign, nonatomic) double priority;
+@property (assign, nonatomic) NSUInteger heapIndex;
+@property (assign, nonatomic) SDEvictionSegment segment;
+@property (strong, nonatomic) SDEvictionEntry *next;
+@property (unsafe_unretained, nonatomic) SDEvictionEntry *prev;
+
+@end
+
+@implementation SDEvictionEntry
+@end
+
+// Doubly linked list of entries, most recently used at the head
+@interface SDEvictionList : NSObject
+
+@property (strong, nonatomic, readonly) SDEvictionEntry *head;
+@property (unsafe_unretained, nonatomic, readonly) SDEvictionEntry *tail;
+@property (assign, nonatomic, readonly) NSUInteger totalCost;
+@property (assign, nonatomic, readonly) NSUInteger count;
+
+- (void)pushFront:(SDEvictionEntry *)entry;
+- (void)removeEntry:(SDEvictionEntry *)entry;
+- (void)removeAllEntries;
+
+@end
+
+@implementation SDEvictionList
+
+- (void)pushFront:(SDEvictionEntry *)entry {
+    entry.prev = nil;
+    entry.next = _head;
+    if (_head) {
+        _head.prev = entry;
+    } else {
+        _tail = entry;
+    }
+    _head = entry;
+    _totalCost += entry.cost;
+    _count++;
+}
+
+- (void)removeEntry:(SDEvictionEntry *)entry {
+    SDEvictionEntry *next = entry.next;
+    if (entry.prev) {
+        entry.prev.next = next;
+    } else {
+        _head = next;
+    }
+    if (next) {
+        next.prev = entry.prev;
+    } else {
+        _tail = entry.prev;
+    }
+    entry.prev = nil;
+    entry.next = nil;
+    _totalCost -= entry.cost;
+    _count--;
+}
+
+- (void)removeAllEntries {
+    // unlink one by one so long lists are not released recursively
+    while (_tail) {
+        SDEvictionEntry *entry = _tail;
+        [self removeEntry:entry];
+    }
+}
+
+@end
+
+#pragma mark - LRU
+
+@implementation SDImageCacheLRUPolicy {
+    NSMutableDictionary *_entries;
+    SDEvictionList *_list;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        _entries = [NSMutableDictionary new];
+        _list = [SDEvictionList new];
+    }
+    return self;
+}
+
+- (void)recordInsertionOfKey:(NSString *)key cost:(NSUInteger)cost {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [_list removeEntry:entry];
+    } else {
+        entry = [SDEvictionEntry new];
+        entry.key = key;
+        _entries[key] = entry;
+    }
+    entry.cost = cost;
+    [_list pushFront:entry];
+}
+
+- (void)recordAccessOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [_list removeEntry:entry];
+        [_list pushFront:entry];
+    }
+}
+
+- (void)recordRemovalOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [_list removeEntry:entry];
+        [_entries removeObjectForKey:key];
+    }
+}
+
+- (NSArray *)keysToEvictForCostLimit:(NSUInteger)limit {
+    NSMutableArray *keys = [NSMutableArray new];
+    while (_list.totalCost > limit && _list.tail) {
+        SDEvictionEntry *victim = _list.tail;
+        [_list removeEntry:victim];
+        [_entries removeObjectForKey:victim.key];
+        [keys addObject:victim.key];
+    }
+    return keys;
+}
+
+- (void)removeAllKeys {
+    [_list removeAllEntries];
+    [_entries removeAllObjects];
+}
+
+- (NSUInteger)totalCost {
+    return _list.totalCost;
+}
+
+@end
+
+#pragma mark - LFU
+
+@implementation SDImageCacheLFUPolicy {
+    NSMutableDictionary *_entries;
+    NSMutableDictionary *_buckets; // frequency -> SDEvictionList
+    NSUInteger _minFrequency;
+    NSUInteger _totalCost;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        _entries = [NSMutableDictionary new];
+        _buckets = [NSMutableDictionary new];
+    }
+    return self;
+}
+
+- (SDEvictionList *)bucketForFrequency:(NSUInteger)frequency {
+    SDEvictionList *bucket = _buckets[@(frequency)];
+    if (!bucket) {
+        bucket = [SDEvictionList new];
+        _buckets[@(frequency)] = bucket;
+    }
+    return bucket;
+}
+
+// Returns YES if the entry's bucket is empty afterwards
+- (BOOL)unlinkEntry:(SDEvictionEntry *)entry {
+    SDEvictionList *bucket = _buckets[@(entry.frequency)];
+    [bucket removeEntry:entry];
+    _totalCost -= entry.cost;
+    if (bucket.count == 0) {
+        [_buckets removeObjectForKey:@(entry.frequency)];
+        return YES;
+    }
+    return NO;
+}
+
+- (void)linkEntry:(SDEvictionEntry *)entry {
+    [[self bucketForFrequency:entry.frequency] pushFront:entry];
+    _totalCost += entry.cost;
+}
+
+// Moves a tracked entry to the next frequency. If it left the lowest bucket empty, that next frequency is the new minimum.
+- (void)incrementFrequencyOfEntry:(SDEvictionEntry *)entry {
+    BOOL emptied = [self unlinkEntry:entry];
+    if (emptied && _minFrequency == entry.frequency) {
+        _minFrequency = entry.frequency + 1;
+    }
+    entry.frequency++;
+    [self linkEntry:entry];
+}
+
+// Drops a tracked entry. Only an emptied lowest bucket moves the minimum, up to the next frequency that has entries.
+- (void)dropEntry:(SDEvictionEntry *)entry {
+    BOOL emptied = [self unlinkEntry:entry];
+    [_entries removeObjectForKey:entry.key];
+    if (emptied && _minFrequency == entry.frequency) {
+        if (_entries.count == 0) {
+            _minFrequency = 0;
+        } else {
+            while (!_buckets[@(_minFrequency)]) {
+                _minFrequency++;
+            }
+        }
+    }
+}
+
+- (void)recordInsertionOfKey:(NSString *)key cost:(NSUInteger)cost {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        // the cost is part of the bucket totals, swap it while the entry is unlinked
+        [self unlinkEntry:entry];
+        entry.cost = cost;
+        [self linkEntry:entry];
+        [self incrementFrequencyOfEntry:entry];
+        return;
+    }
+    entry = [SDEvictionEntry new];
+    entry.key = key;
+    entry.cost = cost;
+    entry.frequency = 1;
+    _entries[key] = entry;
+    [self linkEntry:entry];
+    _minFrequency = 1;
+}
+
+- (void)recordAccessOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [self incrementFrequencyOfEntry:entry];
+    }
+}
+
+- (void)recordRemovalOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [self dropEntry:entry];
+    }
+}
+
+- (NSArray *)keysToEvictForCostLimit:(NSUInteger)limit {
+    NSMutableArray *keys = [NSMutableArray new];
+    while (_totalCost > limit && _minFrequency > 0) {
+        SDEvictionEntry *victim = [_buckets[@(_minFrequency)] tail];
+        [keys addObject:victim.key];
+        [self dropEntry:victim];
+    }
+    return keys;
+}
+
+- (void)removeAllKeys {
+    for (SDEvictionList *bucket in [_buckets allValues]) {
+        [bucket removeAllEntries];
+    }
+    [_buckets removeAllObjects];
+    [_entries removeAllObjects];
+    _minFrequency = 0;
+    _totalCost = 0;
+}
+
+- (NSUInteger)totalCost {
+    return _totalCost;
+}
+
+@end
+
+#pragma mark - W-TinyLFU
+
+static const NSUInteger kSketchDepth = 4;
+static const uint8_t kSketchMaxCount = 15;
+
+@implementation SDImageCacheTinyLFUPolicy {
+    NSMutableDictionary *_entries;
+    SDEvictionList *_window;
+    SDEvictionList *_probation;
+    SDEvictionList *_protected;
+    // count-min sketch, kSketchDepth rows of _sketchWidth saturating counters
+    uint8_t *_sketch;
+    NSUInteger _sketchWidth;
+    NSUInteger _sketchAdditions;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        _windowRatio = 0.01;
+        _entries = [NSMutableDictionary new];
+        _window = [SDEvictionList new];
+        _probation = [SDEvictionList new];
+        _protected = [SDEvictionList new];
+        [self resizeSketchForCount:64];
+    }
+    return self;
+}
+
+- (id)initWithCostLimit:(NSUInteger)costLimit {
+    if ((self = [self init])) {
+        _costLimit = costLimit;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_sketch);
+}
+
+#pragma mark Frequency sketch
+
+- (void)resizeSketchForCount:(NSUInteger)count {
+    NSUInteger width = 64;
+    while (width < count) {
+        width <<= 1;
+    }
+    free(_sketch);
+    _sketchWidth = width;
+    _sketch = calloc(kSketchDepth * width, sizeof(uint8_t));
+    _sketchAdditions = 0;
+}
+
+static NSUInteger SDSketchIndex(NSUInteger hash, NSUInteger row, NSUInteger width) {
+    uint64_t h = (uint64_t)hash * (0x9E3779B97F4A7C15ULL + 2 * row);
+    h ^= h >> 32;
+    return row * width + (NSUInteger)(h & (width - 1));
+}
+
+- (void)incrementFrequencyOfKey:(NSString *)key {
+    if (_entries.count > _sketchWidth) {
+        [self resizeSketchForCount:_entries.count * 2];
+    }
+    NSUInteger hash = [key hash];
+    for (NSUInteger row = 0; row < kSketchDepth; row++) {
+        NSUInteger i = SDSketchIndex(hash, row, _sketchWidth);
+        if (_sketch[i] < kSketchMaxCount) {
+            _sketch[i]++;
+        }
+    }
+    // halve every counter periodically so old popularity fades away
+    if (++_sketchAdditions >= 10 * _sketchWidth) {
+        for (NSUInteger i = 0; i < kSketchDepth * _sketchWidth; i++) {
+            _sketch[i] >>= 1;
+        }
+        _sketchAdditions /= 2;
+    }
+}
+
+- (uint8_t)frequencyOfKey:(NSString *)key {
+    NSUInteger hash = [key hash];
+    uint8_t frequency = kSketchMaxCount;
+    for (NSUInteger row = 0; row < kSketchDepth; row++) {
+        frequency = MIN(frequency, _sketch[SDSketchIndex(hash, row, _sketchWidth)]);
+    }
+    return frequency;
+}
+
+#pragma mark Segments
+
+- (SDEvictionList *)listForSegment:(SDEvictionSegment)segment {
+    switch (segment) {
+        case SDEvictionSegmentWindow:
+            return _window;
+        case SDEvictionSegmentProbation:
+            return _probation;
+        case SDEvictionSegmentProtected:
+            return _protected;
+    }
+    return nil;
+}
+
+- (NSUInteger)windowLimit {
+    return (NSUInteger)(_costLimit * self.windowRatio);
+}
+
+- (NSUInteger)protectedLimit {
+    return (_costLimit - [self windowLimit]) * 4 / 5;
+}
+
+- (void)recordInsertionOfKey:(NSString *)key cost:(NSUInteger)cost {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [[self listForSegment:entry.segment] removeEntry:entry];
+    } else {
+        entry = [SDEvictionEntry new];
+        entry.key = key;
+        entry.segment = SDEvictionSegmentWindow;
+        _entries[key] = entry;
+    }
+    entry.cost = cost;
+    [[self listForSegment:entry.segment] pushFront:entry];
+    [self incrementFrequencyOfKey:key];
+}
+
+- (void)recordAccessOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (!entry) {
+        return;
+    }
+    [self incrementFrequencyOfKey:key];
+    [[self listForSegment:entry.segment] removeEntry:entry];
+    if (entry.segment == SDEvictionSegmentProbation) {
+        // a second hit in the main space promotes to protected, making room there by demoting its oldest entries
+        entry.segment = SDEvictionSegmentProtected;
+        while (_protected.tail && _protected.totalCost + entry.cost > [self protectedLimit]) {
+            SDEvictionEntry *demoted = _protected.tail;
+            [_protected removeEntry:demoted];
+            demoted.segment = SDEvictionSegmentProbation;
+            [_probation pushFront:demoted];
+        }
+    }
+    [[self listForSegment:entry.segment] pushFront:entry];
+}
+
+- (void)recordRemovalOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [[self listForSegment:entry.segment] removeEntry:entry];
+        [_entries removeObjectForKey:key];
+    }
+}
+
+- (void)evictEntry:(SDEvictionEntry *)entry into:(NSMutableArray *)keys {
+    NSString *key = entry.key;
+    [keys addObject:key];
+    [[self listForSegment:entry.segment] removeEntry:entry];
+    [_entries removeObjectForKey:key];
+}
+
+- (NSArray *)keysToEvictForCostLimit:(NSUInteger)limit {
+    _costLimit = limit;
+    NSMutableArray *keys = [NSMutableArray new];
+    while ([self totalCost] > limit) {
+        // entries pushed out of the window compete with the main space's victim for admission
+        SDEvictionEntry *candidate = _window.totalCost > [self windowLimit] ? _window.tail : nil;
+        SDEvictionEntry *victim = _probation.tail ?: _protected.tail;
+        if (candidate && victim) {
+            if ([self frequencyOfKey:candidate.key] > [self frequencyOfKey:victim.key]) {
+                [self evictEntry:victim into:keys];
+                [_window removeEntry:candidate];
+                candidate.segment = SDEvictionSegmentProbation;
+                [_probation pushFront:candidate];
+            } else {
+                [self evictEntry:candidate into:keys];
+            }
+        } else if (victim) {
+            [self evictEntry:victim into:keys];
+        } else if (_window.tail) {
+            [self evictEntry:_window.tail into:keys];
+        } else {
+            break;
+        }
+    }
+    // whatever still overflows the window moves to the main space now that there is room
+    while (_window.tail && _window.totalCost > [self windowLimit]) {
+        SDEvictionEntry *entry = _window.tail;
+        [_window removeEntry:entry];
+        entry.segment = SDEvictionSegmentProbation;
+        [_probation pushFront:entry];
+    }
+    return keys;
+}
+
+- (void)removeAllKeys {
+    [_window removeAllEntries];
+    [_probation removeAllEntries];
+    [_protected removeAllEntries];
+    [_entries removeAllObjects];
+    memset(_sketch, 0, kSketchDepth * _sketchWidth);
+    _sketchAdditions = 0;
+}
+
+- (NSUInteger)totalCost {
+    return _window.totalCost + _probation.totalCost + _protected.totalCost;
+}
+
+@end
+
+#pragma mark - Cost aware
+
+@implementation SDImageCacheCostAwarePolicy {
+    NSMutableDictionary *_entries;
+    NSMutableArray *_heap; // binary min-heap on priority
+    double _inflation;
+    NSUInteger _totalCost;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        _entries = [NSMutableDictionary new];
+        _heap = [NSMutableArray new];
+    }
+    return self;
+}
+
+- (void)updatePriorityOfEntry:(SDEvictionEntry *)entry {
+    NSUInteger bytes = MAX(entry.cost, 1);
+    double refetchCost = self.refetchCostBlock ? self.refetchCostBlock(entry.key, entry.cost) : (double)bytes;
+    entry.priority = _inflation + entry.frequency * refetchCost / bytes;
+}
+
+- (void)swapHeapIndex:(NSUInteger)a with:(NSUInteger)b {
+    [_heap exchangeObjectAtIndex:a withObjectAtIndex:b];
+    ((SDEvictionEntry *)_heap[a]).heapIndex = a;
+    ((SDEvictionEntry *)_heap[b]).heapIndex = b;
+}
+
+- (void)siftUp:(NSUInteger)i {
+    while (i > 0) {
+        NSUInteger parent = (i - 1) / 2;
+        if ([_heap[parent] priority] <= [_heap[i] priority]) {
+            break;
+        }
+        [self swapHeapIndex:i with:parent];
+        i = parent;
+    }
+}
+
+- (void)siftDown:(NSUInteger)i {
+    NSUInteger count = _heap.count;
+    while (YES) {
+        NSUInteger smallest = i;
+        NSUInteger left = 2 * i + 1;
+        NSUInteger right = left + 1;
+        if (left < count && [_heap[left] priority] < [_heap[smallest] priority]) {
+            smallest = left;
+        }
+        if (right < count && [_heap[right] priority] < [_heap[smallest] priority]) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        [self swapHeapIndex:i with:smallest];
+        i = smallest;
+    }
+}
+
+- (void)removeHeapEntry:(SDEvictionEntry *)entry {
+    NSUInteger i = entry.heapIndex;
+    NSUInteger last = _heap.count - 1;
+    if (i != last) {
+        [self swapHeapIndex:i with:last];
+    }
+    [_heap removeLastObject];
+    if (i < _heap.count) {
+        [self siftDown:i];
+        [self siftUp:i];
+    }
+    _totalCost -= entry.cost;
+}
+
+- (void)recordInsertionOfKey:(NSString *)key cost:(NSUInteger)cost {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [self removeHeapEntry:entry];
+    } else {
+        entry = [SDEvictionEntry new];
+        entry.key = key;
+        _entries[key] = entry;
+    }
+    entry.cost = cost;
+    entry.frequency++;
+    [self updatePriorityOfEntry:entry];
+    entry.heapIndex = _heap.count;
+    [_heap addObject:entry];
+    [self siftUp:entry.heapIndex];
+    _totalCost += cost;
+}
+
+- (void)recordAccessOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        entry.frequency++;
+        [self updatePriorityOfEntry:entry];
+        // priority only ever grows on access
+        [self siftDown:entry.heapIndex];
+    }
+}
+
+- (void)recordRemovalOfKey:(NSString *)key {
+    SDEvictionEntry *entry = _entries[key];
+    if (entry) {
+        [self removeHeapEntry:entry];
+        [_entries removeObjectForKey:key];
+    }
+}
+
+- (NSArray *)keysToEvictForCostLimit:(NSUInteger)limit {
+    NSMutableArray *keys = [NSMutableArray new];
+    while (_totalCost > limit && _heap.count > 0) {
+        SDEvictionEntry *victim = _heap[0];
+        // age every remaining entry by the victim's priority
+        _inflation = victim.priority;
+        [self removeHeapEntry:victim];
+        [_entries removeObjectForKey:victim.key];
+        [keys addObject:victim.key];
+    }
+    return keys;
+}
+
+- (void)removeAllKeys {
+    [_heap removeAllObjects];
+    [_entries removeAllObjects];
+    _inflation = 0;
+    _totalCost = 0;
+}
+
+- (NSUInteger)totalCost {
+    return _totalCost;
+}
+
+@end
+
+#pragma mark - Simulator
+
+@implementation SDImageCacheEvictionSimulator
+
++ (SDImageCacheEvictionSimulationResult)replayKeys:(NSArray *)keys costs:(NSDictionary *)costs capacity:(NSUInteger)capacity policy:(id<SDImageCacheEvictionPolicy>)policy {
+    SDImageCacheEvictionSimulationResult result = {0, 0, 0};
+    NSMutableSet *resident = [NSMutableSet new];
+    [policy removeAllKeys];
+
+    for (NSString *key in keys) {
+        @autoreleasepool {
+            result.requests++;
+            if ([resident containsObject:key]) {
+                result.hits++;
+                [policy recordAccessOfKey:key];
+                continue;
+            }
+            NSNumber *cost = costs[key];
+            [policy recordInsertionOfKey:key cost:cost ? [cost unsignedIntegerValue] : 1];
+            [resident addObject:key];
+            for (NSString *evicted in [policy keysToEvictForCostLimit:capacity]) {
+                NSNumber *evictedCost = costs[evicted];
+                result.bytesEvicted += evictedCost ? [evictedCost unsignedIntegerValue] : 1;
+                [resident removeObject:evicted];
+            }
+        }
+    }
+    return result;
+}
+
+@end
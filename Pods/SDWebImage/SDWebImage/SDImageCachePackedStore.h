@@ -0,0 +1,47 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+#import "SDImageCache.h"
+
+/**
+ * SDImageCachePackedStore is an SDImageCache disk backend that appends image data to a few large segment files
+ * instead of writing one file per image. A memory mapped open-addressing index maps each key to its segment, offset,
+ * length and last access time, so lookups, existence checks and size queries never touch the directory, and LRU
+ * eviction only visits the entries it removes.
+ *
+ * Every record carries a checksum. Records cut short by a crash are treated as missing and dropped from the index.
+ * Space left behind by removed entries is reclaimed by compaction, which runs on a low priority queue.
+ */
+@interface SDImageCachePackedStore : NSObject <SDImageCacheDiskBackend>
+
+/**
+ * Size in bytes after which a new segment file is started [defaults to 16MB]
+ */
+@property (assign, nonatomic) NSUInteger maxSegmentSize;
+
+/**
+ * A segment is rewritten by compaction once the share of its bytes still in use drops below this ratio [defaults to 0.5]
+ */
+@property (assign, nonatomic) double compactionThreshold;
+
+/**
+ * Opens the store in the given directory, creating it if needed
+ *
+ * @param directory The directory holding the index and segment files
+ */
+- (id)initWithDirectory:(NSString *)directory;
+
+/**
+ * Rewrites sparsely used segments and deletes them. Non-blocking method - returns immediately.
+ * @param completionBlock An block that should be executed after compaction completes (optional)
+ */
+- (void)compactWithCompletionBlock:(SDWebImageNoParamsBlock)completionBlock;
+
+@end
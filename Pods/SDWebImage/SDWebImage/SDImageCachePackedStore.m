@@ -0,0 +1,736 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDImageCachePackedStore.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+static const uint32_t kIndexMagic = 0x53445049; // "SDPI"
+static const uint32_t kIndexVersion = 1;
+static const uint32_t kRecordMagic = 0x53445052; // "SDPR"
+static const uint32_t kInitialCapacity = 1024;
+static const uint32_t kNoSlot = UINT32_MAX;
+static const NSUInteger kDefaultMaxSegmentSize = 16 * 1024 * 1024;
+static NSString *const kIndexFileName = @"index";
+static NSString *const kSegmentFilePrefix = @"segment.";
+
+typedef NS_ENUM(uint32_t, SDPackedSlotState) {
+    SDPackedSlotStateEmpty = 0,
+    SDPackedSlotStateLive,
+    SDPackedSlotStateRemoved
+};
+
+// The index file is this header followed by `capacity` slots, mapped read/write into memory
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;      // number of slots, always a power of two
+    uint32_t count;         // live slots
+    uint32_t tombstones;    // removed slots still taking part in probing
+    uint32_t nextSegmentID;
+    uint64_t totalSize;     // bytes of image data held by live slots
+} SDPackedIndexHeader;
+
+typedef struct {
+    uint64_t keyHash;
+    uint64_t offset;        // of the record header in the segment file
+    uint32_t segmentID;
+    uint32_t length;        // of the image data, without the record header
+    double lastAccess;      // CFAbsoluteTime
+    uint32_t state;
+    uint32_t reserved;
+} SDPackedIndexSlot;
+
+// Written in front of the image data of every record in a segment file
+typedef struct {
+    uint32_t magic;
+    uint32_t length;
+    uint64_t keyHash;
+    uint64_t checksum;
+} SDPackedRecordHeader;
+
+static size_t SDPackedIndexFileSize(uint32_t capacity) {
+    return sizeof(SDPackedIndexHeader) + (size_t)capacity * sizeof(SDPackedIndexSlot);
+}
+
+static uint64_t SDPackedKeyHash(NSString *key) {
+    const char *str = [key UTF8String];
+    if (str == NULL) {
+        str = "";
+    }
+    unsigned char r[CC_MD5_DIGEST_LENGTH];
+    CC_MD5(str, (CC_LONG)strlen(str), r);
+    uint64_t hash;
+    memcpy(&hash, r, sizeof(hash));
+    return hash;
+}
+
+// 64 bit FNV-1a, enough to tell a complete record from a torn one
+static uint64_t SDPackedChecksum(const void *bytes, size_t length) {
+    const uint8_t *p = bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static BOOL SDPackedReadFully(int fd, void *buffer, size_t length, off_t offset) {
+    uint8_t *p = buffer;
+    while (length > 0) {
+        ssize_t result = pread(fd, p, length, offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return NO;
+        }
+        p += result;
+        length -= result;
+        offset += result;
+    }
+    return YES;
+}
+
+static BOOL SDPackedWriteFully(int fd, const void *buffer, size_t length, off_t offset) {
+    const uint8_t *p = buffer;
+    while (length > 0) {
+        ssize_t result = pwrite(fd, p, length, offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return NO;
+        }
+        p += result;
+        length -= result;
+        offset += result;
+    }
+    return YES;
+}
+
+@implementation SDImageCachePackedStore {
+    NSString *_directory;
+    NSFileManager *_fileManager;
+    int _indexFD;
+    void *_indexMap;
+    size_t _indexMapLength;
+    SDPackedIndexHeader *_header;
+    SDPackedIndexSlot *_slots;
+    // LRU order of the live slots, most recently used first. Kept in memory only and rebuilt from lastAccess on open
+    uint32_t *_lruPrev;
+    uint32_t *_lruNext;
+    uint32_t _lruHead;
+    uint32_t _lruTail;
+    uint32_t _activeSegmentID;
+    uint64_t _activeSegmentLength;
+    NSMutableDictionary *_segmentFDs;
+    NSMutableDictionary *_segmentLiveBytes;
+    dispatch_queue_t _compactionQueue;
+}
+
+- (id)initWithDirectory:(NSString *)directory {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _fileManager = [NSFileManager new];
+        _maxSegmentSize = kDefaultMaxSegmentSize;
+        _compactionThreshold = 0.5;
+        _indexFD = -1;
+        _lruHead = kNoSlot;
+        _lruTail = kNoSlot;
+        _segmentFDs = [NSMutableDictionary new];
+        _segmentLiveBytes = [NSMutableDictionary new];
+
+        _compactionQueue = dispatch_queue_create("com.hackemist.SDImageCachePackedStore.compaction", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_compactionQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+
+        [_fileManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:NULL];
+        [[NSURL fileURLWithPath:_directory isDirectory:YES] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+
+        // an index we cannot read means the segments cannot be trusted either, start over
+        if ([self openIndex]) {
+            [self recoverIndex];
+        } else {
+            [self resetStore];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self closeSegments];
+    [self unmapIndex];
+    free(_lruPrev);
+    free(_lruNext);
+    SDDispatchQueueRelease(_compactionQueue);
+}
+
+#pragma mark SDImageCacheDiskBackend
+
+- (NSData *)dataForKey:(NSString *)key {
+    uint64_t hash = SDPackedKeyHash(key);
+    @synchronized (self) {
+        if (!_header) {
+            return nil;
+        }
+        uint32_t i = [self findSlotForHash:hash];
+        if (i == kNoSlot) {
+            return nil;
+        }
+        NSData *data = [self readRecordForSlot:&_slots[i] checksum:NULL];
+        if (!data) {
+            // torn or overwritten record, forget about it
+            [self removeSlot:i];
+            return nil;
+        }
+        _slots[i].lastAccess = CFAbsoluteTimeGetCurrent();
+        [self lruUnlink:i];
+        [self lruPushFront:i];
+        return data;
+    }
+}
+
+- (BOOL)containsDataForKey:(NSString *)key {
+    uint64_t hash = SDPackedKeyHash(key);
+    @synchronized (self) {
+        return _header && [self findSlotForHash:hash] != kNoSlot;
+    }
+}
+
+- (void)setData:(NSData *)data forKey:(NSString *)key {
+    if (!data || data.length > UINT32_MAX) {
+        return;
+    }
+    uint64_t hash = SDPackedKeyHash(key);
+    uint64_t checksum = SDPackedChecksum(data.bytes, data.length);
+    @synchronized (self) {
+        if (!_header) {
+            return;
+        }
+        uint32_t existing = [self findSlotForHash:hash];
+        if (existing != kNoSlot) {
+            [self removeSlot:existing];
+        }
+        if ((_header->count + _header->tombstones + 1) * 10 > _header->capacity * 7 && ![self rehash]) {
+            return;
+        }
+
+        uint32_t segmentID;
+        uint64_t offset;
+        if (![self appendRecordWithHash:hash bytes:data.bytes length:(uint32_t)data.length checksum:checksum segment:&segmentID offset:&offset]) {
+            return;
+        }
+
+        uint32_t i = [self insertionSlotForHash:hash];
+        if (_slots[i].state == SDPackedSlotStateRemoved) {
+            _header->tombstones--;
+        }
+        _slots[i].keyHash = hash;
+        _slots[i].offset = offset;
+        _slots[i].segmentID = segmentID;
+        _slots[i].length = (uint32_t)data.length;
+        _slots[i].lastAccess = CFAbsoluteTimeGetCurrent();
+        _slots[i].state = SDPackedSlotStateLive;
+        _header->count++;
+        _header->totalSize += data.length;
+        [self lruPushFront:i];
+    }
+}
+
+- (void)removeDataForKey:(NSString *)key {
+    uint64_t hash = SDPackedKeyHash(key);
+    @synchronized (self) {
+        if (!_header) {
+            return;
+        }
+        uint32_t i = [self findSlotForHash:hash];
+        if (i != kNoSlot) {
+            [self removeSlot:i];
+        }
+    }
+}
+
+- (void)removeAllData {
+    @synchronized (self) {
+        [self resetStore];
+    }
+}
+
+- (void)removeDataLastAccessedBefore:(NSDate *)date {
+    CFAbsoluteTime limit = [date timeIntervalSinceReferenceDate];
+    @synchronized (self) {
+        while (_header && _lruTail != kNoSlot && _slots[_lruTail].lastAccess < limit) {
+            [self removeSlot:_lruTail];
+        }
+    }
+    [self compactWithCompletionBlock:nil];
+}
+
+- (void)trimToSize:(NSUInteger)size {
+    @synchronized (self) {
+        while (_header && _lruTail != kNoSlot && _header->totalSize > size) {
+            [self removeSlot:_lruTail];
+        }
+    }
+    [self compactWithCompletionBlock:nil];
+}
+
+- (NSUInteger)totalSize {
+    @synchronized (self) {
+        return _header ? (NSUInteger)_header->totalSize : 0;
+    }
+}
+
+- (NSUInteger)totalCount {
+    @synchronized (self) {
+        return _header ? _header->count : 0;
+    }
+}
+
+#pragma mark Compaction
+
+- (void)compactWithCompletionBlock:(SDWebImageNoParamsBlock)completionBlock {
+    dispatch_async(_compactionQueue, ^{
+        NSArray *segments;
+        @synchronized (self) {
+            segments = [self segmentsToCompact];
+        }
+        // one segment at a time so lookups get a chance to run in between
+        for (NSNumber *segmentID in segments) {
+            @synchronized (self) {
+                [self compactSegment:[segmentID unsignedIntValue]];
+            }
+        }
+        if (completionBlock) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionBlock();
+            });
+        }
+    });
+}
+
+- (NSArray *)segmentsToCompact {
+    NSMutableArray *segments = [NSMutableArray new];
+    if (!_header) {
+        return segments;
+    }
+    for (NSString *name in [_fileManager contentsOfDirectoryAtPath:_directory error:NULL]) {
+        if (![name hasPrefix:kSegmentFilePrefix]) {
+            continue;
+        }
+        uint32_t segmentID = (uint32_t)[[name substringFromIndex:kSegmentFilePrefix.length] longLongValue];
+        if (segmentID == _activeSegmentID) {
+            continue;
+        }
+        NSDictionary *attrs = [_fileManager attributesOfItemAtPath:[_directory stringByAppendingPathComponent:name] error:nil];
+        uint64_t fileSize = [attrs fileSize];
+        uint64_t liveBytes = [_segmentLiveBytes[@(segmentID)] unsignedLongLongValue];
+        if (fileSize == 0 || (double)liveBytes / fileSize < self.compactionThreshold) {
+            [segments addObject:@(segmentID)];
+        }
+    }
+    return segments;
+}
+
+- (void)compactSegment:(uint32_t)segmentID {
+    if (!_header || segmentID == _activeSegmentID) {
+        return;
+    }
+    // the LRU list links exactly the live slots, so walk it instead of every slot of the table. Collect first since
+    // removing a torn record below unlinks it from the list.
+    uint32_t *moving = malloc(MAX(_header->count, 1) * sizeof(uint32_t));
+    uint32_t movingCount = 0;
+    for (uint32_t i = _lruHead; i != kNoSlot && movingCount < _header->count; i = _lruNext[i]) {
+        if (_slots[i].segmentID == segmentID) {
+            moving[movingCount++] = i;
+        }
+    }
+
+    // move the records still in use to the active segment, segment ids only grow so it is never this one
+    for (uint32_t j = 0; j < movingCount; j++) {
+        uint32_t i = moving[j];
+        SDPackedIndexSlot *slot = &_slots[i];
+        uint64_t checksum;
+        NSData *data = [self readRecordForSlot:slot checksum:&checksum];
+        if (!data) {
+            [self removeSlot:i];
+            continue;
+        }
+        uint32_t newSegmentID;
+        uint64_t newOffset;
+        if (![self appendRecordWithHash:slot->keyHash bytes:data.bytes length:slot->length checksum:checksum segment:&newSegmentID offset:&newOffset]) {
+            // out of space, keep the segment around and try again next time
+            free(moving);
+            return;
+        }
+        [self addLiveBytes:-(int64_t)(sizeof(SDPackedRecordHeader) + slot->length) toSegment:segmentID];
+        slot->segmentID = newSegmentID;
+        slot->offset = newOffset;
+    }
+    free(moving);
+
+    NSNumber *fd = _segmentFDs[@(segmentID)];
+    if (fd) {
+        close([fd intValue]);
+        [_segmentFDs removeObjectForKey:@(segmentID)];
+    }
+    [_segmentLiveBytes removeObjectForKey:@(segmentID)];
+    unlink([[self pathForSegment:segmentID] fileSystemRepresentation]);
+}
+
+#pragma mark Index
+
+- (BOOL)openIndex {
+    NSString *path = [_directory stringByAppendingPathComponent:kIndexFileName];
+    int fd = open([path fileSystemRepresentation], O_RDWR);
+    if (fd < 0) {
+        return NO;
+    }
+    struct stat st;
+    SDPackedIndexHeader header;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) || !SDPackedReadFully(fd, &header, sizeof(header), 0) ||
+        header.magic != kIndexMagic || header.version != kIndexVersion ||
+        header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+        st.st_size < (off_t)SDPackedIndexFileSize(header.capacity)) {
+        close(fd);
+        return NO;
+    }
+    return [self mapIndexFile:fd capacity:header.capacity];
+}
+
+- (int)createIndexFileAtPath:(NSString *)path capacity:(uint32_t)capacity {
+    int fd = open([path fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    // ftruncate zero fills, so every slot starts out empty
+    SDPackedIndexHeader header = {kIndexMagic, kIndexVersion, capacity, 0, 0, 1, 0};
+    if (ftruncate(fd, SDPackedIndexFileSize(capacity)) != 0 || !SDPackedWriteFully(fd, &header, sizeof(header), 0)) {
+        close(fd);
+        unlink([path fileSystemRepresentation]);
+        return -1;
+    }
+    return fd;
+}
+
+// Takes ownership of fd, closing it on failure
+- (BOOL)mapIndexFile:(int)fd capacity:(uint32_t)capacity {
+    size_t length = SDPackedIndexFileSize(capacity);
+    void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NO;
+    }
+    [self unmapIndex];
+    _indexFD = fd;
+    _indexMap = map;
+    _indexMapLength = length;
+    _header = map;
+    _slots = (SDPackedIndexSlot *)((uint8_t *)map + sizeof(SDPackedIndexHeader));
+
+    free(_lruPrev);
+    free(_lruNext);
+    _lruPrev = malloc(capacity * sizeof(uint32_t));
+    _lruNext = malloc(capacity * sizeof(uint32_t));
+    _lruHead = kNoSlot;
+    _lruTail = kNoSlot;
+    return YES;
+}
+
+- (void)unmapIndex {
+    if (_indexMap) {
+        munmap(_indexMap, _indexMapLength);
+        _indexMap = NULL;
+        _header = NULL;
+        _slots = NULL;
+    }
+    if (_indexFD >= 0) {
+        close(_indexFD);
+        _indexFD = -1;
+    }
+}
+
+- (void)resetStore {
+    [self closeSegments];
+    [self unmapIndex];
+    [_fileManager removeItemAtPath:_directory error:nil];
+    [_fileManager createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    [[NSURL fileURLWithPath:_directory isDirectory:YES] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+
+    NSString *path = [_directory stringByAppendingPathComponent:kIndexFileName];
+    int fd = [self createIndexFileAtPath:path capacity:kInitialCapacity];
+    if (fd >= 0) {
+        [self mapIndexFile:fd capacity:kInitialCapacity];
+    }
+    _activeSegmentID = 0;
+    _activeSegmentLength = 0;
+}
+
+// Drops index entries pointing past the end of their segment, which happens when the app dies after the index
+// was updated but before the segment data reached the disk, then rebuilds the counters and the LRU order.
+- (void)recoverIndex {
+    NSMutableDictionary *segmentSizes = [NSMutableDictionary new];
+    uint32_t lastSegmentID = 0;
+    for (NSString *name in [_fileManager contentsOfDirectoryAtPath:_directory error:NULL]) {
+        if (![name hasPrefix:kSegmentFilePrefix]) {
+            continue;
+        }
+        uint32_t segmentID = (uint32_t)[[name substringFromIndex:kSegmentFilePrefix.length] longLongValue];
+        NSDictionary *attrs = [_fileManager attributesOfItemAtPath:[_directory stringByAppendingPathComponent:name] error:nil];
+        segmentSizes[@(segmentID)] = @([attrs fileSize]);
+        lastSegmentID = MAX(lastSegmentID, segmentID);
+    }
+    if (lastSegmentID >= _header->nextSegmentID) {
+        _header->nextSegmentID = lastSegmentID + 1;
+    }
+
+    uint32_t count = 0;
+    uint32_t tombstones = 0;
+    uint64_t totalSize = 0;
+    uint32_t *order = malloc(MAX(_header->capacity, 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < _header->capacity; i++) {
+        SDPackedIndexSlot *slot = &_slots[i];
+        if (slot->state == SDPackedSlotStateLive) {
+            NSNumber *segmentSize = segmentSizes[@(slot->segmentID)];
+            uint64_t recordSize = sizeof(SDPackedRecordHeader) + slot->length;
+            if (!segmentSize || slot->offset + recordSize > [segmentSize unsignedLongLongValue]) {
+                slot->state = SDPackedSlotStateRemoved;
+            } else {
+                order[count++] = i;
+                totalSize += slot->length;
+                [self addLiveBytes:(int64_t)recordSize toSegment:slot->segmentID];
+            }
+        }
+        if (slot->state == SDPackedSlotStateRemoved) {
+            tombstones++;
+        }
+    }
+    _header->count = count;
+    _header->tombstones = tombstones;
+    _header->totalSize = totalSize;
+
+    // least recently used first, each push moves it one step further from the head
+    SDPackedIndexSlot *slots = _slots;
+    qsort_b(order, count, sizeof(uint32_t), ^int(const void *a, const void *b) {
+        double ta = slots[*(const uint32_t *)a].lastAccess;
+        double tb = slots[*(const uint32_t *)b].lastAccess;
+        return ta < tb ? -1 : (ta > tb ? 1 : 0);
+    });
+    for (uint32_t i = 0; i < count; i++) {
+        [self lruPushFront:order[i]];
+    }
+    free(order);
+
+    // keep appending to the last segment while it has room
+    NSNumber *lastSegmentSize = segmentSizes[@(lastSegmentID)];
+    if (lastSegmentSize && [lastSegmentSize unsignedLongLongValue] < self.maxSegmentSize) {
+        _activeSegmentID = lastSegmentID;
+        _activeSegmentLength = [lastSegmentSize unsignedLongLongValue];
+    }
+}
+
+// Rewrites the index into a fresh file without tombstones, doubling the capacity when it is more than half full
+- (BOOL)rehash {
+    uint32_t capacity = _header->capacity;
+    if ((_header->count + 1) * 2 > capacity) {
+        capacity *= 2;
+    }
+
+    // copy the live slots out in LRU order, least recently used first
+    uint32_t count = _header->count;
+    uint32_t nextSegmentID = _header->nextSegmentID;
+    SDPackedIndexSlot *live = malloc(MAX(count, 1) * sizeof(SDPackedIndexSlot));
+    uint32_t n = 0;
+    for (uint32_t i = _lruTail; i != kNoSlot && n < count; i = _lruPrev[i]) {
+        live[n++] = _slots[i];
+    }
+
+    NSString *path = [_directory stringByAppendingPathComponent:kIndexFileName];
+    NSString *temporaryPath = [path stringByAppendingPathExtension:@"tmp"];
+    int fd = [self createIndexFileAtPath:temporaryPath capacity:capacity];
+    if (fd < 0) {
+        free(live);
+        return NO;
+    }
+    // keep mapIndexFile:capacity: from tearing down the old index until the new one is mapped
+    int previousFD = _indexFD;
+    void *previousMap = _indexMap;
+    size_t previousLength = _indexMapLength;
+    _indexFD = -1;
+    _indexMap = NULL;
+    if (![self mapIndexFile:fd capacity:capacity]) {
+        _indexFD = previousFD;
+        _indexMap = previousMap;
+        free(live);
+        unlink([temporaryPath fileSystemRepresentation]);
+        return NO;
+    }
+    munmap(previousMap, previousLength);
+    close(previousFD);
+
+    _header->nextSegmentID = nextSegmentID;
+    for (uint32_t j = 0; j < n; j++) {
+        uint32_t i = [self insertionSlotForHash:live[j].keyHash];
+        _slots[i] = live[j];
+        _header->count++;
+        _header->totalSize += live[j].length;
+        [self lruPushFront:i];
+    }
+    free(live);
+
+    msync(_indexMap, _indexMapLength, MS_SYNC);
+    rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]);
+    return YES;
+}
+
+- (uint32_t)findSlotForHash:(uint64_t)hash {
+    uint32_t mask = _header->capacity - 1;
+    uint32_t i = (uint32_t)hash & mask;
+    for (uint32_t probes = 0; probes < _header->capacity; probes++, i = (i + 1) & mask) {
+        if (_slots[i].state == SDPackedSlotStateEmpty) {
+            return kNoSlot;
+        }
+        if (_slots[i].state == SDPackedSlotStateLive && _slots[i].keyHash == hash) {
+            return i;
+        }
+    }
+    return kNoSlot;
+}
+
+// The table is never more than 70% used, so there always is a free slot
+- (uint32_t)insertionSlotForHash:(uint64_t)hash {
+    uint32_t mask = _header->capacity - 1;
+    uint32_t i = (uint32_t)hash & mask;
+    while (_slots[i].state == SDPackedSlotStateLive) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+- (void)removeSlot:(uint32_t)i {
+    SDPackedIndexSlot *slot = &_slots[i];
+    uint32_t next = (i + 1) & (_header->capacity - 1);
+    // a slot right before an empty one ends every probe sequence through it, so it can be emptied outright
+    if (_slots[next].state == SDPackedSlotStateEmpty) {
+        slot->state = SDPackedSlotStateEmpty;
+    } else {
+        slot->state = SDPackedSlotStateRemoved;
+        _header->tombstones++;
+    }
+    _header->count--;
+    _header->totalSize -= slot->length;
+    [self addLiveBytes:-(int64_t)(sizeof(SDPackedRecordHeader) + slot->length) toSegment:slot->segmentID];
+    [self lruUnlink:i];
+}
+
+- (void)lruUnlink:(uint32_t)i {
+    uint32_t prev = _lruPrev[i];
+    uint32_t next = _lruNext[i];
+    if (prev != kNoSlot) {
+        _lruNext[prev] = next;
+    } else {
+        _lruHead = next;
+    }
+    if (next != kNoSlot) {
+        _lruPrev[next] = prev;
+    } else {
+        _lruTail = prev;
+    }
+}
+
+- (void)lruPushFront:(uint32_t)i {
+    _lruPrev[i] = kNoSlot;
+    _lruNext[i] = _lruHead;
+    if (_lruHead != kNoSlot) {
+        _lruPrev[_lruHead] = i;
+    } else {
+        _lruTail = i;
+    }
+    _lruHead = i;
+}
+
+#pragma mark Segments
+
+- (NSString *)pathForSegment:(uint32_t)segmentID {
+    return [_directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%@%u", kSegmentFilePrefix, segmentID]];
+}
+
+- (int)fileDescriptorForSegment:(uint32_t)segmentID create:(BOOL)create {
+    NSNumber *fd = _segmentFDs[@(segmentID)];
+    if (fd) {
+        return [fd intValue];
+    }
+    int newFD = open([[self pathForSegment:segmentID] fileSystemRepresentation], create ? (O_RDWR | O_CREAT) : O_RDWR, 0644);
+    if (newFD >= 0) {
+        _segmentFDs[@(segmentID)] = @(newFD);
+    }
+    return newFD;
+}
+
+- (void)closeSegments {
+    for (NSNumber *fd in [_segmentFDs allValues]) {
+        close([fd intValue]);
+    }
+    [_segmentFDs removeAllObjects];
+    [_segmentLiveBytes removeAllObjects];
+}
+
+- (void)addLiveBytes:(int64_t)bytes toSegment:(uint32_t)segmentID {
+    int64_t liveBytes = [_segmentLiveBytes[@(segmentID)] longLongValue] + bytes;
+    _segmentLiveBytes[@(segmentID)] = @(MAX(liveBytes, 0));
+}
+
+- (BOOL)appendRecordWithHash:(uint64_t)hash bytes:(const void *)bytes length:(uint32_t)length checksum:(uint64_t)checksum segment:(uint32_t *)segmentID offset:(uint64_t *)offset {
+    uint64_t recordSize = sizeof(SDPackedRecordHeader) + length;
+    if (_activeSegmentID == 0 || (_activeSegmentLength > 0 && _activeSegmentLength + recordSize > self.maxSegmentSize)) {
+        _activeSegmentID = _header->nextSegmentID++;
+        _activeSegmentLength = 0;
+    }
+    int fd = [self fileDescriptorForSegment:_activeSegmentID create:YES];
+    if (fd < 0) {
+        return NO;
+    }
+    // a failed write leaves garbage past the end of the segment which the next append overwrites
+    SDPackedRecordHeader record = {kRecordMagic, length, hash, checksum};
+    if (!SDPackedWriteFully(fd, &record, sizeof(record), _activeSegmentLength) ||
+        !SDPackedWriteFully(fd, bytes, length, _activeSegmentLength + sizeof(record))) {
+        return NO;
+    }
+    *segmentID = _activeSegmentID;
+    *offset = _activeSegmentLength;
+    _activeSegmentLength += recordSize;
+    [self addLiveBytes:(int64_t)recordSize toSegment:_activeSegmentID];
+    return YES;
+}
+
+- (NSData *)readRecordForSlot:(SDPackedIndexSlot *)slot checksum:(uint64_t *)checksum {
+    int fd = [self fileDescriptorForSegment:slot->segmentID create:NO];
+    if (fd < 0) {
+        return nil;
+    }
+    SDPackedRecordHeader record;
+    if (!SDPackedReadFully(fd, &record, sizeof(record), slot->offset) ||
+        record.magic != kRecordMagic || record.length != slot->length || record.keyHash != slot->keyHash) {
+        return nil;
+    }
+    NSMutableData *data = [NSMutableData dataWithLength:record.length];
+    if (!SDPackedReadFully(fd, data.mutableBytes, record.length, slot->offset + sizeof(record)) ||
+        SDPackedChecksum(data.bytes, data.length) != record.checksum) {
+        return nil;
+    }
+    if (checksum) {
+        *checksum = record.checksum;
+    }
+    return data;
+}
+
+@end
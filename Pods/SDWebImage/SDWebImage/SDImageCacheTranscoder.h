@@ -0,0 +1,47 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * A transcoder rewrites image data right before SDImageCache writes it to disk, e.g. to keep smaller copies
+ * of large downloads. It is called from the IO queues, so implementations must be thread safe.
+ */
+@protocol SDImageCacheTranscoder <NSObject>
+
+/**
+ * Returns the data to store on disk for an image
+ *
+ * @param image The image being stored
+ * @param data  The data SDImageCache would store otherwise: the downloaded bytes, or the image encoded by the cache
+ *              when no bytes were given or the image was transformed
+ *
+ * @return The data to store, or nil to store `data` unchanged
+ */
+- (NSData *)cacheDataForImage:(UIImage *)image originalData:(NSData *)data;
+
+@end
+
+/**
+ * Stores opaque still images as JPEGs at a given quality, optionally downscaled. Animated images and images with an
+ * alpha channel are left alone, and so is any image the transcoded copy would not be smaller than.
+ */
+@interface SDImageCacheJPEGTranscoder : NSObject <SDImageCacheTranscoder>
+
+/**
+ * JPEG compression quality, between 0 and 1 [defaults to 0.8]
+ */
+@property (assign, nonatomic) CGFloat compressionQuality;
+
+/**
+ * Longest side in pixels of the stored image, larger images are downscaled. 0 keeps the original dimensions [defaults to 0]
+ */
+@property (assign, nonatomic) NSUInteger maxPixelSize;
+
+@end
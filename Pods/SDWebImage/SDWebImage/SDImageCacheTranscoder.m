@@ -0,0 +1,92 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDImageCacheTranscoder.h"
+#import "NSData+ImageContentType.h"
+#import <ImageIO/ImageIO.h>
+
+@implementation SDImageCacheJPEGTranscoder
+
+- (id)init {
+    if ((self = [super init])) {
+        _compressionQuality = 0.8;
+        _maxPixelSize = 0;
+    }
+    return self;
+}
+
+- (NSData *)cacheDataForImage:(UIImage *)image originalData:(NSData *)data {
+#if TARGET_OS_IPHONE
+    if (!image.CGImage || image.images || [[NSData sd_contentTypeForImageData:data] isEqualToString:@"image/gif"]) {
+        return nil;
+    }
+
+    // JPEG has no alpha channel, keep the transparency
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo(image.CGImage);
+    if (!(alphaInfo == kCGImageAlphaNone ||
+          alphaInfo == kCGImageAlphaNoneSkipFirst ||
+          alphaInfo == kCGImageAlphaNoneSkipLast)) {
+        return nil;
+    }
+
+    UIImage *sourceImage = image;
+    CGFloat longestSide = MAX(CGImageGetWidth(image.CGImage), CGImageGetHeight(image.CGImage));
+    if (self.maxPixelSize > 0 && longestSide > self.maxPixelSize) {
+        sourceImage = [self downscaledImage:image data:data];
+        if (!sourceImage) {
+            return nil;
+        }
+    }
+
+    NSData *transcodedData = UIImageJPEGRepresentation(sourceImage, self.compressionQuality);
+    if (!transcodedData || (data && [transcodedData length] >= [data length])) {
+        return nil;
+    }
+    return transcodedData;
+#else
+    return nil;
+#endif
+}
+
+#if TARGET_OS_IPHONE
+- (UIImage *)downscaledImage:(UIImage *)image data:(NSData *)data {
+    NSDictionary *thumbnailOptions = @{(__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                                       (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                                       (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize: @(self.maxPixelSize)};
+
+    // Scale straight from the encoded bytes when there are some, ImageIO then never decodes the full size image
+    if (data) {
+        CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+        if (source) {
+            CGImageRef thumbnail = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)thumbnailOptions);
+            CFRelease(source);
+            if (thumbnail) {
+                UIImage *downscaledImage = [UIImage imageWithCGImage:thumbnail scale:image.scale orientation:UIImageOrientationUp];
+                CGImageRelease(thumbnail);
+                return downscaledImage;
+            }
+        }
+    }
+
+    CGFloat pixelWidth = image.size.width * image.scale;
+    CGFloat pixelHeight = image.size.height * image.scale;
+    CGFloat ratio = self.maxPixelSize / MAX(pixelWidth, pixelHeight);
+    CGSize targetSize = CGSizeMake(floor(pixelWidth * ratio), floor(pixelHeight * ratio));
+    if (targetSize.width < 1 || targetSize.height < 1) {
+        return nil;
+    }
+
+    UIGraphicsBeginImageContextWithOptions(targetSize, YES, 1.0);
+    [image drawInRect:CGRectMake(0, 0, targetSize.width, targetSize.height)];
+    UIImage *downscaledImage = UIGraphicsGetImageFromCurrentImageContext();
+    UIGraphicsEndImageContext();
+    return downscaledImage;
+}
+#endif
+
+@end
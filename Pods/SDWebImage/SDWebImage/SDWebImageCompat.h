@@ -53,6 +53,9 @@
 
 extern UIImage *SDScaledImageForKey(NSString *key, UIImage *image);
 
+// The scale an image stored under the key is decoded at, 2 or 3 for @2x and @3x file names and 1 otherwise
+extern CGFloat SDImageScaleForKey(NSString *key);
+
 typedef void(^SDWebImageNoParamsBlock)();
 
 extern NSString *const SDWebImageErrorDomain;
@@ -7,17 +7,51 @@
 //
 
 #import "SDWebImageCompat.h"
+#import "SDAnimatedImage.h"
 
 #if !__has_feature(objc_arc)
 #error SDWebImage is ARC only. Either turn on ARC for the project or use -fobjc-arc flag
 #endif
 
+CGFloat SDImageScaleForKey(NSString *key) {
+    CGFloat scale = 1;
+    if (key.length >= 8) {
+        NSRange range = [key rangeOfString:@"@2x."];
+        if (range.location != NSNotFound) {
+            scale = 2.0;
+        }
+
+        range = [key rangeOfString:@"@3x."];
+        if (range.location != NSNotFound) {
+            scale = 3.0;
+        }
+    }
+    return scale;
+}
+
 inline UIImage *SDScaledImageForKey(NSString *key, UIImage *image) {
     if (!image) {
         return nil;
     }
     
-    if ([image.images count] > 0) {
+    if ([image isKindOfClass:[SDAnimatedImage class]]) {
+        // Frames are decoded at the scale of the image, rebuilding it only parses the GIF again
+        SDAnimatedImage *animatedImage = (SDAnimatedImage *)image;
+        CGFloat scale = 1;
+        if (key.length >= 8) {
+            if ([key rangeOfString:@"@2x."].location != NSNotFound) {
+                scale = 2.0;
+            }
+            if ([key rangeOfString:@"@3x."].location != NSNotFound) {
+                scale = 3.0;
+            }
+        }
+        if (animatedImage.scale == scale) {
+            return animatedImage;
+        }
+        return [[animatedImage class] animatedImageWithGIFData:animatedImage.animatedImageData scale:scale] ?: animatedImage;
+    }
+    else if ([image.images count] > 0) {
         NSMutableArray *scaledImages = [NSMutableArray array];
 
         for (UIImage *tempImage in image.images) {
@@ -28,18 +62,7 @@ inline UIImage *SDScaledImageForKey(NSString *key, UIImage *image) {
     }
     else {
         if ([[UIScreen mainScreen] respondsToSelector:@selector(scale)]) {
-            CGFloat scale = 1;
-            if (key.length >= 8) {
-                NSRange range = [key rangeOfString:@"@2x."];
-                if (range.location != NSNotFound) {
-                    scale = 2.0;
-                }
-                
-                range = [key rangeOfString:@"@3x."];
-                if (range.location != NSNotFound) {
-                    scale = 3.0;
-                }
-            }
+            CGFloat scale = SDImageScaleForKey(key);
 
             UIImage *scaledImage = [[UIImage alloc] initWithCGImage:image.CGImage scale:scale orientation:image.imageOrientation];
             image = scaledImage;
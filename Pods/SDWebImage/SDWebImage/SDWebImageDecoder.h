@@ -15,4 +15,15 @@
 
 + (UIImage *)decodedImageWithImage:(UIImage *)image;
 
+/**
+ * Decodes image data straight into a bitmap no larger than needed to fill the target size, without decoding
+ * the full size image first. Animated images and data ImageIO cannot read are decoded at full size.
+ *
+ * @param data            The encoded image data
+ * @param scale           The scale of the returned image
+ * @param targetPixelSize The size in pixels the image should cover once displayed aspect fill,
+ *                        CGSizeZero decodes at full size. Images are never scaled up.
+ */
++ (UIImage *)decodedImageWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize;
+
 @end
@@ -9,6 +9,9 @@
  */
 
 #import "SDWebImageDecoder.h"
+#import "UIImage+MultiFormat.h"
+#import "UIImage+GIF.h"
+#import <ImageIO/ImageIO.h>
 
 @implementation UIImage (ForceDecode)
 
@@ -26,7 +29,7 @@
     
     @autoreleasepool{
         // do not decode animated images
-        if (image.images != nil) {
+        if ([image sd_isAnimated]) {
             return image;
         }
         
@@ -36,57 +39,120 @@
         BOOL anyAlpha = (alpha == kCGImageAlphaFirst ||
                          alpha == kCGImageAlphaLast ||
                          alpha == kCGImageAlphaPremultipliedFirst ||
-                         alpha == kCGImageAlphaPremultipliedLast);
-        if (anyAlpha) {
-            return image;
-        }
+                         alpha == kCGImageAlphaPremultipliedLast ||
+                         alpha == kCGImageAlphaOnly);
         
         // current
         CGColorSpaceModel imageColorSpaceModel = CGColorSpaceGetModel(CGImageGetColorSpace(imageRef));
-        CGColorSpaceRef colorspaceRef = CGImageGetColorSpace(imageRef);
         
-        BOOL unsupportedColorSpace = (imageColorSpaceModel == kCGColorSpaceModelUnknown ||
-                                      imageColorSpaceModel == kCGColorSpaceModelMonochrome ||
-                                      imageColorSpaceModel == kCGColorSpaceModelCMYK ||
-                                      imageColorSpaceModel == kCGColorSpaceModelIndexed);
-        if (unsupportedColorSpace) {
-            colorspaceRef = CGColorSpaceCreateDeviceRGB();
+        // Pick the most compact format the bitmap can be drawn in: one byte per pixel for opaque grayscale images,
+        // four otherwise. Images with alpha are drawn premultiplied, the format Core Animation composites without
+        // converting. kCGImageAlphaNone is not supported for RGB contexts, opaque images skip the alpha byte instead.
+        BOOL grayscale = (imageColorSpaceModel == kCGColorSpaceModelMonochrome && !anyAlpha);
+        CGColorSpaceRef colorspaceRef;
+        CGBitmapInfo bitmapInfo;
+        if (grayscale) {
+            colorspaceRef = CGColorSpaceCreateDeviceGray();
+            bitmapInfo = (CGBitmapInfo)kCGImageAlphaNone;
+        }
+        else {
+            // keep RGB color spaces such as Display P3, convert the unsupported ones (CMYK, indexed...)
+            if (imageColorSpaceModel == kCGColorSpaceModelRGB) {
+                colorspaceRef = CGColorSpaceRetain(CGImageGetColorSpace(imageRef));
+            }
+            else {
+                colorspaceRef = CGColorSpaceCreateDeviceRGB();
+            }
+            bitmapInfo = kCGBitmapByteOrder32Host | (anyAlpha ? kCGImageAlphaPremultipliedFirst : kCGImageAlphaNoneSkipFirst);
         }
         
         size_t width = CGImageGetWidth(imageRef);
         size_t height = CGImageGetHeight(imageRef);
-        NSUInteger bytesPerPixel = 4;
-        NSUInteger bytesPerRow = bytesPerPixel * width;
         NSUInteger bitsPerComponent = 8;
 
-
-        // kCGImageAlphaNone is not supported in CGBitmapContextCreate.
-        // Since the original image here has no alpha info, use kCGImageAlphaNoneSkipLast
-        // to create bitmap graphics contexts without alpha info.
+        // Let Core Graphics pick the row alignment
         CGContextRef context = CGBitmapContextCreate(NULL,
                                                      width,
                                                      height,
                                                      bitsPerComponent,
-                                                     bytesPerRow,
+                                                     0,
                                                      colorspaceRef,
-                                                     kCGBitmapByteOrderDefault|kCGImageAlphaNoneSkipLast);
+                                                     bitmapInfo);
+        CGColorSpaceRelease(colorspaceRef);
+        if (!context) {
+            return image;
+        }
         
-        // Draw the image into the context and retrieve the new bitmap image without alpha
+        // Draw the image into the context and retrieve the new decoded bitmap image
         CGContextDrawImage(context, CGRectMake(0, 0, width, height), imageRef);
-        CGImageRef imageRefWithoutAlpha = CGBitmapContextCreateImage(context);
-        UIImage *imageWithoutAlpha = [UIImage imageWithCGImage:imageRefWithoutAlpha
-                                                         scale:image.scale
-                                                   orientation:image.imageOrientation];
-        
-        if (unsupportedColorSpace) {
-            CGColorSpaceRelease(colorspaceRef);
-        }
+        CGImageRef decodedImageRef = CGBitmapContextCreateImage(context);
+        UIImage *decodedImage = [UIImage imageWithCGImage:decodedImageRef
+                                                    scale:image.scale
+                                              orientation:image.imageOrientation];
         
         CGContextRelease(context);
-        CGImageRelease(imageRefWithoutAlpha);
+        CGImageRelease(decodedImageRef);
         
-        return imageWithoutAlpha;
+        return decodedImage;
+    }
+}
+
++ (UIImage *)decodedImageWithData:(NSData *)data scale:(CGFloat)scale targetPixelSize:(CGSize)targetPixelSize {
+    if (!data) {
+        return nil;
+    }
+    if (scale <= 0) {
+        scale = 1;
+    }
+
+    @autoreleasepool {
+        UIImage *image = nil;
+        CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+        if (source) {
+            // Animated images need every frame, they go through sd_imageWithData: below
+            if (CGImageSourceGetCount(source) == 1) {
+                NSDictionary *properties = (__bridge_transfer NSDictionary *)CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+                CGFloat pixelWidth = [properties[(__bridge NSString *)kCGImagePropertyPixelWidth] doubleValue];
+                CGFloat pixelHeight = [properties[(__bridge NSString *)kCGImagePropertyPixelHeight] doubleValue];
+                // EXIF orientations 5 to 8 are rotated by 90 degrees, the thumbnail comes out with width and height swapped
+                if ([properties[(__bridge NSString *)kCGImagePropertyOrientation] integerValue] >= 5) {
+                    CGFloat swap = pixelWidth;
+                    pixelWidth = pixelHeight;
+                    pixelHeight = swap;
+                }
+
+                if (pixelWidth > 0 && pixelHeight > 0) {
+                    CGFloat maxPixelSize = MAX(pixelWidth, pixelHeight);
+                    if (targetPixelSize.width > 0 && targetPixelSize.height > 0) {
+                        CGFloat ratio = MIN(1, MAX(targetPixelSize.width / pixelWidth, targetPixelSize.height / pixelHeight));
+                        maxPixelSize = ceil(maxPixelSize * ratio);
+                    }
+
+                    // ImageIO scales while decoding, so the full size bitmap is never allocated
+                    NSDictionary *options = @{(__bridge NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                                              (__bridge NSString *)kCGImageSourceCreateThumbnailWithTransform: @YES,
+                                              (__bridge NSString *)kCGImageSourceShouldCacheImmediately: @YES,
+                                              (__bridge NSString *)kCGImageSourceThumbnailMaxPixelSize: @(maxPixelSize)};
+                    CGImageRef imageRef = CGImageSourceCreateThumbnailAtIndex(source, 0, (__bridge CFDictionaryRef)options);
+                    if (imageRef) {
+                        image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+                        CGImageRelease(imageRef);
+                    }
+                }
+            }
+            CFRelease(source);
+        }
+
+        if (image) {
+            return image;
+        }
+    }
+
+    UIImage *image = [UIImage sd_imageWithData:data];
+    if ([image sd_isAnimated]) {
+        return image;
     }
+    return [self decodedImageWithImage:image];
 }
 
 @end
@@ -51,6 +51,26 @@ typedef NS_OPTIONS(NSUInteger, SDWebImageDownloaderOptions) {
     SDWebImageDownloaderHighPriority = 1 << 7,
 };
 
+/**
+ * Pending downloads start by priority first, then in the downloader execution order.
+ */
+typedef NS_ENUM(NSInteger, SDWebImageDownloaderPriority) {
+    /**
+     * Images nobody is looking at, e.g. a cell that scrolled off screen.
+     */
+    SDWebImageDownloaderPriorityBackground,
+
+    /**
+     * Images that will probably be shown soon. Used for the SDWebImageDownloaderLowPriority option.
+     */
+    SDWebImageDownloaderPriorityPrefetch,
+
+    /**
+     * Default value. Images shown on screen right now.
+     */
+    SDWebImageDownloaderPriorityVisible
+};
+
 typedef NS_ENUM(NSInteger, SDWebImageDownloaderExecutionOrder) {
     /**
      * Default value. All download operations will execute in queue style (first-in-first-out).
@@ -72,6 +92,30 @@ typedef void(^SDWebImageDownloaderCompletedBlock)(UIImage *image, NSData *data,
 
 typedef NSDictionary *(^SDWebImageDownloaderHeadersFilterBlock)(NSURL *url, NSDictionary *headers);
 
+/**
+ * One request for a download. Requests for the same URL share a single download, which runs at the highest
+ * priority of its requests and is only cancelled once every request was cancelled.
+ */
+@interface SDWebImageDownloadToken : NSObject <SDWebImageOperation>
+
+/**
+ * The URL of the download
+ */
+@property (strong, nonatomic, readonly) NSURL *url;
+
+/**
+ * The priority of this request. Can be changed while the download waits for its turn,
+ * e.g. when its cell scrolls on or off screen.
+ */
+@property (assign, nonatomic) SDWebImageDownloaderPriority priority;
+
+/**
+ * Stops this request. Its blocks are not called anymore, and the download is cancelled if no other request needs it.
+ */
+- (void)cancel;
+
+@end
+
 /**
  * Asynchronous downloader dedicated and optimized for image loading.
  */
@@ -83,10 +127,13 @@ typedef NSDictionary *(^SDWebImageDownloaderHeadersFilterBlock)(NSURL *url, NSDi
  */
 @property (assign, nonatomic) BOOL shouldDecompressImages;
 
+/**
+ * The maximum number of downloads running at the same time, the others wait for their turn by priority [defaults to 6]
+ */
 @property (assign, nonatomic) NSInteger maxConcurrentDownloads;
 
 /**
- * Shows the current amount of downloads that still need to be downloaded
+ * Shows the current amount of downloads that still need to be downloaded, running or waiting
  */
 @property (readonly, nonatomic) NSUInteger currentDownloadCount;
 
@@ -98,7 +145,8 @@ typedef NSDictionary *(^SDWebImageDownloaderHeadersFilterBlock)(NSURL *url, NSDi
 
 
 /**
- * Changes download operations execution order. Default value is `SDWebImageDownloaderFIFOExecutionOrder`.
+ * Changes download operations execution order among downloads of the same priority.
+ * Default value is `SDWebImageDownloaderFIFOExecutionOrder`.
  */
 @property (assign, nonatomic) SDWebImageDownloaderExecutionOrder executionOrder;
 
@@ -176,7 +224,7 @@ typedef NSDictionary *(^SDWebImageDownloaderHeadersFilterBlock)(NSURL *url, NSDi
  *                       before to be called a last time with the full image and finished argument
  *                       set to YES. In case of error, the finished argument is always YES.
  *
- * @return A cancellable SDWebImageOperation
+ * @return A cancellable SDWebImageDownloadToken, nil if the url is nil
  */
 - (id <SDWebImageOperation>)downloadImageWithURL:(NSURL *)url
                                          options:(SDWebImageDownloaderOptions)options
@@ -184,7 +232,55 @@ typedef NSDictionary *(^SDWebImageDownloaderHeadersFilterBlock)(NSURL *url, NSDi
                                        completed:(SDWebImageDownloaderCompletedBlock)completedBlock;
 
 /**
- * Sets the download queue suspension state
+ * Same as `downloadImageWithURL:options:progress:completed:` with an explicit priority
+ * instead of the one picked from the options.
+ *
+ * @param url            The URL to the image to download
+ * @param options        The options to be used for this download
+ * @param priority       The priority of this request, see `SDWebImageDownloadToken`
+ * @param progressBlock  A block called repeatedly while the image is downloading
+ * @param completedBlock A block called once the download is completed
+ *
+ * @return A cancellable SDWebImageDownloadToken, nil if the url is nil
+ */
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url
+                                          options:(SDWebImageDownloaderOptions)options
+                                         priority:(SDWebImageDownloaderPriority)priority
+                                         progress:(SDWebImageDownloaderProgressBlock)progressBlock
+                                        completed:(SDWebImageDownloaderCompletedBlock)completedBlock;
+
+/**
+ * Same as `downloadImageWithURL:options:progress:completed:`, decoding the image once, straight at the given size.
+ *
+ * Requests for the same URL share one download, which decodes large enough for all of them and at full size
+ * as soon as one of them asks for it.
+ *
+ * @param url             The URL to the image to download
+ * @param options         The options to be used for this download
+ * @param targetPixelSize The size in pixels the image will be displayed at, CGSizeZero decodes at full size
+ * @param progressBlock   A block called repeatedly while the image is downloading
+ * @param completedBlock  A block called once the download is completed
+ *
+ * @return A cancellable SDWebImageDownloadToken, nil if the url is nil
+ */
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url
+                                          options:(SDWebImageDownloaderOptions)options
+                                  targetPixelSize:(CGSize)targetPixelSize
+                                         progress:(SDWebImageDownloaderProgressBlock)progressBlock
+                                        completed:(SDWebImageDownloaderCompletedBlock)completedBlock;
+
+/**
+ * Same as `downloadImageWithURL:options:targetPixelSize:progress:completed:` with an explicit priority
+ */
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url
+                                          options:(SDWebImageDownloaderOptions)options
+                                         priority:(SDWebImageDownloaderPriority)priority
+                                  targetPixelSize:(CGSize)targetPixelSize
+                                         progress:(SDWebImageDownloaderProgressBlock)progressBlock
+                                        completed:(SDWebImageDownloaderCompletedBlock)completedBlock;
+
+/**
+ * Sets the download queue suspension state. Suspended downloaders start no new download.
  */
 - (void)setSuspended:(BOOL)suspended;
 
@@ -10,25 +10,104 @@
 #import "SDWebImageDownloaderOperation.h"
 #import <ImageIO/ImageIO.h>
 
-static NSString *const kProgressCallbackKey = @"progress";
-static NSString *const kCompletedCallbackKey = @"completed";
-
 @interface SDWebImageDownloader () <NSURLSessionTaskDelegate, NSURLSessionDataDelegate>
 
 @property (strong, nonatomic) NSOperationQueue *downloadQueue;
-@property (weak, nonatomic) NSOperation *lastAddedOperation;
 @property (assign, nonatomic) Class operationClass;
-@property (strong, nonatomic) NSMutableDictionary *URLCallbacks;
+// Shared downloads by URL, running or waiting for their turn
+@property (strong, nonatomic) NSMutableDictionary *downloads;
+// Downloads waiting for their turn, as a binary heap with the next one to start first
+@property (strong, nonatomic) NSMutableArray *pendingDownloads;
 @property (strong, nonatomic) NSMutableDictionary *HTTPHeaders;
-// This queue is used to serialize the handling of the network responses of all the download operation in a single queue
+// Operations by the identifier of their data task, added when the download is enqueued and removed when it finishes
+// or is cancelled. Operations creating their task only once they start are added on the first delegate call instead.
+@property (strong, nonatomic) NSMutableDictionary *operationsByTaskIdentifier;
+// This queue is used to serialize the handling of the network responses of all the download operation in a single queue.
+// It also guards the scheduler state: downloads, pendingDownloads and the counters below
 @property (SDDispatchQueueSetterSementics, nonatomic) dispatch_queue_t barrierQueue;
 
 // The session in which data tasks will run
 @property (strong, nonatomic) NSURLSession *session;
 
+- (void)cancelToken:(SDWebImageDownloadToken *)token;
+- (void)updatePriorityOfToken:(SDWebImageDownloadToken *)token;
+
+@end
+
+@interface SDWebImageDownloadToken ()
+
+@property (strong, nonatomic, readwrite) NSURL *url;
+@property (weak, nonatomic) SDWebImageDownloader *downloader;
+@property (copy, nonatomic) SDWebImageDownloaderProgressBlock progressBlock;
+@property (copy, nonatomic) SDWebImageDownloaderCompletedBlock completedBlock;
+@property (assign, nonatomic) CGSize targetPixelSize;
+
 @end
 
-@implementation SDWebImageDownloader
+// A download shared by every token of a URL
+@interface SDWebImageDownload : NSObject
+
+@property (strong, nonatomic) NSURL *url;
+@property (strong, nonatomic) SDWebImageDownloaderOperation *operation;
+// Identifier of the operation's data task, nil until the operation has one
+@property (strong, nonatomic) NSNumber *taskIdentifier;
+@property (strong, nonatomic) NSMutableArray *tokens;
+// Highest priority of the tokens
+@property (assign, nonatomic) SDWebImageDownloaderPriority priority;
+// Requested with SDWebImageDownloaderHighPriority, goes before the other downloads of its priority
+@property (assign, nonatomic) BOOL urgent;
+// Enqueue order
+@property (assign, nonatomic) unsigned long long sequence;
+// Position in the pending heap, NSNotFound when not waiting
+@property (assign, nonatomic) NSUInteger heapIndex;
+@property (assign, nonatomic, getter = isRunning) BOOL running;
+
+@end
+
+@implementation SDWebImageDownload
+
+- (id)init {
+    if ((self = [super init])) {
+        _tokens = [NSMutableArray new];
+        _heapIndex = NSNotFound;
+    }
+    return self;
+}
+
+@end
+
+@implementation SDWebImageDownloadToken {
+    SDWebImageDownloaderPriority _priority;
+}
+
+- (SDWebImageDownloaderPriority)priority {
+    @synchronized (self) {
+        return _priority;
+    }
+}
+
+- (void)setPriority:(SDWebImageDownloaderPriority)priority {
+    @synchronized (self) {
+        if (_priority == priority) {
+            return;
+        }
+        _priority = priority;
+    }
+    [self.downloader updatePriorityOfToken:self];
+}
+
+- (void)cancel {
+    [self.downloader cancelToken:self];
+}
+
+@end
+
+@implementation SDWebImageDownloader {
+    NSInteger _maxConcurrentDownloads;
+    NSUInteger _runningDownloadCount;
+    unsigned long long _lastSequence;
+    BOOL _suspended;
+}
 
 + (void)initialize {
     // Bind SDNetworkActivityIndicator if available (download it here: http://github.com/rs/SDNetworkActivityIndicator )
@@ -67,10 +146,13 @@ static NSString *const kCompletedCallbackKey = @"completed";
         _operationClass = [SDWebImageDownloaderOperation class];
         _shouldDecompressImages = YES;
         _executionOrder = SDWebImageDownloaderFIFOExecutionOrder;
+        // The queue only runs the operations the scheduler picked, the scheduler enforces the concurrency limit
         _downloadQueue = [NSOperationQueue new];
-        _downloadQueue.maxConcurrentOperationCount = 6;
         _downloadQueue.name = @"com.hackemist.SDWebImageDownloader";
-        _URLCallbacks = [NSMutableDictionary new];
+        _maxConcurrentDownloads = 6;
+        _downloads = [NSMutableDictionary new];
+        _pendingDownloads = [NSMutableArray new];
+        _operationsByTaskIdentifier = [NSMutableDictionary new];
 #ifdef SD_WEBP
         _HTTPHeaders = [@{@"Accept": @"image/webp,image/*;q=0.8"} mutableCopy];
 #else
@@ -99,6 +181,10 @@ static NSString *const kCompletedCallbackKey = @"completed";
     self.session = nil;
 
     [self.downloadQueue cancelAllOperations];
+    // Waiting operations are not in the queue, cancelling them releases the blocks that hold their download
+    for (SDWebImageDownload *download in self.pendingDownloads) {
+        [download.operation cancel];
+    }
     SDDispatchQueueRelease(_barrierQueue);
 }
 
@@ -116,15 +202,36 @@ static NSString *const kCompletedCallbackKey = @"completed";
 }
 
 - (void)setMaxConcurrentDownloads:(NSInteger)maxConcurrentDownloads {
-    _downloadQueue.maxConcurrentOperationCount = maxConcurrentDownloads;
+    dispatch_barrier_async(self.barrierQueue, ^{
+        _maxConcurrentDownloads = maxConcurrentDownloads;
+        [self startPendingDownloads];
+    });
 }
 
 - (NSUInteger)currentDownloadCount {
-    return _downloadQueue.operationCount;
+    __block NSUInteger count;
+    dispatch_sync(self.barrierQueue, ^{
+        count = self.downloads.count;
+    });
+    return count;
 }
 
 - (NSInteger)maxConcurrentDownloads {
-    return _downloadQueue.maxConcurrentOperationCount;
+    __block NSInteger maxConcurrentDownloads;
+    dispatch_sync(self.barrierQueue, ^{
+        maxConcurrentDownloads = _maxConcurrentDownloads;
+    });
+    return maxConcurrentDownloads;
+}
+
+- (void)setExecutionOrder:(SDWebImageDownloaderExecutionOrder)executionOrder {
+    dispatch_barrier_sync(self.barrierQueue, ^{
+        _executionOrder = executionOrder;
+        // The heap order depends on the execution order, rebuild it
+        for (NSInteger i = (NSInteger)self.pendingDownloads.count / 2 - 1; i >= 0; i--) {
+            [self siftDownPendingDownloadAtIndex:i];
+        }
+    });
 }
 
 - (void)setOperationClass:(Class)operationClass {
@@ -132,140 +239,366 @@ static NSString *const kCompletedCallbackKey = @"completed";
 }
 
 - (id <SDWebImageOperation>)downloadImageWithURL:(NSURL *)url options:(SDWebImageDownloaderOptions)options progress:(SDWebImageDownloaderProgressBlock)progressBlock completed:(SDWebImageDownloaderCompletedBlock)completedBlock {
-    __block SDWebImageDownloaderOperation *operation;
-    __weak __typeof(self)wself = self;
+    SDWebImageDownloaderPriority priority = (options & SDWebImageDownloaderLowPriority) ? SDWebImageDownloaderPriorityPrefetch : SDWebImageDownloaderPriorityVisible;
+    return [self downloadImageWithURL:url options:options priority:priority progress:progressBlock completed:completedBlock];
+}
 
-    [self addProgressCallback:progressBlock completedBlock:completedBlock forURL:url createCallback:^{
-        NSTimeInterval timeoutInterval = wself.downloadTimeout;
-        if (timeoutInterval == 0.0) {
-            timeoutInterval = 15.0;
-        }
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url options:(SDWebImageDownloaderOptions)options priority:(SDWebImageDownloaderPriority)priority progress:(SDWebImageDownloaderProgressBlock)progressBlock completed:(SDWebImageDownloaderCompletedBlock)completedBlock {
+    return [self downloadImageWithURL:url options:options priority:priority targetPixelSize:CGSizeZero progress:progressBlock completed:completedBlock];
+}
 
-        // In order to prevent from potential duplicate caching (NSURLCache + SDImageCache) we disable the cache for image requests if told otherwise
-        NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:url cachePolicy:(options & SDWebImageDownloaderUseNSURLCache ? NSURLRequestUseProtocolCachePolicy : NSURLRequestReloadIgnoringLocalCacheData) timeoutInterval:timeoutInterval];
-        request.HTTPShouldHandleCookies = (options & SDWebImageDownloaderHandleCookies);
-        request.HTTPShouldUsePipelining = YES;
-        if (wself.headersFilter) {
-            request.allHTTPHeaderFields = wself.headersFilter(url, [wself.HTTPHeaders copy]);
-        }
-        else {
-            request.allHTTPHeaderFields = wself.HTTPHeaders;
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url options:(SDWebImageDownloaderOptions)options targetPixelSize:(CGSize)targetPixelSize progress:(SDWebImageDownloaderProgressBlock)progressBlock completed:(SDWebImageDownloaderCompletedBlock)completedBlock {
+    SDWebImageDownloaderPriority priority = (options & SDWebImageDownloaderLowPriority) ? SDWebImageDownloaderPriorityPrefetch : SDWebImageDownloaderPriorityVisible;
+    return [self downloadImageWithURL:url options:options priority:priority targetPixelSize:targetPixelSize progress:progressBlock completed:completedBlock];
+}
+
+- (SDWebImageDownloadToken *)downloadImageWithURL:(NSURL *)url options:(SDWebImageDownloaderOptions)options priority:(SDWebImageDownloaderPriority)priority targetPixelSize:(CGSize)targetPixelSize progress:(SDWebImageDownloaderProgressBlock)progressBlock completed:(SDWebImageDownloaderCompletedBlock)completedBlock {
+    // The URL will be used as the key to the downloads dictionary so it cannot be nil. If it is nil immediately call the completed block with no image or data.
+    if (url == nil) {
+        if (completedBlock != nil) {
+            completedBlock(nil, nil, nil, NO);
         }
-        operation = [[wself.operationClass alloc] initWithRequest:request
-                                                        inSession:self.session
-                                                          options:options
-                                                         progress:^(NSInteger receivedSize, NSInteger expectedSize) {
-                                                             SDWebImageDownloader *sself = wself;
-                                                             if (!sself) return;
-                                                             __block NSArray *callbacksForURL;
-                                                             dispatch_sync(sself.barrierQueue, ^{
-                                                                 callbacksForURL = [sself.URLCallbacks[url] copy];
-                                                             });
-                                                             for (NSDictionary *callbacks in callbacksForURL) {
-                                                                 dispatch_async(dispatch_get_main_queue(), ^{
-                                                                     SDWebImageDownloaderProgressBlock callback = callbacks[kProgressCallbackKey];
-                                                                     if (callback) callback(receivedSize, expectedSize);
-                                                                 });
-                                                             }
-                                                         }
-                                                        completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
-                                                            SDWebImageDownloader *sself = wself;
-                                                            if (!sself) return;
-                                                            __block NSArray *callbacksForURL;
-                                                            dispatch_barrier_sync(sself.barrierQueue, ^{
-                                                                callbacksForURL = [sself.URLCallbacks[url] copy];
-                                                                if (finished) {
-                                                                    [sself.URLCallbacks removeObjectForKey:url];
-                                                                }
-                                                            });
-                                                            for (NSDictionary *callbacks in callbacksForURL) {
-                                                                SDWebImageDownloaderCompletedBlock callback = callbacks[kCompletedCallbackKey];
-                                                                if (callback) callback(image, data, error, finished);
-                                                            }
-                                                        }
-                                                        cancelled:^{
-                                                            SDWebImageDownloader *sself = wself;
-                                                            if (!sself) return;
-                                                            dispatch_barrier_async(sself.barrierQueue, ^{
-                                                                [sself.URLCallbacks removeObjectForKey:url];
-                                                            });
-                                                        }];
-        operation.shouldDecompressImages = wself.shouldDecompressImages;
-        
-        if (wself.urlCredential) {
-            operation.credential = wself.urlCredential;
-        } else if (wself.username && wself.password) {
-            operation.credential = [NSURLCredential credentialWithUser:wself.username password:wself.password persistence:NSURLCredentialPersistenceForSession];
+        return nil;
+    }
+
+    SDWebImageDownloadToken *token = [SDWebImageDownloadToken new];
+    token.priority = priority;
+    token.url = url;
+    token.progressBlock = progressBlock;
+    token.completedBlock = completedBlock;
+    token.targetPixelSize = targetPixelSize;
+    token.downloader = self;
+
+    dispatch_barrier_sync(self.barrierQueue, ^{
+        // Handle single download of simultaneous download request for the same URL
+        SDWebImageDownload *download = self.downloads[url];
+        if (!download) {
+            download = [SDWebImageDownload new];
+            download.url = url;
+            download.operation = [self operationForDownload:download options:options];
+            if (download.operation.dataTask) {
+                download.taskIdentifier = @(download.operation.dataTask.taskIdentifier);
+                self.operationsByTaskIdentifier[download.taskIdentifier] = download.operation;
+            }
+            download.sequence = ++_lastSequence;
+            self.downloads[url] = download;
         }
-        
+        [download.tokens addObject:token];
         if (options & SDWebImageDownloaderHighPriority) {
-            operation.queuePriority = NSOperationQueuePriorityHigh;
-        } else if (options & SDWebImageDownloaderLowPriority) {
-            operation.queuePriority = NSOperationQueuePriorityLow;
+            download.urgent = YES;
         }
-
-        [wself.downloadQueue addOperation:operation];
-        if (wself.executionOrder == SDWebImageDownloaderLIFOExecutionOrder) {
-            // Emulate LIFO execution order by systematically adding new operations as last operation's dependency
-            [wself.lastAddedOperation addDependency:operation];
-            wself.lastAddedOperation = operation;
+        [self updatePriorityOfDownload:download];
+        [self updateTargetPixelSizeOfDownload:download];
+        if (!download.isRunning && download.heapIndex == NSNotFound) {
+            [self addPendingDownload:download];
         }
-    }];
+        [self startPendingDownloads];
+    });
+
+    return token;
+}
+
+- (SDWebImageDownloaderOperation *)operationForDownload:(SDWebImageDownload *)download options:(SDWebImageDownloaderOptions)options {
+    NSURL *url = download.url;
+    NSTimeInterval timeoutInterval = self.downloadTimeout;
+    if (timeoutInterval == 0.0) {
+        timeoutInterval = 15.0;
+    }
+
+    // In order to prevent from potential duplicate caching (NSURLCache + SDImageCache) we disable the cache for image requests if told otherwise
+    NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:url cachePolicy:(options & SDWebImageDownloaderUseNSURLCache ? NSURLRequestUseProtocolCachePolicy : NSURLRequestReloadIgnoringLocalCacheData) timeoutInterval:timeoutInterval];
+    request.HTTPShouldHandleCookies = (options & SDWebImageDownloaderHandleCookies);
+    request.HTTPShouldUsePipelining = YES;
+    if (self.headersFilter) {
+        request.allHTTPHeaderFields = self.headersFilter(url, [self.HTTPHeaders copy]);
+    }
+    else {
+        request.allHTTPHeaderFields = self.HTTPHeaders;
+    }
+
+    // The blocks hold the download until the operation finishes or is cancelled, the operation then releases them
+    __weak __typeof(self)wself = self;
+    SDWebImageDownloaderOperation *operation = [[self.operationClass alloc] initWithRequest:request
+                                                                                 inSession:self.session
+                                                                                   options:options
+                                                                                  progress:^(NSInteger receivedSize, NSInteger expectedSize) {
+                                                                                      SDWebImageDownloader *sself = wself;
+                                                                                      if (!sself) return;
+                                                                                      __block NSArray *tokens;
+                                                                                      dispatch_sync(sself.barrierQueue, ^{
+                                                                                          tokens = [download.tokens copy];
+                                                                                      });
+                                                                                      for (SDWebImageDownloadToken *token in tokens) {
+                                                                                          SDWebImageDownloaderProgressBlock callback = token.progressBlock;
+                                                                                          if (!callback) continue;
+                                                                                          dispatch_async(dispatch_get_main_queue(), ^{
+                                                                                              callback(receivedSize, expectedSize);
+                                                                                          });
+                                                                                      }
+                                                                                  }
+                                                                                 completed:^(UIImage *image, NSData *data, NSError *error, BOOL finished) {
+                                                                                     SDWebImageDownloader *sself = wself;
+                                                                                     if (!sself) return;
+                                                                                     __block NSArray *tokens;
+                                                                                     dispatch_barrier_sync(sself.barrierQueue, ^{
+                                                                                         tokens = [download.tokens copy];
+                                                                                         if (finished) {
+                                                                                             [sself finishDownload:download];
+                                                                                         }
+                                                                                     });
+                                                                                     for (SDWebImageDownloadToken *token in tokens) {
+                                                                                         SDWebImageDownloaderCompletedBlock callback = token.completedBlock;
+                                                                                         if (callback) callback(image, data, error, finished);
+                                                                                     }
+                                                                                 }
+                                                                                 cancelled:^{
+                                                                                     SDWebImageDownloader *sself = wself;
+                                                                                     if (!sself) return;
+                                                                                     dispatch_barrier_async(sself.barrierQueue, ^{
+                                                                                         [sself finishDownload:download];
+                                                                                     });
+                                                                                 }];
+    operation.shouldDecompressImages = self.shouldDecompressImages;
+
+    if (self.urlCredential) {
+        operation.credential = self.urlCredential;
+    } else if (self.username && self.password) {
+        operation.credential = [NSURLCredential credentialWithUser:self.username password:self.password persistence:NSURLCredentialPersistenceForSession];
+    }
 
     return operation;
 }
 
-- (void)addProgressCallback:(SDWebImageDownloaderProgressBlock)progressBlock completedBlock:(SDWebImageDownloaderCompletedBlock)completedBlock forURL:(NSURL *)url createCallback:(SDWebImageNoParamsBlock)createCallback {
-    // The URL will be used as the key to the callbacks dictionary so it cannot be nil. If it is nil immediately call the completed block with no image or data.
-    if (url == nil) {
-        if (completedBlock != nil) {
-            completedBlock(nil, nil, nil, NO);
+- (void)setSuspended:(BOOL)suspended {
+    dispatch_barrier_async(self.barrierQueue, ^{
+        _suspended = suspended;
+        [self startPendingDownloads];
+    });
+    [self.downloadQueue setSuspended:suspended];
+}
+
+- (void)cancelAllDownloads {
+    __block NSArray *downloads;
+    dispatch_barrier_sync(self.barrierQueue, ^{
+        downloads = [self.downloads allValues];
+        [self.downloads removeAllObjects];
+        for (SDWebImageDownload *download in self.pendingDownloads) {
+            download.heapIndex = NSNotFound;
         }
-        return;
+        [self.pendingDownloads removeAllObjects];
+    });
+    // Running operations give their slot back from their cancelled block
+    for (SDWebImageDownload *download in downloads) {
+        [download.operation cancel];
     }
+}
 
+#pragma mark Scheduling
+
+- (void)cancelToken:(SDWebImageDownloadToken *)token {
+    __block SDWebImageDownloaderOperation *operationToCancel = nil;
     dispatch_barrier_sync(self.barrierQueue, ^{
-        BOOL first = NO;
-        if (!self.URLCallbacks[url]) {
-            self.URLCallbacks[url] = [NSMutableArray new];
-            first = YES;
+        SDWebImageDownload *download = self.downloads[token.url];
+        if (![download.tokens containsObject:token]) {
+            return;
         }
+        [download.tokens removeObjectIdenticalTo:token];
 
-        // Handle single download of simultaneous download request for the same URL
-        NSMutableArray *callbacksForURL = self.URLCallbacks[url];
-        NSMutableDictionary *callbacks = [NSMutableDictionary new];
-        if (progressBlock) callbacks[kProgressCallbackKey] = [progressBlock copy];
-        if (completedBlock) callbacks[kCompletedCallbackKey] = [completedBlock copy];
-        [callbacksForURL addObject:callbacks];
-        self.URLCallbacks[url] = callbacksForURL;
-
-        if (first) {
-            createCallback();
+        if (download.tokens.count > 0) {
+            [self updatePriorityOfDownload:download];
+            [self updateTargetPixelSizeOfDownload:download];
+            return;
         }
+
+        // The last request left, the download is not needed anymore
+        [self.downloads removeObjectForKey:download.url];
+        [self removePendingDownload:download];
+        operationToCancel = download.operation;
     });
+    // Cancelling calls back into the barrier queue
+    [operationToCancel cancel];
 }
 
-- (void)setSuspended:(BOOL)suspended {
-    [self.downloadQueue setSuspended:suspended];
+- (void)updatePriorityOfToken:(SDWebImageDownloadToken *)token {
+    if (!token.url) {
+        return;
+    }
+    dispatch_barrier_async(self.barrierQueue, ^{
+        SDWebImageDownload *download = self.downloads[token.url];
+        if ([download.tokens containsObject:token]) {
+            [self updatePriorityOfDownload:download];
+        }
+    });
 }
 
-- (void)cancelAllDownloads {
-    [self.downloadQueue cancelAllOperations];
+// The following methods must be called on the barrier queue, as barrier blocks
+
+- (void)updatePriorityOfDownload:(SDWebImageDownload *)download {
+    SDWebImageDownloaderPriority priority = SDWebImageDownloaderPriorityBackground;
+    for (SDWebImageDownloadToken *token in download.tokens) {
+        priority = MAX(priority, token.priority);
+    }
+    if (priority == download.priority) {
+        return;
+    }
+    download.priority = priority;
+    if (download.heapIndex != NSNotFound) {
+        [self siftUpPendingDownloadAtIndex:download.heapIndex];
+        [self siftDownPendingDownloadAtIndex:download.heapIndex];
+    }
+}
+
+// The shared operation decodes large enough for every token, and at full size if one of them wants it
+- (void)updateTargetPixelSizeOfDownload:(SDWebImageDownload *)download {
+    CGSize targetPixelSize = CGSizeZero;
+    for (SDWebImageDownloadToken *token in download.tokens) {
+        if (token.targetPixelSize.width <= 0 || token.targetPixelSize.height <= 0) {
+            targetPixelSize = CGSizeZero;
+            break;
+        }
+        targetPixelSize.width = MAX(targetPixelSize.width, token.targetPixelSize.width);
+        targetPixelSize.height = MAX(targetPixelSize.height, token.targetPixelSize.height);
+    }
+    download.operation.targetPixelSize = targetPixelSize;
+}
+
+- (void)finishDownload:(SDWebImageDownload *)download {
+    if (self.downloads[download.url] == download) {
+        [self.downloads removeObjectForKey:download.url];
+    }
+    if (download.taskIdentifier) {
+        [self.operationsByTaskIdentifier removeObjectForKey:download.taskIdentifier];
+    }
+    [self removePendingDownload:download];
+    if (download.isRunning) {
+        download.running = NO;
+        _runningDownloadCount--;
+    }
+    [self startPendingDownloads];
+}
+
+- (void)startPendingDownloads {
+    while (!_suspended && (NSInteger)_runningDownloadCount < _maxConcurrentDownloads && self.pendingDownloads.count > 0) {
+        SDWebImageDownload *download = self.pendingDownloads[0];
+        [self removePendingDownload:download];
+        download.running = YES;
+        _runningDownloadCount++;
+        [self.downloadQueue addOperation:download.operation];
+    }
+}
+
+- (BOOL)pendingDownload:(SDWebImageDownload *)download startsBefore:(SDWebImageDownload *)otherDownload {
+    if (download.priority != otherDownload.priority) {
+        return download.priority > otherDownload.priority;
+    }
+    if (download.urgent != otherDownload.urgent) {
+        return download.urgent;
+    }
+    if (self.executionOrder == SDWebImageDownloaderLIFOExecutionOrder) {
+        return download.sequence > otherDownload.sequence;
+    }
+    return download.sequence < otherDownload.sequence;
+}
+
+- (void)addPendingDownload:(SDWebImageDownload *)download {
+    download.heapIndex = self.pendingDownloads.count;
+    [self.pendingDownloads addObject:download];
+    [self siftUpPendingDownloadAtIndex:download.heapIndex];
+}
+
+- (void)removePendingDownload:(SDWebImageDownload *)download {
+    NSUInteger index = download.heapIndex;
+    if (index == NSNotFound) {
+        return;
+    }
+    NSUInteger lastIndex = self.pendingDownloads.count - 1;
+    if (index != lastIndex) {
+        [self swapPendingDownloadAtIndex:index withIndex:lastIndex];
+    }
+    [self.pendingDownloads removeLastObject];
+    download.heapIndex = NSNotFound;
+    if (index < self.pendingDownloads.count) {
+        [self siftUpPendingDownloadAtIndex:index];
+        [self siftDownPendingDownloadAtIndex:index];
+    }
+}
+
+- (void)swapPendingDownloadAtIndex:(NSUInteger)index withIndex:(NSUInteger)otherIndex {
+    [self.pendingDownloads exchangeObjectAtIndex:index withObjectAtIndex:otherIndex];
+    ((SDWebImageDownload *)self.pendingDownloads[index]).heapIndex = index;
+    ((SDWebImageDownload *)self.pendingDownloads[otherIndex]).heapIndex = otherIndex;
+}
+
+- (void)siftUpPendingDownloadAtIndex:(NSUInteger)index {
+    while (index > 0) {
+        NSUInteger parent = (index - 1) / 2;
+        if (![self pendingDownload:self.pendingDownloads[index] startsBefore:self.pendingDownloads[parent]]) {
+            break;
+        }
+        [self swapPendingDownloadAtIndex:index withIndex:parent];
+        index = parent;
+    }
+}
+
+- (void)siftDownPendingDownloadAtIndex:(NSUInteger)index {
+    NSUInteger count = self.pendingDownloads.count;
+    while (YES) {
+        NSUInteger first = index;
+        NSUInteger left = 2 * index + 1;
+        NSUInteger right = left + 1;
+        if (left < count && [self pendingDownload:self.pendingDownloads[left] startsBefore:self.pendingDownloads[first]]) {
+            first = left;
+        }
+        if (right < count && [self pendingDownload:self.pendingDownloads[right] startsBefore:self.pendingDownloads[first]]) {
+            first = right;
+        }
+        if (first == index) {
+            break;
+        }
+        [self swapPendingDownloadAtIndex:index withIndex:first];
+        index = first;
+    }
 }
 
 #pragma mark Helper methods
 
 - (SDWebImageDownloaderOperation *)operationWithTask:(NSURLSessionTask *)task {
-    SDWebImageDownloaderOperation *returnOperation = nil;
-    for (SDWebImageDownloaderOperation *operation in self.downloadQueue.operations) {
-        if (operation.dataTask.taskIdentifier == task.taskIdentifier) {
-            returnOperation = operation;
-            break;
+    NSNumber *taskIdentifier = @(task.taskIdentifier);
+    __block SDWebImageDownloaderOperation *returnOperation = nil;
+    dispatch_sync(self.barrierQueue, ^{
+        returnOperation = self.operationsByTaskIdentifier[taskIdentifier];
+    });
+
+    if (!returnOperation) {
+        // Only operation classes that create their task once they start get here, on the first call for the task.
+        // Every later call, including each didReceiveData:, is a single dictionary lookup.
+        for (SDWebImageDownloaderOperation *operation in self.downloadQueue.operations) {
+            if (operation.dataTask == task) {
+                returnOperation = operation;
+                break;
+            }
+        }
+        if (returnOperation) {
+            dispatch_barrier_async(self.barrierQueue, ^{
+                self.operationsByTaskIdentifier[taskIdentifier] = returnOperation;
+            });
         }
     }
+
+    // An operation that was cancelled or gave up on its response drops its task, it must not get the remaining calls
+    if (returnOperation.dataTask != task) {
+        return nil;
+    }
     return returnOperation;
 }
 
+- (void)removeOperationWithTask:(NSURLSessionTask *)task {
+    NSNumber *taskIdentifier = @(task.taskIdentifier);
+    dispatch_barrier_async(self.barrierQueue, ^{
+        [self.operationsByTaskIdentifier removeObjectForKey:taskIdentifier];
+    });
+}
+
 #pragma mark NSURLSessionDataDelegate
 
 - (void)URLSession:(NSURLSession *)session
@@ -304,6 +637,9 @@ didReceiveResponse:(NSURLResponse *)response
     // Identify the operation that runs this task and pass it the delegate method
     SDWebImageDownloaderOperation *dataOperation = [self operationWithTask:task];
 
+    // This is the last delegate call of a task, whether it finished, failed or was cancelled
+    [self removeOperationWithTask:task];
+
     [dataOperation URLSession:session task:task didCompleteWithError:error];
 }
 
@@ -30,6 +30,12 @@ extern NSString *const SDWebImageDownloadFinishNotification;
 
 @property (assign, nonatomic) BOOL shouldDecompressImages;
 
+/**
+ * The size in pixels the image will be displayed at. When set, the downloaded data is decoded once, straight at
+ * that size, whatever `shouldDecompressImages` says. Defaults to CGSizeZero, which decodes at full size.
+ */
+@property (assign, atomic) CGSize targetPixelSize;
+
 /**
  *  Was used to determine whether the URL connection should consult the credential storage for authenticating the connection.
  *  @deprecated Not used for a couple of versions
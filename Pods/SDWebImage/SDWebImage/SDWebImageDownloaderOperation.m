@@ -8,7 +8,9 @@
 
 #import "SDWebImageDownloaderOperation.h"
 #import "SDWebImageDecoder.h"
+#import "SDWebImageProgressiveDecoder.h"
 #import "UIImage+MultiFormat.h"
+#import "UIImage+GIF.h"
 #import <ImageIO/ImageIO.h>
 #import "SDWebImageManager.h"
 
@@ -26,6 +28,7 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
 @property (assign, nonatomic, getter = isExecuting) BOOL executing;
 @property (assign, nonatomic, getter = isFinished) BOOL finished;
 @property (strong, nonatomic) NSMutableData *imageData;
+@property (strong, nonatomic) SDWebImageProgressiveDecoder *progressiveDecoder;
 
 // This is weak because it is injected by whoever manages this session. If this gets nil-ed out, we won't be able to run
 // the task associated with this operation
@@ -44,8 +47,6 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
 @end
 
 @implementation SDWebImageDownloaderOperation {
-    size_t width, height;
-    UIImageOrientation orientation;
     BOOL responseFromCached;
 }
 
@@ -83,6 +84,10 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
         _finished = NO;
         _expectedSize = 0;
         _unownedSession = session;
+        // a shared session's delegate can map the task to this operation before it starts, the task is resumed by start
+        if (session) {
+            _dataTask = [session dataTaskWithRequest:_request];
+        }
         responseFromCached = YES; // Initially wrong until `- URLSession:dataTask:willCacheResponse:completionHandler: is called or not called
     }
     return self;
@@ -130,7 +135,9 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
             session = self.ownedSession;
         }
         
-        self.dataTask = [session dataTaskWithRequest:self.request];
+        if (!self.dataTask) {
+            self.dataTask = [session dataTaskWithRequest:self.request];
+        }
         self.executing = YES;
         self.thread = [NSThread currentThread];
     }
@@ -185,8 +192,9 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
     [super cancel];
     if (self.cancelBlock) self.cancelBlock();
 
-    if (self.dataTask) {
-        [self.dataTask cancel];
+    // the task of an operation that never started was never resumed, there is no download to report as stopped
+    [self.dataTask cancel];
+    if (self.dataTask && self.isExecuting) {
         dispatch_async(dispatch_get_main_queue(), ^{
             [[NSNotificationCenter defaultCenter] postNotificationName:SDWebImageDownloadStopNotification object:self];
         });
@@ -212,6 +220,7 @@ NSString *const SDWebImageDownloadFinishNotification = @"SDWebImageDownloadFinis
     self.progressBlock = nil;
     self.dataTask = nil;
     self.imageData = nil;
+    self.progressiveDecoder = nil;
     self.thread = nil;
     if (self.ownedSession) {
         [self.ownedSession invalidateAndCancel];
@@ -288,67 +297,24 @@ didReceiveResponse:(NSURLResponse *)response
         // The following code is from http://www.cocoaintheshell.com/2011/05/progressive-images-download-imageio/
         // Thanks to the author @Nyx0uf
 
-        // Get the total bytes downloaded
-        const NSInteger totalSize = self.imageData.length;
-
-        // Update the data source, we must pass ALL the data, not just the new bytes
-        CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)self.imageData, NULL);
+        if (!self.progressiveDecoder) {
+            self.progressiveDecoder = [SDWebImageProgressiveDecoder new];
+        }
 
-        if (width + height == 0) {
-            CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
-            if (properties) {
-                NSInteger orientationValue = -1;
-                CFTypeRef val = CFDictionaryGetValue(properties, kCGImagePropertyPixelHeight);
-                if (val) CFNumberGetValue(val, kCFNumberLongType, &height);
-                val = CFDictionaryGetValue(properties, kCGImagePropertyPixelWidth);
-                if (val) CFNumberGetValue(val, kCFNumberLongType, &width);
-                val = CFDictionaryGetValue(properties, kCGImagePropertyOrientation);
-                if (val) CFNumberGetValue(val, kCFNumberNSIntegerType, &orientationValue);
-                CFRelease(properties);
+        if ((NSInteger)self.imageData.length < self.expectedSize) {
+            // Only renders when enough new data came in, e.g. a new scan of a progressive JPEG
+            CGImageRef partialImageRef = [self.progressiveDecoder copyPartialImageWithData:self.imageData];
 
+            if (partialImageRef) {
                 // When we draw to Core Graphics, we lose orientation information,
                 // which means the image below born of initWithCGIImage will be
                 // oriented incorrectly sometimes. (Unlike the image born of initWithData
-                // in didCompleteWithError.) So save it here and pass it on later.
-                orientation = [[self class] orientationFromPropertyValue:(orientationValue == -1 ? 1 : orientationValue)];
-            }
-
-        }
-
-        if (width + height > 0 && totalSize < self.expectedSize) {
-            // Create the image
-            CGImageRef partialImageRef = CGImageSourceCreateImageAtIndex(imageSource, 0, NULL);
-
-#ifdef TARGET_OS_IPHONE
-            // Workaround for iOS anamorphic image
-            if (partialImageRef) {
-                const size_t partialHeight = CGImageGetHeight(partialImageRef);
-                CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-                CGContextRef bmContext = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace, kCGBitmapByteOrderDefault | kCGImageAlphaPremultipliedFirst);
-                CGColorSpaceRelease(colorSpace);
-                if (bmContext) {
-                    CGContextDrawImage(bmContext, (CGRect){.origin.x = 0.0f, .origin.y = 0.0f, .size.width = width, .size.height = partialHeight}, partialImageRef);
-                    CGImageRelease(partialImageRef);
-                    partialImageRef = CGBitmapContextCreateImage(bmContext);
-                    CGContextRelease(bmContext);
-                }
-                else {
-                    CGImageRelease(partialImageRef);
-                    partialImageRef = nil;
-                }
-            }
-#endif
-
-            if (partialImageRef) {
+                // in didCompleteWithError.) So pass it on from the image properties.
+                UIImageOrientation orientation = [[self class] orientationFromPropertyValue:self.progressiveDecoder.exifOrientation];
                 UIImage *image = [UIImage imageWithCGImage:partialImageRef scale:1 orientation:orientation];
                 NSString *key = [[SDWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
-                UIImage *scaledImage = [self scaledImageForKey:key image:image];
-                if (self.shouldDecompressImages) {
-                    image = [UIImage decodedImageWithImage:scaledImage];
-                }
-                else {
-                    image = scaledImage;
-                }
+                // The partial image was drawn into a bitmap context already, no need to decompress it again
+                image = [self scaledImageForKey:key image:image];
                 CGImageRelease(partialImageRef);
                 dispatch_main_sync_safe(^{
                     if (self.completedBlock) {
@@ -357,8 +323,6 @@ didReceiveResponse:(NSURLResponse *)response
                 });
             }
         }
-
-        CFRelease(imageSource);
     }
 
     if (self.progressBlock) {
@@ -414,14 +378,22 @@ didReceiveResponse:(NSURLResponse *)response
             if (self.options & SDWebImageDownloaderIgnoreCachedResponse && responseFromCached && [[NSURLCache sharedURLCache] cachedResponseForRequest:self.request]) {
                 completionBlock(nil, nil, nil, YES);
             } else if (self.imageData) {
-                UIImage *image = [UIImage sd_imageWithData:self.imageData];
+                UIImage *image = nil;
+                CGSize targetPixelSize = self.targetPixelSize;
                 NSString *key = [[SDWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
-                image = [self scaledImageForKey:key image:image];
-                
-                // Do not force decoding animated GIFs
-                if (!image.images) {
-                    if (self.shouldDecompressImages) {
-                        image = [UIImage decodedImageWithImage:image];
+                if (targetPixelSize.width > 0 && targetPixelSize.height > 0) {
+                    // ImageIO downsamples while decoding, the full size bitmap is never created. The scale comes from
+                    // the key as for a full size image, so the same key decodes alike from the network and the cache
+                    image = [UIImage decodedImageWithData:self.imageData scale:SDImageScaleForKey(key) targetPixelSize:targetPixelSize];
+                } else {
+                    image = [UIImage sd_imageWithData:self.imageData];
+                    image = [self scaledImageForKey:key image:image];
+
+                    // Do not force decoding animated GIFs
+                    if (![image sd_isAnimated]) {
+                        if (self.shouldDecompressImages) {
+                            image = [UIImage decodedImageWithImage:image];
+                        }
                     }
                 }
                 if (CGSizeEqualToSize(image.size, CGSizeZero)) {
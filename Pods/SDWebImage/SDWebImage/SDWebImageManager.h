@@ -87,7 +87,15 @@ typedef NS_OPTIONS(NSUInteger, SDWebImageOptions) {
      * have the hand before setting the image (apply a filter or add it with cross-fade animation for instance)
      * Use this flag if you want to manually set the image in the completion when success
      */
-    SDWebImageAvoidAutoSetImage = 1 << 11
+    SDWebImageAvoidAutoSetImage = 1 << 11,
+
+    /**
+     * By default, images are decoded at their full resolution. This flag makes the view categories decode them
+     * at the pixel size of the view instead, straight from the downloaded or cached data, which saves most of
+     * the memory a large photo shown as a thumbnail takes. The view should have its final bounds when the load starts.
+     * Animated images are not scaled down.
+     */
+    SDWebImageScaleDownToViewSize = 1 << 12
 };
 
 typedef void(^SDWebImageCompletionBlock)(UIImage *image, NSError *error, SDImageCacheType cacheType, NSURL *imageURL);
@@ -214,6 +222,22 @@ SDWebImageManager *manager = [SDWebImageManager sharedManager];
                                         progress:(SDWebImageDownloaderProgressBlock)progressBlock
                                        completed:(SDWebImageCompletionWithFinishedBlock)completedBlock;
 
+/**
+ * Downloads the image at the given URL if not present in cache or return the cached version otherwise,
+ * decoded for the given size instead of at full resolution. The cache keeps the original data on disk.
+ * @param url             The URL to the image
+ * @param options         A mask to specify options to use for this request
+ * @param targetPixelSize The size in pixels the image will be displayed at, CGSizeZero decodes at full size
+ * @param progressBlock   A block called while image is downloading
+ * @param completedBlock  A block called when operation has been completed, see `downloadImageWithURL:options:progress:completed:`
+ * @return Returns an NSObject conforming to SDWebImageOperation. Should be an instance of SDWebImageDownloaderOperation
+ */
+- (id <SDWebImageOperation>)downloadImageWithURL:(NSURL *)url
+                                         options:(SDWebImageOptions)options
+                                 targetPixelSize:(CGSize)targetPixelSize
+                                        progress:(SDWebImageDownloaderProgressBlock)progressBlock
+                                       completed:(SDWebImageCompletionWithFinishedBlock)completedBlock;
+
 /**
  * Saves image to cache for given URL
  *
@@ -224,6 +248,14 @@ SDWebImageManager *manager = [SDWebImageManager sharedManager];
 
 - (void)saveImageToCache:(UIImage *)image forURL:(NSURL *)url;
 
+/**
+ * Changes the download priority of an image load, e.g. when the cell showing the image scrolls on or off screen.
+ * Has no effect once the download has started.
+ * @param priority  The new priority
+ * @param operation An operation returned by `downloadImageWithURL:options:progress:completed:`
+ */
+- (void)setDownloadPriority:(SDWebImageDownloaderPriority)priority forOperation:(id <SDWebImageOperation>)operation;
+
 /**
  * Cancel all current operations
  */
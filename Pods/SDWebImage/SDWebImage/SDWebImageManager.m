@@ -7,6 +7,7 @@
  */
 
 #import "SDWebImageManager.h"
+#import "UIImage+GIF.h"
 #import <objc/message.h>
 
 @interface SDWebImageCombinedOperation : NSObject <SDWebImageOperation>
@@ -14,6 +15,9 @@
 @property (assign, nonatomic, getter = isCancelled) BOOL cancelled;
 @property (copy, nonatomic) SDWebImageNoParamsBlock cancelBlock;
 @property (strong, nonatomic) NSOperation *cacheOperation;
+@property (strong, nonatomic) SDWebImageDownloadToken *downloadToken;
+
+- (void)setDownloadPriority:(SDWebImageDownloaderPriority)priority;
 
 @end
 
@@ -116,6 +120,14 @@
                                          options:(SDWebImageOptions)options
                                         progress:(SDWebImageDownloaderProgressBlock)progressBlock
                                        completed:(SDWebImageCompletionWithFinishedBlock)completedBlock {
+    return [self downloadImageWithURL:url options:options targetPixelSize:CGSizeZero progress:progressBlock completed:completedBlock];
+}
+
+- (id <SDWebImageOperation>)downloadImageWithURL:(NSURL *)url
+                                         options:(SDWebImageOptions)options
+                                 targetPixelSize:(CGSize)targetPixelSize
+                                        progress:(SDWebImageDownloaderProgressBlock)progressBlock
+                                       completed:(SDWebImageCompletionWithFinishedBlock)completedBlock {
     // Invoking this method without a completedBlock is pointless
     NSAssert(completedBlock != nil, @"If you mean to prefetch the image, use -[SDWebImagePrefetcher prefetchURLs] instead");
 
@@ -151,7 +163,7 @@
     }
     NSString *key = [self cacheKeyForURL:url];
 
-    operation.cacheOperation = [self.imageCache queryDiskCacheForKey:key done:^(UIImage *image, SDImageCacheType cacheType) {
+    operation.cacheOperation = [self.imageCache queryDiskCacheForKey:key targetPixelSize:targetPixelSize done:^(UIImage *image, SDImageCacheType cacheType) {
         if (operation.isCancelled) {
             @synchronized (self.runningOperations) {
                 [self.runningOperations removeObject:operation];
@@ -184,7 +196,7 @@
                 // ignore image read from NSURLCache if image if cached but force refreshing
                 downloaderOptions |= SDWebImageDownloaderIgnoreCachedResponse;
             }
-            id <SDWebImageOperation> subOperation = [self.imageDownloader downloadImageWithURL:url options:downloaderOptions progress:progressBlock completed:^(UIImage *downloadedImage, NSData *data, NSError *error, BOOL finished) {
+            id <SDWebImageOperation> subOperation = [self.imageDownloader downloadImageWithURL:url options:downloaderOptions targetPixelSize:targetPixelSize progress:progressBlock completed:^(UIImage *downloadedImage, NSData *data, NSError *error, BOOL finished) {
                 __strong __typeof(weakOperation) strongOperation = weakOperation;
                 if (!strongOperation || strongOperation.isCancelled) {
                     // Do nothing if the operation was cancelled
@@ -222,13 +234,13 @@
                     if (options & SDWebImageRefreshCached && image && !downloadedImage) {
                         // Image refresh hit the NSURLCache cache, do not call the completion block
                     }
-                    else if (downloadedImage && (!downloadedImage.images || (options & SDWebImageTransformAnimatedImage)) && [self.delegate respondsToSelector:@selector(imageManager:transformDownloadedImage:withURL:)]) {
+                    else if (downloadedImage && (![downloadedImage sd_isAnimated] || (options & SDWebImageTransformAnimatedImage)) && [self.delegate respondsToSelector:@selector(imageManager:transformDownloadedImage:withURL:)]) {
                         dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
                             UIImage *transformedImage = [self.delegate imageManager:self transformDownloadedImage:downloadedImage withURL:url];
 
                             if (transformedImage && finished) {
                                 BOOL imageWasTransformed = ![transformedImage isEqual:downloadedImage];
-                                [self.imageCache storeImage:transformedImage recalculateFromImage:imageWasTransformed imageData:(imageWasTransformed ? nil : data) forKey:key toDisk:cacheOnDisk];
+                                [self.imageCache storeImage:transformedImage recalculateFromImage:imageWasTransformed imageData:(imageWasTransformed ? nil : data) forKey:key targetPixelSize:targetPixelSize toDisk:cacheOnDisk];
                             }
 
                             dispatch_main_sync_safe(^{
@@ -240,7 +252,7 @@
                     }
                     else {
                         if (downloadedImage && finished) {
-                            [self.imageCache storeImage:downloadedImage recalculateFromImage:NO imageData:data forKey:key toDisk:cacheOnDisk];
+                            [self.imageCache storeImage:downloadedImage recalculateFromImage:NO imageData:data forKey:key targetPixelSize:targetPixelSize toDisk:cacheOnDisk];
                         }
 
                         dispatch_main_sync_safe(^{
@@ -259,6 +271,9 @@
                     }
                 }
             }];
+            if ([subOperation isKindOfClass:[SDWebImageDownloadToken class]]) {
+                operation.downloadToken = (SDWebImageDownloadToken *)subOperation;
+            }
             operation.cancelBlock = ^{
                 [subOperation cancel];
                 
@@ -305,6 +320,12 @@
     }
 }
 
+- (void)setDownloadPriority:(SDWebImageDownloaderPriority)priority forOperation:(id <SDWebImageOperation>)operation {
+    if ([operation isKindOfClass:[SDWebImageCombinedOperation class]]) {
+        [(SDWebImageCombinedOperation *)operation setDownloadPriority:priority];
+    }
+}
+
 - (void)cancelAll {
     @synchronized (self.runningOperations) {
         NSArray *copiedOperations = [self.runningOperations copy];
@@ -324,7 +345,28 @@
 @end
 
 
-@implementation SDWebImageCombinedOperation
+@implementation SDWebImageCombinedOperation {
+    BOOL _hasDownloadPriority;
+    SDWebImageDownloaderPriority _downloadPriority;
+}
+
+- (void)setDownloadToken:(SDWebImageDownloadToken *)downloadToken {
+    @synchronized (self) {
+        _downloadToken = downloadToken;
+        // the priority may have changed while the cache was queried
+        if (_hasDownloadPriority) {
+            downloadToken.priority = _downloadPriority;
+        }
+    }
+}
+
+- (void)setDownloadPriority:(SDWebImageDownloaderPriority)priority {
+    @synchronized (self) {
+        _hasDownloadPriority = YES;
+        _downloadPriority = priority;
+        _downloadToken.priority = priority;
+    }
+}
 
 - (void)setCancelBlock:(SDWebImageNoParamsBlock)cancelBlock {
     // check if the operation is already cancelled, then we just call the cancelBlock
@@ -0,0 +1,49 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "SDWebImageCompat.h"
+
+/**
+ * Renders partial images of a download in progress. The data is fed to a single incremental ImageIO source and
+ * partial images are drawn into one bitmap context that is reused for every render. Renders are throttled by bytes
+ * received and time elapsed, and for progressive JPEGs they only happen once a new scan is complete.
+ * Not thread safe, feed it from a single queue.
+ */
+@interface SDWebImageProgressiveDecoder : NSObject
+
+/**
+ * Bytes to receive after a render before the next one [defaults to 16KB]
+ */
+@property (assign, nonatomic) NSUInteger minimumBytesBetweenRenders;
+
+/**
+ * Time to wait after a render before the next one, in seconds [defaults to 0.1]
+ */
+@property (assign, nonatomic) NSTimeInterval minimumIntervalBetweenRenders;
+
+/**
+ * The EXIF orientation of the image, 1 until the image properties were read
+ */
+@property (assign, nonatomic, readonly) NSInteger exifOrientation;
+
+/**
+ * Number of JPEG scans received completely so far. A progressive JPEG only renders again once this grows.
+ */
+@property (assign, nonatomic, readonly) NSUInteger completedScanCount;
+
+/**
+ * Feeds the data received so far and renders a partial image if one is due
+ *
+ * @param data All the data received so far, not only the last chunk
+ *
+ * @return A partial image the caller has to release, or NULL when there is nothing new worth showing
+ */
+- (CGImageRef)copyPartialImageWithData:(NSData *)data CF_RETURNS_RETAINED;
+
+@end
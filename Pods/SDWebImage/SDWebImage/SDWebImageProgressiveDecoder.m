@@ -0,0 +1,187 @@
+/*
+ * This file is part of the SDWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "SDWebImageProgressiveDecoder.h"
+#import <ImageIO/ImageIO.h>
+
+@implementation SDWebImageProgressiveDecoder {
+    CGImageSourceRef _source;
+    CGContextRef _context;
+    size_t _width, _height;
+
+    // JPEG marker scanning, resumes where the previous chunk ended
+    NSUInteger _scannedLength;
+    BOOL _isJPEG;
+    BOOL _isProgressiveJPEG;
+    BOOL _inScan;
+    NSUInteger _renderedScanCount;
+
+    NSUInteger _renderedLength;
+    CFAbsoluteTime _renderTime;
+}
+
+- (id)init {
+    if ((self = [super init])) {
+        _minimumBytesBetweenRenders = 16 * 1024;
+        _minimumIntervalBetweenRenders = 0.1;
+        _exifOrientation = 1;
+        _source = CGImageSourceCreateIncremental(NULL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_source) {
+        CFRelease(_source);
+    }
+    CGContextRelease(_context);
+}
+
+- (CGImageRef)copyPartialImageWithData:(NSData *)data {
+    if (!_source || !data) {
+        return NULL;
+    }
+
+    // The incremental source keeps its parsing state between updates, it still wants all the data received so far
+    CGImageSourceUpdateData(_source, (__bridge CFDataRef)data, false);
+    [self scanJPEGMarkersInData:data];
+
+    if (_width + _height == 0 && ![self readImageProperties]) {
+        return NULL;
+    }
+
+    if (data.length - _renderedLength < self.minimumBytesBetweenRenders ||
+        CFAbsoluteTimeGetCurrent() - _renderTime < self.minimumIntervalBetweenRenders) {
+        return NULL;
+    }
+
+    // A progressive JPEG only looks better once another scan is complete
+    if (_isProgressiveJPEG && _completedScanCount <= _renderedScanCount) {
+        return NULL;
+    }
+
+    CGImageRef partialImageRef = CGImageSourceCreateImageAtIndex(_source, 0, NULL);
+    if (!partialImageRef) {
+        return NULL;
+    }
+    _renderedLength = data.length;
+    _renderTime = CFAbsoluteTimeGetCurrent();
+    _renderedScanCount = _completedScanCount;
+
+#if TARGET_OS_IPHONE
+    // Workaround for iOS anamorphic image
+    if (!_context) {
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        _context = CGBitmapContextCreate(NULL, _width, _height, 8, 0, colorSpace, kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst);
+        CGColorSpaceRelease(colorSpace);
+    }
+    if (!_context) {
+        CGImageRelease(partialImageRef);
+        return NULL;
+    }
+
+    const size_t partialHeight = CGImageGetHeight(partialImageRef);
+    CGContextClearRect(_context, CGRectMake(0, 0, _width, _height));
+    CGContextDrawImage(_context, CGRectMake(0, 0, _width, partialHeight), partialImageRef);
+    CGImageRelease(partialImageRef);
+    // The image shares the context memory until the next draw, which then copies it
+    partialImageRef = CGBitmapContextCreateImage(_context);
+#endif
+
+    return partialImageRef;
+}
+
+- (BOOL)readImageProperties {
+    CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(_source, 0, NULL);
+    if (!properties) {
+        return NO;
+    }
+
+    NSInteger orientationValue = -1;
+    CFTypeRef val = CFDictionaryGetValue(properties, kCGImagePropertyPixelHeight);
+    if (val) CFNumberGetValue(val, kCFNumberLongType, &_height);
+    val = CFDictionaryGetValue(properties, kCGImagePropertyPixelWidth);
+    if (val) CFNumberGetValue(val, kCFNumberLongType, &_width);
+    val = CFDictionaryGetValue(properties, kCGImagePropertyOrientation);
+    if (val) CFNumberGetValue(val, kCFNumberNSIntegerType, &orientationValue);
+    CFRelease(properties);
+
+    _exifOrientation = (orientationValue == -1 ? 1 : orientationValue);
+    return _width + _height > 0;
+}
+
+- (void)scanJPEGMarkersInData:(NSData *)data {
+    const uint8_t *bytes = data.bytes;
+    NSUInteger length = data.length;
+
+    if (!_isJPEG) {
+        if (_scannedLength == 0 && length >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF) {
+            _isJPEG = YES;
+            _scannedLength = 2;
+        }
+        else {
+            return;
+        }
+    }
+
+    // Walk the marker segments by their length, so that bytes inside EXIF data or an embedded thumbnail are never
+    // taken for markers. Stops at the first segment that is not fully received, and picks up from there next time.
+    NSUInteger i = _scannedLength;
+    while (i + 1 < length) {
+        if (_inScan) {
+            // Entropy coded data escapes 0xFF as FF 00, and restart markers belong to the scan
+            if (bytes[i] != 0xFF || bytes[i + 1] == 0x00 || (bytes[i + 1] >= 0xD0 && bytes[i + 1] <= 0xD7)) {
+                i += (bytes[i] == 0xFF) ? 2 : 1;
+                continue;
+            }
+            _inScan = NO;
+            _completedScanCount++;
+        }
+
+        if (bytes[i] != 0xFF) {
+            // Not a marker, the data is not what we expected. Give up on scan detection
+            _isJPEG = NO;
+            _isProgressiveJPEG = NO;
+            i = length;
+            break;
+        }
+        uint8_t marker = bytes[i + 1];
+        if (marker == 0xFF) {
+            // Fill byte
+            i++;
+            continue;
+        }
+        if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            i += 2;
+            continue;
+        }
+        if (marker == 0xD9) {
+            // EOI, nothing left to scan
+            i = length;
+            break;
+        }
+
+        if (i + 3 >= length) {
+            break;
+        }
+        NSUInteger segmentLength = ((NSUInteger)bytes[i + 2] << 8) | bytes[i + 3];
+        if (marker == 0xC2 || marker == 0xC6 || marker == 0xCA || marker == 0xCE) {
+            _isProgressiveJPEG = YES;
+        }
+        if (marker == 0xDA) {
+            if (i + 2 + segmentLength > length) {
+                break;
+            }
+            _inScan = YES;
+        }
+        i += 2 + segmentLength;
+    }
+    _scannedLength = MIN(i, length);
+}
+
+@end
@@ -12,8 +12,24 @@
 
 + (UIImage *)sd_animatedGIFNamed:(NSString *)name;
 
+/**
+ * Creates an image from GIF data. Animated GIFs become either an SDAnimatedImage, when lazy decoding is on,
+ * or an animated UIImage holding every decoded frame.
+ */
 + (UIImage *)sd_animatedGIFWithData:(NSData *)data;
 
+/**
+ * Decode animated GIFs frame by frame as they are shown instead of all at once. Only SDAnimatedImageView
+ * plays the resulting images, a plain UIImageView shows their first frame [defaults to NO]
+ */
++ (void)sd_setDecodesAnimatedGIFsLazily:(BOOL)lazily;
++ (BOOL)sd_decodesAnimatedGIFsLazily;
+
+/**
+ * YES for an animated UIImage or an SDAnimatedImage
+ */
+- (BOOL)sd_isAnimated;
+
 - (UIImage *)sd_animatedImageByScalingAndCroppingToSize:(CGSize)size;
 
 @end
@@ -7,15 +7,46 @@
 //
 
 #import "UIImage+GIF.h"
+#import "SDAnimatedImage.h"
 #import <ImageIO/ImageIO.h>
 
+static BOOL SDDecodesAnimatedGIFsLazily = NO;
+
+static NSUInteger SDGreatestCommonDivisor(NSUInteger a, NSUInteger b) {
+    while (b != 0) {
+        NSUInteger remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
 @implementation UIImage (GIF)
 
++ (void)sd_setDecodesAnimatedGIFsLazily:(BOOL)lazily {
+    SDDecodesAnimatedGIFsLazily = lazily;
+}
+
++ (BOOL)sd_decodesAnimatedGIFsLazily {
+    return SDDecodesAnimatedGIFsLazily;
+}
+
+- (BOOL)sd_isAnimated {
+    return self.images.count > 0 || [self isKindOfClass:[SDAnimatedImage class]];
+}
+
 + (UIImage *)sd_animatedGIFWithData:(NSData *)data {
     if (!data) {
         return nil;
     }
 
+    if (SDDecodesAnimatedGIFsLazily) {
+        UIImage *lazyImage = [SDAnimatedImage animatedImageWithGIFData:data scale:[UIScreen mainScreen].scale];
+        if (lazyImage) {
+            return lazyImage;
+        }
+    }
+
     CGImageSourceRef source = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
 
     size_t count = CGImageSourceGetCount(source);
@@ -26,9 +57,8 @@
         animatedImage = [[UIImage alloc] initWithData:data];
     }
     else {
-        NSMutableArray *images = [NSMutableArray array];
-
-        NSTimeInterval duration = 0.0f;
+        NSMutableArray *frames = [NSMutableArray array];
+        NSMutableArray *frameDelays = [NSMutableArray array];
 
         for (size_t i = 0; i < count; i++) {
             CGImageRef image = CGImageSourceCreateImageAtIndex(source, i, NULL);
@@ -36,18 +66,33 @@
                 continue;
             }
 
-            duration += [self sd_frameDurationAtIndex:i source:source];
+            // Delays in hundredths of a second, the precision of the GIF format
+            NSUInteger delay = MAX((NSUInteger)1, (NSUInteger)lround([self sd_frameDurationAtIndex:i source:source] * 100));
+            [frameDelays addObject:@(delay)];
 
-            [images addObject:[UIImage imageWithCGImage:image scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp]];
+            [frames addObject:[UIImage imageWithCGImage:image scale:[UIScreen mainScreen].scale orientation:UIImageOrientationUp]];
 
             CGImageRelease(image);
         }
 
-        if (!duration) {
-            duration = (1.0f / 10.0f) * count;
+        // UIImage shows every frame for the same time, so repeat each frame as many times as its delay
+        // holds the greatest common divisor of all the delays
+        NSUInteger divisor = 0;
+        NSUInteger totalDelay = 0;
+        for (NSNumber *delay in frameDelays) {
+            divisor = SDGreatestCommonDivisor([delay unsignedIntegerValue], divisor);
+            totalDelay += [delay unsignedIntegerValue];
+        }
+
+        NSMutableArray *images = [NSMutableArray array];
+        for (NSUInteger i = 0; i < frames.count; i++) {
+            NSUInteger repeatCount = [frameDelays[i] unsignedIntegerValue] / divisor;
+            for (NSUInteger j = 0; j < repeatCount; j++) {
+                [images addObject:frames[i]];
+            }
         }
 
-        animatedImage = [UIImage animatedImageWithImages:images duration:duration];
+        animatedImage = [UIImage animatedImageWithImages:images duration:totalDelay / 100.0];
     }
 
     CFRelease(source);
@@ -174,6 +174,13 @@
  */
 - (void)sd_cancelCurrentImageLoad;
 
+/**
+ * Change the priority of the current download, e.g. from a table view's willDisplayCell / didEndDisplayingCell
+ *
+ * @param priority The new priority
+ */
+- (void)sd_setCurrentImageLoadPriority:(SDWebImageDownloaderPriority)priority;
+
 - (void)sd_cancelCurrentAnimationImagesLoad;
 
 /**
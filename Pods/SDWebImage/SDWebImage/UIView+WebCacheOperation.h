@@ -33,4 +33,21 @@
  */
 - (void)sd_removeImageLoadOperationWithKey:(NSString *)key;
 
+/**
+ *  Change the download priority of the operations for the current UIView and key
+ *
+ *  @param priority the new priority
+ *  @param key      key for identifying the operations
+ */
+- (void)sd_setImageLoadPriority:(SDWebImageDownloaderPriority)priority forKey:(NSString *)key;
+
+/**
+ *  The size in pixels images loaded into the view should be decoded at
+ *
+ *  @param options the options of the image load
+ *
+ *  @return the pixel size of the view bounds when options contain SDWebImageScaleDownToViewSize, CGSizeZero otherwise
+ */
+- (CGSize)sd_targetPixelSizeForOptions:(SDWebImageOptions)options;
+
 @end
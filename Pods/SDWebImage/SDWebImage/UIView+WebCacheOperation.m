@@ -52,4 +52,20 @@ static char loadOperationKey;
     [operationDictionary removeObjectForKey:key];
 }
 
+- (void)sd_setImageLoadPriority:(SDWebImageDownloaderPriority)priority forKey:(NSString *)key {
+    id operations = [[self operationDictionary] objectForKey:key];
+    NSArray *operationsArray = [operations isKindOfClass:[NSArray class]] ? operations : (operations ? @[operations] : nil);
+    for (id <SDWebImageOperation> operation in operationsArray) {
+        [SDWebImageManager.sharedManager setDownloadPriority:priority forOperation:operation];
+    }
+}
+
+- (CGSize)sd_targetPixelSizeForOptions:(SDWebImageOptions)options {
+    if (!(options & SDWebImageScaleDownToViewSize)) {
+        return CGSizeZero;
+    }
+    CGFloat scale = [[UIScreen mainScreen] scale];
+    return CGSizeMake(ceil(self.bounds.size.width * scale), ceil(self.bounds.size.height * scale));
+}
+
 @end
@@ -1,7 +1,12 @@
 #import <UIKit/UIKit.h>
 
 #import "NSData+ImageContentType.h"
+#import "SDAnimatedImage.h"
+#import "SDAnimatedImageView.h"
 #import "SDImageCache.h"
+#import "SDImageCacheEvictionPolicy.h"
+#import "SDImageCachePackedStore.h"
+#import "SDImageCacheTranscoder.h"
 #import "SDWebImageCompat.h"
 #import "SDWebImageDecoder.h"
 #import "SDWebImageDownloader.h"
@@ -9,6 +14,7 @@
 #import "SDWebImageManager.h"
 #import "SDWebImageOperation.h"
 #import "SDWebImagePrefetcher.h"
+#import "SDWebImageProgressiveDecoder.h"
 #import "UIButton+WebCache.h"
 #import "UIImage+GIF.h"
 #import "UIImage+MultiFormat.h"